@@ -30,10 +30,12 @@ from pybind.writer import Writer
 from pybind import Module, Class
 from pybind.parameters import (StringParameter, ClassParameter,
                                NumericParameter, ArgvObjects, IntegralArgv,
-                               ListOfStringsParameter)
+                               ListOfStringsParameter, UInt128Parameter,
+                               BufferParameter)
 from pybind.retval import (StringViewRetVal, StringRetVal, ListOfStringsRetVal,
                            NumericRetVal, ObjCopyRetval, ObjOwnerRetval,
-                           ObjTupleRetVal, IntegralTupleRetVal)
+                           ObjTupleRetVal, IntegralTupleRetVal,
+                           UInt128RetVal)
 from pybind.exceptions import CppException
 
 # Module
@@ -60,13 +62,12 @@ weights.AddMethod('filters').AddRetVal(NumericRetVal('i'))
 # Input class
 input = mod.AddClass(Class('Input', cpp_name='lczero::python::Input'))
 input.AddMethod('set_mask').AddParameter(NumericParameter('plane'),
-                                         NumericParameter(
-                                             'mask', type='u64')).AddEx(ex)
+                                         UInt128Parameter('mask')).AddEx(ex)
 input.AddMethod('set_val').AddParameter(NumericParameter('plane'),
                                         NumericParameter('value',
                                                          type='f32')).AddEx(ex)
 input.AddMethod('mask').AddParameter(NumericParameter('plane')).AddRetVal(
-    NumericRetVal('u64')).AddEx(ex)
+    UInt128RetVal()).AddEx(ex)
 input.AddMethod('val').AddParameter(NumericParameter('plane')).AddRetVal(
     NumericRetVal('f32')).AddEx(ex)
 input.AddMethod('clone').AddRetVal(ObjOwnerRetval(input))
@@ -84,6 +85,22 @@ output.AddMethod('p_raw').AddParameter(IntegralArgv('samples', 'i')).AddRetVal(
 output.AddMethod('p_softmax').AddParameter(IntegralArgv(
     'samples', 'i')).AddRetVal(IntegralTupleRetVal('f32')).AddEx(ex)
 
+# Array class, numpy.asarray() can wrap it without copying.
+array = mod.AddClass(
+    Class('Array',
+          cpp_name='lczero::python::Array',
+          disable_constructor=True,
+          buffer=True))
+
+# Pending batch class
+pending_batch = mod.AddClass(
+    Class('PendingBatch',
+          cpp_name='lczero::python::PendingBatch',
+          disable_constructor=True))
+pending_batch.AddMethod('ready').AddRetVal(NumericRetVal('i'))
+pending_batch.AddMethod('wait', release_gil=True).AddRetVal(
+    ObjTupleRetVal(array)).AddEx(ex)
+
 # Backend capabilities class
 backend_caps = mod.AddClass(
     Class('BackendCapabilities',
@@ -99,8 +116,16 @@ backend.constructor.AddParameter(
     ClassParameter(weights, 'weights', optional=True),
     StringParameter('backend', optional=True, can_be_none=True),
     StringParameter('options', optional=True, can_be_none=True)).AddEx(ex)
-backend.AddMethod('evaluate').AddParameter(ArgvObjects(
-    'inputs', input)).AddRetVal(ObjTupleRetVal(output)).AddEx(ex)
+backend.AddMethod('evaluate', release_gil=True).AddParameter(
+    ArgvObjects('inputs', input)).AddRetVal(ObjTupleRetVal(output)).AddEx(ex)
+backend.AddMethod('evaluate_batch', release_gil=True).AddParameter(
+    BufferParameter('planes'),
+    BufferParameter('values', optional=True,
+                    can_be_none=True)).AddRetVal(ObjTupleRetVal(array)).AddEx(ex)
+backend.AddMethod('submit', release_gil=True).AddParameter(
+    BufferParameter('planes'),
+    BufferParameter('values', optional=True, can_be_none=True)).AddRetVal(
+        ObjOwnerRetval(pending_batch)).AddEx(ex)
 backend.AddMethod('capabilities').AddRetVal(ObjCopyRetval(backend_caps))
 
 # PositionHistory class
@@ -117,6 +142,23 @@ game_state.AddMethod('moves').AddRetVal(ListOfStringsRetVal())
 game_state.AddMethod('policy_indices').AddRetVal(IntegralTupleRetVal('i'))
 game_state.AddMethod('as_string').AddRetVal(StringRetVal())
 
+# Batch encoder class
+batch_encoder = mod.AddClass(
+    Class('BatchEncoder', cpp_name='lczero::python::BatchEncoder'))
+batch_encoder.constructor.AddParameter(
+    ClassParameter(backend, 'backend'),
+    NumericParameter('threads', optional=True),
+)
+batch_encoder.AddMethod('encode', release_gil=True).AddParameter(
+    ListOfStringsParameter('fens'),
+    ListOfStringsParameter('moves'),
+).AddRetVal(ObjTupleRetVal(array)).AddEx(ex)
+batch_encoder.AddMethod('encode_packed', release_gil=True).AddParameter(
+    BufferParameter('moves'),
+    BufferParameter('offsets'),
+    ListOfStringsParameter('fens', optional=True),
+).AddRetVal(ObjTupleRetVal(array)).AddEx(ex)
+
 with open(sys.argv[1], 'wt') as f:
     writer = Writer(f)
     mod.Generate(writer)
\ No newline at end of file
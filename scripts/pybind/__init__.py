@@ -55,8 +55,13 @@ class Class(FunctionContainer):
                  *argv,
                  cpp_name=None,
                  disable_constructor=False,
+                 buffer=False,
                  **kwargs):
         self.cpp_name = cpp_name or name
+        # When set, the class exposes the buffer protocol. The C++ class must
+        # provide buffer_data(), buffer_size(), itemsize(), format(), shape()
+        # and strides() (the latter two as std::vector<ptrdiff_t>).
+        self.buffer = buffer
         super().__init__(name, *argv, **kwargs)
         if disable_constructor:
             self.constructor = DisabledConstructor(
@@ -85,6 +90,10 @@ class Class(FunctionContainer):
         self.constructor.Generate(w)
         self._generate_destructor(w)
 
+        # Buffer protocol.
+        if self.buffer:
+            self._generate_buffer_procs(w)
+
         # Type object.
         self._generate_class_struct(w, module)
 
@@ -130,6 +139,12 @@ class Class(FunctionContainer):
     def function_list_name(self):
         return f'rg{self.name}ClassFunctions'
 
+    def getbuffer_name(self):
+        return f'F{self.name}GetBuffer'
+
+    def buffer_procs_name(self):
+        return f'rg{self.name}BufferProcs'
+
     def _generate_class_struct(self, w, module):
         w.Open(f'PyTypeObject {self.type_object_name()} = {{')
         w.Write('.ob_base = PyVarObject_HEAD_INIT(NULL, 0)')
@@ -137,6 +152,8 @@ class Class(FunctionContainer):
         w.Write(f'.tp_basicsize = sizeof({self.object_struct_name()}),')
         w.Write('.tp_dealloc = reinterpret_cast<destructor>'
                 f'({self.destructor_name()}),')
+        if self.buffer:
+            w.Write(f'.tp_as_buffer = &{self.buffer_procs_name()},')
         w.Write('.tp_flags = Py_TPFLAGS_DEFAULT,')
         w.Write(f'.tp_doc = {self.BuildDocString()},')
         w.Write(f'.tp_methods = {self.function_list_name()},')
@@ -146,6 +163,41 @@ class Class(FunctionContainer):
         w.Write('.tp_new = PyType_GenericNew,')
         w.Close('};')
 
+    def _generate_buffer_procs(self, w):
+        w.Open(f'int {self.getbuffer_name()}('
+               f'{self.object_struct_name()}* self, Py_buffer* view, '
+               'int flags) {')
+        w.Write('static_assert(sizeof(Py_ssize_t) == sizeof(ptrdiff_t));')
+        w.Write(f'{self.cpp_name}* value = self->value;')
+        w.Write('view->obj = &self->ob_base;')
+        w.Write('Py_INCREF(view->obj);')
+        w.Write('view->buf = value->buffer_data();')
+        w.Write('view->len = value->buffer_size();')
+        w.Write('view->readonly = 0;')
+        w.Write('view->itemsize = value->itemsize();')
+        w.Write('view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT')
+        w.Write('    ? const_cast<char*>(value->format()) : nullptr;')
+        w.Write('view->ndim = value->shape().size();')
+        w.Write('view->shape = (flags & PyBUF_ND) == PyBUF_ND')
+        w.Write('    ? const_cast<Py_ssize_t*>(')
+        w.Write('          reinterpret_cast<const Py_ssize_t*>('
+                'value->shape().data()))')
+        w.Write('    : nullptr;')
+        w.Write('view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES')
+        w.Write('    ? const_cast<Py_ssize_t*>(')
+        w.Write('          reinterpret_cast<const Py_ssize_t*>('
+                'value->strides().data()))')
+        w.Write('    : nullptr;')
+        w.Write('view->suboffsets = nullptr;')
+        w.Write('view->internal = nullptr;')
+        w.Write('return 0;')
+        w.Close('}\n')
+        w.Open(f'PyBufferProcs {self.buffer_procs_name()} = {{')
+        w.Write('.bf_getbuffer = reinterpret_cast<getbufferproc>'
+                f'({self.getbuffer_name()}),')
+        w.Write('.bf_releasebuffer = nullptr,')
+        w.Close('};\n')
+
     def _generate_destructor(self, w):
         w.Open(f'void {self.destructor_name()}('
                f'{self.object_struct_name()}* self) {{')
@@ -188,6 +240,7 @@ class Module(FunctionContainer):
             w.Write(f'#include "{x}"')
 
         w.Write('\nnamespace {')
+        self._generate_gil_helper(w)
         for cls in self.exceptions:
             cls.Generate(w)
         for cls in self.classes:
@@ -200,6 +253,19 @@ class Module(FunctionContainer):
 
         self._generate_main_func(w)
 
+    def _generate_gil_helper(self, w):
+        w.Open('class ScopedGilRelease {')
+        w.Write(' public:')
+        w.Write('ScopedGilRelease() : state_(PyEval_SaveThread()) {}')
+        w.Write('~ScopedGilRelease() { Acquire(); }')
+        w.Open('void Acquire() {')
+        w.Write('if (state_ != nullptr) PyEval_RestoreThread(state_);')
+        w.Write('state_ = nullptr;')
+        w.Close('}\n')
+        w.Write(' private:')
+        w.Write('PyThreadState* state_;')
+        w.Close('};\n')
+
     def struct_name(self):
         return f'T{self.name}Module'
 
@@ -44,8 +44,10 @@ class Function(PyObject):
                  name,
                  gen_function_name,
                  self_type=None,
-                 param_type=None):
+                 param_type=None,
+                 release_gil=False):
         super().__init__(name)
+        self.release_gil = release_gil
         self.parameters = []
         self.exceptions = []
         self.gen_function_name = gen_function_name
@@ -80,7 +82,13 @@ class Function(PyObject):
         if self.exceptions:
             w.Open('try {')
 
+        if self.release_gil:
+            # The GIL is reacquired before the result is converted to python
+            # objects, and also on exception through the destructor.
+            w.Write('ScopedGilRelease gil_release;')
         self._generate_call(w)
+        if self.release_gil:
+            w.Write('gil_release.Acquire();')
         self.retval.GenerateConversion(w)
 
         if self.exceptions:
@@ -206,3 +206,84 @@ class IntegralArgv(ArgvParameter):
                 f'&& PyErr_Occurred() != nullptr) return {func._failure()};')
         w.Write(f'{self.name}[i] = tmp;')
         w.Close('}')
+
+
+class UInt128Parameter(Parameter):
+    '''128-bit unsigned integer, passed from python as a regular int.'''
+    def GenerateParseTupleSinkDeclaration(self, w):
+        w.Write(f'PyObject* {self.name} = nullptr;')
+
+    def parse_tuple_format(self):
+        return 'O!'
+
+    def parse_tuple_sink_list(self):
+        return ['&PyLong_Type', f'&{self.name}']
+
+    def GenerateCppParamInitialization(self, w, func):
+        w.Write(f'__uint128_t {self.name_at_caller()} = 0;')
+        w.Open(f'if ({self.name} != nullptr) {{')
+        w.Write(f'PyObject* {self.name}_shift = PyLong_FromLong(64);')
+        w.Write(f'PyObject* {self.name}_hi = PyNumber_Rshift({self.name}, '
+                f'{self.name}_shift);')
+        w.Write(f'Py_DECREF({self.name}_shift);')
+        w.Write(f'if ({self.name}_hi == nullptr) return {func._failure()};')
+        w.Write(f'{self.name_at_caller()} = PyLong_AsUnsignedLongLongMask('
+                f'{self.name}_hi);')
+        w.Write(f'Py_DECREF({self.name}_hi);')
+        w.Write(f'{self.name_at_caller()} = ({self.name_at_caller()} << 64) | '
+                f'PyLong_AsUnsignedLongLongMask({self.name});')
+        w.Write(f'if (PyErr_Occurred() != nullptr) return {func._failure()};')
+        w.Close('}')
+
+    def name_at_caller(self):
+        return f'{self.cpp_name}_cpp'
+
+
+class BufferParameter(Parameter):
+    '''Any object supporting the buffer protocol (e.g. numpy.ndarray).
+
+    The buffer must be C-contiguous. It's passed to C++ as ArrayView that
+    stays valid until the call returns; no data is copied.'''
+    def __init__(self, *args, can_be_none=False, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.can_be_none = can_be_none
+
+    def GenerateParseTupleSinkDeclaration(self, w):
+        w.Write(f'PyObject* {self.name} = nullptr;')
+
+    def parse_tuple_format(self):
+        return 'O'
+
+    def parse_tuple_sink_list(self):
+        return [f'&{self.name}']
+
+    def GenerateCppParamInitialization(self, w, func):
+        view = f'{self.name}_view'
+        if self.optional or self.can_be_none:
+            w.Write('std::optional<lczero::python::ArrayView> '
+                    f'{self.name_at_caller()};')
+        else:
+            w.Write('lczero::python::ArrayView '
+                    f'{self.name_at_caller()};')
+        w.Write(f'Py_buffer {view};')
+        w.Write(f'std::unique_ptr<Py_buffer, void (*)(Py_buffer*)> '
+                f'{view}_guard(nullptr, PyBuffer_Release);')
+        w.Open(f'if ({self.name} != nullptr && {self.name} != Py_None) {{')
+        w.Write(f'if (PyObject_GetBuffer({self.name}, &{view}, '
+                f'PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) '
+                f'return {func._failure()};')
+        w.Write(f'{view}_guard.reset(&{view});')
+        w.Write(f'{self.name_at_caller()} = lczero::python::ArrayView('
+                f'{view}.buf, {view}.format, {view}.itemsize, '
+                f'{view}.shape, {view}.ndim);')
+        if not (self.optional or self.can_be_none):
+            w.Close('} else {')
+            w.Indent()
+            w.Write('PyErr_SetString(PyExc_TypeError, '
+                    f'"Argument \'{self.name}\' must support the buffer '
+                    'protocol.");')
+            w.Write(f'return {func._failure()};')
+        w.Close('}')
+
+    def name_at_caller(self):
+        return f'{self.cpp_name}_cpp'
@@ -112,6 +112,24 @@ class NumericRetVal(RetVal):
                 f'"{self.parse_tuple_format()}", {self.cpp_val()});')
 
 
+class UInt128RetVal(RetVal):
+    def cpp_type(self):
+        return '__uint128_t'
+
+    def GenerateConversion(self, w):
+        w.Write('PyObject* hi = PyLong_FromUnsignedLongLong('
+                f'static_cast<uint64_t>({self.cpp_val()} >> 64));')
+        w.Write('PyObject* lo = PyLong_FromUnsignedLongLong('
+                f'static_cast<uint64_t>({self.cpp_val()}));')
+        w.Write('PyObject* shift = PyLong_FromLong(64);')
+        w.Write('PyObject* hi_shifted = PyNumber_Lshift(hi, shift);')
+        w.Write(f'{self.py_val()} = PyNumber_Or(hi_shifted, lo);')
+        w.Write('Py_DECREF(hi_shifted);')
+        w.Write('Py_DECREF(shift);')
+        w.Write('Py_DECREF(lo);')
+        w.Write('Py_DECREF(hi);')
+
+
 class ObjCopyRetval(RetVal):
     def __init__(self, type):
         self.type = type
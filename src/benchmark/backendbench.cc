@@ -27,9 +27,12 @@
 
 #include "benchmark/backendbench.h"
 
+#include <iomanip>
+
 #include "chess/board.h"
 #include "mcts/node.h"
 #include "neural/factory.h"
+#include "neural/shared/layer_profiler.h"
 #include "utils/optionsparser.h"
 
 namespace lczero {
@@ -49,6 +52,47 @@ const OptionId kBatchStepId{"batch-step", "",
 const OptionId kFenId{"fen", "", "Benchmark initial position FEN."};
 
 const OptionId kClippyId{"clippy", "", "Enable helpful assistant."};
+const OptionId kProfileId{
+    "profile", "",
+    "Record time spent per layer (CPU backends only) and print a sorted "
+    "breakdown for every batch size."};
+
+void PrintProfileTable(const std::string& title,
+                       const std::vector<LayerProfiler::Entry>& entries,
+                       double total, int batches) {
+  std::cout << std::left << std::setw(28) << title << std::right
+            << std::setw(12) << "total ms" << std::setw(10) << "calls"
+            << std::setw(12) << "ms/batch" << std::setw(9) << "share"
+            << std::endl;
+  for (const auto& entry : entries) {
+    std::cout << "  " << std::left << std::setw(26) << entry.Name()
+              << std::right << std::fixed << std::setprecision(3)
+              << std::setw(12) << entry.seconds * 1000 << std::setw(10)
+              << entry.calls << std::setw(12)
+              << entry.seconds * 1000 / batches << std::setw(8)
+              << std::setprecision(1) << 100.0 * entry.seconds / total << "%"
+              << std::endl;
+  }
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
+
+void PrintLayerProfile(int batch_size, int batches) {
+  const auto& profiler = LayerProfiler::Get();
+  const auto entries = profiler.GetEntries();
+  if (entries.empty()) {
+    std::cout << "No layer profile recorded, the backend does not support "
+                 "profiling."
+              << std::endl;
+    return;
+  }
+  double total = 0.0;
+  for (const auto& entry : entries) total += entry.seconds;
+  std::cout << "Layer profile for batch size " << batch_size << ", "
+            << total * 1000 / batches << "ms per batch:" << std::endl;
+  PrintProfileTable("Layer", entries, total, batches);
+  PrintProfileTable("Layer type", profiler.GetTypeTotals(), total, batches);
+}
 
 void Clippy(std::string title,
             std::string msg3,  std::string best3, std::string msg2,
@@ -87,6 +131,7 @@ void BackendBenchmark::Run() {
   options.Add<IntOption>(kBatchStepId, 1, 256) = 1;
   options.Add<StringOption>(kFenId) = ChessBoard::kStartposFen;
   options.Add<BoolOption>(kClippyId) = false;
+  options.Add<BoolOption>(kProfileId) = false;
 
   if (!options.ProcessAllFlags()) return;
 
@@ -106,6 +151,8 @@ void BackendBenchmark::Run() {
     warmup->ComputeBlocking();
 
     const int batches = option_dict.Get<int>(kBatchesId);
+    const bool profile = option_dict.Get<bool>(kProfileId);
+    LayerProfiler::Get().Enable(profile);
 
     int best = 1; int best2 = 1; int best3 = 1;
     float best_nps = 0.0f; float best_nps2 = 0.0f; float best_nps3 = 0.0f;
@@ -114,6 +161,7 @@ void BackendBenchmark::Run() {
     for (int i = option_dict.Get<int>(kStartBatchSizeId);
          i <= option_dict.Get<int>(kMaxBatchSizeId);
          i += option_dict.Get<int>(kBatchStepId)) {
+      LayerProfiler::Get().Reset();
       const auto start = std::chrono::steady_clock::now();
       // TODO: support threads not equal to 1 to be able to more sensibly test
       // multiplexing backend.
@@ -135,6 +183,7 @@ void BackendBenchmark::Run() {
                 << " with inference average time "
                 << time.count() / batches * 1000 << "ms - throughput " << nps
                 << " nps." << std::endl;
+      if (profile) PrintLayerProfile(i, batches);
 
       if (option_dict.Get<bool>(kClippyId)) {
         float nps_ingame  = std::pow((nps + best_nps)  / 2, 1.085);
@@ -29,6 +29,7 @@
 
 #include <numeric>
 
+#include "mcts/root_parallel.h"
 #include "mcts/search.h"
 #include "mcts/stoppers/factory.h"
 #include "mcts/stoppers/stoppers.h"
@@ -45,6 +46,10 @@ const OptionId kMovetimeId{"movetime", "",
 const OptionId kFenId{"fen", "", "Benchmark position FEN."};
 const OptionId kNumPositionsId{"num-positions", "",
                                "The number of benchmark positions to test."};
+const OptionId kSearchTreesId{
+    "search-trees", "",
+    "Number of independent search trees sharing out the threads, to compare "
+    "root-parallel search against a single shared tree."};
 }  // namespace
 
 void Benchmark::Run() {
@@ -58,6 +63,7 @@ void Benchmark::Run() {
   options.Add<IntOption>(kMovetimeId, -1, 999999999) = 10000;
   options.Add<StringOption>(kFenId) = "";
   options.Add<IntOption>(kNumPositionsId, 1, 48) = 48;
+  options.Add<IntOption>(kSearchTreesId, 1, 64) = 1;
 
   if (!options.ProcessAllFlags()) return;
 
@@ -70,6 +76,9 @@ void Benchmark::Run() {
     const int movetime = option_dict.Get<int>(kMovetimeId);
     const std::string fen = option_dict.Get<std::string>(kFenId);
     int num_positions = option_dict.Get<int>(kNumPositionsId);
+    const int trees = option_dict.Get<int>(kSearchTreesId);
+    const int threads = option_dict.Get<int>(kThreadsOptionId);
+    const int cache_size = option_dict.Get<int>(kNNCacheSizeId) / trees;
 
     std::vector<std::double_t> times;
     std::vector<std::int64_t> playouts;
@@ -91,31 +100,52 @@ void Benchmark::Run() {
         stopper->AddStopper(std::make_unique<TimeLimitStopper>(movetime));
       }
       if (visits > -1) {
-        stopper->AddStopper(std::make_unique<VisitsStopper>(visits, false));
+        // Only the first tree has stoppers.
+        stopper->AddStopper(std::make_unique<VisitsStopper>(
+            (visits + trees - 1) / trees, false));
       }
 
       NNCache cache;
-      cache.SetCapacity(option_dict.Get<int>(kNNCacheSizeId));
+      cache.SetCapacity(cache_size);
 
       NodeTree tree;
       tree.ResetToPosition(position, {});
 
+      std::vector<std::unique_ptr<SearchTreeShard>> shards;
+      std::vector<SearchTreeShard*> shard_ptrs;
+      for (int i = 1; i < trees; i++) {
+        shards.push_back(std::make_unique<SearchTreeShard>());
+        shards.back()->tree = std::make_unique<NodeTree>();
+        shards.back()->tree->ResetToPosition(position, {});
+        shards.back()->cache.SetCapacity(cache_size);
+        shard_ptrs.push_back(shards.back().get());
+      }
+
       const auto start = std::chrono::steady_clock::now();
-      auto search = std::make_unique<Search>(
-          tree, network.get(),
-          std::make_unique<CallbackUciResponder>(
-              std::bind(&Benchmark::OnBestMove, this, std::placeholders::_1),
-              std::bind(&Benchmark::OnInfo, this, std::placeholders::_1)),
-          MoveList(), start, std::move(stopper), false, false, option_dict,
-          &cache);
-      search->StartThreads(option_dict.Get<int>(kThreadsOptionId));
-      search->Wait();
+      auto responder = std::make_unique<CallbackUciResponder>(
+          std::bind(&Benchmark::OnBestMove, this, std::placeholders::_1),
+          std::bind(&Benchmark::OnInfo, this, std::placeholders::_1));
+      if (trees > 1) {
+        RootParallelSearch search(tree, network.get(), &cache, shard_ptrs,
+                                  std::move(responder), MoveList(), start,
+                                  std::move(stopper), false, false,
+                                  option_dict, nullptr);
+        search.StartThreads(std::max(threads / trees, 1));
+        search.Wait();
+        playouts.push_back(search.GetTotalPlayouts());
+      } else {
+        Search search(tree, network.get(), std::move(responder), MoveList(),
+                      start, std::move(stopper), false, false, option_dict,
+                      &cache, nullptr);
+        search.StartThreads(threads);
+        search.Wait();
+        playouts.push_back(search.GetTotalPlayouts());
+      }
       const auto end = std::chrono::steady_clock::now();
 
       const auto time =
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
       times.push_back(time.count());
-      playouts.push_back(search->GetTotalPlayouts());
     }
 
     const auto total_playouts =
@@ -0,0 +1,364 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "bitbase/bitbase.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <tuple>
+
+#include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/logging.h"
+
+namespace lczero {
+namespace {
+
+// Letters of non-king pieces, in ChessBoard::PieceType order.
+constexpr char kPieceLetters[] = "RACPNB";
+// Maximum number of pieces of a type for one side.
+constexpr int kMaxPieces[] = {2, 2, 2, 5, 2, 2};
+
+struct Domain {
+  std::vector<uint8_t> squares;
+  // Position of a square in squares, -1 if the piece can't stand there.
+  std::vector<int8_t> lookup;
+};
+
+// Whether a piece of the type can ever stand on the square. Domains of the
+// side not to move are the mirrored domains of the side to move.
+bool InDomain(bool ours, ChessBoard::PieceType type, int row, int col) {
+  if (!ours) row = 9 - row;
+  switch (type) {
+    case ChessBoard::KING:
+      return row <= 2 && col >= 3 && col <= 5;
+    case ChessBoard::ADVISOR:
+      return row <= 2 && col >= 3 && col <= 5 && (row + col) % 2 == 1;
+    case ChessBoard::BISHOP:
+      return row <= 4 && row % 2 == 0 && col % 2 == 0 &&
+             (row / 2 + col / 2) % 2 == 1;
+    case ChessBoard::PAWN:
+      return row >= 5 || (row >= 3 && col % 2 == 0);
+    default:
+      return true;
+  }
+}
+
+const Domain& GetDomain(bool ours, ChessBoard::PieceType type) {
+  static const auto kDomains = [] {
+    std::array<std::array<Domain, ChessBoard::KING + 1>, 2> domains;
+    for (int side = 0; side < 2; side++) {
+      for (int type = 0; type <= ChessBoard::KING; type++) {
+        auto& domain = domains[side][type];
+        domain.lookup.assign(90, -1);
+        for (uint8_t sq = 0; sq < 90; sq++) {
+          if (!InDomain(side == 0, static_cast<ChessBoard::PieceType>(type),
+                        sq / 9, sq % 9)) {
+            continue;
+          }
+          domain.lookup[sq] = domain.squares.size();
+          domain.squares.push_back(sq);
+        }
+      }
+    }
+    return domains;
+  }();
+  return kDomains[ours ? 0 : 1][type];
+}
+
+BitBoard PiecesOfType(const ChessBoard& board, ChessBoard::PieceType type) {
+  switch (type) {
+    case ChessBoard::ROOK:
+      return board.rooks();
+    case ChessBoard::ADVISOR:
+      return board.advisors();
+    case ChessBoard::CANNON:
+      return board.cannons();
+    case ChessBoard::PAWN:
+      return board.pawns();
+    case ChessBoard::KNIGHT:
+      return board.knights();
+    case ChessBoard::BISHOP:
+      return board.bishops();
+    default:
+      return board.kings();
+  }
+}
+
+ChessBoard::PieceType LetterToType(char c) {
+  const char* pos = std::strchr(kPieceLetters, c);
+  if (c == '\0' || pos == nullptr) {
+    throw Exception(std::string("Bad piece in bitbase material: ") + c);
+  }
+  return static_cast<ChessBoard::PieceType>(pos - kPieceLetters);
+}
+
+// Rough piece values, only used to decide which side is listed first.
+constexpr int kPieceValues[] = {9, 2, 5, 1, 4, 2};
+
+// Orders sides so that stronger ones compare larger.
+std::tuple<int, size_t, std::string> SideStrength(const std::string& pieces) {
+  int value = 0;
+  std::string rank;
+  for (char c : pieces) {
+    value += kPieceValues[LetterToType(c)];
+    rank += static_cast<char>('9' - LetterToType(c));
+  }
+  return {value, pieces.size(), rank};
+}
+
+}  // namespace
+
+BitbaseWdl operator-(BitbaseWdl wdl) {
+  return wdl == BitbaseWdl::kWin    ? BitbaseWdl::kLoss
+         : wdl == BitbaseWdl::kLoss ? BitbaseWdl::kWin
+                                    : wdl;
+}
+
+std::string SideMaterial(const ChessBoard& board, bool ours) {
+  const BitBoard side = ours ? board.ours() : board.theirs();
+  std::string result;
+  for (int type = ChessBoard::ROOK; type <= ChessBoard::BISHOP; type++) {
+    const int count =
+        (PiecesOfType(board, static_cast<ChessBoard::PieceType>(type)) & side)
+            .count_few();
+    result.append(count, kPieceLetters[type]);
+  }
+  return result;
+}
+
+std::string MaterialKey(const std::string& first, const std::string& second,
+                        bool* swapped) {
+  const bool swap = SideStrength(second) > SideStrength(first);
+  if (swapped) *swapped = swap;
+  return swap ? "K" + second + "vK" + first : "K" + first + "vK" + second;
+}
+
+void ParseMaterial(const std::string& material, std::string* first,
+                   std::string* second) {
+  const auto v = material.find('v');
+  if (v == std::string::npos || material.size() < 3 || material[0] != 'K' ||
+      v + 1 >= material.size() || material[v + 1] != 'K') {
+    throw Exception("Bad bitbase material: " + material);
+  }
+  std::string sides[2] = {material.substr(1, v - 1), material.substr(v + 2)};
+  for (auto& side : sides) {
+    int counts[6] = {};
+    for (char c : side) {
+      if (++counts[LetterToType(c)] > kMaxPieces[LetterToType(c)]) {
+        throw Exception("Too many pieces in bitbase material: " + material);
+      }
+    }
+    std::sort(side.begin(), side.end(), [](char a, char b) {
+      return LetterToType(a) < LetterToType(b);
+    });
+  }
+  *first = sides[0];
+  *second = sides[1];
+}
+
+BitbaseIndexer::BitbaseIndexer(const std::string& ours,
+                               const std::string& theirs) {
+  auto add_slot = [&](bool side, ChessBoard::PieceType type) {
+    const auto& domain = GetDomain(side, type);
+    slots_.push_back({side, type, &domain.squares, &domain.lookup});
+    size_ *= domain.squares.size();
+  };
+  add_slot(true, ChessBoard::KING);
+  add_slot(false, ChessBoard::KING);
+  for (char c : ours) add_slot(true, LetterToType(c));
+  for (char c : theirs) add_slot(false, LetterToType(c));
+}
+
+uint64_t BitbaseIndexer::Index(const ChessBoard& board) const {
+  uint64_t index = 0;
+  size_t i = 0;
+  while (i < slots_.size()) {
+    // Identical pieces occupy consecutive slots.
+    const bool ours = slots_[i].ours;
+    const auto type = slots_[i].type;
+    size_t group_end = i;
+    while (group_end < slots_.size() && slots_[group_end].ours == ours &&
+           slots_[group_end].type == type) {
+      ++group_end;
+    }
+    const BitBoard pieces =
+        PiecesOfType(board, type) & (ours ? board.ours() : board.theirs());
+    if (static_cast<size_t>(pieces.count_few()) != group_end - i) {
+      return kInvalid;
+    }
+    for (auto sq : pieces) {
+      const Slot& slot = slots_[i++];
+      const int pos = (*slot.lookup)[sq.as_int()];
+      if (pos < 0) return kInvalid;
+      index = index * slot.squares->size() + pos;
+    }
+  }
+  return index;
+}
+
+bool BitbaseIndexer::Board(uint64_t index, ChessBoard* board) const {
+  if (index >= size_) return false;
+  std::array<uint8_t, 32> squares;
+  for (size_t i = slots_.size(); i-- > 0;) {
+    const auto radix = slots_[i].squares->size();
+    squares[i] = (*slots_[i].squares)[index % radix];
+    index /= radix;
+  }
+
+  char grid[90] = {};
+  for (size_t i = 0; i < slots_.size(); i++) {
+    const Slot& slot = slots_[i];
+    // Identical pieces are only indexed in increasing square order.
+    if (i > 0 && slots_[i - 1].type == slot.type &&
+        slots_[i - 1].ours == slot.ours && squares[i - 1] >= squares[i]) {
+      return false;
+    }
+    if (grid[squares[i]]) return false;
+    const char letter =
+        slot.type == ChessBoard::KING ? 'K' : kPieceLetters[slot.type];
+    grid[squares[i]] = slot.ours ? letter : letter - 'A' + 'a';
+  }
+
+  // Flying generals.
+  const int our_king = squares[0];
+  const int their_king = squares[1];
+  if (our_king % 9 == their_king % 9) {
+    bool blocked = false;
+    for (int sq = our_king + 9; sq < their_king; sq += 9) {
+      if (grid[sq]) blocked = true;
+    }
+    if (!blocked) return false;
+  }
+
+  std::string fen;
+  for (int row = 9; row >= 0; --row) {
+    int empty = 0;
+    for (int col = 0; col < 9; ++col) {
+      const char c = grid[row * 9 + col];
+      if (!c) {
+        ++empty;
+        continue;
+      }
+      if (empty) fen += static_cast<char>('0' + empty);
+      empty = 0;
+      fen += c;
+    }
+    if (empty) fen += static_cast<char>('0' + empty);
+    if (row > 0) fen += '/';
+  }
+  board->SetFromFen(fen + " w - - 0 1");
+
+  // The side not to move must not be in check.
+  ChessBoard them = *board;
+  them.Mirror();
+  return !them.IsUnderCheck();
+}
+
+Bitbase::Bitbase() = default;
+Bitbase::~Bitbase() = default;
+
+bool Bitbase::Init(const std::string& paths) {
+#ifdef _WIN32
+  constexpr char kPathSeparator = ';';
+#else
+  constexpr char kPathSeparator = ':';
+#endif
+  size_t start = 0;
+  while (start <= paths.size()) {
+    auto end = paths.find(kPathSeparator, start);
+    if (end == std::string::npos) end = paths.size();
+    const std::string dir = paths.substr(start, end - start);
+    start = end + 1;
+    if (dir.empty()) continue;
+    for (const auto& name : GetFileList(dir)) {
+      const std::string filename = dir + "/" + name;
+      const std::string extension(kBitbaseExtension);
+      if (filename.size() <= extension.size() ||
+          filename.compare(filename.size() - extension.size(),
+                           extension.size(), extension) != 0) {
+        continue;
+      }
+      // A bad file is skipped, so that the others can still be used.
+      try {
+        Table table;
+        table.file = std::make_unique<MappedFile>(filename);
+        const uint8_t* data = table.file->data();
+        uint32_t magic, version;
+        uint64_t sizes[2];
+        char key[17] = {};
+        if (table.file->size() < kBitbaseHeaderSize) {
+          throw Exception("file is too short");
+        }
+        std::memcpy(&magic, data, 4);
+        std::memcpy(&version, data + 4, 4);
+        std::memcpy(sizes, data + 8, 16);
+        std::memcpy(key, data + 24, 16);
+        if (magic != kBitbaseMagic || version != kBitbaseVersion) {
+          throw Exception("bad header");
+        }
+        std::string first, second;
+        ParseMaterial(key, &first, &second);
+        table.indexers[0] = BitbaseIndexer(first, second);
+        table.indexers[1] = BitbaseIndexer(second, first);
+        if (sizes[0] != table.indexers[0].size() ||
+            sizes[1] != table.indexers[1].size() ||
+            table.file->size() < kBitbaseHeaderSize + (sizes[0] + 3) / 4 +
+                                     (sizes[1] + 3) / 4) {
+          throw Exception("file size mismatch");
+        }
+        table.blocks[0] = data + kBitbaseHeaderSize;
+        table.blocks[1] = table.blocks[0] + (sizes[0] + 3) / 4;
+        max_cardinality_ =
+            std::max(max_cardinality_,
+                     2 + static_cast<int>(first.size() + second.size()));
+        tables_[MaterialKey(first, second)] = std::move(table);
+      } catch (Exception& ex) {
+        CERR << "Skipping bad bitbase file " << filename << ": " << ex.what();
+      }
+    }
+  }
+  CERR << "Found " << tables_.size() << " Xiangqi bitbase files.";
+  return !tables_.empty();
+}
+
+BitbaseWdl Bitbase::Probe(const ChessBoard& board) const {
+  bool swapped;
+  const auto key =
+      MaterialKey(SideMaterial(board, true), SideMaterial(board, false),
+                  &swapped);
+  const auto iter = tables_.find(key);
+  if (iter == tables_.end()) return BitbaseWdl::kUnknown;
+  const Table& table = iter->second;
+  const int block = swapped ? 1 : 0;
+  const auto index = table.indexers[block].Index(board);
+  if (index == BitbaseIndexer::kInvalid) return BitbaseWdl::kUnknown;
+  return GetPackedWdl(table.blocks[block], index);
+}
+
+}  // namespace lczero
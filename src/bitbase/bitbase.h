@@ -0,0 +1,149 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chess/board.h"
+#include "utils/mappedfile.h"
+
+namespace lczero {
+
+// Game theoretical value of a bitbase position from the side to move's point
+// of view. kUnknown is returned for positions the bitbase doesn't cover and
+// for positions whose result can't be claimed safely (e.g. a win that takes
+// longer than the 60 move rule allows, or a draw that could be overturned by
+// the perpetual check or chase rules).
+enum class BitbaseWdl : uint8_t { kUnknown = 0, kLoss = 1, kDraw = 2, kWin = 3 };
+
+// Flips the value to the other side's point of view.
+BitbaseWdl operator-(BitbaseWdl wdl);
+
+// Material of a bitbase is written as e.g. "KRvKA": the pieces of the side
+// listed first, "v", the pieces of the other side. Pieces of a side are
+// ordered R, A, C, P, N, B after the king. The stronger side is always listed
+// first, so that every material has exactly one canonical key.
+
+// Returns the non-king pieces of the side to move (@ours) or of the other side
+// in canonical order, e.g. "RA".
+std::string SideMaterial(const ChessBoard& board, bool ours);
+
+// Returns canonical key of a material given by the non-king pieces of both
+// sides. Sets @swapped to whether @second is listed first in the key.
+std::string MaterialKey(const std::string& first, const std::string& second,
+                        bool* swapped = nullptr);
+
+// Parses material like "KRvKA" into non-king pieces of both sides. Throws
+// Exception on malformed input.
+void ParseMaterial(const std::string& material, std::string* first,
+                   std::string* second);
+
+// Maps positions of one material with a given side to move to a dense index.
+// Kings and pieces with restricted mobility (advisors, bishops, pawns) only
+// range over the squares they can ever occupy.
+class BitbaseIndexer {
+ public:
+  static constexpr uint64_t kInvalid = ~0ULL;
+
+  BitbaseIndexer() = default;
+  // @ours are non-king pieces of the side to move, @theirs of the other side.
+  BitbaseIndexer(const std::string& ours, const std::string& theirs);
+
+  // Number of indices, including the ones of illegal positions.
+  uint64_t size() const { return size_; }
+
+  // Returns index of the board, which must have the material of the indexer.
+  // Returns kInvalid if some piece stands outside of its domain.
+  uint64_t Index(const ChessBoard& board) const;
+
+  // Sets up the board for the index. Returns false if the index doesn't
+  // correspond to a legal canonical position (pieces overlap, identical pieces
+  // are out of order, the side not to move is in check or the kings face each
+  // other).
+  bool Board(uint64_t index, ChessBoard* board) const;
+
+ private:
+  struct Slot {
+    bool ours;
+    ChessBoard::PieceType type;
+    const std::vector<uint8_t>* squares;
+    const std::vector<int8_t>* lookup;
+  };
+  std::vector<Slot> slots_;
+  uint64_t size_ = 1;
+};
+
+// Bitbase file format (all integers little endian):
+//   uint32 magic, uint32 version, uint64 size of the first block,
+//   uint64 size of the second block, char[16] zero padded material key,
+//   followed by both blocks with 2 bits (BitbaseWdl) per position.
+// The first block has the first side of the key to move, the second one the
+// other side.
+constexpr uint32_t kBitbaseMagic = 0x42425850;  // "PXBB"
+constexpr uint32_t kBitbaseVersion = 1;
+constexpr size_t kBitbaseHeaderSize = 40;
+constexpr const char* kBitbaseExtension = ".pxb";
+
+// Returns the value of the position at @index of a packed block.
+inline BitbaseWdl GetPackedWdl(const uint8_t* data, uint64_t index) {
+  return static_cast<BitbaseWdl>((data[index / 4] >> (2 * (index % 4))) & 3);
+}
+
+// Set of memory-mapped bitbase files.
+class Bitbase {
+ public:
+  Bitbase();
+  ~Bitbase();
+
+  // Maps all bitbase files found in the directories of @paths (separated by
+  // ';' on Windows and ':' otherwise). Malformed files are logged and
+  // skipped. Returns whether any file was loaded.
+  bool Init(const std::string& paths);
+
+  // Maximum number of pieces (including kings) of the loaded bitbases.
+  int max_cardinality() const { return max_cardinality_; }
+
+  // Returns the value of the position from the side to move's point of view.
+  // The value assumes the 60 move counter was just reset.
+  BitbaseWdl Probe(const ChessBoard& board) const;
+
+ private:
+  struct Table {
+    std::unique_ptr<MappedFile> file;
+    const uint8_t* blocks[2];
+    BitbaseIndexer indexers[2];
+  };
+  std::unordered_map<std::string, Table> tables_;
+  int max_cardinality_ = 0;
+};
+
+}  // namespace lczero
@@ -0,0 +1,101 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "bitbase/generator.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "bitbase/bitbase.h"
+#include "utils/exception.h"
+
+namespace lczero {
+
+TEST(Bitbase, MaterialKey) {
+  EXPECT_EQ(MaterialKey("R", ""), "KRvK");
+  bool swapped;
+  EXPECT_EQ(MaterialKey("A", "R", &swapped), "KRvKA");
+  EXPECT_TRUE(swapped);
+  EXPECT_EQ(MaterialKey("RA", "RR", &swapped), "KRRvKRA");
+  EXPECT_TRUE(swapped);
+  std::string first, second;
+  ParseMaterial("KARvKP", &first, &second);
+  EXPECT_EQ(first, "RA");
+  EXPECT_EQ(second, "P");
+  EXPECT_THROW(ParseMaterial("KRRRvK", &first, &second), Exception);
+}
+
+TEST(Bitbase, IndexRoundTrip) {
+  const BitbaseIndexer indexer("RA", "P");
+  ChessBoard board;
+  int legal = 0;
+  for (uint64_t index = 0; index < indexer.size(); index += 7) {
+    if (!indexer.Board(index, &board)) continue;
+    ++legal;
+    EXPECT_EQ(indexer.Index(board), index);
+    EXPECT_EQ(SideMaterial(board, true), "RA");
+    EXPECT_EQ(SideMaterial(board, false), "P");
+  }
+  EXPECT_GT(legal, 0);
+}
+
+TEST(Bitbase, RookAgainstBareKing) {
+  BitbaseGenerator generator;
+  EXPECT_EQ(generator.Generate("KvKR"), "KRvK");
+  EXPECT_EQ(generator.Probe(ChessBoard("3k5/9/9/9/9/9/9/9/9/R3K4 w")),
+            BitbaseWdl::kWin);
+  EXPECT_EQ(generator.Probe(ChessBoard("3k5/9/9/9/9/9/9/9/9/R3K4 b")),
+            BitbaseWdl::kLoss);
+}
+
+TEST(Bitbase, BottomPawnCannotWin) {
+  BitbaseGenerator generator;
+  generator.Generate("KPvK");
+  EXPECT_EQ(generator.Probe(ChessBoard("P2k5/9/9/9/9/9/9/9/9/4K4 w")),
+            BitbaseWdl::kDraw);
+  EXPECT_EQ(generator.Probe(ChessBoard("P2k5/9/9/9/9/9/9/9/9/4K4 b")),
+            BitbaseWdl::kDraw);
+}
+
+TEST(Bitbase, MalformedFileIsSkipped) {
+  const std::string dir = ::testing::TempDir();
+  const std::string filename = dir + "/bad" + kBitbaseExtension;
+  std::ofstream(filename) << "not a bitbase";
+  Bitbase bitbase;
+  EXPECT_FALSE(bitbase.Init(dir));
+  std::remove(filename.c_str());
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  lczero::InitializeMagicBitboards();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,404 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "bitbase/generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "utils/exception.h"
+#include "utils/files.h"
+#include "utils/logging.h"
+
+namespace lczero {
+namespace {
+
+// State of a position during the retrograde analysis.
+enum State : uint8_t { kUndecided, kLost, kWon, kDrawn, kIllegal };
+
+// Ways to leave the material through a capture, from the mover's view.
+enum ExitFlags : uint8_t {
+  kWinningExit = 1,
+  kDrawingExit = 2,
+  kUnknownExit = 4,
+};
+
+// Number of plies without capture after which the game is drawn.
+constexpr int kMaxPlies = 120;
+// Marks an edge of a move that neither checks nor chases.
+constexpr uint32_t kQuietBit = 0x80000000u;
+
+// Calls fn(item, &edges) for every item, split into contiguous chunks over
+// threads, and collects appended edges in compressed sparse row form.
+template <typename Fn>
+void BuildEdges(uint64_t size, int threads, Fn fn, std::vector<uint64_t>* start,
+                std::vector<uint32_t>* edges) {
+  threads = std::max(1, threads);
+  const uint64_t chunk = (size + threads - 1) / threads;
+  std::vector<std::vector<uint32_t>> chunk_edges(threads);
+  std::vector<uint32_t> counts(size);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      const uint64_t begin = std::min(size, t * chunk);
+      const uint64_t end = std::min(size, begin + chunk);
+      for (uint64_t item = begin; item < end; item++) {
+        const auto before = chunk_edges[t].size();
+        fn(item, &chunk_edges[t]);
+        counts[item] = chunk_edges[t].size() - before;
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+
+  start->assign(size + 1, 0);
+  for (uint64_t item = 0; item < size; item++) {
+    (*start)[item + 1] = (*start)[item] + counts[item];
+  }
+  edges->clear();
+  edges->reserve(start->back());
+  for (const auto& part : chunk_edges) {
+    edges->insert(edges->end(), part.begin(), part.end());
+  }
+}
+
+// Builds the reverse graph (edge targets to sources) of a CSR graph.
+void ReverseEdges(const std::vector<uint64_t>& start,
+                  const std::vector<uint32_t>& edges, uint32_t mask,
+                  std::vector<uint64_t>* reverse_start,
+                  std::vector<uint32_t>* reverse_edges) {
+  const uint64_t size = start.size() - 1;
+  reverse_start->assign(size + 1, 0);
+  for (auto edge : edges) (*reverse_start)[(edge & mask) + 1]++;
+  for (uint64_t i = 0; i < size; i++) {
+    (*reverse_start)[i + 1] += (*reverse_start)[i];
+  }
+  reverse_edges->resize(edges.size());
+  std::vector<uint64_t> fill(reverse_start->begin(), reverse_start->end() - 1);
+  for (uint64_t i = 0; i < size; i++) {
+    for (auto e = start[i]; e < start[i + 1]; e++) {
+      (*reverse_edges)[fill[edges[e] & mask]++] = i;
+    }
+  }
+}
+
+}  // namespace
+
+std::string BitbaseGenerator::Generate(const std::string& material) {
+  std::string first, second;
+  ParseMaterial(material, &first, &second);
+  Solve(first, second);
+  return MaterialKey(first, second);
+}
+
+std::vector<std::string> BitbaseGenerator::GetKeys() const {
+  std::vector<std::string> keys;
+  for (const auto& table : tables_) keys.push_back(table.first);
+  return keys;
+}
+
+BitbaseWdl BitbaseGenerator::Probe(const ChessBoard& board) const {
+  bool swapped;
+  const auto key =
+      MaterialKey(SideMaterial(board, true), SideMaterial(board, false),
+                  &swapped);
+  const auto iter = tables_.find(key);
+  if (iter == tables_.end()) return BitbaseWdl::kUnknown;
+  const int block = swapped ? 1 : 0;
+  const auto index = iter->second.indexers[block].Index(board);
+  if (index == BitbaseIndexer::kInvalid) return BitbaseWdl::kUnknown;
+  return static_cast<BitbaseWdl>(iter->second.values[block][index]);
+}
+
+void BitbaseGenerator::Save(const std::string& key,
+                            const std::string& directory) const {
+  const Table& table = tables_.at(key);
+  if (key.size() > 16) throw Exception("Bitbase key is too long: " + key);
+  std::string data(kBitbaseHeaderSize, '\0');
+  const uint64_t sizes[2] = {table.values[0].size(), table.values[1].size()};
+  std::memcpy(&data[0], &kBitbaseMagic, 4);
+  std::memcpy(&data[4], &kBitbaseVersion, 4);
+  std::memcpy(&data[8], sizes, 16);
+  std::memcpy(&data[24], key.data(), key.size());
+  for (const auto& values : table.values) {
+    std::string packed((values.size() + 3) / 4, '\0');
+    for (size_t i = 0; i < values.size(); i++) {
+      packed[i / 4] |= values[i] << (2 * (i % 4));
+    }
+    data += packed;
+  }
+  WriteStringToFile(directory + "/" + key + kBitbaseExtension, data);
+}
+
+void BitbaseGenerator::Solve(std::string first, std::string second) {
+  bool swapped;
+  const auto key = MaterialKey(first, second, &swapped);
+  if (tables_.count(key)) return;
+  if (swapped) std::swap(first, second);
+  // Captures lead to materials with one piece less, which are solved first.
+  for (size_t i = 0; i < first.size(); i++) {
+    Solve(first.substr(0, i) + first.substr(i + 1), second);
+  }
+  for (size_t i = 0; i < second.size(); i++) {
+    Solve(first, second.substr(0, i) + second.substr(i + 1));
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+  Table table;
+  table.indexers[0] = BitbaseIndexer(first, second);
+  table.indexers[1] = BitbaseIndexer(second, first);
+  // Positions of both sides to move share one global index space, the ones
+  // with the second side to move come after the ones of the first.
+  const uint64_t offsets[2] = {0, table.indexers[0].size()};
+  const uint64_t total = table.indexers[0].size() + table.indexers[1].size();
+  if (total >= kQuietBit) throw Exception("Bitbase is too large: " + key);
+  auto block_of = [&](uint64_t pos) { return pos >= offsets[1] ? 1 : 0; };
+  auto make_board = [&](uint64_t pos, ChessBoard* board) {
+    const int block = block_of(pos);
+    return table.indexers[block].Board(pos - offsets[block], board);
+  };
+  auto child_pos = [&](int block, const ChessBoard& child) {
+    return static_cast<uint32_t>(offsets[1 - block] +
+                                 table.indexers[1 - block].Index(child));
+  };
+
+  std::vector<uint8_t> state(total, kUndecided);
+  std::vector<uint8_t> exits(total, 0);
+  // Number of moves not yet known to lose.
+  std::vector<uint16_t> count(total, 0);
+  // Plies to mate or to a capture into a solved material.
+  std::vector<uint16_t> dist(total, 0);
+
+  // Forward pass: moves within the material become edges, captures are looked
+  // up in the already solved materials.
+  std::vector<uint64_t> start;
+  std::vector<uint32_t> edges;
+  BuildEdges(
+      total, threads_,
+      [&](uint64_t pos, std::vector<uint32_t>* out) {
+        ChessBoard board;
+        if (!make_board(pos, &board)) {
+          state[pos] = kIllegal;
+          return;
+        }
+        if (!board.HasMatingMaterial()) {
+          state[pos] = kDrawn;
+          return;
+        }
+        const auto moves = board.GenerateLegalMoves();
+        if (moves.empty()) {
+          state[pos] = kLost;
+          return;
+        }
+        for (auto move : moves) {
+          ChessBoard child = board;
+          const bool capture = child.ApplyMove(move);
+          child.Mirror();
+          if (!capture) {
+            out->push_back(child_pos(block_of(pos), child));
+            ++count[pos];
+            continue;
+          }
+          const auto wdl =
+              child.HasMatingMaterial() ? Probe(child) : BitbaseWdl::kDraw;
+          if (wdl == BitbaseWdl::kLoss) {
+            exits[pos] |= kWinningExit;
+          } else if (wdl == BitbaseWdl::kDraw) {
+            exits[pos] |= kDrawingExit;
+            ++count[pos];
+          } else if (wdl == BitbaseWdl::kUnknown) {
+            exits[pos] |= kUnknownExit;
+            ++count[pos];
+          }
+        }
+      },
+      &start, &edges);
+
+  // Retrograde pass, ply by ply.
+  {
+    std::vector<uint64_t> parent_start;
+    std::vector<uint32_t> parents;
+    ReverseEdges(start, edges, ~0u, &parent_start, &parents);
+    std::vector<std::vector<uint32_t>> levels(2);
+    for (uint64_t pos = 0; pos < total; pos++) {
+      if (state[pos] == kLost) {
+        levels[0].push_back(pos);
+      } else if (state[pos] == kUndecided &&
+                 ((exits[pos] & kWinningExit) || count[pos] == 0)) {
+        state[pos] = (exits[pos] & kWinningExit) ? kWon : kLost;
+        dist[pos] = 1;
+        levels[1].push_back(pos);
+      }
+    }
+    for (size_t ply = 0; ply < levels.size(); ply++) {
+      for (size_t i = 0; i < levels[ply].size(); i++) {
+        const uint32_t pos = levels[ply][i];
+        for (auto p = parent_start[pos]; p < parent_start[pos + 1]; p++) {
+          const uint32_t parent = parents[p];
+          if (state[parent] != kUndecided) continue;
+          if (state[pos] == kLost) {
+            state[parent] = kWon;
+          } else if (--count[parent] == 0) {
+            state[parent] = kLost;
+          } else {
+            continue;
+          }
+          dist[parent] = std::min<size_t>(ply + 1, 0xffff);
+          if (levels.size() == ply + 1) levels.emplace_back();
+          levels[ply + 1].push_back(parent);
+        }
+      }
+    }
+  }
+
+  // The remaining positions can't be won by either side in the usual sense.
+  // They are draws unless a side has to give perpetual check or perpetual
+  // chase to hold them, so for every side find the positions from which it
+  // can keep the game going while making quiet moves infinitely often (a
+  // Buchi game over the undecided positions).
+  std::vector<uint32_t> undecided;
+  std::vector<uint32_t> local(total, ~0u);
+  for (uint64_t pos = 0; pos < total; pos++) {
+    if (state[pos] != kUndecided) continue;
+    local[pos] = undecided.size();
+    undecided.push_back(pos);
+  }
+  start.clear();
+  edges.clear();
+  BuildEdges(
+      undecided.size(), threads_,
+      [&](uint64_t u, std::vector<uint32_t>* out) {
+        const uint32_t pos = undecided[u];
+        ChessBoard board;
+        make_board(pos, &board);
+        for (auto move : board.GenerateLegalMoves()) {
+          ChessBoard after = board;
+          if (after.ApplyMove(move)) continue;
+          ChessBoard child = after;
+          child.Mirror();
+          const uint32_t child_index = child_pos(block_of(pos), child);
+          if (state[child_index] == kDrawn) exits[pos] |= kDrawingExit;
+          if (state[child_index] != kUndecided) continue;
+          const bool quiet = !child.IsUnderCheck() && after.Chased() == 0;
+          out->push_back(local[child_index] | (quiet ? kQuietBit : 0));
+        }
+      },
+      &start, &edges);
+  std::vector<uint64_t> parent_start;
+  std::vector<uint32_t> parents;
+  ReverseEdges(start, edges, ~kQuietBit, &parent_start, &parents);
+
+  auto solve_holding = [&](int side) {
+    const size_t size = undecided.size();
+    std::vector<uint8_t> holds(size, 1);
+    std::vector<uint8_t> reached(size);
+    std::vector<uint16_t> remaining(size);
+    std::vector<uint32_t> queue;
+    auto holder_to_move = [&](uint32_t u) {
+      return block_of(undecided[u]) == side;
+    };
+    auto add = [&](uint32_t u) {
+      reached[u] = 1;
+      queue.push_back(u);
+    };
+    while (true) {
+      // Positions from which the holder can force reaching a quiet move into
+      // the current holding set.
+      std::fill(reached.begin(), reached.end(), 0);
+      queue.clear();
+      for (uint32_t u = 0; u < size; u++) {
+        const uint8_t flags = exits[undecided[u]];
+        if (holder_to_move(u)) {
+          bool ok = flags & kDrawingExit;
+          for (auto e = start[u]; !ok && e < start[u + 1]; e++) {
+            ok = (edges[e] & kQuietBit) && holds[edges[e] & ~kQuietBit];
+          }
+          if (ok) add(u);
+        } else {
+          remaining[u] = start[u + 1] - start[u];
+          if (remaining[u] == 0 && !(flags & kUnknownExit)) add(u);
+        }
+      }
+      for (size_t i = 0; i < queue.size(); i++) {
+        const uint32_t u = queue[i];
+        for (auto p = parent_start[u]; p < parent_start[u + 1]; p++) {
+          const uint32_t parent = parents[p];
+          if (reached[parent]) continue;
+          if (holder_to_move(parent) ||
+              (--remaining[parent] == 0 &&
+               !(exits[undecided[parent]] & kUnknownExit))) {
+            add(parent);
+          }
+        }
+      }
+      bool changed = false;
+      for (uint32_t u = 0; u < size; u++) {
+        if (holds[u] && !reached[u]) {
+          holds[u] = 0;
+          changed = true;
+        }
+      }
+      if (!changed) return holds;
+    }
+  };
+  const auto first_holds = solve_holding(0);
+  const auto second_holds = solve_holding(1);
+
+  uint64_t stats[4] = {};
+  for (int block = 0; block < 2; block++) {
+    table.values[block].resize(table.indexers[block].size());
+  }
+  for (uint64_t pos = 0; pos < total; pos++) {
+    BitbaseWdl wdl = BitbaseWdl::kUnknown;
+    if (state[pos] == kWon && dist[pos] <= kMaxPlies) {
+      wdl = BitbaseWdl::kWin;
+    } else if (state[pos] == kLost && dist[pos] <= kMaxPlies) {
+      wdl = BitbaseWdl::kLoss;
+    } else if (state[pos] == kDrawn ||
+               (state[pos] == kUndecided && first_holds[local[pos]] &&
+                second_holds[local[pos]])) {
+      wdl = BitbaseWdl::kDraw;
+    }
+    if (state[pos] != kIllegal) stats[static_cast<int>(wdl)]++;
+    const int block = block_of(pos);
+    table.values[block][pos - offsets[block]] = static_cast<uint8_t>(wdl);
+  }
+  tables_[key] = std::move(table);
+
+  CERR << "Solved " << key << " in "
+       << std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - start_time)
+              .count()
+       << "ms: " << stats[static_cast<int>(BitbaseWdl::kWin)] << " won, "
+       << stats[static_cast<int>(BitbaseWdl::kDraw)] << " drawn, "
+       << stats[static_cast<int>(BitbaseWdl::kLoss)] << " lost, "
+       << stats[static_cast<int>(BitbaseWdl::kUnknown)] << " unknown.";
+}
+
+}  // namespace lczero
@@ -0,0 +1,76 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bitbase/bitbase.h"
+
+namespace lczero {
+
+// Solves small Xiangqi endings by retrograde analysis, using the regular move
+// generator of ChessBoard.
+//
+// Wins and losses are only claimed when they are forced within the 60 move
+// rule counted from the last capture. Positions which neither side can win
+// are only claimed as draws if both sides can keep the draw while giving
+// neither perpetual check nor perpetual chase, so that the repetition rules
+// can't turn them into a loss. Everything else is left kUnknown.
+class BitbaseGenerator {
+ public:
+  explicit BitbaseGenerator(int threads = 1) : threads_(threads) {}
+
+  // Solves the material (e.g. "KRvKA") and, before that, all materials that
+  // can be reached from it by captures. Returns the canonical key.
+  std::string Generate(const std::string& material);
+
+  // Writes a solved material into the directory, named after its key.
+  void Save(const std::string& key, const std::string& directory) const;
+
+  // Keys of all solved materials.
+  std::vector<std::string> GetKeys() const;
+
+  // Returns the value of a position of an already solved material.
+  BitbaseWdl Probe(const ChessBoard& board) const;
+
+ private:
+  struct Table {
+    BitbaseIndexer indexers[2];
+    // One BitbaseWdl per position, for both sides to move.
+    std::vector<uint8_t> values[2];
+  };
+
+  void Solve(std::string first, std::string second);
+
+  const int threads_;
+  std::map<std::string, Table> tables_;
+};
+
+}  // namespace lczero
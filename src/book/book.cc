@@ -0,0 +1,158 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "book/book.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "utils/exception.h"
+#include "utils/random.h"
+
+namespace lczero {
+
+const OptionId kBookFileId{
+    "book-file", "BookFile",
+    "Path to an opening book created by the makebook mode. Moves found in the "
+    "book are played instantly without searching."};
+const OptionId kBookMaxPlyId{
+    "book-max-ply", "BookMaxPly",
+    "Only probe the opening book in positions before this game ply."};
+const OptionId kBookMinWeightId{
+    "book-min-weight", "BookMinWeight",
+    "Ignore book moves that were played fewer times than this."};
+
+namespace {
+struct HashLess {
+  bool operator()(const BookEntry& entry, uint64_t hash) const {
+    return entry.hash < hash;
+  }
+  bool operator()(uint64_t hash, const BookEntry& entry) const {
+    return hash < entry.hash;
+  }
+};
+}  // namespace
+
+OpeningBook::OpeningBook(const std::string& filename)
+    : file_(std::make_unique<MappedFile>(filename)) {
+  const uint8_t* data = file_->data();
+  uint32_t magic, version;
+  uint64_t count;
+  if (file_->size() < kBookHeaderSize) {
+    throw Exception("Opening book file is too short: " + filename);
+  }
+  std::memcpy(&magic, data, 4);
+  std::memcpy(&version, data + 4, 4);
+  std::memcpy(&count, data + 8, 8);
+  if (magic != kBookMagic || version != kBookVersion) {
+    throw Exception("Bad opening book file: " + filename);
+  }
+  if (file_->size() != kBookHeaderSize + count * sizeof(BookEntry)) {
+    throw Exception("Opening book file size mismatch: " + filename);
+  }
+  begin_ = reinterpret_cast<const BookEntry*>(data + kBookHeaderSize);
+  end_ = begin_ + count;
+}
+
+std::vector<std::pair<Move, uint32_t>> OpeningBook::Probe(
+    const ChessBoard& board) const {
+  std::vector<std::pair<Move, uint32_t>> result;
+  const auto range = std::equal_range(begin_, end_, board.Hash(), HashLess());
+  if (range.first == range.second) return result;
+  const auto legal_moves = board.GenerateLegalMoves();
+  for (auto entry = range.first; entry != range.second; ++entry) {
+    const Move move = Move::FromPackedInt(entry->move);
+    // Guard against hash collisions.
+    if (std::none_of(legal_moves.begin(), legal_moves.end(),
+                     [&](Move m) { return board.IsSameMove(m, move); })) {
+      continue;
+    }
+    result.emplace_back(move, entry->weight);
+  }
+  return result;
+}
+
+Move OpeningBook::Pick(const ChessBoard& board, uint32_t min_weight) const {
+  auto moves = Probe(board);
+  moves.erase(std::remove_if(moves.begin(), moves.end(),
+                             [&](const auto& m) { return m.second < min_weight; }),
+              moves.end());
+  if (moves.empty()) return Move();
+  uint64_t total = 0;
+  for (const auto& m : moves) total += m.second;
+  float pick = Random::Get().GetFloat(static_cast<float>(total));
+  for (const auto& m : moves) {
+    pick -= m.second;
+    if (pick < 0) return m.first;
+  }
+  return moves.back().first;
+}
+
+void OpeningBookBuilder::AddGame(const ChessBoard& start, const MoveList& moves,
+                                 int max_ply) {
+  ChessBoard board = start;
+  for (int ply = 0; ply < std::min<int>(max_ply, moves.size()); ++ply) {
+    const Move move = moves[ply];
+    const auto legal_moves = board.GenerateLegalMoves();
+    if (std::none_of(legal_moves.begin(), legal_moves.end(),
+                     [&](Move m) { return board.IsSameMove(m, move); })) {
+      return;
+    }
+    ++counts_[{board.Hash(), move.as_packed_int()}];
+    board.ApplyMove(move);
+    board.Mirror();
+  }
+}
+
+size_t OpeningBookBuilder::Save(const std::string& filename,
+                                uint32_t min_weight) const {
+  std::vector<BookEntry> entries;
+  for (const auto& count : counts_) {
+    if (count.second < min_weight) continue;
+    entries.push_back({count.first.first, count.second,
+                       count.first.second, 0});
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const BookEntry& a, const BookEntry& b) {
+                     if (a.hash != b.hash) return a.hash < b.hash;
+                     return a.weight > b.weight;
+                   });
+
+  std::ofstream out(filename, std::ios::binary);
+  if (!out) throw Exception("Unable to create opening book " + filename);
+  const uint64_t count = entries.size();
+  out.write(reinterpret_cast<const char*>(&kBookMagic), 4);
+  out.write(reinterpret_cast<const char*>(&kBookVersion), 4);
+  out.write(reinterpret_cast<const char*>(&count), 8);
+  out.write(reinterpret_cast<const char*>(entries.data()),
+            entries.size() * sizeof(BookEntry));
+  if (!out) throw Exception("Unable to write opening book " + filename);
+  return entries.size();
+}
+
+}  // namespace lczero
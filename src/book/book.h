@@ -0,0 +1,108 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chess/board.h"
+#include "utils/mappedfile.h"
+#include "utils/optionsdict.h"
+
+namespace lczero {
+
+extern const OptionId kBookFileId;
+extern const OptionId kBookMaxPlyId;
+extern const OptionId kBookMinWeightId;
+
+// Opening book file layout: a 16 byte header (magic, version, number of
+// entries) followed by the entries sorted by position hash and, for the same
+// position, by decreasing weight.
+constexpr uint32_t kBookMagic = 0x4b4f4250;  // "PBOK"
+constexpr uint32_t kBookVersion = 1;
+constexpr size_t kBookHeaderSize = 16;
+
+struct BookEntry {
+  // ChessBoard::Hash() of the position, i.e. from the side to move's view.
+  uint64_t hash;
+  // How often the move was played.
+  uint32_t weight;
+  // Move::as_packed_int() from the side to move's view.
+  uint16_t move;
+  uint16_t reserved;
+};
+static_assert(sizeof(BookEntry) == 16, "Unexpected BookEntry size");
+
+// Memory-mapped opening book. Lookups are a binary search over the mapped
+// entries, so opening the book costs nothing regardless of its size.
+class OpeningBook {
+ public:
+  // Maps @filename, throws if it's not a valid book.
+  explicit OpeningBook(const std::string& filename);
+
+  // Number of (position, move) entries in the book.
+  size_t size() const { return end_ - begin_; }
+
+  // Returns the book moves of the position, from the side to move's point of
+  // view, with their weights. Sorted by decreasing weight.
+  std::vector<std::pair<Move, uint32_t>> Probe(const ChessBoard& board) const;
+
+  // Picks a random book move with probability proportional to its weight,
+  // ignoring moves with weight below @min_weight. The move is from the side to
+  // move's point of view. Returns Move() when out of book.
+  Move Pick(const ChessBoard& board, uint32_t min_weight) const;
+
+ private:
+  std::unique_ptr<MappedFile> file_;
+  const BookEntry* begin_;
+  const BookEntry* end_;
+};
+
+// Counts the moves played in a collection of games and writes them as a book.
+class OpeningBookBuilder {
+ public:
+  // Adds the first @max_ply moves of a game. Moves are from the side to move's
+  // point of view (as in PositionHistory::Append). Illegal moves end the game.
+  void AddGame(const ChessBoard& board, const MoveList& moves, int max_ply);
+
+  // Number of distinct (position, move) pairs collected so far.
+  size_t size() const { return counts_.size(); }
+
+  // Writes entries played at least @min_weight times. Returns the number of
+  // entries written.
+  size_t Save(const std::string& filename, uint32_t min_weight) const;
+
+ private:
+  std::map<std::pair<uint64_t, uint16_t>, uint32_t> counts_;
+};
+
+}  // namespace lczero
@@ -0,0 +1,92 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "book/book.h"
+
+#include <gtest/gtest.h>
+
+#include "utils/exception.h"
+
+namespace lczero {
+
+TEST(OpeningBook, BuildAndProbe) {
+  const ChessBoard startpos(ChessBoard::kStartposFen);
+  OpeningBookBuilder builder;
+  builder.AddGame(startpos, {Move("h2e2"), Move("h9g7", true)}, 10);
+  builder.AddGame(startpos, {Move("h2e2"), Move("b9c7", true)}, 10);
+  builder.AddGame(startpos, {Move("b2e2"), Move("h9g7", true)}, 10);
+  // Only the first ply is used.
+  builder.AddGame(startpos, {Move("c3c4"), Move("c6c5", true)}, 1);
+  EXPECT_EQ(builder.size(), 6u);
+
+  const std::string filename = testing::TempDir() + "book_test.bin";
+  EXPECT_EQ(builder.Save(filename, 1), 6u);
+  const OpeningBook book(filename);
+  EXPECT_EQ(book.size(), 6u);
+
+  const auto moves = book.Probe(startpos);
+  ASSERT_EQ(moves.size(), 3u);
+  EXPECT_EQ(moves[0].first, Move("h2e2"));
+  EXPECT_EQ(moves[0].second, 2u);
+  EXPECT_EQ(book.Pick(startpos, 2), Move("h2e2"));
+  EXPECT_FALSE(book.Pick(startpos, 3));
+
+  ChessBoard board = startpos;
+  board.ApplyMove(Move("h2e2"));
+  board.Mirror();
+  EXPECT_EQ(book.Probe(board).size(), 2u);
+  board.ApplyMove(Move("h9g7", true));
+  board.Mirror();
+  EXPECT_TRUE(book.Probe(board).empty());
+}
+
+TEST(OpeningBook, MinWeight) {
+  const ChessBoard startpos(ChessBoard::kStartposFen);
+  OpeningBookBuilder builder;
+  builder.AddGame(startpos, {Move("h2e2")}, 10);
+  builder.AddGame(startpos, {Move("h2e2")}, 10);
+  builder.AddGame(startpos, {Move("b2e2")}, 10);
+  // Illegal moves end the game.
+  builder.AddGame(startpos, {Move("a0a5")}, 10);
+  const std::string filename = testing::TempDir() + "book_test_min.bin";
+  EXPECT_EQ(builder.Save(filename, 2), 1u);
+  const OpeningBook book(filename);
+  EXPECT_EQ(book.Pick(startpos, 1), Move("h2e2"));
+}
+
+TEST(OpeningBook, BadFile) {
+  EXPECT_THROW(OpeningBook(testing::TempDir() + "no_such_book.bin"),
+               Exception);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  lczero::InitializeMagicBitboards();
+  return RUN_ALL_TESTS();
+}
@@ -275,6 +275,12 @@ class Move {
   }
   // 0 .. 16384.
   uint16_t as_packed_int() const;
+  // Inverse of as_packed_int().
+  static Move FromPackedInt(uint16_t packed) {
+    Move move;
+    move.data_ = packed;
+    return move;
+  }
 
   // 0 .. 2061, to use in neural networks.
   // Transform is a bit field which describes a transform to be applied to the
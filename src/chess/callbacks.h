@@ -130,6 +130,14 @@ struct TournamentInfo {
   // Player1's [win/draw/lose] as [white/black].
   // e.g. results[2][1] is how many times player 1 lost as black.
   int results[3][2] = {{0, 0}, {0, 0}, {0, 0}};
+  // Number of game pairs (same opening, colors swapped) where player1 scored
+  // 0, 0.5, 1, 1.5 and 2 points.
+  int pentanomial[5] = {0, 0, 0, 0, 0};
+  // Sequential probability ratio test state, if enabled.
+  bool sprt = false;
+  float llr = 0.0f;
+  float llr_lower = 0.0f;
+  float llr_upper = 0.0f;
   int move_count_ = 0;
   uint64_t nodes_total_ = 0;
 
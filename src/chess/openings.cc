@@ -0,0 +1,299 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "chess/openings.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+#include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/logging.h"
+#include "utils/random.h"
+
+namespace lczero {
+namespace {
+
+std::string ReadFile(const std::string& filename) {
+  const gzFile file = gzopen(filename.c_str(), "r");
+  if (!file) {
+    throw Exception(errno == ENOENT ? "Opening book file not found."
+                                    : "Error opening opening book file.");
+  }
+  std::string text;
+  std::vector<char> buffer(1 << 20);
+  int read;
+  while ((read = gzread(file, buffer.data(), buffer.size())) > 0) {
+    text.append(buffer.data(), read);
+  }
+  gzclose(file);
+  if (read < 0) throw Exception("Error reading opening book file.");
+  return text;
+}
+
+bool IsEpd(const std::string& filename) {
+  std::string extension = filename.substr(filename.find_last_of('.') + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return extension == "epd";
+}
+
+// Returns the first line start at or after @pos. For PGN only the first line of
+// a tag section qualifies, as that is where PgnReader starts a new game.
+size_t NextSplitPoint(const std::string& text, size_t pos, bool epd) {
+  if (pos == 0) return 0;
+  size_t line = text.rfind('\n', pos - 1);
+  line = line == std::string::npos ? 0 : line + 1;
+  while (true) {
+    const size_t next = text.find('\n', line);
+    if (next == std::string::npos) return text.size();
+    const bool prev_is_tag = text[line] == '[';
+    line = next + 1;
+    if (line < pos || line >= text.size()) continue;
+    if (epd || (text[line] == '[' && !prev_is_tag)) return line;
+  }
+}
+
+std::vector<Opening> ParseEpd(const std::string& text) {
+  std::vector<Opening> openings;
+  std::istringstream stream(text);
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    std::istringstream iss(line);
+    std::string board, side = "w";
+    if (!(iss >> board) || board[0] == '#') continue;
+    iss >> side;
+    Opening opening;
+    opening.start_fen = board + " " + side + " - - 0 1";
+    // Throws on malformed positions.
+    ChessBoard(opening.start_fen);
+    openings.push_back(std::move(opening));
+  }
+  return openings;
+}
+
+}  // namespace
+
+std::vector<Opening> OpeningSuite::ParseFile(const std::string& filename,
+                                             int threads) {
+  const std::string text = ReadFile(filename);
+  const bool epd = IsEpd(filename);
+  // Small files are not worth the threads.
+  threads = std::max<int>(1, std::min<int>(threads, text.size() >> 16));
+
+  std::vector<size_t> splits;
+  for (int i = 0; i < threads; i++) {
+    const size_t split = NextSplitPoint(text, text.size() * i / threads, epd);
+    if (splits.empty() || split > splits.back()) splits.push_back(split);
+  }
+  splits.push_back(text.size());
+
+  std::vector<std::vector<Opening>> parts(splits.size() - 1);
+  std::vector<std::exception_ptr> errors(parts.size());
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < parts.size(); i++) {
+    workers.emplace_back([&, i]() {
+      try {
+        const std::string part =
+            text.substr(splits[i], splits[i + 1] - splits[i]);
+        if (epd) {
+          parts[i] = ParseEpd(part);
+        } else {
+          PgnReader reader;
+          reader.AddPgnText(part);
+          parts[i] = reader.ReleaseGames();
+        }
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  for (const auto& error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
+
+  std::vector<Opening> openings = std::move(parts[0]);
+  for (size_t i = 1; i < parts.size(); i++) {
+    openings.insert(openings.end(), std::make_move_iterator(parts[i].begin()),
+                    std::make_move_iterator(parts[i].end()));
+  }
+  return openings;
+}
+
+OpeningSuite::OpeningSuite(const std::string& filename,
+                           const std::string& cache_file, int threads) {
+  const uint64_t source_size = GetFileSize(filename);
+  const int64_t source_time = GetFileTime(filename);
+  if (!cache_file.empty() && MapCache(cache_file, source_size, source_time)) {
+    CERR << "Mapped " << count_ << " openings from " << cache_file;
+    return;
+  }
+  Pack(ParseFile(filename, threads), source_size, source_time);
+  CERR << "Loaded " << count_ << " openings from " << filename;
+  if (cache_file.empty()) return;
+
+  // Write to a temporary file first so that concurrently starting tournaments
+  // never map a partially written cache.
+  const std::string tmp_file =
+      cache_file + ".tmp" + std::to_string(Random::Get().GetInt(0, 999999));
+  {
+    std::ofstream out(tmp_file, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+    if (!out) {
+      CERR << "Unable to write openings cache " << cache_file;
+      return;
+    }
+  }
+  if (std::rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+    std::remove(tmp_file.c_str());
+    CERR << "Unable to write openings cache " << cache_file;
+  }
+}
+
+bool OpeningSuite::MapCache(const std::string& cache_file,
+                            uint64_t source_size, int64_t source_time) {
+  if (GetFileSize(cache_file) < kOpeningsCacheHeaderSize) return false;
+  auto file = std::make_unique<MappedFile>(cache_file);
+  uint32_t magic, version;
+  uint64_t cached_source[2];
+  std::memcpy(&magic, file->data(), 4);
+  std::memcpy(&version, file->data() + 4, 4);
+  std::memcpy(cached_source, file->data() + 32, 16);
+  if (magic != kOpeningsCacheMagic || version != kOpeningsCacheVersion) {
+    return false;
+  }
+  // Without the source file the cache is used as is.
+  if (source_size != 0 &&
+      (cached_source[0] != source_size ||
+       static_cast<int64_t>(cached_source[1]) != source_time)) {
+    return false;
+  }
+  try {
+    SetData(file->data(), file->size());
+  } catch (const Exception&) {
+    return false;
+  }
+  file_ = std::move(file);
+  return true;
+}
+
+void OpeningSuite::Pack(const std::vector<Opening>& openings,
+                        uint64_t source_size, int64_t source_time) {
+  uint64_t move_count = 0;
+  uint64_t fen_bytes = 0;
+  for (const auto& opening : openings) {
+    move_count += opening.moves.size();
+    if (opening.start_fen != ChessBoard::kStartposFen) {
+      fen_bytes += opening.start_fen.size();
+    }
+  }
+  if (move_count > UINT32_MAX || fen_bytes > UINT32_MAX) {
+    throw Exception("Too many openings.");
+  }
+  const uint64_t count = openings.size();
+  buffer_.assign(kOpeningsCacheHeaderSize + 2 * 4 * (count + 1) +
+                     2 * move_count + fen_bytes,
+                 0);
+  uint8_t* data = buffer_.data();
+  const uint64_t header[] = {count, move_count, fen_bytes, source_size,
+                             static_cast<uint64_t>(source_time)};
+  std::memcpy(data, &kOpeningsCacheMagic, 4);
+  std::memcpy(data + 4, &kOpeningsCacheVersion, 4);
+  std::memcpy(data + 8, header, sizeof(header));
+
+  uint32_t* move_offsets =
+      reinterpret_cast<uint32_t*>(data + kOpeningsCacheHeaderSize);
+  uint32_t* fen_offsets = move_offsets + count + 1;
+  uint16_t* moves = reinterpret_cast<uint16_t*>(fen_offsets + count + 1);
+  char* fens = reinterpret_cast<char*>(moves + move_count);
+  uint32_t move_offset = 0;
+  uint32_t fen_offset = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    move_offsets[i] = move_offset;
+    fen_offsets[i] = fen_offset;
+    for (const Move move : openings[i].moves) {
+      moves[move_offset++] = move.as_packed_int();
+    }
+    const auto& fen = openings[i].start_fen;
+    if (fen != ChessBoard::kStartposFen) {
+      std::memcpy(fens + fen_offset, fen.data(), fen.size());
+      fen_offset += fen.size();
+    }
+  }
+  move_offsets[count] = move_offset;
+  fen_offsets[count] = fen_offset;
+  SetData(buffer_.data(), buffer_.size());
+}
+
+void OpeningSuite::SetData(const uint8_t* data, uint64_t size) {
+  uint64_t header[3];
+  std::memcpy(header, data + 8, sizeof(header));
+  const uint64_t count = header[0];
+  if (size != kOpeningsCacheHeaderSize + 2 * 4 * (count + 1) + 2 * header[1] +
+                  header[2]) {
+    throw Exception("Openings cache size mismatch.");
+  }
+  count_ = count;
+  move_offsets_ =
+      reinterpret_cast<const uint32_t*>(data + kOpeningsCacheHeaderSize);
+  fen_offsets_ = move_offsets_ + count + 1;
+  moves_ = reinterpret_cast<const uint16_t*>(fen_offsets_ + count + 1);
+  fens_ = reinterpret_cast<const char*>(moves_ + header[1]);
+}
+
+Opening OpeningSuite::Get(size_t idx) const {
+  if (!order_.empty()) idx = order_[idx];
+  Opening opening;
+  if (fen_offsets_[idx] != fen_offsets_[idx + 1]) {
+    opening.start_fen.assign(fens_ + fen_offsets_[idx],
+                             fen_offsets_[idx + 1] - fen_offsets_[idx]);
+  }
+  opening.moves.reserve(move_offsets_[idx + 1] - move_offsets_[idx]);
+  for (uint32_t i = move_offsets_[idx]; i < move_offsets_[idx + 1]; i++) {
+    opening.moves.push_back(Move::FromPackedInt(moves_[i]));
+  }
+  return opening;
+}
+
+void OpeningSuite::Shuffle() {
+  order_.resize(count_);
+  std::iota(order_.begin(), order_.end(), 0);
+  Random::Get().Shuffle(order_.begin(), order_.end());
+}
+
+}  // namespace lczero
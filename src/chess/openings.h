@@ -0,0 +1,94 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chess/pgn.h"
+#include "utils/mappedfile.h"
+
+namespace lczero {
+
+// Openings cache layout: a 48 byte header (magic, version, number of openings,
+// number of moves, size of the FEN data, size and modification time of the
+// source file), then for every opening plus one an offset into the moves and
+// an offset into the FEN data, then the moves as Move::as_packed_int() and the
+// FEN strings. An empty FEN stands for the starting position.
+constexpr uint32_t kOpeningsCacheMagic = 0x504f5850;  // "PXOP"
+constexpr uint32_t kOpeningsCacheVersion = 1;
+constexpr size_t kOpeningsCacheHeaderSize = 48;
+
+// Read-only set of openings stored in the packed cache layout, either parsed
+// in memory or memory-mapped from a cache file.
+class OpeningSuite {
+ public:
+  // Loads a PGN file, or an EPD file (one position per line) if @filename
+  // ends with ".epd". The file is split into @threads parts which are parsed
+  // in parallel. If @cache_file is not empty and holds the openings of the
+  // current version of @filename, it is memory-mapped instead of parsing;
+  // otherwise the parsed openings are written to it.
+  OpeningSuite(const std::string& filename, const std::string& cache_file,
+               int threads);
+
+  size_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+
+  // Returns the opening at @idx (after shuffling, if shuffled). Moves are in
+  // the same format as PgnReader returns.
+  Opening Get(size_t idx) const;
+
+  // Randomly permutes the order of the openings.
+  void Shuffle();
+
+  // Parses the openings of a PGN or EPD file using @threads threads.
+  static std::vector<Opening> ParseFile(const std::string& filename,
+                                        int threads);
+
+ private:
+  // Maps @cache_file if it's a valid cache of a source file with the given
+  // size and modification time.
+  bool MapCache(const std::string& cache_file, uint64_t source_size,
+                int64_t source_time);
+  void Pack(const std::vector<Opening>& openings, uint64_t source_size,
+            int64_t source_time);
+  void SetData(const uint8_t* data, uint64_t size);
+
+  std::unique_ptr<MappedFile> file_;
+  std::vector<uint8_t> buffer_;
+  std::vector<uint32_t> order_;
+  uint64_t count_ = 0;
+  const uint32_t* move_offsets_ = nullptr;
+  const uint32_t* fen_offsets_ = nullptr;
+  const uint16_t* moves_ = nullptr;
+  const char* fens_ = nullptr;
+};
+
+}  // namespace lczero
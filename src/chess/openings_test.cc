@@ -0,0 +1,123 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "chess/openings.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+namespace lczero {
+namespace {
+
+void ExpectSameOpenings(const std::vector<Opening>& expected,
+                        const OpeningSuite& suite) {
+  ASSERT_EQ(expected.size(), suite.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    const Opening opening = suite.Get(i);
+    EXPECT_EQ(opening.start_fen, expected[i].start_fen);
+    EXPECT_EQ(opening.moves, expected[i].moves);
+  }
+}
+
+// Writes a PGN large enough to be split between several threads.
+std::string WritePgn() {
+  const std::string filename = testing::TempDir() + "openings_test.pgn";
+  std::ofstream out(filename);
+  const char* kLines[] = {"1. h2e2 h9g7 2. h0g2 i9h9", "1. c3c4 {comment} b9c7",
+                          "1. b2e2 h7e7\n2. b0c2 b9c7 *"};
+  for (int i = 0; i < 6000; i++) {
+    out << "[Event \"" << i << "\"]\n";
+    if (i % 7 == 0) {
+      out << "[FEN \"rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/"
+             "RNBAKABNR w - - 0 1\"]\n";
+    }
+    out << "\n" << kLines[i % 3] << "\n\n";
+  }
+  return filename;
+}
+
+}  // namespace
+
+TEST(OpeningSuite, ParallelParseMatchesPgnReader) {
+  const std::string filename = WritePgn();
+  PgnReader reader;
+  reader.AddPgnFile(filename);
+  const auto expected = reader.ReleaseGames();
+  ASSERT_EQ(expected.size(), 6000u);
+  EXPECT_EQ(expected[2].moves.size(), 4u);
+
+  const auto parsed = OpeningSuite::ParseFile(filename, 8);
+  ASSERT_EQ(parsed.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(parsed[i].moves, expected[i].moves);
+  }
+  ExpectSameOpenings(expected, OpeningSuite(filename, "", 8));
+}
+
+TEST(OpeningSuite, Cache) {
+  const std::string filename = WritePgn();
+  const std::string cache = testing::TempDir() + "openings_test.bin";
+  std::remove(cache.c_str());
+  PgnReader reader;
+  reader.AddPgnFile(filename);
+  const auto expected = reader.ReleaseGames();
+  // The first load writes the cache, the second one maps it.
+  ExpectSameOpenings(expected, OpeningSuite(filename, cache, 4));
+  ExpectSameOpenings(expected, OpeningSuite(filename, cache, 4));
+
+  OpeningSuite shuffled(filename, cache, 4);
+  shuffled.Shuffle();
+  EXPECT_EQ(shuffled.size(), expected.size());
+}
+
+TEST(OpeningSuite, Epd) {
+  const std::string filename = testing::TempDir() + "openings_test.epd";
+  {
+    std::ofstream out(filename);
+    out << "# comment\n"
+        << "rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR w\n"
+        << "\n"
+        << "rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C2C4/9/RNBAKABNR b - - "
+           "id \"center cannon\";\r\n";
+  }
+  const OpeningSuite suite(filename, "", 2);
+  ASSERT_EQ(suite.size(), 2u);
+  EXPECT_EQ(suite.Get(0).start_fen, ChessBoard::kStartposFen);
+  EXPECT_EQ(suite.Get(1).start_fen,
+            "rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C2C4/9/RNBAKABNR b - "
+            "- 0 1");
+  EXPECT_TRUE(suite.Get(1).moves.empty());
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  lczero::InitializeMagicBitboards();
+  return RUN_ALL_TESTS();
+}
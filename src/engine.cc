@@ -33,15 +33,30 @@
 
 #include "mcts/search.h"
 #include "mcts/stoppers/factory.h"
+#include "mcts/stoppers/stoppers.h"
 #include "utils/commandline.h"
 #include "utils/configfile.h"
 #include "utils/logging.h"
+#include "utils/numa.h"
 
 namespace lczero {
 namespace {
 const OptionId kThreadsOptionId{
     "threads", "Threads",
     "Number of (CPU) worker threads to use, 0 for the backend default.", 't'};
+const OptionId kGcThreadsId{
+    "gc-threads", "GCThreads",
+    "Number of threads freeing the nodes of discarded search trees."};
+const OptionId kSearchTreesId{
+    "search-trees", "SearchTrees",
+    "Experimental. Number of independent search trees, 0 for one per NUMA "
+    "node. The trees share out the threads and the NN cache, and their root "
+    "move statistics are merged to choose the move. With at most one tree per "
+    "NUMA node, each tree runs on its own node. The speed and strength gains "
+    "have not been measured on NUMA hardware yet."};
+const OptionId kSearchTreeBackendsId{
+    "search-tree-backends", "SearchTreeBackends",
+    "Give every search tree its own backend instance instead of sharing one."};
 const OptionId kLogFileId{"logfile", "LogFile",
                           "Write log to that file. Special value <stderr> to "
                           "output the log to the console.",
@@ -65,6 +80,22 @@ const OptionId kValueOnly{
     "the worst for the opponent."};
 const OptionId kClearTree{"", "ClearTree",
                           "Clear the tree before the next search."};
+const OptionId kBitbasePathId{
+    "bitbase-paths", "BitbasePath",
+    "List of Xiangqi endgame bitbase directories, list entries separated by "
+    "system separator (\";\" for Windows, \":\" for Linux).",
+    's'};
+const OptionId kWarmupId{
+    "warmup", "Warmup",
+    "When the engine is asked whether it is ready, run dummy backend "
+    "computations at every power of two batch size up to the minibatch size, "
+    "so that the first move doesn't pay for lazy backend initialization."};
+const OptionId kWarmupNodesId{
+    "warmup-nodes", "WarmupNodes",
+    "Number of playouts of the starting position to search during warm-up, "
+    "filling the NN cache before the first move. The node pools of every "
+    "search tree are also pre-allocated for this many nodes. 0 to only warm "
+    "up the backends."};
 
 MoveList StringsToMovelist(const std::vector<std::string>& moves,
                            const ChessBoard& board) {
@@ -96,6 +127,13 @@ void EngineController::PopulateOptions(OptionsParser* options) {
       CommandLine::BinaryName().find("simple") != std::string::npos;
   NetworkFactory::PopulateOptions(options);
   options->Add<IntOption>(kThreadsOptionId, 0, 128) = 0;
+  options->Add<IntOption>(kGcThreadsId, 1, 16) = 1;
+  options->Add<IntOption>(kSearchTreesId, 0, 64) = 1;
+  options->Add<BoolOption>(kSearchTreeBackendsId) = false;
+  options->Add<StringOption>(kBitbasePathId);
+  options->Add<StringOption>(kBookFileId);
+  options->Add<IntOption>(kBookMaxPlyId, 0, 1000) = 40;
+  options->Add<IntOption>(kBookMinWeightId, 1, 1000000) = 1;
   options->Add<IntOption>(kNNCacheSizeId, 0, 999999999) = 2000000;
   SearchParams::Populate(options);
 
@@ -120,6 +158,8 @@ void EngineController::PopulateOptions(OptionsParser* options) {
   options->HideOption(kStrictUciTiming);
 
   options->Add<BoolOption>(kPreload) = false;
+  options->Add<BoolOption>(kWarmupId) = false;
+  options->Add<IntOption>(kWarmupNodesId, 0, 1000000) = 0;
   options->Add<BoolOption>(kValueOnly) = false;
   options->Add<ButtonOption>(kClearTree);
   options->HideOption(kClearTree);
@@ -132,23 +172,176 @@ void EngineController::ResetMoveTimer() {
 // Updates values from Uci options.
 void EngineController::UpdateFromUciOptions() {
   SharedLock lock(busy_mutex_);
+  UpdateFromUciOptionsLocked();
+}
+
+void EngineController::UpdateFromUciOptionsLocked() {
+  // Bitbases.
+  std::string tb_paths = options_.Get<std::string>(kBitbasePathId);
+  if (!tb_paths.empty() && tb_paths != tb_paths_) {
+    bitbase_ = std::make_unique<Bitbase>();
+    CERR << "Loading bitbases from " << tb_paths;
+    if (!bitbase_->Init(tb_paths)) {
+      CERR << "Failed to load bitbases!";
+      bitbase_ = nullptr;
+    }
+    tb_paths_ = tb_paths;
+  } else if (tb_paths.empty()) {
+    bitbase_ = nullptr;
+    tb_paths_.clear();
+  }
+
+  // Opening book.
+  std::string book_file = options_.Get<std::string>(kBookFileId);
+  if (!book_file.empty() && book_file != book_file_) {
+    book_ = std::make_unique<OpeningBook>(book_file);
+    CERR << "Loaded opening book " << book_file << " with " << book_->size()
+         << " entries.";
+    book_file_ = book_file;
+  } else if (book_file.empty()) {
+    book_ = nullptr;
+    book_file_.clear();
+  }
 
   // Network.
   const auto network_configuration =
       NetworkFactory::BackendConfiguration(options_);
-  if (network_configuration_ != network_configuration) {
+  const bool network_changed = network_configuration_ != network_configuration;
+  if (network_changed) {
     network_ = NetworkFactory::LoadNetwork(options_);
     network_configuration_ = network_configuration;
+    backend_warmed_up_ = false;
+    cache_warmed_up_ = false;
   }
 
-  // Cache size.
-  cache_.SetCapacity(options_.Get<int>(kNNCacheSizeId));
+  // Root-parallel search trees.
+  int trees = options_.Get<int>(kSearchTreesId);
+  if (trees == 0) trees = Numa::GetNodeCount();
+  const bool shard_backends = options_.Get<bool>(kSearchTreeBackendsId);
+  if (network_changed || shard_backends != tree_shard_backends_) {
+    tree_shards_.clear();
+  }
+  tree_shard_backends_ = shard_backends;
+  tree_shards_.resize(trees - 1);
+  for (size_t i = 0; i < tree_shards_.size(); i++) {
+    auto& shard = tree_shards_[i];
+    if (shard) continue;
+    shard = std::make_unique<SearchTreeShard>();
+    shard->tree = std::make_unique<NodeTree>(
+        RootParallelSearch::GetTreeNumaNode(i + 1, trees));
+    if (shard_backends) shard->network = NetworkFactory::LoadNetwork(options_);
+    backend_warmed_up_ = false;
+    cache_warmed_up_ = false;
+  }
+
+  // Cache size, split between the trees.
+  const int cache_size = options_.Get<int>(kNNCacheSizeId) / trees;
+  cache_.SetCapacity(cache_size);
+  for (auto& shard : tree_shards_) shard->cache.SetCapacity(cache_size);
+
+  SetNodeGcThreads(options_.Get<int>(kGcThreadsId));
 
   // Check whether we can update the move timer in "Go".
   strict_uci_timing_ = options_.Get<bool>(kStrictUciTiming);
 }
 
+void EngineController::Warmup() {
+  SharedLock lock(busy_mutex_);
+  // Never compete with a search that is still running (e.g. "isready" sent
+  // while pondering).
+  if (search_ && search_->IsSearchActive()) return;
+  if (parallel_search_ && parallel_search_->IsSearchActive()) return;
+  UpdateFromUciOptionsLocked();
+  const int warmup_nodes = options_.Get<int>(kWarmupNodesId);
+  if (backend_warmed_up_ && (cache_warmed_up_ || warmup_nodes == 0)) return;
+
+  const auto start = std::chrono::steady_clock::now();
+  auto elapsed_ms = [](std::chrono::steady_clock::time_point from) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - from)
+        .count();
+  };
+  std::string report = "Warm-up:";
+
+  if (!backend_warmed_up_) {
+    int max_batch = options_.Get<int>(SearchParams::kMiniBatchSizeId);
+    if (max_batch == 0) max_batch = network_->GetMiniBatchSize();
+    PositionHistory history;
+    history.Reset(ChessBoard::kStartposBoard, 0, 1);
+    const auto planes =
+        EncodePositionForNN(network_->GetCapabilities().input_format, history,
+                            8, FillEmptyHistory::FEN_ONLY, nullptr);
+
+    // The lead backend and the own backends of the other search trees.
+    std::vector<Network*> networks{network_.get()};
+    for (auto& shard : tree_shards_) {
+      if (shard->network) networks.push_back(shard->network.get());
+    }
+    // The very first computation carries the lazy initialization cost of the
+    // backend, which is what the first move would otherwise pay for.
+    int64_t first_ms = 0;
+    int64_t warm_ms = 0;
+    for (Network* network : networks) {
+      for (int batch = 1;; batch = std::min(batch * 2, max_batch)) {
+        const auto batch_start = std::chrono::steady_clock::now();
+        auto comp = network->NewComputation();
+        for (int i = 0; i < batch; i++) comp->AddInput(InputPlanes(planes));
+        comp->ComputeBlocking();
+        if (batch == 1) first_ms = std::max(first_ms, elapsed_ms(batch_start));
+        if (batch >= max_batch) break;
+      }
+      const auto warm_start = std::chrono::steady_clock::now();
+      auto comp = network->NewComputation();
+      comp->AddInput(InputPlanes(planes));
+      comp->ComputeBlocking();
+      warm_ms = std::max(warm_ms, elapsed_ms(warm_start));
+    }
+    report += " first batch " + std::to_string(first_ms) + "ms (" +
+              std::to_string(warm_ms) + "ms warm), batch sizes up to " +
+              std::to_string(max_batch) + " on " +
+              std::to_string(networks.size()) + " backend(s) in " +
+              std::to_string(elapsed_ms(start)) + "ms.";
+    backend_warmed_up_ = true;
+  }
+
+  if (!cache_warmed_up_ && warmup_nodes > 0) {
+    // Page in the node and edge pools of the trees the next search will use.
+    const auto reserve_start = std::chrono::steady_clock::now();
+    if (!tree_) {
+      tree_ = std::make_unique<NodeTree>(
+          RootParallelSearch::GetTreeNumaNode(0, tree_shards_.size() + 1));
+    }
+    tree_->ReservePools(warmup_nodes);
+    for (auto& shard : tree_shards_) shard->tree->ReservePools(warmup_nodes);
+    report += " Reserved " + std::to_string(warmup_nodes) + " nodes in " +
+              std::to_string(tree_shards_.size() + 1) + " tree(s) in " +
+              std::to_string(elapsed_ms(reserve_start)) + "ms.";
+
+    const auto search_start = std::chrono::steady_clock::now();
+    NodeTree tree;
+    tree.ResetToPosition(ChessBoard::kStartposFen, {});
+    auto responder = std::make_unique<CallbackUciResponder>(
+        [](const BestMoveInfo&) {}, [](const std::vector<ThinkingInfo>&) {});
+    Search search(tree, network_.get(), std::move(responder), {},
+                  search_start,
+                  std::make_unique<VisitsStopper>(warmup_nodes, false),
+                  false, false, options_, &cache_, bitbase_.get());
+    search.RunBlocking(options_.Get<int>(kThreadsOptionId));
+    report += " Pre-searched " + std::to_string(warmup_nodes) +
+              " playouts of the starting position in " +
+              std::to_string(elapsed_ms(search_start)) + "ms.";
+    cache_warmed_up_ = true;
+  }
+
+  LOGFILE << report;
+  ThinkingInfo info;
+  info.comment = report;
+  std::vector<ThinkingInfo> infos{info};
+  uci_responder_->OutputThinkingInfo(&infos);
+}
+
 void EngineController::EnsureReady() {
+  if (options_.Get<bool>(kWarmupId)) Warmup();
   std::unique_lock<RpSharedMutex> lock(busy_mutex_);
   // If a UCI host is waiting for our ready response, we can consider the move
   // not started until we're done ensuring ready.
@@ -161,8 +354,16 @@ void EngineController::NewGame() {
   ResetMoveTimer();
   SharedLock lock(busy_mutex_);
   cache_.Clear();
+  cache_warmed_up_ = false;
+  parallel_search_.reset();
   search_.reset();
   tree_.reset();
+  const int trees = tree_shards_.size() + 1;
+  for (size_t i = 0; i < tree_shards_.size(); i++) {
+    tree_shards_[i]->cache.Clear();
+    tree_shards_[i]->tree = std::make_unique<NodeTree>(
+        RootParallelSearch::GetTreeNumaNode(i + 1, trees));
+  }
   CreateFreshTimeManager();
   current_position_ = {ChessBoard::kStartposFen, {}};
   UpdateFromUciOptions();
@@ -175,6 +376,7 @@ void EngineController::SetPosition(const std::string& fen,
   ResetMoveTimer();
   SharedLock lock(busy_mutex_);
   current_position_ = CurrentPosition{fen, moves_str};
+  parallel_search_.reset();
   search_.reset();
 }
 
@@ -196,16 +398,26 @@ Position EngineController::ApplyPositionMoves() {
 void EngineController::SetupPosition(
     const std::string& fen, const std::vector<std::string>& moves_str) {
   SharedLock lock(busy_mutex_);
+  parallel_search_.reset();
   search_.reset();
 
   UpdateFromUciOptions();
 
-  if (!tree_) tree_ = std::make_unique<NodeTree>();
+  if (!tree_) {
+    // The lead tree of a root-parallel search runs on the first NUMA node.
+    tree_ = std::make_unique<NodeTree>(
+        RootParallelSearch::GetTreeNumaNode(0, tree_shards_.size() + 1));
+  }
 
   std::vector<Move> moves;
   for (const auto& move : moves_str) moves.emplace_back(move);
   const bool is_same_game = tree_->ResetToPosition(fen, moves);
+  for (auto& shard : tree_shards_) shard->tree->ResetToPosition(fen, moves);
   if (!is_same_game) CreateFreshTimeManager();
+  const auto gc_stats = GetNodeGcStats();
+  LOGFILE << "Node GC queue: " << gc_stats.queued_subtrees << " subtrees, ~"
+          << gc_stats.queued_nodes << " nodes (" << gc_stats.freed_nodes
+          << " nodes freed so far).";
 }
 
 void EngineController::CreateFreshTimeManager() {
@@ -349,6 +561,22 @@ void EngineController::Go(const GoParams& params) {
     // Strip movesleft information from the response.
     responder = std::make_unique<MovesLeftResponseFilter>(std::move(responder));
   }
+  if (book_ && !params.infinite && !params.ponder &&
+      params.searchmoves.empty() &&
+      tree_->HeadPosition().GetGamePly() < options_.Get<int>(kBookMaxPlyId)) {
+    Move move = book_->Pick(tree_->HeadPosition().GetBoard(),
+                            options_.Get<int>(kBookMinWeightId));
+    if (move) {
+      if (tree_->IsBlackToMove()) move.Mirror();
+      std::vector<ThinkingInfo> infos(1);
+      infos[0].comment = "book move";
+      responder->OutputThinkingInfo(&infos);
+      BestMoveInfo info(move);
+      responder->OutputBestMove(&info);
+      return;
+    }
+  }
+
   if (options_.Get<bool>(kValueOnly)) {
     ValueOnlyGo(tree_.get(), network_.get(), options_, std::move(responder));
     return;
@@ -356,14 +584,34 @@ void EngineController::Go(const GoParams& params) {
 
   if (options_.Get<Button>(kClearTree).TestAndReset()) {
     tree_->TrimTreeAtHead();
+    for (auto& shard : tree_shards_) shard->tree->TrimTreeAtHead();
+  }
+
+  const auto searchmoves =
+      StringsToMovelist(params.searchmoves, tree_->HeadPosition().GetBoard());
+  if (!tree_shards_.empty()) {
+    const int trees = tree_shards_.size() + 1;
+    // The stoppers of the lead tree see the nodes of all trees.
+    auto stopper = time_manager_->GetStopper(params, *tree_.get());
+    std::vector<SearchTreeShard*> shards;
+    for (auto& shard : tree_shards_) shards.push_back(shard.get());
+    parallel_search_ = std::make_unique<RootParallelSearch>(
+        *tree_, network_.get(), &cache_, shards, std::move(responder),
+        searchmoves, *move_start_time_, std::move(stopper), params.infinite,
+        params.ponder, options_, bitbase_.get());
+    LOGFILE << "Timer started at "
+            << FormatTime(SteadyClockToSystemClock(*move_start_time_))
+            << ", searching " << trees << " trees.";
+    const int threads = options_.Get<int>(kThreadsOptionId);
+    parallel_search_->StartThreads(threads ? std::max(threads / trees, 1) : 0);
+    return;
   }
 
   auto stopper = time_manager_->GetStopper(params, *tree_.get());
   search_ = std::make_unique<Search>(
-      *tree_, network_.get(), std::move(responder),
-      StringsToMovelist(params.searchmoves, tree_->HeadPosition().GetBoard()),
+      *tree_, network_.get(), std::move(responder), searchmoves,
       *move_start_time_, std::move(stopper), params.infinite, params.ponder,
-      options_, &cache_);
+      options_, &cache_, bitbase_.get());
 
   LOGFILE << "Timer started at "
           << FormatTime(SteadyClockToSystemClock(*move_start_time_));
@@ -378,6 +626,7 @@ void EngineController::PonderHit() {
 
 void EngineController::Stop() {
   if (search_) search_->Stop();
+  if (parallel_search_) parallel_search_->Stop();
 }
 
 EngineLoop::EngineLoop()
@@ -29,7 +29,9 @@
 
 #include <optional>
 
+#include "book/book.h"
 #include "chess/uciloop.h"
+#include "mcts/root_parallel.h"
 #include "mcts/search.h"
 #include "neural/cache.h"
 #include "neural/factory.h"
@@ -52,6 +54,7 @@ class EngineController {
   ~EngineController() {
     // Make sure search is destructed first, and it still may be running in
     // a separate thread.
+    parallel_search_.reset();
     search_.reset();
   }
 
@@ -77,6 +80,11 @@ class EngineController {
 
  private:
   void UpdateFromUciOptions();
+  // Same as above, for callers already holding busy_mutex_.
+  void UpdateFromUciOptionsLocked();
+  // Runs dummy backend computations and optionally pre-searches the starting
+  // position, so that the first move starts with a warm backend and cache.
+  void Warmup();
 
   void SetupPosition(const std::string& fen,
                      const std::vector<std::string>& moves);
@@ -93,13 +101,20 @@ class EngineController {
 
   std::unique_ptr<TimeManager> time_manager_;
   std::unique_ptr<Search> search_;
+  std::unique_ptr<RootParallelSearch> parallel_search_;
   std::unique_ptr<NodeTree> tree_;
+  // Trees of a root-parallel search other than tree_, empty for a single tree.
+  std::vector<std::unique_ptr<SearchTreeShard>> tree_shards_;
+  bool tree_shard_backends_ = false;
   std::unique_ptr<Network> network_;
+  std::unique_ptr<Bitbase> bitbase_;
+  std::unique_ptr<OpeningBook> book_;
   NNCache cache_;
 
-  // Store current TB and network settings to track when they change so that
-  // they are reloaded.
+  // Store current bitbase, book and network settings to track when they change
+  // so that they are reloaded.
   std::string tb_paths_;
+  std::string book_file_;
   NetworkFactory::BackendConfiguration network_configuration_;
 
   // The current position as given with SetPosition. For normal (ie. non-ponder)
@@ -112,6 +127,12 @@ class EngineController {
 
   // If true we can reset move_start_time_ in "Go".
   bool strict_uci_timing_;
+
+  // Whether the current backends have already run their warm-up
+  // computations, and whether the cache was prefilled and the node pools
+  // reserved since the last new game.
+  bool backend_warmed_up_ = false;
+  bool cache_warmed_up_ = false;
 };
 
 class EngineLoop : public UciLoop {
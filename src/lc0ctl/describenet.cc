@@ -27,7 +27,15 @@
 
 #include "lc0ctl/describenet.h"
 
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+
 #include "neural/loader.h"
+#include "neural/network.h"
+#include "neural/network_legacy.h"
 #include "neural/onnx/onnx.pb.h"
 #include "utils/optionsparser.h"
 
@@ -36,9 +44,28 @@ namespace {
 
 const OptionId kWeightsFilenameId{"weights", "WeightsFile",
                                   "Path of the input Lc0 weights file.", 'w'};
+const OptionId kGflopsId{
+    "gflops", "Gflops",
+    "Sustained GFLOP/s of the target machine, used to estimate positions per "
+    "second. 0 to skip the estimate."};
+const OptionId kBandwidthId{
+    "bandwidth", "Bandwidth",
+    "Sustained memory bandwidth of the target machine in GB/s, used to "
+    "estimate positions per second. 0 to skip the estimate."};
+const OptionId kBatchSizeId{
+    "batch-size", "BatchSize",
+    "Batch size for which weight traffic and arithmetic intensity are "
+    "estimated."};
+const OptionId kShowLayersId{"show-layers", "ShowLayers",
+                             "Print the cost of every layer, not only the "
+                             "totals per layer type."};
 
 bool ProcessParameters(OptionsParser* options) {
   options->Add<StringOption>(kWeightsFilenameId);
+  options->Add<FloatOption>(kGflopsId, 0.0f, 1e6f) = 0.0f;
+  options->Add<FloatOption>(kBandwidthId, 0.0f, 1e6f) = 0.0f;
+  options->Add<IntOption>(kBatchSizeId, 1, 4096) = 256;
+  options->Add<BoolOption>(kShowLayersId) = false;
   if (!options->ProcessAllFlags()) return false;
   const OptionsDict& dict = options->GetOptionsDict();
   dict.EnsureExists<std::string>(kWeightsFilenameId);
@@ -54,6 +81,236 @@ std::string Justify(std::string str, size_t length = 30) {
   return str;
 }
 
+constexpr size_t kSquares = 90;
+
+// Cost of one layer (or a group of layers computed together), per position.
+struct LayerCost {
+  std::string type;
+  std::string name;
+  // Number of weights, including biases and normalization parameters.
+  size_t params = 0;
+  // Multiply-accumulates per position.
+  double macs = 0;
+  // Floats written per position (read once more by the next layer).
+  size_t activations = 0;
+};
+
+template <typename... Vecs>
+size_t CountParams(const Vecs&... vecs) {
+  return (vecs.size() + ...);
+}
+
+size_t CountParams(const BaseWeights::ConvBlock& conv) {
+  return CountParams(conv.weights, conv.biases, conv.bn_gammas, conv.bn_betas,
+                     conv.bn_means, conv.bn_stddivs);
+}
+
+size_t CountParams(const BaseWeights::FFN& ffn) {
+  return CountParams(ffn.dense1_w, ffn.dense1_b, ffn.dense2_w, ffn.dense2_b);
+}
+
+// Dense layer applied to every square.
+LayerCost SquareDense(const std::string& type, const std::string& name,
+                      const BaseWeights::Vec& w, const BaseWeights::Vec& b) {
+  return {type, name, CountParams(w, b), double(kSquares) * w.size(),
+          kSquares * b.size()};
+}
+
+// Dense layer applied once per position.
+LayerCost Dense(const std::string& type, const std::string& name,
+                const BaseWeights::Vec& w, const BaseWeights::Vec& b) {
+  return {type, name, CountParams(w, b), double(w.size()), b.size()};
+}
+
+// Convolution, 1x1 or 3x3 depending on weights shape.
+LayerCost Conv(const std::string& type, const std::string& name,
+               const BaseWeights::ConvBlock& conv) {
+  return {type, name, CountParams(conv), double(kSquares) * conv.weights.size(),
+          kSquares * conv.biases.size()};
+}
+
+void AddEncoderCost(const std::string& name,
+                    const BaseWeights::EncoderLayer& layer, int heads,
+                    const BaseWeights::Vec& smolgen_w,
+                    std::vector<LayerCost>* costs) {
+  const auto& mha = layer.mha;
+  const size_t d_model = mha.q_b.size();
+  const size_t embedding = mha.dense_b.size();
+  costs->push_back({"MHA QKV", name + " QKV",
+                    CountParams(mha.q_w, mha.q_b, mha.k_w, mha.k_b, mha.v_w,
+                                mha.v_b),
+                    double(kSquares) *
+                        (mha.q_w.size() + mha.k_w.size() + mha.v_w.size()),
+                    kSquares * 3 * d_model});
+  // Q*K^T and softmax(QK)*V.
+  costs->push_back({"MHA attention", name + " attention", 0,
+                    2.0 * kSquares * kSquares * d_model,
+                    kSquares * kSquares * heads + kSquares * d_model});
+  if (mha.has_smolgen) {
+    const auto& sg = mha.smolgen;
+    costs->push_back(
+        {"Smolgen", name + " smolgen",
+         CountParams(sg.compress, sg.dense1_w, sg.dense1_b, sg.ln1_gammas,
+                     sg.ln1_betas, sg.dense2_w, sg.dense2_b, sg.ln2_gammas,
+                     sg.ln2_betas),
+         double(kSquares) * sg.compress.size() + sg.dense1_w.size() +
+             sg.dense2_w.size() + double(heads) * smolgen_w.size(),
+         kSquares * kSquares * heads});
+  }
+  costs->push_back({"MHA output", name + " output",
+                    CountParams(mha.dense_w, mha.dense_b, layer.ln1_gammas,
+                                layer.ln1_betas),
+                    double(kSquares) * mha.dense_w.size(),
+                    kSquares * embedding});
+  costs->push_back({"FFN", name + " FFN",
+                    CountParams(layer.ffn) +
+                        CountParams(layer.ln2_gammas, layer.ln2_betas),
+                    double(kSquares) * (layer.ffn.dense1_w.size() +
+                                        layer.ffn.dense2_w.size()),
+                    kSquares * (layer.ffn.dense1_b.size() +
+                                layer.ffn.dense2_b.size())});
+}
+
+// Builds per layer costs of the network as it is computed on a 90 square
+// board, with the default (vanilla policy, winner value) heads.
+std::vector<LayerCost> GetNetworkCost(const pblczero::Net& net) {
+  using pblczero::NetworkFormat;
+  const MultiHeadWeights w(net.weights());
+  const auto& format = net.format().network_format();
+  std::vector<LayerCost> costs;
+  const bool attn_body = !w.encoder.empty();
+
+  if (!w.residual.empty() || !attn_body) {
+    costs.push_back(Conv("Input conv", "input", w.input));
+    for (size_t i = 0; i < w.residual.size(); ++i) {
+      const auto& res = w.residual[i];
+      const std::string name = "residual " + std::to_string(i);
+      auto cost = Conv("Residual conv", name, res.conv1);
+      const auto conv2 = Conv("Residual conv", name, res.conv2);
+      cost.params += conv2.params;
+      cost.macs += conv2.macs;
+      cost.activations += conv2.activations;
+      costs.push_back(cost);
+      if (res.has_se) {
+        const auto& se = res.se;
+        costs.push_back({"SE", name + " SE",
+                         CountParams(se.w1, se.b1, se.w2, se.b2),
+                         double(se.w1.size() + se.w2.size()) +
+                             kSquares * res.conv2.biases.size(),
+                         se.b1.size() + se.b2.size()});
+      }
+    }
+  }
+
+  if (attn_body) {
+    if (!w.ip_emb_preproc_w.empty()) {
+      costs.push_back(Dense("Embedding", "embedding preprocess",
+                            w.ip_emb_preproc_w, w.ip_emb_preproc_b));
+    }
+    auto embedding = SquareDense("Embedding", "embedding", w.ip_emb_w,
+                                 w.ip_emb_b);
+    embedding.params += CountParams(w.ip_emb_ln_gammas, w.ip_emb_ln_betas,
+                                    w.ip_mult_gate, w.ip_add_gate);
+    costs.push_back(embedding);
+    if (!w.ip_emb_ffn.dense1_w.empty()) {
+      costs.push_back({"FFN", "embedding FFN",
+                       CountParams(w.ip_emb_ffn) +
+                           CountParams(w.ip_emb_ffn_ln_gammas,
+                                       w.ip_emb_ffn_ln_betas),
+                       double(kSquares) * (w.ip_emb_ffn.dense1_w.size() +
+                                           w.ip_emb_ffn.dense2_w.size()),
+                       kSquares * (w.ip_emb_ffn.dense1_b.size() +
+                                   w.ip_emb_ffn.dense2_b.size())});
+    }
+    for (size_t i = 0; i < w.encoder.size(); ++i) {
+      AddEncoderCost("encoder " + std::to_string(i), w.encoder[i],
+                     w.encoder_head_count, w.smolgen_w, &costs);
+    }
+    if (w.has_smolgen) {
+      // Global smolgen weights are shared, count them once.
+      costs.push_back({"Smolgen", "smolgen global", w.smolgen_w.size(), 0, 0});
+    }
+  }
+
+  // Policy head.
+  const auto& policy = w.policy_heads.at("vanilla");
+  if (format.policy() == NetworkFormat::POLICY_ATTENTION) {
+    costs.push_back(SquareDense("Policy head", "policy embedding",
+                                policy.ip_pol_w, policy.ip_pol_b));
+    for (size_t i = 0; i < policy.pol_encoder.size(); ++i) {
+      AddEncoderCost("policy encoder " + std::to_string(i),
+                     policy.pol_encoder[i], policy.pol_encoder_head_count, {},
+                     &costs);
+    }
+    auto qk = SquareDense("Policy head", "policy QK", policy.ip2_pol_w,
+                          policy.ip2_pol_b);
+    const auto k = SquareDense("Policy head", "policy QK", policy.ip3_pol_w,
+                               policy.ip3_pol_b);
+    qk.params += k.params + policy.ip4_pol_w.size();
+    qk.macs += k.macs + double(kSquares) * kSquares * policy.ip2_pol_b.size() +
+               policy.ip4_pol_w.size();
+    qk.activations += k.activations + kSquares * kSquares;
+    costs.push_back(qk);
+  } else if (format.policy() == NetworkFormat::POLICY_CONVOLUTION) {
+    costs.push_back(Conv("Policy head", "policy conv1", policy.policy1));
+    costs.push_back(Conv("Policy head", "policy conv2", policy.policy));
+  } else {
+    costs.push_back(Conv("Policy head", "policy conv", policy.policy));
+    costs.push_back(
+        Dense("Policy head", "policy dense", policy.ip_pol_w, policy.ip_pol_b));
+  }
+
+  // Value head.
+  const auto& value = w.value_heads.at("winner");
+  if (attn_body) {
+    costs.push_back(SquareDense("Value head", "value embedding",
+                                value.ip_val_w, value.ip_val_b));
+  } else {
+    costs.push_back(Conv("Value head", "value conv", value.value));
+  }
+  costs.push_back(
+      Dense("Value head", "value dense1", value.ip1_val_w, value.ip1_val_b));
+  costs.push_back(
+      Dense("Value head", "value dense2", value.ip2_val_w, value.ip2_val_b));
+
+  // Moves left head.
+  if (format.moves_left() != NetworkFormat::MOVES_LEFT_NONE) {
+    if (attn_body) {
+      costs.push_back(
+          SquareDense("MLH", "mlh embedding", w.ip_mov_w, w.ip_mov_b));
+    } else {
+      costs.push_back(Conv("MLH", "mlh conv", w.moves_left));
+    }
+    costs.push_back(Dense("MLH", "mlh dense1", w.ip1_mov_w, w.ip1_mov_b));
+    costs.push_back(Dense("MLH", "mlh dense2", w.ip2_mov_w, w.ip2_mov_b));
+  }
+  return costs;
+}
+
+std::string FormatCount(double value) {
+  const char* suffixes[] = {"", "K", "M", "G", "T"};
+  size_t idx = 0;
+  while (value >= 1000.0 && idx + 1 < std::size(suffixes)) {
+    value /= 1000.0;
+    ++idx;
+  }
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(idx == 0 ? 0 : 2) << value
+      << suffixes[idx];
+  return oss.str();
+}
+
+std::string CostLine(const std::string& name, const LayerCost& cost,
+                     double total_macs) {
+  std::ostringstream oss;
+  oss << std::left << std::setw(28) << name << std::right << std::setw(10)
+      << FormatCount(cost.params) << std::setw(10) << FormatCount(cost.macs)
+      << std::setw(8) << std::fixed << std::setprecision(1)
+      << (total_macs > 0 ? 100.0 * cost.macs / total_macs : 0.0) << "%"
+      << std::setw(10) << FormatCount(cost.activations);
+  return oss.str();
+}
+
 }  // namespace
 
 void ShowNetworkGenericInfo(const pblczero::Net& weights) {
@@ -157,7 +414,7 @@ void ShowNetworkWeightsBodyInfo(const pblczero::Net& weights) {
       COUT << Justify("SE blocks") << se_count;
     }
     COUT << Justify("Filters")
-         << w.input().weights().params().size() / 2 / 112 / 9;
+         << w.input().weights().params().size() / 2 / kInputPlanes / 9;
   }
 }
 
@@ -189,7 +446,10 @@ void ShowNetworkWeightsPolicyInfo(const pblczero::Net& weights) {
       COUT << Justify("Policy FFN activation")
            << NetworkFormat::ActivationFunction_Name(ffn_activation);
     }
-    COUT << Justify("Policy Dmodel") << w.ip2_pol_b().params().size() / 2;
+    const auto& ip2_pol_b = w.has_policy_heads()
+                                ? w.policy_heads().vanilla().ip2_pol_b()
+                                : w.ip2_pol_b();
+    COUT << Justify("Policy Dmodel") << ip2_pol_b.params().size() / 2;
   } else {
     COUT << Justify("Policy") << (w.has_policy1() ? "Convolution" : "Dense");
     COUT << Justify("Policy activation")
@@ -231,6 +491,12 @@ void ShowNetworkOnnxInfo(const pblczero::Net& weights,
   if (onnx_model.has_input_planes()) {
     COUT << Justify("Input planes") << onnx_model.input_planes();
   }
+  if (onnx_model.has_input_plane_masks()) {
+    COUT << Justify("Input plane masks") << onnx_model.input_plane_masks();
+  }
+  if (onnx_model.has_input_plane_values()) {
+    COUT << Justify("Input plane values") << onnx_model.input_plane_values();
+  }
   if (onnx_model.has_output_value()) {
     COUT << Justify("Output value") << onnx_model.output_value();
   }
@@ -291,6 +557,75 @@ void ShowNetworkOnnxInfo(const pblczero::Net& weights,
   }
 }
 
+void ShowNetworkCostInfo(const pblczero::Net& weights, float gflops,
+                         float bandwidth, int batch_size, bool show_layers) {
+  if (!weights.has_weights()) return;
+  const auto costs = GetNetworkCost(weights);
+  LayerCost total;
+  std::vector<std::string> type_order;
+  std::map<std::string, LayerCost> by_type;
+  for (const auto& cost : costs) {
+    total.params += cost.params;
+    total.macs += cost.macs;
+    total.activations += cost.activations;
+    auto& type = by_type[cost.type];
+    if (type.type.empty()) type_order.push_back(cost.type);
+    type.type = cost.type;
+    type.params += cost.params;
+    type.macs += cost.macs;
+    type.activations += cost.activations;
+  }
+
+  COUT << "\nCost per position (" << kSquares << " squares)";
+  COUT << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
+  COUT << std::left << std::setw(28) << "Layer" << std::right << std::setw(10)
+       << "Params" << std::setw(10) << "MACs" << std::setw(9) << "Share"
+       << std::setw(10) << "Outputs";
+  if (show_layers) {
+    for (const auto& cost : costs) {
+      COUT << CostLine(cost.name, cost, total.macs);
+    }
+    COUT << "";
+  }
+  for (const auto& type : type_order) {
+    COUT << CostLine(type, by_type[type], total.macs);
+  }
+  COUT << CostLine("Total", total, total.macs);
+
+  // Weights are streamed once per batch (fp32 in CPU backends), activations
+  // are written once and read once per position.
+  const double weight_bytes = 4.0 * total.params;
+  const double activation_bytes = 2 * 4.0 * total.activations;
+  const double bytes_per_position =
+      weight_bytes / batch_size + activation_bytes;
+  const double flops_per_position = 2.0 * total.macs;
+  COUT << "";
+  COUT << Justify("Weight bytes") << FormatCount(weight_bytes) << "B (fp32), "
+       << FormatCount(weight_bytes / 2) << "B (fp16)";
+  COUT << Justify("FLOPs per position") << FormatCount(flops_per_position);
+  COUT << Justify("Activation traffic")
+       << FormatCount(activation_bytes) << "B per position";
+  COUT << Justify("Arithmetic intensity") << std::fixed << std::setprecision(1)
+       << flops_per_position / bytes_per_position << " FLOP/B at batch "
+       << batch_size;
+  if (gflops <= 0.0f && bandwidth <= 0.0f) return;
+  double nps = std::numeric_limits<double>::infinity();
+  if (gflops > 0.0f) {
+    const double compute_nps = gflops * 1e9 / flops_per_position;
+    COUT << Justify("Compute bound") << std::fixed << std::setprecision(0)
+         << compute_nps << " positions/s";
+    nps = std::min(nps, compute_nps);
+  }
+  if (bandwidth > 0.0f) {
+    const double memory_nps = bandwidth * 1e9 / bytes_per_position;
+    COUT << Justify("Memory bound") << std::fixed << std::setprecision(0)
+         << memory_nps << " positions/s";
+    nps = std::min(nps, memory_nps);
+  }
+  COUT << Justify("Expected") << std::fixed << std::setprecision(0) << nps
+       << " positions/s";
+}
+
 void ShowAllNetworkInfo(const pblczero::Net& weights) {
   ShowNetworkGenericInfo(weights);
   ShowNetworkFormatInfo(weights);
@@ -307,5 +642,9 @@ void DescribeNetworkCmd() {
   auto weights_file =
       LoadWeightsFromFile(dict.Get<std::string>(kWeightsFilenameId));
   ShowAllNetworkInfo(weights_file);
+  ShowNetworkCostInfo(weights_file, dict.Get<float>(kGflopsId),
+                      dict.Get<float>(kBandwidthId),
+                      dict.Get<int>(kBatchSizeId),
+                      dict.Get<bool>(kShowLayersId));
 }
 }  // namespace lczero
@@ -36,6 +36,8 @@ void ShowNetworkTrainingInfo(const pblczero::Net& weights);
 void ShowNetworkWeightsInfo(const pblczero::Net& weights);
 void ShowNetworkOnnxInfo(const pblczero::Net& weights,
                          bool show_onnx_internals);
+void ShowNetworkCostInfo(const pblczero::Net& weights, float gflops,
+                         float bandwidth, int batch_size, bool show_layers);
 void ShowAllNetworkInfo(const pblczero::Net& weights);
 
 }  // namespace lczero
\ No newline at end of file
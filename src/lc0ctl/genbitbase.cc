@@ -0,0 +1,80 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "lc0ctl/genbitbase.h"
+
+#include <thread>
+
+#include "bitbase/generator.h"
+#include "utils/filesystem.h"
+#include "utils/optionsparser.h"
+#include "utils/string.h"
+
+namespace lczero {
+namespace {
+
+const OptionId kMaterialId{
+    "material", "",
+    "Comma separated list of materials to solve, e.g. KRvK,KPvKA. Materials "
+    "reachable by captures are solved and written as well."};
+const OptionId kOutputDirId{"output-dir", "",
+                            "Directory to write the bitbase files to.", 'o'};
+const OptionId kThreadsId{"threads", "",
+                          "Number of threads used for move generation.", 't'};
+
+bool ProcessParameters(OptionsParser* options) {
+  options->Add<StringOption>(kMaterialId);
+  options->Add<StringOption>(kOutputDirId) = ".";
+  options->Add<IntOption>(kThreadsId, 1, 256) =
+      std::max(1u, std::thread::hardware_concurrency());
+  if (!options->ProcessAllFlags()) return false;
+  const OptionsDict& dict = options->GetOptionsDict();
+  dict.EnsureExists<std::string>(kMaterialId);
+  return true;
+}
+
+}  // namespace
+
+void GenerateBitbasesCmd() {
+  OptionsParser options_parser;
+  if (!ProcessParameters(&options_parser)) return;
+  const OptionsDict& dict = options_parser.GetOptionsDict();
+
+  BitbaseGenerator generator(dict.Get<int>(kThreadsId));
+  for (const auto& material :
+       StrSplit(dict.Get<std::string>(kMaterialId), ",")) {
+    generator.Generate(Trim(material));
+  }
+  const auto directory = dict.Get<std::string>(kOutputDirId);
+  CreateDirectory(directory);
+  for (const auto& key : generator.GetKeys()) {
+    generator.Save(key, directory);
+    COUT << "Wrote " << directory << "/" << key << kBitbaseExtension;
+  }
+}
+
+}  // namespace lczero
@@ -57,6 +57,21 @@ const OptionId kOnnxOpsetId{"onnx-opset", "",
 const OptionId kHloAllowPartialResultId = {
     "hlo-allow-partial-result", "",
     "Allow partial result in case of HLO conversion failure (DEBUG ONLY!)."};
+const OptionId kOnnxFuseOpsId{
+    "onnx-fuse-ops", "",
+    "Emit fused onnxruntime operators (com.microsoft domain) for attention, "
+    "skip layer normalization and scaled matmuls."};
+const OptionId kOnnxInt8WeightsId{
+    "onnx-int8-weights", "",
+    "Store dense layer weights as int8 with per channel scales (QDQ format)."};
+const OptionId kOnnxPolicyMaskId{
+    "onnx-policy-mask", "",
+    "Add a legal move mask input and output masked softmax probabilities "
+    "instead of policy logits."};
+const OptionId kOnnxPackedInputId{
+    "onnx-packed-input", "",
+    "Take bit-packed plane masks and per-plane values as inputs, and expand "
+    "them to input planes inside the model."};
 const OptionId kRelaxOpTypes{
     "relax-op-types", "", "Use onnx-data-type even if unsuported by operator."};
 
@@ -96,6 +111,10 @@ bool ProcessParameters(OptionsParser* options) {
   options->Add<ChoiceOption>(
       kOnnxDataTypeId,
       std::vector<std::string>{"f32", "f16", "bf16", "f8e5m2"}) = "f32";
+  options->Add<BoolOption>(kOnnxFuseOpsId) = false;
+  options->Add<BoolOption>(kOnnxInt8WeightsId) = false;
+  options->Add<BoolOption>(kOnnxPolicyMaskId) = false;
+  options->Add<BoolOption>(kOnnxPackedInputId) = false;
   options->Add<BoolOption>(kHloAllowPartialResultId);
   options->Add<BoolOption>(kRelaxOpTypes) = false;
   options->HideOption(kOnnxBatchSizeId);
@@ -150,6 +169,10 @@ void ConvertLeelaToOnnx() {
     onnx_options.data_type = WeightsToOnnxConverterOptions::StringToDataType(
         dict.Get<std::string>(kOnnxDataTypeId));
     onnx_options.relax_op_types = dict.Get<bool>(kRelaxOpTypes);
+    onnx_options.fuse_ops = dict.Get<bool>(kOnnxFuseOpsId);
+    onnx_options.int8_weights = dict.Get<bool>(kOnnxInt8WeightsId);
+    onnx_options.policy_mask = dict.Get<bool>(kOnnxPolicyMaskId);
+    onnx_options.packed_input = dict.Get<bool>(kOnnxPackedInputId);
     // onnx2pytorch only needs an alternate layernorm-implementation, so it's
     // currently only enables that. Might need to be extended in the future.
     onnx_options.alt_layernorm = dict.Get<bool>(kOnnxToPytorch);
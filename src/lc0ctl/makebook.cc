@@ -0,0 +1,149 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "lc0ctl/makebook.h"
+
+#include "book/book.h"
+#include "chess/pgn.h"
+#include "neural/decoder.h"
+#include "trainingdata/reader.h"
+#include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/optionsparser.h"
+#include "utils/string.h"
+
+namespace lczero {
+namespace {
+
+const OptionId kPgnFilesId{"pgn", "",
+                           "Comma separated list of PGN files to read games "
+                           "from."};
+const OptionId kTrainingDirId{
+    "training-dir", "",
+    "Directory with training data (.gz) files to read games from."};
+const OptionId kOutputId{"output", "", "Opening book file to write.", 'o'};
+const OptionId kMaxPlyId{"max-ply", "",
+                         "Number of plies of every game to add to the book."};
+const OptionId kMinWeightId{
+    "min-weight", "",
+    "Only keep moves played at least this many times in the same position."};
+
+bool ProcessParameters(OptionsParser* options) {
+  options->Add<StringOption>(kPgnFilesId);
+  options->Add<StringOption>(kTrainingDirId);
+  options->Add<StringOption>(kOutputId) = "book.bin";
+  options->Add<IntOption>(kMaxPlyId, 1, 1000) = 30;
+  options->Add<IntOption>(kMinWeightId, 1, 1000000) = 2;
+  if (!options->ProcessAllFlags()) return false;
+  const OptionsDict& dict = options->GetOptionsDict();
+  if (!dict.OwnExists<std::string>(kPgnFilesId) &&
+      !dict.OwnExists<std::string>(kTrainingDirId)) {
+    throw Exception("Please specify --pgn and/or --training-dir.");
+  }
+  return true;
+}
+
+// Adds the games of a PGN file. Opening moves are stored from white's point of
+// view and have to be mirrored back for black.
+int AddPgnFile(const std::string& filename, int max_ply,
+               OpeningBookBuilder* builder) {
+  PgnReader reader;
+  reader.AddPgnFile(filename);
+  const auto games = reader.ReleaseGames();
+  for (const auto& game : games) {
+    ChessBoard board;
+    board.SetFromFen(game.start_fen);
+    MoveList moves = game.moves;
+    bool black = board.flipped();
+    for (auto& move : moves) {
+      if (black) move.Mirror();
+      black = !black;
+    }
+    builder->AddGame(board, moves, max_ply);
+  }
+  return games.size();
+}
+
+// Adds the game of a training data file. The moves are decoded from the input
+// planes of consecutive positions.
+bool AddTrainingFile(const std::string& filename, int max_ply,
+                     OpeningBookBuilder* builder) {
+  TrainingDataReader reader(filename);
+  std::vector<V6TrainingData> chunks;
+  V6TrainingData data;
+  while (reader.ReadChunk(&data)) chunks.push_back(data);
+  if (chunks.empty()) return false;
+  ChessBoard board;
+  int rule50ply;
+  int gameply;
+  PopulateBoard(static_cast<pblczero::NetworkFormat::InputFormat>(
+                    chunks[0].input_format),
+                PlanesFromTrainingData(chunks[0]), &board, &rule50ply,
+                &gameply);
+  if (gameply >= max_ply) return false;
+  MoveList moves;
+  for (size_t i = 1; i < chunks.size(); i++) {
+    moves.push_back(DecodeMoveFromInput(PlanesFromTrainingData(chunks[i]),
+                                        PlanesFromTrainingData(chunks[i - 1])));
+    // Decoded moves are from the point of view of the side after the move.
+    moves.back().Mirror();
+  }
+  builder->AddGame(board, moves, max_ply - gameply);
+  return true;
+}
+
+}  // namespace
+
+void MakeBookCmd() {
+  OptionsParser options_parser;
+  if (!ProcessParameters(&options_parser)) return;
+  const OptionsDict& dict = options_parser.GetOptionsDict();
+  const int max_ply = dict.Get<int>(kMaxPlyId);
+
+  OpeningBookBuilder builder;
+  int games = 0;
+  if (dict.OwnExists<std::string>(kPgnFilesId)) {
+    for (const auto& file : StrSplit(dict.Get<std::string>(kPgnFilesId), ",")) {
+      games += AddPgnFile(Trim(file), max_ply, &builder);
+    }
+  }
+  if (dict.OwnExists<std::string>(kTrainingDirId)) {
+    const auto directory = dict.Get<std::string>(kTrainingDirId);
+    for (const auto& name : GetFileList(directory)) {
+      if (name.size() < 3 || name.compare(name.size() - 3, 3, ".gz") != 0) {
+        continue;
+      }
+      if (AddTrainingFile(directory + "/" + name, max_ply, &builder)) ++games;
+    }
+  }
+  const auto output = dict.Get<std::string>(kOutputId);
+  const auto entries = builder.Save(output, dict.Get<int>(kMinWeightId));
+  COUT << "Read " << games << " games, wrote " << entries << " of "
+       << builder.size() << " book entries to " << output;
+}
+
+}  // namespace lczero
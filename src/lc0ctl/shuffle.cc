@@ -0,0 +1,422 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "lc0ctl/shuffle.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "trainingdata/reader.h"
+#include "trainingdata/writer.h"
+#include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/hashcat.h"
+#include "utils/logging.h"
+#include "utils/optionsparser.h"
+#include "utils/string.h"
+
+namespace lczero {
+namespace {
+
+const OptionId kInputId{
+    "input", "",
+    "Comma separated list of training data files, and directories whose .gz "
+    "files are all read.",
+    'i'};
+const OptionId kOutputId{"output", "",
+                         "Directory to write the shuffled shards to.", 'o'};
+const OptionId kTempDirId{
+    "temp-dir", "",
+    "Directory for the bucket files of the first pass, <output>/tmp if "
+    "empty."};
+const OptionId kBucketsId{
+    "buckets", "",
+    "Number of temporary buckets. Every bucket is shuffled in memory on its "
+    "own, so each thread needs about positions / buckets * 10 KB."};
+const OptionId kShardSizeId{
+    "shard-size", "", "Positions per output shard, the last may be smaller."};
+const OptionId kFormatId{
+    "format", "",
+    "Shard format: v6 (V6TrainingData records) or compact (bit-packed planes "
+    "and legal move probabilities only, see shuffle.cc)."};
+const OptionId kThreadsId{
+    "threads", "",
+    "Threads for decompression, shuffling and compression.", 't'};
+const OptionId kSeedId{"seed", "", "Shuffle seed, 0 picks a random one."};
+
+// Compact record layout, little-endian, all records in a shard gzip stream
+// back to back:
+//   uint32 version         kCompactVersion
+//   uint32 input_format
+//   uint16 n               number of legal moves
+//   uint16 index[n]        policy indices of the legal moves
+//   float  probability[n]
+//   uint8  planes[120][12] 90 squares per plane, square i is bit i % 8 of
+//                          byte i / 8
+//   the V6TrainingData fields from side_to_move to reserved, unchanged.
+// Illegal moves (probability -1 in V6) are left out, which makes a record
+// about 5 times smaller.
+constexpr uint32_t kCompactVersion = 0x80000006;
+constexpr size_t kPackedPlaneBytes = 12;
+constexpr size_t kV6TailOffset = offsetof(V6TrainingData, side_to_move);
+constexpr size_t kV6TailBytes = sizeof(V6TrainingData) - kV6TailOffset;
+
+// Bucket files are written through stdio with a buffer of this size.
+constexpr size_t kBucketBufferBytes = 256 * 1024;
+
+struct ShuffleOptions {
+  std::vector<std::string> inputs;
+  std::string output;
+  std::string temp_dir;
+  int buckets;
+  int shard_size;
+  bool compact;
+  int threads;
+  uint64_t seed;
+};
+
+bool HasGzExtension(const std::string& name) {
+  return name.size() >= 3 && name.compare(name.size() - 3, 3, ".gz") == 0;
+}
+
+std::vector<std::string> ListInputFiles(const std::string& list) {
+  std::vector<std::string> files;
+  for (auto input : StrSplit(list, ",")) {
+    input = Trim(input);
+    if (input.empty()) continue;
+    const auto names = GetFileList(input);
+    if (names.empty() && GetFileSize(input) > 0) {
+      files.push_back(input);
+      continue;
+    }
+    for (const auto& name : names) {
+      if (HasGzExtension(name)) files.push_back(input + "/" + name);
+    }
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+std::string NumberedName(const std::string& dir, const std::string& prefix,
+                         int number, const std::string& extension) {
+  std::ostringstream oss;
+  oss << dir << '/' << prefix << std::setfill('0') << std::setw(6) << number
+      << extension;
+  return oss.str();
+}
+
+void AppendCompact(const V6TrainingData& data, std::string* out) {
+  auto append = [out](const void* bytes, size_t size) {
+    out->append(reinterpret_cast<const char*>(bytes), size);
+  };
+  uint16_t indices[2062];
+  float probabilities[2062];
+  uint16_t count = 0;
+  for (uint16_t i = 0; i < 2062; i++) {
+    if (data.probabilities[i] < 0.0f) continue;
+    indices[count] = i;
+    probabilities[count++] = data.probabilities[i];
+  }
+  append(&kCompactVersion, sizeof(kCompactVersion));
+  append(&data.input_format, sizeof(data.input_format));
+  append(&count, sizeof(count));
+  append(indices, count * sizeof(indices[0]));
+  append(probabilities, count * sizeof(probabilities[0]));
+  for (const auto& plane : data.planes) append(&plane, kPackedPlaneBytes);
+  append(reinterpret_cast<const char*>(&data) + kV6TailOffset, kV6TailBytes);
+}
+
+void WriteShard(const std::string& filename,
+                const std::vector<V6TrainingData>& positions, bool compact) {
+  if (!compact) {
+    TrainingDataWriter writer(filename);
+    for (const auto& data : positions) writer.WriteChunk(data);
+    writer.Finalize();
+    return;
+  }
+  std::string buffer;
+  for (const auto& data : positions) AppendCompact(data, &buffer);
+  gzFile file = gzopen(filename.c_str(), "wb");
+  if (!file) throw Exception("Cannot create gzip file " + filename);
+  const int written = gzwrite(file, buffer.data(), buffer.size());
+  gzclose(file);
+  if (written != static_cast<int>(buffer.size())) {
+    throw Exception("Unable to write into " + filename);
+  }
+}
+
+class Shuffler {
+ public:
+  Shuffler(const ShuffleOptions& options) : options_(options) {}
+
+  // First pass: decompresses the inputs in parallel and scatters positions to
+  // bucket files by a seeded hash of their file and position index.
+  uint64_t Scatter() {
+    buckets_ = std::vector<Bucket>(options_.buckets);
+    for (int i = 0; i < options_.buckets; i++) {
+      auto& bucket = buckets_[i];
+      bucket.filename = NumberedName(options_.temp_dir, "bucket_", i, ".bin");
+      bucket.file = std::fopen(bucket.filename.c_str(), "wb");
+      if (!bucket.file) {
+        throw Exception("Cannot create bucket file " + bucket.filename);
+      }
+      std::setvbuf(bucket.file, nullptr, _IOFBF, kBucketBufferBytes);
+    }
+    std::atomic<size_t> next_file{0};
+    RunThreads([&]() {
+      size_t idx;
+      while ((idx = next_file++) < options_.inputs.size()) {
+        ScatterFile(idx);
+      }
+    });
+    uint64_t total = 0;
+    for (auto& bucket : buckets_) {
+      if (std::fclose(bucket.file) != 0) {
+        throw Exception("Unable to write into " + bucket.filename);
+      }
+      total += bucket.count;
+    }
+    return total;
+  }
+
+  // Second pass: shuffles each bucket in memory and cuts the concatenation of
+  // the shuffled buckets into shards. A uniform random bucket followed by a
+  // uniform shuffle within the bucket makes the whole order uniform. The
+  // shuffle sorts by a key derived from the scatter hash, so it doesn't depend
+  // on the order in which threads filled the bucket. Buckets are shuffled and
+  // shards compressed in parallel, but appended to the shard sequence in
+  // bucket order, so a seed always gives the same shards.
+  int Gather() {
+    std::atomic<int> next_bucket{0};
+    std::vector<V6TrainingData> pending;
+    int next_shard = 0;
+    int turn = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+    RunThreads([&]() {
+      int idx;
+      while ((idx = next_bucket++) < options_.buckets) {
+        std::vector<KeyedPosition> positions;
+        std::vector<std::pair<uint64_t, uint32_t>> order;
+        // A failed bucket still takes its turn, later ones wait for it.
+        std::exception_ptr error;
+        try {
+          positions = LoadBucket(idx);
+          order.reserve(positions.size());
+          for (uint32_t i = 0; i < positions.size(); i++) {
+            order.emplace_back(Hash(positions[i].key), i);
+          }
+          std::sort(order.begin(), order.end());
+        } catch (...) {
+          error = std::current_exception();
+        }
+
+        std::vector<std::pair<int, std::vector<V6TrainingData>>> shards;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&]() { return turn == idx; });
+          for (const auto& entry : order) {
+            pending.push_back(positions[entry.second].data);
+            if (pending.size() ==
+                static_cast<size_t>(options_.shard_size)) {
+              shards.emplace_back(next_shard++, std::move(pending));
+              pending.clear();
+            }
+          }
+          if (idx == options_.buckets - 1 && !pending.empty()) {
+            shards.emplace_back(next_shard++, std::move(pending));
+          }
+          ++turn;
+        }
+        cv.notify_all();
+        if (error) std::rethrow_exception(error);
+        positions.clear();
+        positions.shrink_to_fit();
+        for (const auto& shard : shards) {
+          WriteShard(NumberedName(options_.output, "shard_", shard.first,
+                                  ".gz"),
+                     shard.second, options_.compact);
+        }
+      }
+    });
+    return next_shard;
+  }
+
+ private:
+  // Bucket file record, the scatter hash is kept to order the bucket.
+  struct KeyedPosition {
+    uint64_t key;
+    V6TrainingData data;
+  };
+
+  struct Bucket {
+    std::string filename;
+    FILE* file = nullptr;
+    uint64_t count = 0;
+    std::mutex mutex;
+  };
+
+  template <typename Fn>
+  void RunThreads(Fn fn) {
+    std::vector<std::thread> threads;
+    std::mutex error_mutex;
+    std::string error;
+    for (int i = 0; i < options_.threads; i++) {
+      threads.emplace_back([&]() {
+        try {
+          fn();
+        } catch (std::exception& ex) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          error = ex.what();
+        }
+      });
+    }
+    for (auto& thread : threads) thread.join();
+    if (!error.empty()) throw Exception(error);
+  }
+
+  void ScatterFile(size_t file_idx) {
+    const auto& filename = options_.inputs[file_idx];
+    KeyedPosition entry;
+    uint64_t position = 0;
+    try {
+      TrainingDataReader reader(filename);
+      while (reader.ReadChunk(&entry.data)) {
+        entry.key = HashCat(HashCat(options_.seed, file_idx), position++);
+        auto& bucket = buckets_[entry.key % buckets_.size()];
+        std::lock_guard<std::mutex> lock(bucket.mutex);
+        if (std::fwrite(&entry, sizeof(entry), 1, bucket.file) != 1) {
+          throw Exception("Unable to write into " + bucket.filename);
+        }
+        ++bucket.count;
+      }
+    } catch (Exception& ex) {
+      // A truncated game file keeps the positions read before the error.
+      CERR << "Skipping rest of " << filename << ": " << ex.what();
+    }
+  }
+
+  std::vector<KeyedPosition> LoadBucket(int idx) {
+    auto& bucket = buckets_[idx];
+    std::vector<KeyedPosition> positions(bucket.count);
+    FILE* file = std::fopen(bucket.filename.c_str(), "rb");
+    if (!file ||
+        std::fread(positions.data(), sizeof(KeyedPosition), bucket.count,
+                   file) != bucket.count) {
+      if (file) std::fclose(file);
+      throw Exception("Unable to read bucket file " + bucket.filename);
+    }
+    std::fclose(file);
+    std::remove(bucket.filename.c_str());
+    return positions;
+  }
+
+  const ShuffleOptions& options_;
+  std::vector<Bucket> buckets_;
+};
+
+bool ProcessParameters(OptionsParser* options) {
+  options->Add<StringOption>(kInputId);
+  options->Add<StringOption>(kOutputId) = "shuffled";
+  options->Add<StringOption>(kTempDirId);
+  options->Add<IntOption>(kBucketsId, 1, 1000) = 256;
+  options->Add<IntOption>(kShardSizeId, 1, 1000000) = 4096;
+  options->Add<ChoiceOption>(kFormatId,
+                             std::vector<std::string>{"v6", "compact"}) = "v6";
+  options->Add<IntOption>(kThreadsId, 1, 256) =
+      std::max(1u, std::thread::hardware_concurrency());
+  options->Add<IntOption>(kSeedId, 0, 2147483647) = 0;
+  if (!options->ProcessAllFlags()) return false;
+  if (!options->GetOptionsDict().OwnExists<std::string>(kInputId)) {
+    throw Exception("Please specify --input.");
+  }
+  return true;
+}
+
+double Rate(uint64_t positions, double seconds) {
+  return seconds > 0 ? positions / seconds : 0.0;
+}
+
+}  // namespace
+
+void ShuffleTrainingDataCmd() {
+  OptionsParser options_parser;
+  if (!ProcessParameters(&options_parser)) return;
+  const OptionsDict& dict = options_parser.GetOptionsDict();
+
+  ShuffleOptions options;
+  options.inputs = ListInputFiles(dict.Get<std::string>(kInputId));
+  options.output = dict.Get<std::string>(kOutputId);
+  options.temp_dir = dict.Get<std::string>(kTempDirId);
+  if (options.temp_dir.empty()) options.temp_dir = options.output + "/tmp";
+  options.buckets = dict.Get<int>(kBucketsId);
+  options.shard_size = dict.Get<int>(kShardSizeId);
+  options.compact = dict.Get<std::string>(kFormatId) == "compact";
+  options.threads = dict.Get<int>(kThreadsId);
+  options.seed = dict.Get<int>(kSeedId);
+  if (options.seed == 0) options.seed = std::random_device()();
+  if (options.inputs.empty()) throw Exception("No input files found.");
+  CreateDirectory(options.output);
+  CreateDirectory(options.temp_dir);
+
+  Shuffler shuffler(options);
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t positions = shuffler.Scatter();
+  const auto scattered = std::chrono::steady_clock::now();
+  const double scatter_seconds =
+      std::chrono::duration<double>(scattered - start).count();
+  COUT << "Read " << positions << " positions from " << options.inputs.size()
+       << " files in " << scatter_seconds << "s, "
+       << Rate(positions, scatter_seconds) << " positions/s.";
+
+  const int shards = shuffler.Gather();
+  std::remove(options.temp_dir.c_str());
+  const auto end = std::chrono::steady_clock::now();
+  const double gather_seconds =
+      std::chrono::duration<double>(end - scattered).count();
+  const double total_seconds =
+      std::chrono::duration<double>(end - start).count();
+  COUT << "Wrote " << shards << " shards to " << options.output << " in "
+       << gather_seconds << "s, " << Rate(positions, gather_seconds)
+       << " positions/s.";
+  COUT << "Shuffled " << positions << " positions in " << total_seconds
+       << "s, " << Rate(positions, total_seconds) << " positions/s overall.";
+}
+
+}  // namespace lczero
@@ -30,8 +30,14 @@
 #include "chess/board.h"
 #include "engine.h"
 #include "lc0ctl/describenet.h"
+#include "lc0ctl/genbitbase.h"
 #include "lc0ctl/leela2onnx.h"
+#include "lc0ctl/makebook.h"
 #include "lc0ctl/onnx2leela.h"
+#include "lc0ctl/shuffle.h"
+#ifdef __linux__
+#include "neural/shm/server.h"
+#endif
 #include "selfplay/loop.h"
 #include "utils/commandline.h"
 #include "utils/esc_codes.h"
@@ -64,6 +70,16 @@ int main(int argc, const char** argv) {
                               "Convert ONNX network to Leela net.");
     CommandLine::RegisterMode("describenet",
                               "Shows details about the Leela network.");
+    CommandLine::RegisterMode("genbitbase",
+                              "Generate Xiangqi endgame bitbases.");
+    CommandLine::RegisterMode("makebook",
+                              "Build an opening book from games.");
+    CommandLine::RegisterMode("shuffle",
+                              "Shuffle training data into fixed-size shards.");
+#ifdef __linux__
+    CommandLine::RegisterMode(
+        "serve", "Serve a network to \"shm\" backend clients on this host.");
+#endif
 
     if (CommandLine::ConsumeCommand("selfplay")) {
       // Selfplay mode.
@@ -83,6 +99,16 @@ int main(int argc, const char** argv) {
       lczero::ConvertOnnxToLeela();
     } else if (CommandLine::ConsumeCommand("describenet")) {
       lczero::DescribeNetworkCmd();
+    } else if (CommandLine::ConsumeCommand("genbitbase")) {
+      lczero::GenerateBitbasesCmd();
+    } else if (CommandLine::ConsumeCommand("makebook")) {
+      lczero::MakeBookCmd();
+    } else if (CommandLine::ConsumeCommand("shuffle")) {
+      lczero::ShuffleTrainingDataCmd();
+#ifdef __linux__
+    } else if (CommandLine::ConsumeCommand("serve")) {
+      lczero::RunInferenceServer();
+#endif
     } else {
       // Consuming optional "uci" mode.
       CommandLine::ConsumeCommand("uci");
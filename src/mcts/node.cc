@@ -30,6 +30,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
 #include <iostream>
 #include <sstream>
@@ -49,73 +50,275 @@ namespace lczero {
 namespace {
 // Periodicity of garbage collection, milliseconds.
 const int kGCIntervalMs = 100;
-
-// Every kGCIntervalMs milliseconds release nodes in a separate GC thread.
+// Queuing a subtree with at least this many visits wakes the collector up
+// immediately.
+const uint32_t kGCLargeSubtreeNodes = 10000;
+// A collector thread shares half of its pending subtrees with idle threads
+// once it holds this many.
+const size_t kGCShareThreshold = 256;
+// Freed runs are returned to the pools in batches of this size.
+const size_t kGCFreeBatch = 1024;
+
+// Frees queued subtrees in background threads. Subtrees are released
+// iteratively with an explicit stack, so that deep trees can't overflow the
+// call stack, and a large backlog is split between the threads.
 class NodeGarbageCollector {
  public:
-  NodeGarbageCollector() : gc_thread_([this]() { Worker(); }) {}
+  NodeGarbageCollector() { SetThreads(1); }
 
   // Takes ownership of a subtree, to dispose it in a separate thread when
   // it has time.
-  void AddToGcQueue(std::unique_ptr<Node> node, size_t solid_size = 0) {
+  void AddToGcQueue(uint32_t node, size_t solid_size = 0) {
     if (!node) return;
-    Mutex::Lock lock(gc_mutex_);
-    subtrees_to_gc_.emplace_back(std::move(node));
-    subtrees_to_gc_solid_size_.push_back(solid_size);
+    const size_t nodes = CountNodes(node, solid_size);
+    auto pools = NodePool::Get(node)->GetPools()->shared_from_this();
+    {
+      Mutex::Lock lock(gc_mutex_);
+      subtrees_to_gc_.push_back({node, solid_size, nodes, std::move(pools)});
+      queued_nodes_ += nodes;
+    }
+    if (nodes >= kGCLargeSubtreeNodes) gc_cv_.notify_all();
+  }
+
+  NodeGcStats GetStats() {
+    NodeGcStats stats;
+    {
+      Mutex::Lock lock(gc_mutex_);
+      stats.queued_subtrees = subtrees_to_gc_.size();
+      stats.queued_nodes = queued_nodes_;
+    }
+    stats.freed_nodes = freed_nodes_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  void SetThreads(int threads) {
+    Mutex::Lock lock(threads_mutex_);
+    threads = std::max(threads, 1);
+    while (static_cast<int>(gc_threads_.size()) > threads) {
+      num_threads_.store(gc_threads_.size() - 1);
+      gc_cv_.notify_all();
+      gc_threads_.back().join();
+      gc_threads_.pop_back();
+    }
+    num_threads_.store(threads);
+    while (static_cast<int>(gc_threads_.size()) < threads) {
+      gc_threads_.emplace_back(
+          [this, id = static_cast<int>(gc_threads_.size())]() { Worker(id); });
+    }
   }
 
   ~NodeGarbageCollector() {
-    // Flips stop flag and waits for a worker thread to stop.
+    // Flips stop flag and waits for worker threads to stop.
     stop_.store(true);
-    gc_thread_.join();
+    gc_cv_.notify_all();
+    Mutex::Lock lock(threads_mutex_);
+    for (auto& thread : gc_threads_) thread.join();
   }
 
  private:
-  void GarbageCollect() {
-    while (!stop_.load()) {
-      // Node will be released in destructor when mutex is not locked.
-      std::unique_ptr<Node> node_to_gc;
-      size_t solid_size = 0;
-      {
-        // Lock the mutex and move last subtree from subtrees_to_gc_ into
-        // node_to_gc.
-        Mutex::Lock lock(gc_mutex_);
-        if (subtrees_to_gc_.empty()) return;
-        node_to_gc = std::move(subtrees_to_gc_.back());
-        subtrees_to_gc_.pop_back();
-        solid_size = subtrees_to_gc_solid_size_.back();
-        subtrees_to_gc_solid_size_.pop_back();
+  struct Subtree {
+    // Pool index of the first node.
+    uint32_t node = 0;
+    // Length of the solid children array, 0 for a single node.
+    size_t solid_size = 0;
+    // Approximate number of nodes, for statistics.
+    size_t nodes = 0;
+    // Pools holding the subtree, kept alive until it is freed. Only set for
+    // queued subtrees, the stack of a collector relies on its queued one.
+    std::shared_ptr<NodePools> pools;
+  };
+
+  static size_t CountNodes(uint32_t index, size_t solid_size) {
+    const Node* node = NodePool::Get(index);
+    if (solid_size == 0) return std::max<size_t>(node->GetN(), 1);
+    size_t nodes = 0;
+    for (size_t i = 0; i < solid_size; i++) {
+      nodes += std::max<size_t>(node[i].GetN(), 1);
+    }
+    return nodes;
+  }
+
+  bool ShouldExit(int id) const {
+    return stop_.load() || id >= num_threads_.load();
+  }
+
+  // Runs released by a worker, returned to their pools in batches that span
+  // the many small subtrees queued while a tree is made solid or trimmed.
+  struct FreeBatch {
+    std::shared_ptr<NodePools> pools;
+    std::vector<NodePool::Run> nodes;
+    std::vector<EdgePool::Run> edges;
+  };
+
+  static void Flush(FreeBatch* batch) {
+    if (!batch->pools) return;
+    FlushFree(&batch->pools->nodes, &batch->nodes);
+    FlushFree(&batch->pools->edges, &batch->edges);
+    batch->pools.reset();
+  }
+
+  // Frees the subtree and everything below it, without recursion.
+  void GarbageCollect(Subtree subtree, FreeBatch* batch) {
+    if (batch->pools != subtree.pools) {
+      Flush(batch);
+      batch->pools = subtree.pools;
+    }
+    NodePools* pools = subtree.pools.get();
+    std::vector<Subtree> stack;
+    stack.push_back({subtree.node, subtree.solid_size, 0, nullptr});
+    auto& free_nodes = batch->nodes;
+    auto& free_edges = batch->edges;
+    size_t freed = 0;
+    while (!stack.empty() && !stop_.load(std::memory_order_relaxed)) {
+      Subtree item = stack.back();
+      stack.pop_back();
+      Node* nodes = NodePool::Get(item.node);
+      const size_t count = item.solid_size ? item.solid_size : 1;
+      for (size_t i = 0; i < count; i++) {
+        Subtree child;
+        Subtree sibling;
+        uint32_t edges;
+        const uint32_t num_edges = nodes[i].GetNumEdges();
+        nodes[i].ReleaseSubtrees(&child.node, &child.solid_size, &sibling.node,
+                                 &edges);
+        if (child.node) stack.push_back(child);
+        if (sibling.node) stack.push_back(sibling);
+        if (edges) free_edges.push_back({edges, num_edges});
       }
-      // Solid is a hack...
-      if (solid_size != 0) {
-        for (size_t i = 0; i < solid_size; i++) {
-          node_to_gc.get()[i].~Node();
-        }
-        std::allocator<Node> alloc;
-        alloc.deallocate(node_to_gc.release(), solid_size);
+      free_nodes.push_back({item.node, static_cast<uint32_t>(count)});
+      freed += count;
+      if (free_nodes.size() >= kGCFreeBatch) {
+        FlushFree(&pools->nodes, &free_nodes);
+      }
+      if (free_edges.size() >= kGCFreeBatch) {
+        FlushFree(&pools->edges, &free_edges);
+      }
+      if (stack.size() >= kGCShareThreshold &&
+          idle_threads_.load(std::memory_order_relaxed) > 0) {
+        ShareWork(&stack, subtree.pools);
+      }
+    }
+    freed_nodes_.fetch_add(freed, std::memory_order_relaxed);
+    if (!stack.empty()) {
+      // Stopping, leave the rest to the destructor.
+      Mutex::Lock lock(gc_mutex_);
+      for (auto& item : stack) {
+        item.pools = subtree.pools;
+        subtrees_to_gc_.push_back(std::move(item));
       }
     }
   }
 
-  void Worker() {
-    while (!stop_.load()) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(kGCIntervalMs));
-      GarbageCollect();
-    };
+  template <typename Pool>
+  static void FlushFree(Pool* pool, std::vector<typename Pool::Run>* runs) {
+    pool->Free(*runs);
+    runs->clear();
+  }
+
+  // Moves the bottom half of the stack, which holds the subtrees closest to
+  // the root and so likely the largest ones, to the shared queue.
+  void ShareWork(std::vector<Subtree>* stack,
+                 const std::shared_ptr<NodePools>& pools) {
+    const size_t shared = stack->size() / 2;
+    {
+      Mutex::Lock lock(gc_mutex_);
+      for (size_t i = 0; i < shared; i++) {
+        auto& item = (*stack)[i];
+        item.nodes = CountNodes(item.node, item.solid_size);
+        item.pools = pools;
+        queued_nodes_ += item.nodes;
+        subtrees_to_gc_.push_back(std::move(item));
+      }
+    }
+    stack->erase(stack->begin(), stack->begin() + shared);
+    gc_cv_.notify_all();
+  }
+
+  void Worker(int id) {
+    FreeBatch batch;
+    while (!ShouldExit(id)) {
+      Subtree subtree;
+      {
+        Mutex::Lock lock(gc_mutex_);
+        if (subtrees_to_gc_.empty() && !batch.pools) {
+          ++idle_threads_;
+          gc_cv_.wait_for(lock.get_raw(),
+                          std::chrono::milliseconds(kGCIntervalMs));
+          --idle_threads_;
+          continue;
+        }
+        if (!subtrees_to_gc_.empty()) {
+          subtree = std::move(subtrees_to_gc_.back());
+          subtrees_to_gc_.pop_back();
+          queued_nodes_ -= subtree.nodes;
+        }
+      }
+      // The queue is empty, return what was released before going idle.
+      if (!subtree.node) {
+        Flush(&batch);
+        continue;
+      }
+      // Subtree is released when mutex is not locked.
+      GarbageCollect(std::move(subtree), &batch);
+    }
+    Flush(&batch);
   }
 
   mutable Mutex gc_mutex_;
-  std::vector<std::unique_ptr<Node>> subtrees_to_gc_ GUARDED_BY(gc_mutex_);
-  std::vector<size_t> subtrees_to_gc_solid_size_ GUARDED_BY(gc_mutex_);
+  std::vector<Subtree> subtrees_to_gc_ GUARDED_BY(gc_mutex_);
+  size_t queued_nodes_ GUARDED_BY(gc_mutex_) = 0;
+  std::condition_variable gc_cv_;
+  std::atomic<int> idle_threads_{0};
+  std::atomic<size_t> freed_nodes_{0};
 
   // When true, Worker() should stop and exit.
   std::atomic<bool> stop_{false};
-  std::thread gc_thread_;
+  // Workers with index not below this exit.
+  std::atomic<int> num_threads_{0};
+  Mutex threads_mutex_;
+  std::vector<std::thread> gc_threads_ GUARDED_BY(threads_mutex_);
 };
 
 NodeGarbageCollector gNodeGc;
+
+// Allocation caches of the current thread, for the pools it allocated from
+// last. Search threads only ever allocate in one tree.
+class ThreadCache {
+ public:
+  ~ThreadCache() { Select(nullptr); }
+
+  uint32_t AllocateNodes(NodePools* pools, uint32_t count) {
+    Select(pools);
+    return nodes_.Allocate(&pools->nodes, count);
+  }
+  uint32_t AllocateEdges(NodePools* pools, uint32_t count) {
+    Select(pools);
+    return edges_.Allocate(&pools->edges, count);
+  }
+
+ private:
+  // Returns everything cached for other pools before switching to @pools.
+  void Select(NodePools* pools) {
+    if (pools_.get() == pools) return;
+    if (pools_) {
+      nodes_.Drain(&pools_->nodes);
+      edges_.Drain(&pools_->edges);
+    }
+    pools_ = pools ? pools->shared_from_this() : nullptr;
+  }
+
+  std::shared_ptr<NodePools> pools_;
+  NodePool::Cache nodes_;
+  EdgePool::Cache edges_;
+};
+
+thread_local ThreadCache tThreadCache;
 }  // namespace
 
+NodeGcStats GetNodeGcStats() { return gNodeGc.GetStats(); }
+
+void SetNodeGcThreads(int threads) { gNodeGc.SetThreads(threads); }
+
 /////////////////////////////////////////////////////////////////////////
 // Edge
 /////////////////////////////////////////////////////////////////////////
@@ -180,30 +383,46 @@ std::string Edge::DebugString() const {
   return oss.str();
 }
 
-std::unique_ptr<Edge[]> Edge::FromMovelist(const MoveList& moves) {
-  std::unique_ptr<Edge[]> edges = std::make_unique<Edge[]>(moves.size());
-  auto* edge = edges.get();
-  for (const auto move : moves) edge++->move_ = move;
-  return edges;
+uint32_t Edge::FromMovelist(const MoveList& moves, NodePools* pools) {
+  if (moves.empty()) return 0;
+  const uint32_t index = tThreadCache.AllocateEdges(pools, moves.size());
+  auto* edge = EdgePool::Get(index);
+  for (const auto move : moves) {
+    edge->move_ = move;
+    edge++->p_ = 0;
+  }
+  return index;
 }
 
 /////////////////////////////////////////////////////////////////////////
 // Node
 /////////////////////////////////////////////////////////////////////////
 
+uint32_t Node::Allocate(NodePools* pools, Node* parent, uint16_t index) {
+  const uint32_t node = tThreadCache.AllocateNodes(pools, 1);
+  new (NodePool::Get(node)) Node(parent, index);
+  return node;
+}
+
+void Node::ReleaseEdges() {
+  if (edges_) GetPools()->edges.Free(edges_, num_edges_);
+  edges_ = 0;
+  num_edges_ = 0;
+}
+
 Node* Node::CreateSingleChildNode(Move move) {
   assert(!edges_);
   assert(!child_);
-  edges_ = Edge::FromMovelist({move});
+  edges_ = Edge::FromMovelist({move}, GetPools());
   num_edges_ = 1;
-  child_ = std::make_unique<Node>(this, 0);
-  return child_.get();
+  child_ = Allocate(GetPools(), this, 0);
+  return FromIndex(child_);
 }
 
 void Node::CreateEdges(const MoveList& moves) {
   assert(!edges_);
   assert(!child_);
-  edges_ = Edge::FromMovelist(moves);
+  edges_ = Edge::FromMovelist(moves, GetPools());
   num_edges_ = moves.size();
 }
 
@@ -221,9 +440,9 @@ float Node::GetVisitedPolicy() const {
 }
 
 Edge* Node::GetEdgeToNode(const Node* node) const {
-  assert(node->parent_ == this);
+  assert(node->GetParent() == this);
   assert(node->index_ < num_edges_);
-  return &edges_[node->index_];
+  return &GetEdges()[node->index_];
 }
 
 Edge* Node::GetOwnEdge() const { return GetParent()->GetEdgeToNode(this); }
@@ -232,7 +451,7 @@ std::string Node::DebugString() const {
   std::ostringstream oss;
   oss << " Term:" << static_cast<int>(terminal_type_) << " This:" << this
       << " Parent:" << parent_ << " Index:" << index_
-      << " Child:" << child_.get() << " Sibling:" << sibling_.get()
+      << " Child:" << child_ << " Sibling:" << sibling_
       << " WL:" << wl_ << " N:" << n_ << " N_:" << n_in_flight_
       << " Edges:" << static_cast<int>(num_edges_)
       << " Bounds:" << static_cast<int>(lower_bound_) - 2 << ","
@@ -245,7 +464,7 @@ bool Node::MakeSolid() {
   if (solid_children_ || num_edges_ == 0 || IsTerminal()) return false;
   // Can only make solid if no immediate leaf children are in flight since we
   // allow the search code to hold references to leaf nodes across locks.
-  Node* old_child_to_check = child_.get();
+  Node* old_child_to_check = FromIndex(child_);
   uint32_t total_in_flight = 0;
   while (old_child_to_check != nullptr) {
     if (old_child_to_check->GetN() <= 1 &&
@@ -257,7 +476,7 @@ bool Node::MakeSolid() {
       return false;
     }
     total_in_flight += old_child_to_check->GetNInFlight();
-    old_child_to_check = old_child_to_check->sibling_.get();
+    old_child_to_check = FromIndex(old_child_to_check->sibling_);
   }
   // If the total of children in flight is not the same as self, then there are
   // collisions against immediate children (which don't update the GetNInFlight
@@ -265,23 +484,29 @@ bool Node::MakeSolid() {
   if (total_in_flight != GetNInFlight()) {
     return false;
   }
-  std::allocator<Node> alloc;
-  auto* new_children = alloc.allocate(num_edges_);
+  const uint32_t new_children_index =
+      tThreadCache.AllocateNodes(GetPools(), num_edges_);
+  Node* new_children = NodePool::Get(new_children_index);
   for (int i = 0; i < num_edges_; i++) {
     new (&(new_children[i])) Node(this, i);
   }
-  std::unique_ptr<Node> old_child = std::move(child_);
+  uint32_t old_child = child_;
   while (old_child) {
-    int index = old_child->index_;
-    new_children[index] = std::move(*old_child.get());
-    // This isn't needed, but it helps crash things faster if something has gone wrong.
-    old_child->parent_ = nullptr;
-    gNodeGc.AddToGcQueue(std::move(old_child));
+    Node* old_node = FromIndex(old_child);
+    int index = old_node->index_;
+    new_children[index] = *old_node;
+    new_children[index].sibling_ = 0;
+    // The subtree and the edges now belong to the copy, only the node itself
+    // is freed. Clearing parent_ isn't needed, but it helps crash things faster
+    // if something has gone wrong.
+    const uint32_t next = old_node->sibling_;
+    old_node->parent_ = old_node->child_ = old_node->edges_ = 0;
+    old_node->sibling_ = 0;
+    gNodeGc.AddToGcQueue(old_child);
     new_children[index].UpdateChildrenParents();
-    old_child = std::move(new_children[index].sibling_);
+    old_child = next;
   }
-  // This is a hack.
-  child_ = std::unique_ptr<Node>(new_children);
+  child_ = new_children_index;
   solid_children_ = true;
   return true;
 }
@@ -291,7 +516,7 @@ void Node::SortEdges() {
   assert(!child_);
   // Sorting on raw p_ is the same as sorting on GetP() as a side effect of
   // the encoding, and its noticeably faster.
-  std::sort(edges_.get(), (edges_.get() + num_edges_),
+  std::sort(GetEdges(), (GetEdges() + num_edges_),
             [](const Edge& a, const Edge& b) { return a.p_ > b.p_; });
 }
 
@@ -392,60 +617,62 @@ void Node::RevertTerminalVisits(float v, float d, float m, int multivisit) {
 }
 
 void Node::UpdateChildrenParents() {
+  const uint32_t self = ToIndex(this);
   if (!solid_children_) {
-    Node* cur_child = child_.get();
+    Node* cur_child = FromIndex(child_);
     while (cur_child != nullptr) {
-      cur_child->parent_ = this;
-      cur_child = cur_child->sibling_.get();
+      cur_child->parent_ = self;
+      cur_child = FromIndex(cur_child->sibling_);
     }
   } else {
-    Node* child_array = child_.get();
+    Node* child_array = FromIndex(child_);
     for (int i = 0; i < num_edges_; i++) {
-      child_array[i].parent_ = this;
+      child_array[i].parent_ = self;
     }
   }
 }
 
 void Node::ReleaseChildren() {
-  gNodeGc.AddToGcQueue(std::move(child_), solid_children_ ? num_edges_ : 0);
+  gNodeGc.AddToGcQueue(child_, solid_children_ ? num_edges_ : 0);
+  child_ = 0;
 }
 
 void Node::ReleaseChildrenExceptOne(Node* node_to_save) {
   if (solid_children_) {
-    std::unique_ptr<Node> saved_node;
+    uint32_t saved_node = 0;
     if (node_to_save != nullptr) {
-      saved_node = std::make_unique<Node>(this, node_to_save->index_);
-      *saved_node = std::move(*node_to_save);
+      saved_node = Allocate(GetPools(), this, node_to_save->index_);
+      *FromIndex(saved_node) = *node_to_save;
+      // The subtree now belongs to the copy.
+      node_to_save->child_ = node_to_save->edges_ = 0;
     }
-    gNodeGc.AddToGcQueue(std::move(child_), num_edges_);
-    child_ = std::move(saved_node);
+    gNodeGc.AddToGcQueue(child_, num_edges_);
+    child_ = saved_node;
     if (child_) {
-      child_->UpdateChildrenParents();
+      FromIndex(child_)->UpdateChildrenParents();
     }
     solid_children_ = false;
   } else {
-    // Stores node which will have to survive (or nullptr if it's not found).
-    std::unique_ptr<Node> saved_node;
-    // Pointer to unique_ptr, so that we could move from it.
-    for (std::unique_ptr<Node>* node = &child_; *node;
-         node = &(*node)->sibling_) {
+    // Stores node which will have to survive (or 0 if it's not found).
+    uint32_t saved_node = 0;
+    // Pointer to the index, so that we could unlink it.
+    for (uint32_t* node = &child_; *node; node = &FromIndex(*node)->sibling_) {
       // If current node is the one that we have to save.
-      if (node->get() == node_to_save) {
+      if (FromIndex(*node) == node_to_save) {
         // Kill all remaining siblings.
-        gNodeGc.AddToGcQueue(std::move((*node)->sibling_));
-        // Save the node, and take the ownership from the unique_ptr.
-        saved_node = std::move(*node);
+        gNodeGc.AddToGcQueue(node_to_save->sibling_);
+        node_to_save->sibling_ = 0;
+        // Save the node, and unlink it from the list.
+        saved_node = *node;
+        *node = 0;
         break;
       }
     }
     // Make saved node the only child. (kills previous siblings).
-    gNodeGc.AddToGcQueue(std::move(child_));
-    child_ = std::move(saved_node);
-  }
-  if (!child_) {
-    num_edges_ = 0;
-    edges_.reset();  // Clear edges list.
+    gNodeGc.AddToGcQueue(child_);
+    child_ = saved_node;
   }
+  if (!child_) ReleaseEdges();  // Clear edges list.
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -477,7 +704,7 @@ void NodeTree::MakeMove(Move move) {
     }
   }
   current_head_->ReleaseChildrenExceptOne(new_head);
-  new_head = current_head_->child_.get();
+  new_head = Node::FromIndex(current_head_->child_);
   current_head_ =
       new_head ? new_head : current_head_->CreateSingleChildNode(move);
   history_.Append(move);
@@ -486,11 +713,12 @@ void NodeTree::MakeMove(Move move) {
 void NodeTree::TrimTreeAtHead() {
   // If solid, this will be empty before move and will be moved back empty
   // afterwards which is fine.
-  auto tmp = std::move(current_head_->sibling_);
+  const auto tmp = current_head_->sibling_;
   // Send dependent nodes for GC instead of destroying them immediately.
   current_head_->ReleaseChildren();
+  current_head_->ReleaseEdges();
   *current_head_ = Node(current_head_->GetParent(), current_head_->index_);
-  current_head_->sibling_ = std::move(tmp);
+  current_head_->sibling_ = tmp;
 }
 
 bool NodeTree::ResetToPosition(const std::string& starting_fen,
@@ -507,15 +735,15 @@ bool NodeTree::ResetToPosition(const std::string& starting_fen,
   }
 
   if (!gamebegin_node_) {
-    gamebegin_node_ = std::make_unique<Node>(nullptr, 0);
+    gamebegin_node_ = Node::Allocate(pools_.get(), nullptr, 0);
   }
 
   history_.Reset(starting_board, no_capture_ply,
                  full_moves * 2 - (starting_board.flipped() ? 1 : 2));
 
   Node* old_head = current_head_;
-  current_head_ = gamebegin_node_.get();
-  bool seen_old_head = (gamebegin_node_.get() == old_head);
+  current_head_ = GetGameBeginNode();
+  bool seen_old_head = (current_head_ == old_head);
   for (const auto& move : moves) {
     MakeMove(move);
     if (old_head == current_head_) seen_old_head = true;
@@ -530,11 +758,19 @@ bool NodeTree::ResetToPosition(const std::string& starting_fen,
   return seen_old_head;
 }
 
+void NodeTree::ReservePools(size_t nodes) {
+  // Every visited node gets the edges of its legal moves, about 40 in the
+  // middlegame.
+  constexpr size_t kEdgesPerNode = 40;
+  pools_->nodes.Reserve(nodes);
+  pools_->edges.Reserve(nodes * kEdgesPerNode);
+}
+
 void NodeTree::DeallocateTree() {
   // Same as gamebegin_node_.reset(), but actual deallocation will happen in
   // GC thread.
-  gNodeGc.AddToGcQueue(std::move(gamebegin_node_));
-  gamebegin_node_ = nullptr;
+  gNodeGc.AddToGcQueue(gamebegin_node_);
+  gamebegin_node_ = 0;
   current_head_ = nullptr;
 }
 
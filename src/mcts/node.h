@@ -39,6 +39,7 @@
 #include "neural/cache.h"
 #include "neural/encoder.h"
 #include "proto/net.pb.h"
+#include "utils/index_pool.h"
 #include "utils/mutex.h"
 
 namespace lczero {
@@ -46,13 +47,16 @@ namespace lczero {
 // Children of a node are stored the following way:
 // * Edges and Nodes edges point to are stored separately.
 // * There may be dangling edges (which don't yet point to any Node object yet)
-// * Edges are stored are a simple array on heap.
+// * Edges are stored are a simple array in the edge pool.
 // * Nodes are stored as a linked list, and contain index_ field which shows
 //   which edge of a parent that node points to.
-//   Or they are stored a contiguous array of Node objects on the heap if
+//   Or they are stored a contiguous array of Node objects in the pool if
 //   solid_children_ is true. If the children have been 'solidified' their
 //   sibling links are unused and left empty. In this state there are no
 //   dangling edges, but the nodes may not have ever received any visits.
+// * Nodes and edges live in the pools of their tree and refer to each other
+//   with 32-bit pool indices rather than pointers, 0 meaning null. This keeps
+//   a Node at 40 bytes.
 //
 // Example:
 //                                Parent Node
@@ -77,14 +81,16 @@ namespace lczero {
 //                     +------------+    +------------+    +--------+
 //                                       | index_ = 3 |
 //                                       | q_ = -0.2  |
-//                                       | sibling_   | -> nullptr
+//                                       | sibling_   | -> 0
 //                                       +------------+
 
 class Node;
+class NodePools;
 class Edge {
  public:
-  // Creates array of edges from the list of moves.
-  static std::unique_ptr<Edge[]> FromMovelist(const MoveList& moves);
+  // Creates array of edges from the list of moves in @pools, returns its index
+  // in the edge pool.
+  static uint32_t FromMovelist(const MoveList& moves, NodePools* pools);
 
   // Returns move from the point of view of the player making it (if as_opponent
   // is false) or as opponent (if as_opponent is true).
@@ -130,20 +136,16 @@ class Node {
 
   enum class Terminal : uint8_t { NonTerminal, EndOfGame, Tablebase, TwoFold };
 
-  // Takes pointer to a parent node and own index in a parent.
+  // Takes pointer to a parent node and own index in a parent. Nodes are only
+  // created in the pools of their tree, by NodeTree and the node itself.
   Node(Node* parent, uint16_t index)
-      : parent_(parent),
+      : parent_(ToIndex(parent)),
         index_(index),
         terminal_type_(Terminal::NonTerminal),
         lower_bound_(GameResult::BLACK_WON),
         upper_bound_(GameResult::WHITE_WON),
         solid_children_(false) {}
 
-  // We have a custom destructor, but its behavior does not need to be emulated
-  // during move operations so default is fine.
-  Node(Node&& move_from) = default;
-  Node& operator=(Node&& move_from) = default;
-
   // Allocates a new edge and a new node. The node has to be no edges before
   // that.
   Node* CreateSingleChildNode(Move m);
@@ -152,10 +154,13 @@ class Node {
   void CreateEdges(const MoveList& moves);
 
   // Gets parent node.
-  Node* GetParent() const { return parent_; }
+  Node* GetParent() const { return FromIndex(parent_); }
+
+  // Returns the pools of the tree this node belongs to.
+  NodePools* GetPools() const;
 
   // Returns whether a node has children.
-  bool HasChildren() const { return static_cast<bool>(edges_); }
+  bool HasChildren() const { return edges_ != 0; }
 
   // Returns sum of policy priors which have had at least one playout.
   float GetVisitedPolicy() const;
@@ -182,9 +187,10 @@ class Node {
   // Output must point to at least max_needed floats.
   void CopyPolicy(int max_needed, float* output) const {
     if (!edges_) return;
+    const Edge* edges = GetEdges();
     int loops = std::min(static_cast<int>(num_edges_), max_needed);
     for (int i = 0; i < loops; i++) {
-      output[i] = edges_[i].GetP();
+      output[i] = edges[i].GetP();
     }
   }
 
@@ -258,47 +264,43 @@ class Node {
   // Index in parent edges - useful for correlated ordering.
   uint16_t Index() const { return index_; }
 
-  ~Node() {
-    if (solid_children_ && child_) {
-      // As a hack, solid_children is actually storing an array in here, release
-      // so we can correctly invoke the array delete.
-      for (int i = 0; i < num_edges_; i++) {
-        child_.get()[i].~Node();
-      }
-      std::allocator<Node> alloc;
-      alloc.deallocate(child_.release(), num_edges_);
-    }
+  // Moves the children, the next sibling and the edges out of the node, so
+  // that it can be freed without recursion. @solid_size is set to the length of
+  // the solid children array, or to 0 when children form a linked list.
+  // All are pool indices, 0 when absent.
+  void ReleaseSubtrees(uint32_t* child, size_t* solid_size, uint32_t* sibling,
+                       uint32_t* edges) {
+    *solid_size = solid_children_ && child_ ? num_edges_ : 0;
+    *child = child_;
+    *sibling = sibling_;
+    *edges = edges_;
+    child_ = sibling_ = edges_ = 0;
   }
 
  private:
   // For each child, ensures that its parent pointer is pointing to this.
   void UpdateChildrenParents();
 
+  // Conversions between pool indices and pointers, 0 being nullptr.
+  static Node* FromIndex(uint32_t index);
+  static uint32_t ToIndex(const Node* node);
+  // Allocates and constructs a node in @pools, returns its index.
+  static uint32_t Allocate(NodePools* pools, Node* parent, uint16_t index);
+  Edge* GetEdges() const;
+  // Returns the edges to the pool.
+  void ReleaseEdges();
+
   // To minimize the number of padding bytes and to avoid having unnecessary
   // padding when new fields are added, we arrange the fields by size, largest
   // to smallest.
 
-  // 8 byte fields.
+  // 4 byte fields.
   // Average value (from value head of neural network) of all visited nodes in
   // subtree. For terminal nodes, eval is stored. This is from the perspective
   // of the player who "just" moved to reach this position, rather than from the
   // perspective of the player-to-move for the position.
   // WL stands for "W minus L". Is equal to Q if draw score is 0.
-  double wl_ = 0.0f;
-
-  // 8 byte fields on 64-bit platforms, 4 byte on 32-bit.
-  // Array of edges.
-  std::unique_ptr<Edge[]> edges_;
-  // Pointer to a parent node. nullptr for the root.
-  Node* parent_ = nullptr;
-  // Pointer to a first child. nullptr for a leaf node.
-  // As a 'hack' actually a unique_ptr to Node[] if solid_children.
-  std::unique_ptr<Node> child_;
-  // Pointer to a next sibling. nullptr if there are no further siblings.
-  // Also null in the solid case.
-  std::unique_ptr<Node> sibling_;
-
-  // 4 byte fields.
+  float wl_ = 0.0f;
   // Averaged draw probability. Works similarly to WL, except that D is not
   // flipped depending on the side to move.
   float d_ = 0.0f;
@@ -310,6 +312,16 @@ class Node {
   // but not finished). This value is added to n during selection which node
   // to pick in MCTS, and also when selecting the best move.
   uint32_t n_in_flight_ = 0;
+  // Index of the array of edges in the edge pool.
+  uint32_t edges_ = 0;
+  // Index of a parent node. 0 for the root.
+  uint32_t parent_ = 0;
+  // Index of a first child. 0 for a leaf node.
+  // The first of a contiguous run of num_edges_ nodes if solid_children.
+  uint32_t child_ = 0;
+  // Index of a next sibling. 0 if there are no further siblings.
+  // Also 0 in the solid case.
+  uint32_t sibling_ = 0;
 
   // 2 byte fields.
   // Index of this node is parent's edge list.
@@ -346,11 +358,46 @@ class Node {
 #endif
 
 // A basic sanity check. This must be adjusted when Node members are adjusted.
-#if defined(__i386__) || (defined(__arm__) && !defined(__aarch64__))
-static_assert(sizeof(Node) == 48, "Unexpected size of Node for 32bit compile");
-#else
-static_assert(sizeof(Node) == 64, "Unexpected size of Node");
-#endif
+// Getting to 32 bytes would mean moving the child links into the edges, which
+// costs more than it saves: searches create 30 to 40 edges per node.
+static_assert(sizeof(Node) == 40, "Unexpected size of Node");
+
+// Runs are limited by the number of edges of a node.
+using NodePool = IndexPool<Node, 255>;
+using EdgePool = IndexPool<Edge, 255>;
+
+// Pools holding the nodes and edge arrays of one tree. A node finds the pools
+// of its tree from its own address. The tree, the garbage collector and the
+// allocation caches of threads share ownership, so the memory is returned to
+// the system once the tree is gone and its nodes are collected.
+class NodePools : public std::enable_shared_from_this<NodePools> {
+ public:
+  // Memory is placed on NUMA node @numa_node, unless it is negative.
+  explicit NodePools(int numa_node = -1)
+      : nodes(this, numa_node), edges(this, numa_node) {}
+
+  // Whether the 32-bit node or edge indices of all trees are nearly used up.
+  // Searches stop then, as allocating past the reserve throws.
+  static bool IsNearlyExhausted() {
+    return NodePool::IsNearlyExhausted() || EdgePool::IsNearlyExhausted();
+  }
+
+  NodePool nodes;
+  EdgePool edges;
+};
+
+inline Node* Node::FromIndex(uint32_t index) {
+  return index ? NodePool::Get(index) : nullptr;
+}
+inline uint32_t Node::ToIndex(const Node* node) {
+  return node ? NodePool::IndexOf(node) : 0;
+}
+inline NodePools* Node::GetPools() const {
+  return static_cast<NodePools*>(NodePool::OwnerOf(this));
+}
+inline Edge* Node::GetEdges() const {
+  return edges_ ? EdgePool::Get(edges_) : nullptr;
+}
 
 // Contains Edge and Node pair and set of proxy functions to simplify access
 // to them.
@@ -436,8 +483,7 @@ class EdgeAndNode {
 template <bool is_const>
 class Edge_Iterator : public EdgeAndNode {
  public:
-  using Ptr = std::conditional_t<is_const, const std::unique_ptr<Node>*,
-                                 std::unique_ptr<Node>*>;
+  using Ptr = std::conditional_t<is_const, const uint32_t*, uint32_t*>;
 
   // Creates "end()" iterator.
   Edge_Iterator() {}
@@ -445,12 +491,12 @@ class Edge_Iterator : public EdgeAndNode {
   // Creates "begin()" iterator. Also happens to be a range constructor.
   // child_ptr will be nullptr if parent_node is solid children.
   Edge_Iterator(const Node& parent_node, Ptr child_ptr)
-      : EdgeAndNode(parent_node.edges_.get(), nullptr),
+      : EdgeAndNode(parent_node.GetEdges(), nullptr),
         node_ptr_(child_ptr),
         total_count_(parent_node.num_edges_) {
     if (edge_ && child_ptr != nullptr) Actualize();
     if (edge_ && child_ptr == nullptr) {
-      node_ = parent_node.child_.get();
+      node_ = Node::FromIndex(parent_node.child_);
     }
   }
 
@@ -488,17 +534,17 @@ class Edge_Iterator : public EdgeAndNode {
     //    node_ptr_ -> &Node(idx_.3).sibling_  ->  Node(idx_.7)
     // Here is how we do that:
     // 1. Store pointer to a node idx_.7:
-    //    node_ptr_ -> &Node(idx_.3).sibling_  ->  nullptr
+    //    node_ptr_ -> &Node(idx_.3).sibling_  ->  0
     //    tmp -> Node(idx_.7)
-    std::unique_ptr<Node> tmp = std::move(*node_ptr_);
+    const uint32_t tmp = *node_ptr_;
     // 2. Create fresh Node(idx_.5):
     //    node_ptr_ -> &Node(idx_.3).sibling_  ->  Node(idx_.5)
     //    tmp -> Node(idx_.7)
-    *node_ptr_ = std::make_unique<Node>(parent, current_idx_);
+    *node_ptr_ = Node::Allocate(parent->GetPools(), parent, current_idx_);
     // 3. Attach stored pointer back to a list:
     //    node_ptr_ ->
     //         &Node(idx_.3).sibling_ -> Node(idx_.5).sibling_ -> Node(idx_.7)
-    (*node_ptr_)->sibling_ = std::move(tmp);
+    Node::FromIndex(*node_ptr_)->sibling_ = tmp;
     // 4. Actualize:
     //    node_ -> &Node(idx_.5)
     //    node_ptr_ -> &Node(idx_.5).sibling_ -> Node(idx_.7)
@@ -514,21 +560,23 @@ class Edge_Iterator : public EdgeAndNode {
     // This is needed (and has to be 'while' rather than 'if') as other threads
     // could spawn new nodes between &node_ptr_ and *node_ptr_ while we didn't
     // see.
-    while (*node_ptr_ && (*node_ptr_)->index_ < current_idx_) {
-      node_ptr_ = &(*node_ptr_)->sibling_;
+    Node* node = Node::FromIndex(*node_ptr_);
+    while (node && node->index_ < current_idx_) {
+      node_ptr_ = &node->sibling_;
+      node = Node::FromIndex(*node_ptr_);
     }
     // If in the end node_ptr_ points to the node that we need, populate node_
     // and advance node_ptr_.
-    if (*node_ptr_ && (*node_ptr_)->index_ == current_idx_) {
-      node_ = (*node_ptr_).get();
+    if (node && node->index_ == current_idx_) {
+      node_ = node;
       node_ptr_ = &node_->sibling_;
     } else {
       node_ = nullptr;
     }
   }
 
-  // Pointer to a pointer to the next node. Has to be a pointer to pointer
-  // as we'd like to update it when spawning a new node.
+  // Pointer to the index of the next node. Has to be a pointer as we'd like
+  // to update it when spawning a new node.
   Ptr node_ptr_;
   uint16_t current_idx_ = 0;
   uint16_t total_count_ = 0;
@@ -591,7 +639,7 @@ class VisitedNode_Iterator {
       }
     } else {
       do {
-        node_ptr_ = node_ptr_->sibling_.get();
+        node_ptr_ = Node::FromIndex(node_ptr_->sibling_);
         // If n started is 0, can jump direct to end due to sorted policy
         // ensuring that each time a new edge becomes best for the first time,
         // it is always the first of the section at the end that has NStarted of
@@ -621,14 +669,34 @@ class VisitedNode_Iterator {
 };
 
 inline VisitedNode_Iterator<true> Node::VisitedNodes() const {
-  return {*this, child_.get()};
+  return {*this, FromIndex(child_)};
 }
 inline VisitedNode_Iterator<false> Node::VisitedNodes() {
-  return {*this, child_.get()};
+  return {*this, FromIndex(child_)};
 }
 
+// State of the background garbage collector which frees discarded subtrees.
+struct NodeGcStats {
+  // Subtrees waiting in the queue.
+  size_t queued_subtrees = 0;
+  // Approximate number of nodes in the queued subtrees.
+  size_t queued_nodes = 0;
+  // Total number of nodes freed so far.
+  size_t freed_nodes = 0;
+};
+NodeGcStats GetNodeGcStats();
+// Sets the number of garbage collector threads.
+void SetNodeGcThreads(int threads);
+
 class NodeTree {
  public:
+  // The nodes are placed on NUMA node @numa_node, unless it is negative.
+  explicit NodeTree(int numa_node = -1)
+      : pools_(std::make_shared<NodePools>(numa_node)) {}
+  // The tree owns its nodes through a plain pool index, so it must not be
+  // copied.
+  NodeTree(const NodeTree&) = delete;
+  NodeTree& operator=(const NodeTree&) = delete;
   ~NodeTree() { DeallocateTree(); }
   // Adds a move to current_head_.
   void MakeMove(Move move);
@@ -643,19 +711,24 @@ class NodeTree {
   // or if it's shorter than before.
   bool ResetToPosition(const std::string& starting_fen,
                        const std::vector<Move>& moves);
+  // Allocates and touches the pool memory for about @nodes nodes and their
+  // edges, so that searches don't pay for it until the tree grows beyond.
+  void ReservePools(size_t nodes);
   const Position& HeadPosition() const { return history_.Last(); }
   int GetPlyCount() const { return HeadPosition().GetGamePly(); }
   bool IsBlackToMove() const { return HeadPosition().IsBlackToMove(); }
   Node* GetCurrentHead() const { return current_head_; }
-  Node* GetGameBeginNode() const { return gamebegin_node_.get(); }
+  Node* GetGameBeginNode() const { return Node::FromIndex(gamebegin_node_); }
   const PositionHistory& GetPositionHistory() const { return history_; }
 
  private:
   void DeallocateTree();
   // A node which to start search from.
   Node* current_head_ = nullptr;
-  // Root node of a game tree.
-  std::unique_ptr<Node> gamebegin_node_;
+  // Pools holding the nodes of this tree.
+  std::shared_ptr<NodePools> pools_;
+  // Pool index of the root node of a game tree.
+  uint32_t gamebegin_node_ = 0;
   PositionHistory history_;
 };
 
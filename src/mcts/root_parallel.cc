@@ -0,0 +1,292 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+
+#include "mcts/root_parallel.h"
+
+#include <algorithm>
+
+#include "mcts/stoppers/stoppers.h"
+#include "utils/numa.h"
+
+namespace lczero {
+
+namespace {
+// Minimum time between two merges of the statistics for the stoppers.
+const int kMergeIntervalMs = 10;
+
+// Merges the root moves of all trees into those of the first tree with an
+// expanded root, keeping its edge order.
+std::vector<RootMoveStats> MergeRootMoves(
+    const std::vector<std::vector<RootMoveStats>>& trees) {
+  std::vector<RootMoveStats> merged;
+  for (const auto& moves : trees) {
+    if (merged.empty()) {
+      merged = moves;
+      continue;
+    }
+    for (size_t i = 0; i < moves.size(); i++) {
+      // Trees of the same position usually have their edges in the same
+      // order.
+      size_t j = i;
+      if (j >= merged.size() || !(merged[j].move == moves[i].move)) {
+        j = std::find_if(merged.begin(), merged.end(),
+                         [&](const auto& m) {
+                           return m.move == moves[i].move;
+                         }) -
+            merged.begin();
+        if (j == merged.size()) continue;
+      }
+      merged[j].Merge(moves[i]);
+    }
+  }
+  return merged;
+}
+
+// Forwards the responses of the lead search to the root-parallel search.
+class LeadResponder : public UciResponder {
+ public:
+  using InfoCallback = std::function<void(std::vector<ThinkingInfo>*)>;
+  using BestMoveCallback = std::function<void(const BestMoveInfo&)>;
+
+  LeadResponder(InfoCallback info, BestMoveCallback bestmove)
+      : info_(info), bestmove_(bestmove) {}
+  void OutputBestMove(BestMoveInfo* info) override { bestmove_(*info); }
+  void OutputThinkingInfo(std::vector<ThinkingInfo>* infos) override {
+    info_(infos);
+  }
+
+ private:
+  const InfoCallback info_;
+  const BestMoveCallback bestmove_;
+};
+}  // namespace
+
+RootParallelSearch::RootParallelSearch(
+    const NodeTree& lead_tree, Network* network, NNCache* cache,
+    const std::vector<SearchTreeShard*>& shards,
+    std::unique_ptr<UciResponder> uci_responder, const MoveList& searchmoves,
+    std::chrono::steady_clock::time_point start_time,
+    std::unique_ptr<SearchStopper> stopper, bool infinite, bool ponder,
+    const OptionsDict& options, Bitbase* bitbase)
+    : uci_responder_(std::move(uci_responder)) {
+  trees_.push_back(&lead_tree);
+  searches_.push_back(std::make_unique<Search>(
+      lead_tree, network,
+      std::make_unique<LeadResponder>(
+          [this](std::vector<ThinkingInfo>* infos) { OnLeadInfo(infos); },
+          [this](const BestMoveInfo& info) { OnLeadBestMove(info); }),
+      searchmoves, start_time, std::move(stopper), infinite, ponder, options,
+      cache, bitbase));
+  searches_[0]->SetIterationStatsMerger(
+      [this](IterationStats* stats) { MergeIterationStats(stats); });
+  for (auto* shard : shards) {
+    trees_.push_back(shard->tree.get());
+    // The other trees have no stoppers of their own, they run until the lead
+    // search is over, and the lead stoppers see their statistics. Their
+    // responses are dropped.
+    searches_.push_back(std::make_unique<Search>(
+        *shard->tree, shard->network ? shard->network.get() : network,
+        std::make_unique<CallbackUciResponder>(
+            [](const BestMoveInfo&) {},
+            [](const std::vector<ThinkingInfo>&) {}),
+        searchmoves, start_time, std::make_unique<ChainedSearchStopper>(),
+        false, false, options, &shard->cache, bitbase));
+  }
+}
+
+RootParallelSearch::~RootParallelSearch() {
+  Abort();
+  Wait();
+}
+
+int RootParallelSearch::GetTreeNumaNode(int tree, int trees) {
+  const int numa_nodes = Numa::GetNodeCount();
+  return trees > 1 && trees <= numa_nodes ? tree : -1;
+}
+
+void RootParallelSearch::StartThreads(size_t threads_per_tree) {
+  for (size_t i = 0; i < searches_.size(); i++) {
+    // Worker threads inherit the affinity of the thread which starts them.
+    std::thread([&, i]() {
+      const int numa_node = GetTreeNumaNode(i, searches_.size());
+      if (numa_node >= 0) Numa::BindThreadToNode(numa_node);
+      searches_[i]->StartThreads(threads_per_tree);
+    }).join();
+  }
+  Mutex::Lock lock(threads_mutex_);
+  coordinator_ = std::thread([this]() { CoordinatorThread(); });
+}
+
+void RootParallelSearch::Stop() { searches_[0]->Stop(); }
+
+void RootParallelSearch::Abort() {
+  {
+    Mutex::Lock lock(mutex_);
+    aborted_ = true;
+  }
+  cv_.notify_all();
+  for (auto& search : searches_) search->Abort();
+}
+
+void RootParallelSearch::Wait() {
+  Mutex::Lock lock(threads_mutex_);
+  if (coordinator_.joinable()) coordinator_.join();
+  for (auto& search : searches_) search->Wait();
+}
+
+bool RootParallelSearch::IsSearchActive() const {
+  return searches_[0]->IsSearchActive();
+}
+
+int64_t RootParallelSearch::GetTotalPlayouts() const {
+  int64_t playouts = 0;
+  for (const auto& search : searches_) playouts += search->GetTotalPlayouts();
+  return playouts;
+}
+
+void RootParallelSearch::OnLeadInfo(std::vector<ThinkingInfo>* infos) {
+  // Report the nodes of all trees, and the nps scaled accordingly.
+  int64_t other_playouts = 0;
+  for (size_t i = 1; i < searches_.size(); i++) {
+    other_playouts += searches_[i]->GetTotalPlayouts();
+  }
+  for (auto& info : *infos) {
+    if (info.nodes > 0 && info.nps > 0) {
+      info.nps = static_cast<int>(info.nps * (info.nodes + other_playouts) /
+                                  info.nodes);
+    }
+    if (info.nodes >= 0) info.nodes += other_playouts;
+  }
+  uci_responder_->OutputThinkingInfo(infos);
+}
+
+void RootParallelSearch::OnLeadBestMove(const BestMoveInfo& info) {
+  {
+    Mutex::Lock lock(mutex_);
+    lead_bestmove_ = info;
+  }
+  cv_.notify_all();
+}
+
+void RootParallelSearch::CoordinatorThread() {
+  BestMoveInfo lead_bestmove{Move()};
+  {
+    Mutex::Lock lock(mutex_);
+    while (!aborted_ && !lead_bestmove_) cv_.wait(lock.get_raw());
+    if (aborted_) return;
+    lead_bestmove = *lead_bestmove_;
+  }
+  for (size_t i = 1; i < searches_.size(); i++) searches_[i]->Abort();
+  for (auto& search : searches_) search->Wait();
+  BestMoveInfo bestmove = GetMergedBestMove();
+  // Nothing was searched, e.g. the search was stopped right away.
+  if (bestmove.bestmove == Move()) bestmove = lead_bestmove;
+  LOGFILE << "Root-parallel search of " << searches_.size()
+          << " trees: lead tree chose " << lead_bestmove.bestmove.as_string()
+          << ", merged statistics chose " << bestmove.bestmove.as_string();
+  uci_responder_->OutputBestMove(&bestmove);
+}
+
+void RootParallelSearch::MergeIterationStats(IterationStats* stats) {
+  Mutex::Lock lock(merge_mutex_);
+  const auto now = std::chrono::steady_clock::now();
+  if (now >= next_merge_) {
+    next_merge_ = now + std::chrono::milliseconds(kMergeIntervalMs);
+    other_nodes_ = other_playouts_ = other_batches_ = other_depth_sum_ = 0;
+    std::vector<std::vector<RootMoveStats>> tree_moves;
+    tree_moves.push_back(searches_[0]->GetRootMoveStats());
+    for (size_t i = 1; i < searches_.size(); i++) {
+      IterationStats tree_stats;
+      searches_[i]->PopulateCommonIterationStats(&tree_stats);
+      other_nodes_ += tree_stats.total_nodes;
+      other_playouts_ += tree_stats.nodes_since_movestart;
+      other_batches_ += tree_stats.batches_since_movestart;
+      other_depth_sum_ += static_cast<int64_t>(tree_stats.average_depth) *
+                          tree_stats.nodes_since_movestart;
+      tree_moves.push_back(searches_[i]->GetRootMoveStats());
+    }
+    merged_moves_.clear();
+    if (!tree_moves[0].empty()) {
+      merged_moves_ = MergeRootMoves(tree_moves);
+      merged_moves_.resize(
+          std::min<size_t>(merged_moves_.size(), RootEdgeVisits::kMaxEdges));
+      for (size_t i = 0; i < merged_moves_.size(); i++) {
+        merged_visits_.Set(i, merged_moves_[i].n);
+      }
+      searches_[0]->PopulateRootIterationStats(merged_moves_,
+                                               &merged_root_stats_);
+    }
+  }
+
+  const int64_t depth_sum = static_cast<int64_t>(stats->average_depth) *
+                                stats->nodes_since_movestart +
+                            other_depth_sum_;
+  stats->total_nodes += other_nodes_;
+  stats->nodes_since_movestart += other_playouts_;
+  stats->batches_since_movestart += other_batches_;
+  if (stats->nodes_since_movestart > 0) {
+    stats->average_depth = depth_sum / stats->nodes_since_movestart;
+  }
+  if (!merged_moves_.empty() &&
+      stats->num_root_edges == static_cast<int>(merged_moves_.size())) {
+    stats->root_edge_visits = &merged_visits_;
+    stats->win_found = merged_root_stats_.win_found;
+    stats->may_resign = merged_root_stats_.may_resign;
+    stats->num_losing_edges = merged_root_stats_.num_losing_edges;
+    stats->time_usage_hint_ = merged_root_stats_.time_usage_hint_;
+  }
+}
+
+BestMoveInfo RootParallelSearch::GetMergedBestMove() const {
+  std::vector<std::vector<RootMoveStats>> tree_moves;
+  for (const auto& search : searches_) {
+    tree_moves.push_back(search->GetRootMoveStats());
+  }
+  const auto merged = MergeRootMoves(tree_moves);
+  const int best = searches_[0]->ChooseRootMove(merged);
+  if (best < 0) return BestMoveInfo(Move());
+  const Move move = merged[best].move;
+
+  // The ponder move comes from the tree which searched the move most.
+  size_t ponder_tree = 0;
+  uint32_t ponder_tree_n = 0;
+  for (size_t i = 0; i < tree_moves.size(); i++) {
+    for (const auto& stats : tree_moves[i]) {
+      if (stats.move == move && stats.n > ponder_tree_n) {
+        ponder_tree = i;
+        ponder_tree_n = stats.n;
+      }
+    }
+  }
+  const Move ponder = searches_[ponder_tree]->GetPonderMove(move);
+  Move bestmove = move;
+  if (trees_[0]->IsBlackToMove()) bestmove.Mirror();
+  return BestMoveInfo(bestmove, ponder);
+}
+
+}  // namespace lczero
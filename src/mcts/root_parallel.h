@@ -0,0 +1,132 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "mcts/search.h"
+
+namespace lczero {
+
+// An additional search tree of a root-parallel search, with its own NN cache
+// and optionally its own backend. Kept between moves, so that the tree can be
+// reused.
+struct SearchTreeShard {
+  std::unique_ptr<NodeTree> tree;
+  NNCache cache;
+  // Own backend instance, or nullptr to share the lead tree's one.
+  std::unique_ptr<Network> network;
+};
+
+// Searches the same position in several independent trees, typically one per
+// NUMA node, so that selection and backup never touch memory or locks of
+// another node. The first (lead) tree is searched with the time manager's
+// stoppers, which see the root statistics of all trees merged every few
+// milliseconds; the other trees are searched until the lead search stops. The
+// root move statistics of all trees are then merged to choose the move, by the
+// rules a single search uses.
+class RootParallelSearch {
+ public:
+  // All trees of @shards must be set to the position of @lead_tree.
+  RootParallelSearch(const NodeTree& lead_tree, Network* network,
+                     NNCache* cache,
+                     const std::vector<SearchTreeShard*>& shards,
+                     std::unique_ptr<UciResponder> uci_responder,
+                     const MoveList& searchmoves,
+                     std::chrono::steady_clock::time_point start_time,
+                     std::unique_ptr<SearchStopper> stopper, bool infinite,
+                     bool ponder, const OptionsDict& options,
+                     Bitbase* bitbase);
+
+  ~RootParallelSearch();
+
+  // Starts @threads_per_tree worker threads in every tree and returns
+  // immediately. Tree i runs on NUMA node i, see GetTreeNumaNode().
+  void StartThreads(size_t threads_per_tree);
+
+  // Stops search. At the end the merged bestmove will be returned. Not
+  // blocking.
+  void Stop();
+  // Stops search, but does not return bestmove. Not blocking.
+  void Abort();
+  // Blocks until all trees are done and the bestmove is sent.
+  void Wait();
+  // Returns whether the lead search is active.
+  bool IsSearchActive() const;
+  // Returns the total number of playouts in all trees.
+  int64_t GetTotalPlayouts() const;
+
+  // Returns the NUMA node that tree @tree of @trees runs on. -1 for a single
+  // tree, or more trees than nodes: stacking trees round-robin would leave
+  // some nodes with more trees than others.
+  static int GetTreeNumaNode(int tree, int trees);
+
+ private:
+  void OnLeadInfo(std::vector<ThinkingInfo>* infos);
+  void OnLeadBestMove(const BestMoveInfo& info);
+  // Waits for the lead search to finish, stops the other trees and sends the
+  // merged bestmove.
+  void CoordinatorThread();
+  // Adds the statistics of the other trees to @stats of the lead tree. They
+  // are collected at most every kMergeIntervalMs.
+  void MergeIterationStats(IterationStats* stats);
+  // Chooses the move from the root statistics merged over all trees.
+  BestMoveInfo GetMergedBestMove() const;
+
+  std::vector<const NodeTree*> trees_;
+  std::vector<std::unique_ptr<Search>> searches_;
+  const std::unique_ptr<UciResponder> uci_responder_;
+
+  mutable Mutex mutex_;
+  std::condition_variable cv_;
+  std::optional<BestMoveInfo> lead_bestmove_ GUARDED_BY(mutex_);
+  bool aborted_ GUARDED_BY(mutex_) = false;
+
+  Mutex threads_mutex_;
+  std::thread coordinator_ GUARDED_BY(threads_mutex_);
+
+  Mutex merge_mutex_;
+  std::chrono::steady_clock::time_point next_merge_ GUARDED_BY(merge_mutex_);
+  // Counters summed over the other trees.
+  int64_t other_nodes_ GUARDED_BY(merge_mutex_) = 0;
+  int64_t other_playouts_ GUARDED_BY(merge_mutex_) = 0;
+  int64_t other_batches_ GUARDED_BY(merge_mutex_) = 0;
+  int64_t other_depth_sum_ GUARDED_BY(merge_mutex_) = 0;
+  // Root moves of all trees merged in the edge order of the lead tree, empty
+  // while its root is not expanded, and the stats computed from them.
+  std::vector<RootMoveStats> merged_moves_ GUARDED_BY(merge_mutex_);
+  IterationStats merged_root_stats_ GUARDED_BY(merge_mutex_);
+  RootEdgeVisits merged_visits_;
+};
+
+}  // namespace lczero
@@ -81,6 +81,12 @@ class MEvaluator {
         parent_within_threshold_{parent ? WithinThreshold(parent, q_threshold_)
                                         : false} {}
 
+  MEvaluator(const SearchParams& params, const RootMoveStats& parent)
+      : MEvaluator(params) {
+    parent_m_ = parent.m;
+    parent_within_threshold_ = std::abs(parent.wl) > q_threshold_;
+  }
+
   void SetParent(const Node* parent) {
     assert(parent);
     if (enabled_) {
@@ -91,8 +97,11 @@ class MEvaluator {
 
   // Calculates the utility for favoring shorter wins and longer losses.
   float GetMUtility(Node* child, float q) const {
+    return GetMUtility(child->GetM(), q);
+  }
+
+  float GetMUtility(float child_m, float q) const {
     if (!enabled_ || !parent_within_threshold_) return 0.0f;
-    const float child_m = child->GetM();
     float m = std::clamp(m_slope_ * (child_m - parent_m_), -m_cap_, m_cap_);
     m *= FastSign(-q);
     if (q_threshold_ > 0.0f && q_threshold_ < 1.0f) {
@@ -110,6 +119,12 @@ class MEvaluator {
     return GetMUtility(child.node(), q);
   }
 
+  float GetMUtility(const RootMoveStats& child, float q) const {
+    if (!enabled_ || !parent_within_threshold_) return 0.0f;
+    if (child.GetN() == 0) return GetDefaultMUtility();
+    return GetMUtility(child.m, q);
+  }
+
   // The M utility to use for unvisited nodes.
   float GetDefaultMUtility() const { return 0.0f; }
 
@@ -131,16 +146,45 @@ class MEvaluator {
 
 }  // namespace
 
+void RootMoveStats::Merge(const RootMoveStats& other) {
+  bounds = {std::max(bounds.first, other.bounds.first),
+            std::min(bounds.second, other.bounds.second)};
+  const uint32_t total = n + other.n;
+  if (other.terminal && !terminal) {
+    wl = other.wl;
+    d = other.d;
+    m = other.m;
+    terminal = true;
+    tb_terminal = other.tb_terminal;
+  } else if (!terminal && total > 0) {
+    wl = (wl * n + other.wl * other.n) / total;
+    d = (d * n + other.d * other.n) / total;
+    m = (m * n + other.m * other.n) / total;
+  }
+  n = total;
+  // The bounds of different trees can meet without either tree proving the
+  // result.
+  if (!terminal && n > 0 && bounds.first == bounds.second) {
+    terminal = true;
+    wl = bounds.first == GameResult::WHITE_WON   ? 1.0f
+         : bounds.first == GameResult::BLACK_WON ? -1.0f
+                                                 : 0.0f;
+    d = bounds.first == GameResult::DRAW ? 1.0f : 0.0f;
+  }
+}
+
 Search::Search(const NodeTree& tree, Network* network,
                std::unique_ptr<UciResponder> uci_responder,
                const MoveList& searchmoves,
                std::chrono::steady_clock::time_point start_time,
                std::unique_ptr<SearchStopper> stopper, bool infinite,
-               bool ponder, const OptionsDict& options, NNCache* cache)
+               bool ponder, const OptionsDict& options, NNCache* cache,
+               Bitbase* bitbase)
     : ok_to_respond_bestmove_(!infinite && !ponder),
       stopper_(std::move(stopper)),
       root_node_(tree.GetCurrentHead()),
       cache_(cache),
+      bitbase_(bitbase),
       played_history_(tree.GetPositionHistory()),
       network_(network),
       params_(options),
@@ -153,6 +197,11 @@ Search::Search(const NodeTree& tree, Network* network,
     pending_searchers_.store(params_.GetMaxConcurrentSearchers(),
                              std::memory_order_release);
   }
+  std::vector<uint32_t> root_visits;
+  for (const auto& edge : root_node_->Edges()) {
+    root_visits.push_back(edge.GetN());
+  }
+  root_edge_visits_.Reset(root_visits);
   contempt_mode_ = params_.GetContemptMode();
   // Make sure the contempt mode is never "play" beyond this point.
   if (contempt_mode_ == ContemptMode::PLAY) {
@@ -267,7 +316,7 @@ void Search::SendUciInfo() REQUIRES(nodes_mutex_) REQUIRES(counters_mutex_) {
       common_info.nps = total_playouts_ * 1000 / time_since_first_batch_ms;
     }
   }
-  common_info.tb_hits = 0;
+  common_info.tb_hits = tb_hits_.load(std::memory_order_acquire);
 
   int multipv = 0;
   const auto default_q = -root_node_->GetQ(-draw_score);
@@ -427,6 +476,94 @@ inline float GetFpu(const SearchParams& params, Node* node, bool is_root_node,
              : -node->GetQ(-draw_score) - value * std::sqrt(visited_pol);
 }
 
+// Version for when only the Q of the node is at hand.
+inline float GetFpu(const SearchParams& params, float q, bool is_root_node,
+                    float visited_pol) {
+  const auto value = params.GetFpuValue(is_root_node);
+  return params.GetFpuAbsolute(is_root_node)
+             ? value
+             : -q - value * std::sqrt(visited_pol);
+}
+
+// Fills the statistics of @move that come from its node.
+void SetRootMoveNodeStats(const Node* node, RootMoveStats* move) {
+  move->n = node ? node->GetN() : 0;
+  // Not safe to access IsTerminal if GetN is 0.
+  if (move->n > 0) {
+    move->wl = node->GetWL();
+    move->d = node->GetD();
+    move->m = node->GetM();
+    move->terminal = node->IsTerminal();
+    move->tb_terminal = node->IsTbTerminal();
+    move->bounds = node->GetBounds();
+  }
+}
+
+// Returns whether @a is a better move than @b, when choosing without
+// temperature. T is EdgeAndNode or RootMoveStats.
+template <typename T>
+bool IsBetterMove(const T& a, const T& b, float draw_score) {
+  // Lists edge types from less desirable to more desirable.
+  enum EdgeRank {
+    kTerminalLoss,
+    kTablebaseLoss,
+    kNonTerminal,  // Non terminal or terminal draw.
+    kTablebaseWin,
+    kTerminalWin,
+  };
+
+  auto GetEdgeRank = [](const T& edge) {
+    // This default isn't used as wl only checked for case edge is terminal.
+    const auto wl = edge.GetWL(0.0f);
+    // Not safe to access IsTerminal if GetN is 0.
+    if (edge.GetN() == 0 || !edge.IsTerminal() || !wl) {
+      return kNonTerminal;
+    }
+    if (edge.IsTbTerminal()) {
+      return wl < 0.0 ? kTablebaseLoss : kTablebaseWin;
+    }
+    return wl < 0.0 ? kTerminalLoss : kTerminalWin;
+  };
+
+  // If moves have different outcomes, prefer better outcome.
+  const auto a_rank = GetEdgeRank(a);
+  const auto b_rank = GetEdgeRank(b);
+  if (a_rank != b_rank) return a_rank > b_rank;
+
+  // If both are terminal draws, try to make it shorter.
+  // Not safe to access IsTerminal if GetN is 0.
+  if (a_rank == kNonTerminal && a.GetN() != 0 && b.GetN() != 0 &&
+      a.IsTerminal() && b.IsTerminal()) {
+    if (a.IsTbTerminal() != b.IsTbTerminal()) {
+      // Prefer non-tablebase draws.
+      return a.IsTbTerminal() < b.IsTbTerminal();
+    }
+    // Prefer shorter draws.
+    return a.GetM(0.0f) < b.GetM(0.0f);
+  }
+
+  // Neither is terminal, use standard rule.
+  if (a_rank == kNonTerminal) {
+    // Prefer largest playouts then eval then prior.
+    if (a.GetN() != b.GetN()) return a.GetN() > b.GetN();
+    // Default doesn't matter here so long as they are the same as either
+    // both are N==0 (thus we're comparing equal defaults) or N!=0 and
+    // default isn't used.
+    if (a.GetQ(0.0f, draw_score) != b.GetQ(0.0f, draw_score)) {
+      return a.GetQ(0.0f, draw_score) > b.GetQ(0.0f, draw_score);
+    }
+    return a.GetP() > b.GetP();
+  }
+
+  // Both variants are winning, prefer shortest win.
+  if (a_rank > kNonTerminal) {
+    return a.GetM(0.0f) < b.GetM(0.0f);
+  }
+
+  // Both variants are losing, prefer longest losses.
+  return a.GetM(0.0f) > b.GetM(0.0f);
+}
+
 inline float ComputeCpuct(const SearchParams& params, uint32_t N,
                           bool is_root_node) {
   const float init = params.GetCpuct(is_root_node);
@@ -598,7 +735,14 @@ void Search::MaybeTriggerStop(const IterationStats& stats,
   if (total_playouts_ + initial_visits_ == 0) return;
 
   if (!stop_.load(std::memory_order_acquire)) {
-    if (stopper_->ShouldStop(stats, hints)) FireStopInternal();
+    if (stopper_->ShouldStop(stats, hints)) {
+      FireStopInternal();
+    } else if (NodePools::IsNearlyExhausted()) {
+      // A tree of some 100M nodes, stop like at the visits limit rather than
+      // failing the next allocation in a worker thread.
+      LOGFILE << "Stopped search: Node or edge indices are nearly exhausted.";
+      FireStopInternal();
+    }
   }
 
   // If we are the first to see that stop is needed.
@@ -660,6 +804,19 @@ void Search::EnsureBestMoveKnown() REQUIRES(nodes_mutex_)
   if (root_node_->GetN() == 0) return;
   if (!root_node_->HasChildren()) return;
 
+  const float temperature = GetTemperature();
+  auto bestmove_edge = temperature
+                           ? GetBestRootChildWithTemperature(temperature)
+                           : GetBestChildNoTemperature(root_node_, 0);
+  final_bestmove_ = bestmove_edge.GetMove(played_history_.IsBlackToMove());
+
+  if (bestmove_edge.GetN() > 0 && bestmove_edge.node()->HasChildren()) {
+    final_pondermove_ = GetBestChildNoTemperature(bestmove_edge.node(), 1)
+                            .GetMove(!played_history_.IsBlackToMove());
+  }
+}
+
+float Search::GetTemperature() const {
   float temperature = params_.GetTemperature();
   const int cutoff_move = params_.GetTemperatureCutoffMove();
   const int decay_delay_moves = params_.GetTempDecayDelayMoves();
@@ -681,18 +838,105 @@ void Search::EnsureBestMoveKnown() REQUIRES(nodes_mutex_)
       temperature = params_.GetTemperatureEndgame();
     }
   }
+  return temperature;
+}
 
-  auto bestmove_edge = temperature
-                           ? GetBestRootChildWithTemperature(temperature)
-                           : GetBestChildNoTemperature(root_node_, 0);
-  final_bestmove_ = bestmove_edge.GetMove(played_history_.IsBlackToMove());
+std::vector<RootMoveStats> Search::GetRootMoveStats() const {
+  SharedMutex::SharedLock lock(nodes_mutex_);
+  std::vector<RootMoveStats> moves;
+  if (root_node_->GetN() == 0) return moves;
+  for (const auto& edge : root_node_->Edges()) {
+    RootMoveStats move;
+    move.move = edge.GetMove();
+    move.p = edge.GetP();
+    SetRootMoveNodeStats(edge.node(), &move);
+    moves.push_back(move);
+  }
+  return moves;
+}
 
-  if (bestmove_edge.GetN() > 0 && bestmove_edge.node()->HasChildren()) {
-    final_pondermove_ = GetBestChildNoTemperature(bestmove_edge.node(), 1)
-                            .GetMove(!played_history_.IsBlackToMove());
+RootMoveStats Search::GetRootNodeStats() const {
+  RootMoveStats root;
+  root.n = root_node_->GetN();
+  root.wl = root_node_->GetWL();
+  root.d = root_node_->GetD();
+  root.m = root_node_->GetM();
+  return root;
+}
+
+void Search::RefreshRootMoves() {
+  const auto& changed = root_changes_.Collect(&root_edge_visits_);
+  const size_t num_edges = root_node_->GetNumEdges();
+  const bool moved = root_children_moved_.exchange(false);
+  if (root_moves_.size() != num_edges || moved) {
+    root_moves_.clear();
+    root_children_.clear();
+    for (const auto& edge : root_node_->Edges()) {
+      RootMoveStats move;
+      move.move = edge.GetMove();
+      move.p = edge.GetP();
+      SetRootMoveNodeStats(edge.node(), &move);
+      root_moves_.push_back(move);
+      root_children_.push_back(edge.node());
+    }
+    return;
+  }
+  for (const int i : changed) {
+    if (i >= static_cast<int>(num_edges)) continue;
+    if (!root_children_[i]) {
+      // Spawned since the children were looked up.
+      int j = 0;
+      for (const auto& edge : root_node_->Edges()) {
+        root_children_[j++] = edge.node();
+      }
+    }
+    SetRootMoveNodeStats(root_children_[i], &root_moves_[i]);
   }
 }
 
+int Search::ChooseRootMove(const std::vector<RootMoveStats>& moves) const {
+  SharedMutex::SharedLock lock(nodes_mutex_);
+  if (root_node_->GetN() == 0) return -1;
+  std::vector<RootMoveStats> allowed;
+  std::vector<int> indices;
+  for (size_t i = 0; i < moves.size(); i++) {
+    if (!root_move_filter_.empty() &&
+        std::find(root_move_filter_.begin(), root_move_filter_.end(),
+                  moves[i].move) == root_move_filter_.end()) {
+      continue;
+    }
+    allowed.push_back(moves[i]);
+    indices.push_back(i);
+  }
+  if (allowed.empty()) return -1;
+  const float temperature = GetTemperature();
+  if (temperature) return indices[PickWithTemperature(allowed, temperature)];
+  const float draw_score = GetDrawScore(/* is_odd_depth= */ false);
+  const auto best =
+      std::min_element(allowed.begin(), allowed.end(),
+                       [draw_score](const auto& a, const auto& b) {
+                         return IsBetterMove(a, b, draw_score);
+                       });
+  return indices[best - allowed.begin()];
+}
+
+Move Search::GetPonderMove(Move move) const {
+  SharedMutex::SharedLock lock(nodes_mutex_);
+  if (root_node_->GetN() == 0) return Move();
+  for (auto& edge : root_node_->Edges()) {
+    if (!(edge.GetMove() == move)) continue;
+    if (edge.GetN() == 0 || !edge.node()->HasChildren()) break;
+    return GetBestChildNoTemperature(edge.node(), 1)
+        .GetMove(!played_history_.IsBlackToMove());
+  }
+  return Move();
+}
+
+void Search::SetIterationStatsMerger(
+    std::function<void(IterationStats*)> merger) {
+  stats_merger_ = std::move(merger);
+}
+
 // Returns @count children with most visits.
 std::vector<EdgeAndNode> Search::GetBestChildrenNoTemperature(Node* parent,
                                                               int count,
@@ -720,72 +964,10 @@ std::vector<EdgeAndNode> Search::GetBestChildrenNoTemperature(Node* parent,
   const auto middle = (static_cast<int>(edges.size()) > count)
                           ? edges.begin() + count
                           : edges.end();
-  std::partial_sort(
-      edges.begin(), middle, edges.end(),
-      [draw_score](const auto& a, const auto& b) {
-        // The function returns "true" when a is preferred to b.
-
-        // Lists edge types from less desirable to more desirable.
-        enum EdgeRank {
-          kTerminalLoss,
-          kTablebaseLoss,
-          kNonTerminal,  // Non terminal or terminal draw.
-          kTablebaseWin,
-          kTerminalWin,
-        };
-
-        auto GetEdgeRank = [](const EdgeAndNode& edge) {
-          // This default isn't used as wl only checked for case edge is
-          // terminal.
-          const auto wl = edge.GetWL(0.0f);
-          // Not safe to access IsTerminal if GetN is 0.
-          if (edge.GetN() == 0 || !edge.IsTerminal() || !wl) {
-            return kNonTerminal;
-          }
-          if (edge.IsTbTerminal()) {
-            return wl < 0.0 ? kTablebaseLoss : kTablebaseWin;
-          }
-          return wl < 0.0 ? kTerminalLoss : kTerminalWin;
-        };
-
-        // If moves have different outcomes, prefer better outcome.
-        const auto a_rank = GetEdgeRank(a);
-        const auto b_rank = GetEdgeRank(b);
-        if (a_rank != b_rank) return a_rank > b_rank;
-
-        // If both are terminal draws, try to make it shorter.
-        // Not safe to access IsTerminal if GetN is 0.
-        if (a_rank == kNonTerminal && a.GetN() != 0 && b.GetN() != 0 &&
-            a.IsTerminal() && b.IsTerminal()) {
-          if (a.IsTbTerminal() != b.IsTbTerminal()) {
-            // Prefer non-tablebase draws.
-            return a.IsTbTerminal() < b.IsTbTerminal();
-          }
-          // Prefer shorter draws.
-          return a.GetM(0.0f) < b.GetM(0.0f);
-        }
-
-        // Neither is terminal, use standard rule.
-        if (a_rank == kNonTerminal) {
-          // Prefer largest playouts then eval then prior.
-          if (a.GetN() != b.GetN()) return a.GetN() > b.GetN();
-          // Default doesn't matter here so long as they are the same as either
-          // both are N==0 (thus we're comparing equal defaults) or N!=0 and
-          // default isn't used.
-          if (a.GetQ(0.0f, draw_score) != b.GetQ(0.0f, draw_score)) {
-            return a.GetQ(0.0f, draw_score) > b.GetQ(0.0f, draw_score);
-          }
-          return a.GetP() > b.GetP();
-        }
-
-        // Both variants are winning, prefer shortest win.
-        if (a_rank > kNonTerminal) {
-          return a.GetM(0.0f) < b.GetM(0.0f);
-        }
-
-        // Both variants are losing, prefer longest losses.
-        return a.GetM(0.0f) > b.GetM(0.0f);
-      });
+  std::partial_sort(edges.begin(), middle, edges.end(),
+                    [draw_score](const auto& a, const auto& b) {
+                      return IsBetterMove(a, b, draw_score);
+                    });
 
   if (count < static_cast<int>(edges.size())) {
     edges.resize(count);
@@ -802,10 +984,26 @@ EdgeAndNode Search::GetBestChildNoTemperature(Node* parent, int depth) const {
 // Returns a child of a root chosen according to weighted-by-temperature visit
 // count.
 EdgeAndNode Search::GetBestRootChildWithTemperature(float temperature) const {
+  std::vector<EdgeAndNode> edges;
+  for (auto& edge : root_node_->Edges()) {
+    if (!root_move_filter_.empty() &&
+        std::find(root_move_filter_.begin(), root_move_filter_.end(),
+                  edge.GetMove()) == root_move_filter_.end()) {
+      continue;
+    }
+    edges.push_back(edge);
+  }
+  return edges[PickWithTemperature(edges, temperature)];
+}
+
+template <typename T>
+size_t Search::PickWithTemperature(const std::vector<T>& moves,
+                                   float temperature) const {
   // Root is at even depth.
   const float draw_score = GetDrawScore(/* is_odd_depth= */ false);
 
   std::vector<float> cumulative_sums;
+  std::vector<size_t> indices;
   float sum = 0.0;
   float max_n = 0.0;
   const float offset = params_.GetTemperatureVisitOffset();
@@ -813,54 +1011,35 @@ EdgeAndNode Search::GetBestRootChildWithTemperature(float temperature) const {
   const float fpu =
       GetFpu(params_, root_node_, /* is_root= */ true, draw_score);
 
-  for (auto& edge : root_node_->Edges()) {
-    if (!root_move_filter_.empty() &&
-        std::find(root_move_filter_.begin(), root_move_filter_.end(),
-                  edge.GetMove()) == root_move_filter_.end()) {
-      continue;
-    }
-    if (edge.GetN() + offset > max_n) {
-      max_n = edge.GetN() + offset;
-      max_eval = edge.GetQ(fpu, draw_score);
+  for (const auto& move : moves) {
+    if (move.GetN() + offset > max_n) {
+      max_n = move.GetN() + offset;
+      max_eval = move.GetQ(fpu, draw_score);
     }
   }
 
   // TODO(crem) Simplify this code when samplers.h is merged.
   const float min_eval =
       max_eval - params_.GetTemperatureWinpctCutoff() / 50.0f;
-  for (auto& edge : root_node_->Edges()) {
-    if (!root_move_filter_.empty() &&
-        std::find(root_move_filter_.begin(), root_move_filter_.end(),
-                  edge.GetMove()) == root_move_filter_.end()) {
-      continue;
-    }
-    if (edge.GetQ(fpu, draw_score) < min_eval) continue;
+  for (size_t i = 0; i < moves.size(); i++) {
+    const auto& move = moves[i];
+    if (move.GetQ(fpu, draw_score) < min_eval) continue;
     sum += std::pow(
         std::max(0.0f,
                  (max_n <= 0.0f
-                      ? edge.GetP()
-                      : ((static_cast<float>(edge.GetN()) + offset) / max_n))),
+                      ? move.GetP()
+                      : ((static_cast<float>(move.GetN()) + offset) / max_n))),
         1 / temperature);
     cumulative_sums.push_back(sum);
+    indices.push_back(i);
   }
   assert(sum);
 
   const float toss = Random::Get().GetFloat(cumulative_sums.back());
-  int idx =
+  const int idx =
       std::lower_bound(cumulative_sums.begin(), cumulative_sums.end(), toss) -
       cumulative_sums.begin();
-
-  for (auto& edge : root_node_->Edges()) {
-    if (!root_move_filter_.empty() &&
-        std::find(root_move_filter_.begin(), root_move_filter_.end(),
-                  edge.GetMove()) == root_move_filter_.end()) {
-      continue;
-    }
-    if (edge.GetQ(fpu, draw_score) < min_eval) continue;
-    if (idx-- == 0) return edge;
-  }
-  assert(false);
-  return {};
+  return indices[idx];
 }
 
 void Search::StartThreads(size_t how_many) {
@@ -896,69 +1075,109 @@ bool Search::IsSearchActive() const {
   return !stop_.load(std::memory_order_acquire);
 }
 
+template <typename Range>
+void Search::PopulateRootMoveStats(Range&& moves, const RootMoveStats& root,
+                                   IterationStats* stats) const {
+  bool win_found = false;
+  bool may_resign = true;
+  int num_losing_edges = 0;
+  const auto draw_score = GetDrawScore(true);
+  float visited_policy = 0.0f;
+  for (const auto& edge : moves) {
+    if (edge.GetN() > 0) visited_policy += edge.GetP();
+  }
+  const float fpu = GetFpu(params_, root.GetQ(0.0f, -draw_score),
+                           /* is_root_node */ true, visited_policy);
+  float max_q_plus_m = -1000;
+  uint64_t max_n = 0;
+  bool max_n_has_max_q_plus_m = true;
+  const auto m_evaluator = network_->GetCapabilities().has_mlh()
+                               ? MEvaluator(params_, root)
+                               : MEvaluator();
+  for (const auto& edge : moves) {
+    const auto n = edge.GetN();
+    const auto q = edge.GetQ(fpu, draw_score);
+    const auto m = m_evaluator.GetMUtility(edge, q);
+    const auto q_plus_m = q + m;
+    if (n > 0 && edge.IsTerminal() && edge.GetWL(0.0f) > 0.0f) {
+      win_found = true;
+    }
+    if (n > 0 && edge.IsTerminal() && edge.GetWL(0.0f) < 0.0f) {
+      num_losing_edges += 1;
+    }
+    // If game is resignable, no need for moving quicker. This allows
+    // proving mate when losing anyway for better score output.
+    // Hardcoded resign threshold, because there is no available parameter.
+    if (n > 0 && q > -0.98f) {
+      may_resign = false;
+    }
+    if (max_n < n) {
+      max_n = n;
+      max_n_has_max_q_plus_m = false;
+    }
+    if (max_q_plus_m <= q_plus_m) {
+      max_n_has_max_q_plus_m = (max_n == n);
+      max_q_plus_m = q_plus_m;
+    }
+  }
+  stats->win_found = win_found;
+  stats->may_resign = may_resign;
+  stats->num_losing_edges = num_losing_edges;
+  stats->time_usage_hint_ = max_n_has_max_q_plus_m
+                                ? IterationStats::TimeUsageHint::kNormal
+                                : IterationStats::TimeUsageHint::kNeedMoreTime;
+}
+
+void Search::PopulateRootIterationStats(
+    const std::vector<RootMoveStats>& moves, IterationStats* stats) const {
+  RootMoveStats root;
+  {
+    SharedMutex::SharedLock nodes_lock(nodes_mutex_);
+    root = GetRootNodeStats();
+  }
+  PopulateRootMoveStats(moves, root, stats);
+}
+
 void Search::PopulateCommonIterationStats(IterationStats* stats) {
   stats->time_since_movestart = GetTimeSinceStart();
 
-  SharedMutex::SharedLock nodes_lock(nodes_mutex_);
   {
-    Mutex::Lock counters_lock(counters_mutex_);
-    stats->time_since_first_batch = GetTimeSinceFirstBatch();
-    if (!nps_start_time_ && total_playouts_ > 0) {
-      nps_start_time_ = std::chrono::steady_clock::now();
-    }
-  }
-  stats->total_nodes = total_playouts_ + initial_visits_;
-  stats->nodes_since_movestart = total_playouts_;
-  stats->batches_since_movestart = total_batches_;
-  stats->average_depth = cum_depth_ / (total_playouts_ ? total_playouts_ : 1);
-  stats->edge_n.clear();
-  stats->win_found = false;
-  stats->may_resign = true;
-  stats->num_losing_edges = 0;
-  stats->time_usage_hint_ = IterationStats::TimeUsageHint::kNormal;
-
-  // If root node hasn't finished first visit, none of this code is safe.
-  if (root_node_->GetN() > 0) {
-    const auto draw_score = GetDrawScore(true);
-    const float fpu =
-        GetFpu(params_, root_node_, /* is_root_node */ true, draw_score);
-    float max_q_plus_m = -1000;
-    uint64_t max_n = 0;
-    bool max_n_has_max_q_plus_m = true;
-    const auto m_evaluator = network_->GetCapabilities().has_mlh()
-                                 ? MEvaluator(params_, root_node_)
-                                 : MEvaluator();
-    for (const auto& edge : root_node_->Edges()) {
-      const auto n = edge.GetN();
-      const auto q = edge.GetQ(fpu, draw_score);
-      const auto m = m_evaluator.GetMUtility(edge, q);
-      const auto q_plus_m = q + m;
-      stats->edge_n.push_back(n);
-      if (n > 0 && edge.IsTerminal() && edge.GetWL(0.0f) > 0.0f) {
-        stats->win_found = true;
-      }
-      if (n > 0 && edge.IsTerminal() && edge.GetWL(0.0f) < 0.0f) {
-        stats->num_losing_edges += 1;
-      }
-      // If game is resignable, no need for moving quicker. This allows
-      // proving mate when losing anyway for better score output.
-      // Hardcoded resign threshold, because there is no available parameter.
-      if (n > 0 && q > -0.98f) {
-        stats->may_resign = false;
-      }
-      if (max_n < n) {
-        max_n = n;
-        max_n_has_max_q_plus_m = false;
+    Mutex::Lock root_moves_lock(root_moves_mutex_);
+    RootMoveStats root;
+    {
+      SharedMutex::SharedLock nodes_lock(nodes_mutex_);
+      {
+        Mutex::Lock counters_lock(counters_mutex_);
+        stats->time_since_first_batch = GetTimeSinceFirstBatch();
+        if (!nps_start_time_ && total_playouts_ > 0) {
+          nps_start_time_ = std::chrono::steady_clock::now();
+        }
       }
-      if (max_q_plus_m <= q_plus_m) {
-        max_n_has_max_q_plus_m = (max_n == n);
-        max_q_plus_m = q_plus_m;
+      stats->total_nodes = total_playouts_ + initial_visits_;
+      stats->nodes_since_movestart = total_playouts_;
+      stats->batches_since_movestart = total_batches_;
+      stats->average_depth =
+          cum_depth_ / (total_playouts_ ? total_playouts_ : 1);
+      stats->num_root_edges = 0;
+      stats->root_edge_visits = &root_edge_visits_;
+      stats->win_found = false;
+      stats->may_resign = true;
+      stats->num_losing_edges = 0;
+      stats->time_usage_hint_ = IterationStats::TimeUsageHint::kNormal;
+
+      // If root node hasn't finished first visit, none of this code is safe.
+      if (root_node_->GetN() > 0) {
+        stats->num_root_edges = root_node_->GetNumEdges();
+        RefreshRootMoves();
+        root = GetRootNodeStats();
       }
     }
-    if (!max_n_has_max_q_plus_m) {
-      stats->time_usage_hint_ = IterationStats::TimeUsageHint::kNeedMoreTime;
+    // The moves are a copy, so the tree can be searched meanwhile.
+    if (stats->num_root_edges > 0) {
+      PopulateRootMoveStats(root_moves_, root, stats);
     }
   }
+  if (stats_merger_) stats_merger_(stats);
 }
 
 void Search::WatchdogThread() {
@@ -1428,6 +1647,25 @@ void SearchWorker::ProcessPickedTask(int start_idx, int end_idx,
     if (picked_node.IsExtendable()) {
       // Node was never visited, extend it.
       ExtendNode(node, picked_node.depth, picked_node.moves_to_visit, &history);
+      // Walk through positions with a single legal move without asking the NN,
+      // the visit is evaluated at the first position offering a choice and
+      // backed up through the whole chain. As above, no mutex is needed since
+      // the chain is hidden from other threads behind the N=0 node.
+      while (params_.GetCollapseForcedMoves() && node != search_->root_node_ &&
+             !node->IsTerminal() && node->GetNumEdges() == 1) {
+        auto edge = node->Edges();
+        edge.edge()->SetP(1.0f);
+        Node* child = edge.GetOrSpawnNode(/* parent */ node);
+        child->IncrementNInFlight(picked_node.multivisit);
+        picked_node.moves_to_visit.push_back(edge.GetMove());
+        ++picked_node.depth;
+        // The history already ends at the parent, only the forced move needs
+        // to be appended.
+        history.Append(edge.GetMove());
+        ExtendNode(child, picked_node.depth, &history);
+        node = child;
+      }
+      picked_node.node = node;
       if (!node->IsTerminal()) {
         picked_node.nn_queried = true;
         const auto hash = history.HashLast(params_.GetCacheHistoryLength() + 1);
@@ -1531,6 +1769,10 @@ void SearchWorker::EnsureNodeTwoFoldCorrectForDepth(Node* child_node,
       // Revert all visits on twofold draw when making it non terminal.
       node_to_revert->RevertTerminalVisits(wl, d, m + (float)depth_counter,
                                            terminal_visits);
+      if (node_to_revert->GetParent() == search_->root_node_) {
+        search_->root_edge_visits_.Add(node_to_revert->Index(),
+                                       -static_cast<int>(terminal_visits));
+      }
       depth_counter++;
       // Even if original tree still exists, we don't want to revert
       // more than until new root.
@@ -1903,7 +2145,11 @@ void SearchWorker::ExtendNode(Node* node, int depth,
   for (size_t i = 0; i < moves_to_node.size(); i++) {
     history->Append(moves_to_node[i]);
   }
+  ExtendNode(node, depth, history);
+}
 
+void SearchWorker::ExtendNode(Node* node, int depth,
+                              PositionHistory* history) {
   // We don't need the mutex because other threads will see that N=0 and
   // N-in-flight=1 and will not touch this node.
   const auto& board = history->Last().GetBoard();
@@ -1946,6 +2192,43 @@ void SearchWorker::ExtendNode(Node* node, int depth,
       node->MakeTerminal(GameResult::DRAW);
       return;
     }
+
+    // Neither by-position or by-rule termination, but maybe it's a bitbase
+    // position. Bitbase values assume the 60 move counter was just reset.
+    if (search_->bitbase_ && history->Last().GetRule50Ply() == 0 &&
+        (board.ours() | board.theirs()).count() <=
+            search_->bitbase_->max_cardinality()) {
+      const BitbaseWdl wdl = search_->bitbase_->Probe(board);
+      if (wdl != BitbaseWdl::kUnknown) {
+        // Bitbase nodes don't have NN evaluation, assign M from the closest
+        // evaluated ancestor. Nodes of a collapsed forced move chain have no
+        // evaluation yet, so skip over them.
+        float m = 0.0f;
+        // Need a lock to access parent, in case MakeSolid is in progress.
+        {
+          SharedMutex::SharedLock lock(search_->nodes_mutex_);
+          float plies = 1.0f;
+          auto parent = node->GetParent();
+          while (parent != search_->root_node_ && parent->GetN() == 0) {
+            parent = parent->GetParent();
+            plies += 1.0f;
+          }
+          m = std::max(0.0f, parent->GetM() - plies);
+        }
+        // If the colors seem backwards, check the checkmate check above.
+        if (wdl == BitbaseWdl::kWin) {
+          node->MakeTerminal(GameResult::BLACK_WON, m,
+                             Node::Terminal::Tablebase);
+        } else if (wdl == BitbaseWdl::kLoss) {
+          node->MakeTerminal(GameResult::WHITE_WON, m,
+                             Node::Terminal::Tablebase);
+        } else {
+          node->MakeTerminal(GameResult::DRAW, m, Node::Terminal::Tablebase);
+        }
+        search_->tb_hits_.fetch_add(1, std::memory_order_acq_rel);
+        return;
+      }
+    }
   }
 
   // Add legal moves as edges of this node.
@@ -2248,6 +2531,7 @@ void SearchWorker::DoBackupUpdateSingleNode(
       if (n->MakeSolid() && n == search_->root_node_) {
         // If we make the root solid, the current_best_edge_ becomes invalid and
         // we should repopulate it.
+        search_->root_children_moved_.store(true);
         search_->current_best_edge_ =
             search_->GetBestChildNoTemperature(search_->root_node_, 0);
       }
@@ -2255,6 +2539,9 @@ void SearchWorker::DoBackupUpdateSingleNode(
 
     // Nothing left to do without ancestors to update.
     if (!p) break;
+    if (p == search_->root_node_) {
+      search_->root_edge_visits_.Add(n->Index(), node_to_process.multivisit);
+    }
 
     bool old_update_parent_bounds = update_parent_bounds;
     // If parent already is terminal further adjustment is not required.
@@ -2337,8 +2624,9 @@ bool SearchWorker::MaybeSetBounds(Node* p, float m, int* n_to_fix,
   } else if (lower == upper) {
     // Search can stop at the parent if the bounds can't change anymore, so make
     // it terminal preferring shorter wins and longer losses.
+    // The parent is unvisited if it's inside a collapsed forced move chain,
+    // then there is nothing to fix.
     *n_to_fix = p->GetN();
-    assert(*n_to_fix > 0);
     float cur_v = p->GetWL();
     float cur_d = p->GetD();
     float cur_m = p->GetM();
@@ -34,6 +34,7 @@
 #include <shared_mutex>
 #include <thread>
 
+#include "bitbase/bitbase.h"
 #include "chess/callbacks.h"
 #include "chess/uciloop.h"
 #include "mcts/node.h"
@@ -46,6 +47,37 @@
 
 namespace lczero {
 
+// Statistics of a root move in one tree, or merged over the trees of a
+// root-parallel search. The getters match those of EdgeAndNode, so that the
+// same rules choose the best move. Values are from the point of view of the
+// side to move at the root.
+struct RootMoveStats {
+  // Adds the statistics of the same move in another tree. A result proven in
+  // either tree, or by their bounds together, holds for the merged move.
+  void Merge(const RootMoveStats& other);
+
+  float GetQ(float default_q, float draw_score) const {
+    return n > 0 ? wl + draw_score * d : default_q;
+  }
+  float GetWL(float default_wl) const { return n > 0 ? wl : default_wl; }
+  float GetD(float default_d) const { return n > 0 ? d : default_d; }
+  float GetM(float default_m) const { return n > 0 ? m : default_m; }
+  uint32_t GetN() const { return n; }
+  bool IsTerminal() const { return terminal; }
+  bool IsTbTerminal() const { return tb_terminal; }
+  float GetP() const { return p; }
+
+  Move move;
+  float p = 0.0f;
+  uint32_t n = 0;
+  float wl = 0.0f;
+  float d = 0.0f;
+  float m = 0.0f;
+  bool terminal = false;
+  bool tb_terminal = false;
+  Node::Bounds bounds{GameResult::BLACK_WON, GameResult::WHITE_WON};
+};
+
 class Search {
  public:
   Search(const NodeTree& tree, Network* network,
@@ -53,7 +85,7 @@ class Search {
          const MoveList& searchmoves,
          std::chrono::steady_clock::time_point start_time,
          std::unique_ptr<SearchStopper> stopper, bool infinite, bool ponder,
-         const OptionsDict& options, NNCache* cache);
+         const OptionsDict& options, NNCache* cache, Bitbase* bitbase);
 
   ~Search();
 
@@ -96,6 +128,30 @@ class Search {
   // Returns NN eval for a given node from cache, if that node is cached.
   NNCacheLock GetCachedNNEval(const Node* node) const;
 
+  // Returns the statistics of all root moves in edge order, or nothing before
+  // the root is expanded.
+  std::vector<RootMoveStats> GetRootMoveStats() const;
+  // Returns the index of the move that GetBestMove() would choose from
+  // @moves, the root moves of this search in edge order with statistics
+  // merged from other trees. Returns -1 when there is no move to choose.
+  int ChooseRootMove(const std::vector<RootMoveStats>& moves) const;
+  // Returns the ponder move after root move @move, or Move() if the move has
+  // no visited replies.
+  Move GetPonderMove(Move move) const;
+
+  // Sets a function which merges the statistics of other trees searching the
+  // same position into those of this search, before stoppers see them. It is
+  // called concurrently by all threads. Must be set before the threads start.
+  void SetIterationStatsMerger(std::function<void(IterationStats*)> merger);
+  // Fills IterationStats with global (rather than per-thread) portion of search
+  // statistics. Currently all stats there (in IterationStats) are global
+  // though.
+  void PopulateCommonIterationStats(IterationStats* stats);
+  // Recomputes the root move dependent part of @stats from @moves, the root
+  // moves of this search with statistics merged from other trees.
+  void PopulateRootIterationStats(const std::vector<RootMoveStats>& moves,
+                                  IterationStats* stats) const;
+
  private:
   // Computes the best move, maybe with temperature (according to the settings).
   void EnsureBestMoveKnown();
@@ -107,6 +163,26 @@ class Search {
   std::vector<EdgeAndNode> GetBestChildrenNoTemperature(Node* parent, int count,
                                                         int depth) const;
   EdgeAndNode GetBestRootChildWithTemperature(float temperature) const;
+  // Returns the temperature of the move choice at this point of the game.
+  float GetTemperature() const;
+  // Returns the index of a move of @moves, root moves that searchmoves
+  // allows, sampled by visits weighted with @temperature. T is EdgeAndNode or
+  // RootMoveStats.
+  template <typename T>
+  size_t PickWithTemperature(const std::vector<T>& moves,
+                             float temperature) const;
+  // Fills the parts of @stats that depend on the root moves, @root holding the
+  // statistics of the root node itself. Range iterates EdgeAndNode or
+  // RootMoveStats.
+  template <typename Range>
+  void PopulateRootMoveStats(Range&& moves, const RootMoveStats& root,
+                             IterationStats* stats) const;
+  // Returns the statistics of the root node.
+  RootMoveStats GetRootNodeStats() const REQUIRES_SHARED(nodes_mutex_);
+  // Brings root_moves_ up to date with the root edges changed since the last
+  // call.
+  void RefreshRootMoves() REQUIRES(root_moves_mutex_)
+      REQUIRES_SHARED(nodes_mutex_);
 
   int64_t GetTimeSinceStart() const;
   int64_t GetTimeSinceFirstBatch() const;
@@ -121,11 +197,6 @@ class Search {
   // uci `stop` command;
   void WatchdogThread();
 
-  // Fills IterationStats with global (rather than per-thread) portion of search
-  // statistics. Currently all stats there (in IterationStats) are global
-  // though.
-  void PopulateCommonIterationStats(IterationStats* stats);
-
   // Returns verbose information about given node, as vector of strings.
   // Node can only be root or ponder (depth 1).
   std::vector<std::string> GetVerboseStats(Node* node) const;
@@ -161,6 +232,7 @@ class Search {
 
   Node* root_node_;
   NNCache* cache_;
+  Bitbase* bitbase_;
   // Fixed positions which happened before the search.
   const PositionHistory& played_history_;
 
@@ -171,6 +243,18 @@ class Search {
   int64_t initial_visits_;
   const MoveList root_move_filter_;
 
+  // Root edge visits, updated at backup without holding counters_mutex_.
+  RootEdgeVisits root_edge_visits_;
+  // Root moves in edge order, kept for iteration stats. Only the moves of
+  // changed root edges are refreshed from the tree.
+  Mutex root_moves_mutex_ ACQUIRED_BEFORE(nodes_mutex_);
+  std::vector<RootMoveStats> root_moves_ GUARDED_BY(root_moves_mutex_);
+  // Root children in edge order, nullptr where not spawned yet.
+  std::vector<Node*> root_children_ GUARDED_BY(root_moves_mutex_);
+  RootEdgeChanges root_changes_ GUARDED_BY(root_moves_mutex_);
+  // Set when MakeSolid() moved the root children.
+  std::atomic<bool> root_children_moved_{false};
+
   mutable SharedMutex nodes_mutex_;
   EdgeAndNode current_best_edge_ GUARDED_BY(nodes_mutex_);
   Edge* last_outputted_info_edge_ GUARDED_BY(nodes_mutex_) = nullptr;
@@ -185,6 +269,8 @@ class Search {
   std::optional<std::chrono::steady_clock::time_point> nps_start_time_
       GUARDED_BY(counters_mutex_);
 
+  std::atomic<int> tb_hits_{0};
+
   std::atomic<int> pending_searchers_{0};
   std::atomic<int> backend_waiting_counter_{0};
   std::atomic<int> thread_count_{0};
@@ -193,6 +279,7 @@ class Search {
       GUARDED_BY(nodes_mutex_);
 
   std::unique_ptr<UciResponder> uci_responder_;
+  std::function<void(IterationStats*)> stats_merger_;
   ContemptMode contempt_mode_;
   friend class SearchWorker;
 };
@@ -450,6 +537,8 @@ class SearchWorker {
                          TaskWorkspace* workspace);
   void ExtendNode(Node* node, int depth, const std::vector<Move>& moves_to_add,
                   PositionHistory* history);
+  // Same as above, with @history already ending at the position of @node.
+  void ExtendNode(Node* node, int depth, PositionHistory* history);
   template <typename Computation>
   void FetchSingleNodeResult(NodeToProcess* node_to_process,
                              const Computation& computation,
@@ -470,7 +559,6 @@ class SearchWorker {
   PositionHistory history_;
   int number_out_of_order_ = 0;
   const SearchParams& params_;
-  std::unique_ptr<Node> precached_node_;
   const bool moves_left_support_;
   IterationStats iteration_stats_;
   StoppersHints latest_time_manager_hints_;
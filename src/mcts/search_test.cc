@@ -0,0 +1,178 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "mcts/search.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdio>
+
+#include "bitbase/bitbase.h"
+#include "bitbase/generator.h"
+#include "mcts/stoppers/stoppers.h"
+#include "neural/cache.h"
+
+namespace lczero {
+
+namespace {
+
+constexpr float kNetQ = 0.25f;
+constexpr float kNetM = 30.0f;
+
+// Returns the same Q and M for every position and counts the evaluations.
+class ConstantComputation : public NetworkComputation {
+ public:
+  explicit ConstantComputation(std::atomic<int>* evaluations)
+      : evaluations_(evaluations) {}
+  void AddInput(InputPlanes&&) override { ++batch_size_; }
+  void ComputeBlocking() override { *evaluations_ += batch_size_; }
+  int GetBatchSize() const override { return batch_size_; }
+  float GetQVal(int) const override { return kNetQ; }
+  float GetDVal(int) const override { return 0.0f; }
+  float GetPVal(int, int) const override { return 0.0f; }
+  float GetMVal(int) const override { return kNetM; }
+
+ private:
+  std::atomic<int>* const evaluations_;
+  int batch_size_ = 0;
+};
+
+class ConstantNetwork : public Network {
+ public:
+  const NetworkCapabilities& GetCapabilities() const override {
+    return capabilities_;
+  }
+  std::unique_ptr<NetworkComputation> NewComputation() override {
+    return std::make_unique<ConstantComputation>(&evaluations_);
+  }
+  int evaluations() const { return evaluations_; }
+
+ private:
+  NetworkCapabilities capabilities_{
+      pblczero::NetworkFormat::INPUT_CLASSICAL_112_PLANE,
+      pblczero::NetworkFormat::OUTPUT_CLASSICAL,
+      pblczero::NetworkFormat::MOVES_LEFT_V1};
+  std::atomic<int> evaluations_{0};
+};
+
+// After the root move a8d8 (check) black's only legal move is Kxd8, which
+// leaves KRvK with red to move.
+constexpr const char* kForcedCaptureFen =
+    "3k5/R8/9/9/9/9/9/9/4R4/5K3 w - - 0 1";
+
+// Runs a two playout search restricted to a8d8 with forced moves collapsed
+// and returns the node after a8d8.
+Node* SearchForcedChain(NodeTree* tree, ConstantNetwork* network,
+                        Bitbase* bitbase) {
+  OptionsParser options;
+  SearchParams::Populate(&options);
+  options.SetUciOption("CollapseForcedMoves", "true");
+  options.SetUciOption("MaxPrefetch", "0");
+  tree->ResetToPosition(kForcedCaptureFen, {});
+  NNCache cache;
+  cache.SetCapacity(1000);
+  auto stopper = std::make_unique<ChainedSearchStopper>();
+  stopper->AddStopper(std::make_unique<VisitsStopper>(2, false));
+  Search search(*tree, network,
+                std::make_unique<CallbackUciResponder>(
+                    [](const BestMoveInfo&) {},
+                    [](const std::vector<ThinkingInfo>&) {}),
+                {Move("a8d8")}, std::chrono::steady_clock::now(),
+                std::move(stopper), false, false, options.GetOptionsDict(),
+                &cache, bitbase);
+  search.StartThreads(1);
+  search.Wait();
+  for (auto& edge : tree->GetCurrentHead()->Edges()) {
+    if (edge.GetMove() == Move("a8d8")) return edge.node();
+  }
+  return nullptr;
+}
+
+Node* OnlyChild(Node* node) {
+  Node* child = nullptr;
+  for (auto& edge : node->Edges()) child = edge.node();
+  return child;
+}
+
+}  // namespace
+
+TEST(CollapseForcedMoves, BacksUpThroughChain) {
+  NodeTree tree;
+  ConstantNetwork network;
+  Node* forced = SearchForcedChain(&tree, &network, nullptr);
+  ASSERT_NE(forced, nullptr);
+  ASSERT_EQ(forced->GetNumEdges(), 1);
+  Node* leaf = OnlyChild(forced);
+  ASSERT_NE(leaf, nullptr);
+
+  // Only the root and the position after Kxd8 were evaluated.
+  EXPECT_EQ(network.evaluations(), 2);
+  EXPECT_EQ(forced->GetN(), 1u);
+  EXPECT_EQ(leaf->GetN(), 1u);
+  EXPECT_FLOAT_EQ(leaf->GetWL(), -kNetQ);
+  EXPECT_FLOAT_EQ(leaf->GetM(), kNetM);
+  EXPECT_FLOAT_EQ(forced->GetWL(), kNetQ);
+  EXPECT_FLOAT_EQ(forced->GetM(), kNetM + 1.0f);
+  // The root averages its own evaluation and the one two plies deeper.
+  EXPECT_FLOAT_EQ(tree.GetCurrentHead()->GetM(), kNetM + 1.0f);
+}
+
+TEST(CollapseForcedMoves, BitbaseInChainTakesMFromEvaluatedAncestor) {
+  const std::string dir = ::testing::TempDir();
+  BitbaseGenerator generator;
+  const std::string key = generator.Generate("KvKR");
+  generator.Save(key, dir);
+  Bitbase bitbase;
+  ASSERT_TRUE(bitbase.Init(dir));
+
+  NodeTree tree;
+  ConstantNetwork network;
+  Node* forced = SearchForcedChain(&tree, &network, &bitbase);
+  std::remove((dir + "/" + key + kBitbaseExtension).c_str());
+  ASSERT_NE(forced, nullptr);
+  ASSERT_EQ(forced->GetNumEdges(), 1);
+  Node* leaf = OnlyChild(forced);
+  ASSERT_NE(leaf, nullptr);
+
+  // The bitbase position is two plies below the evaluated root, the forced
+  // node in between has no M of its own.
+  EXPECT_EQ(network.evaluations(), 1);
+  EXPECT_TRUE(leaf->IsTbTerminal());
+  EXPECT_FLOAT_EQ(leaf->GetM(), kNetM - 2.0f);
+  EXPECT_FLOAT_EQ(leaf->GetWL(), -1.0f);
+  EXPECT_FLOAT_EQ(forced->GetWL(), 1.0f);
+  EXPECT_FLOAT_EQ(forced->GetM(), kNetM - 1.0f);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  lczero::InitializeMagicBitboards();
+  return RUN_ALL_TESTS();
+}
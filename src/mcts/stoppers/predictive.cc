@@ -0,0 +1,321 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "mcts/stoppers/predictive.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <optional>
+
+#include "mcts/stoppers/legacy.h"
+#include "mcts/stoppers/stoppers.h"
+#include "utils/mutex.h"
+
+namespace lczero {
+namespace {
+
+// Time manager that predicts how many visits a move gets from the measured
+// throughput. The budget is derived from the running nps, the warm-up cost of
+// a move (time before the first batch is evaluated) and the size of the reused
+// tree. During the search the deadline is recomputed from the live nps, and
+// moved by the expected gain of best move stability: it is extended while the
+// runner-up is projected to overtake the best move, and cut short when the
+// best move gains visits faster than any alternative.
+class PredictiveTimeManager : public TimeManager {
+ public:
+  PredictiveTimeManager(int64_t move_overhead, const OptionsDict& params)
+      : move_overhead_(move_overhead),
+        initial_nps_(params.GetOrDefault<float>("init-nps", 2000.0f)),
+        initial_tree_reuse_(
+            params.GetOrDefault<float>("init-tree-reuse", 0.5f)),
+        max_tree_reuse_(params.GetOrDefault<float>("max-tree-reuse", 0.8f)),
+        update_rate_(params.GetOrDefault<float>("update-rate", 0.3f)),
+        max_move_budget_(
+            params.GetOrDefault<float>("max-move-budget", 0.3f)),
+        max_extension_(params.GetOrDefault<float>("max-extension", 2.0f)),
+        stable_factor_(params.GetOrDefault<float>("stable-factor", 0.7f)),
+        stability_window_ms_(
+            params.GetOrDefault<int>("stability-window-ms", 500)),
+        min_measure_ms_(params.GetOrDefault<int>("min-measure-ms", 100)),
+        midpoint_(params.GetOrDefault<float>("midpoint", 45.2f)),
+        steepness_(params.GetOrDefault<float>("steepness", 5.93f)) {
+    if (initial_nps_ <= 0.0f) {
+      throw Exception("init-nps value to be positive");
+    }
+    if (min_measure_ms_ < 1) {
+      throw Exception("min-measure-ms value to be at least 1");
+    }
+    if (update_rate_ <= 0.0f || update_rate_ > 1.0f) {
+      throw Exception("update-rate value to be in range (0.0, 1.0]");
+    }
+    if (max_tree_reuse_ < 0.0f || max_tree_reuse_ >= 1.0f) {
+      throw Exception("max-tree-reuse value to be in range [0.0, 1.0)");
+    }
+    if (max_extension_ < 1.0f) {
+      throw Exception("max-extension value to be at least 1.0");
+    }
+  }
+
+  // Updates the throughput model with the measurements of a finished move.
+  void UpdateEndOfMoveStats(float nps, int64_t warmup_ms,
+                            int64_t total_nodes) {
+    Mutex::Lock lock(mutex_);
+    if (nps > 0.0f) {
+      nps_ = has_measurements_ ? nps_ + (nps - nps_) * update_rate_ : nps;
+      warmup_ms_ = has_measurements_
+                       ? warmup_ms_ + (warmup_ms - warmup_ms_) * update_rate_
+                       : warmup_ms;
+      has_measurements_ = true;
+    }
+    last_move_final_nodes_ = total_nodes;
+    LOGFILE << std::fixed << std::setprecision(1)
+            << "TMGR: Updating endmove stats. nps=" << nps_
+            << ", warmup=" << warmup_ms_ << "ms, nodes=" << total_nodes;
+  }
+
+ private:
+  std::unique_ptr<SearchStopper> GetStopper(const GoParams& params,
+                                            const NodeTree& tree) override;
+
+  const int64_t move_overhead_;
+  const float initial_nps_;
+  const float initial_tree_reuse_;
+  const float max_tree_reuse_;
+  const float update_rate_;
+  const float max_move_budget_;
+  const float max_extension_;
+  const float stable_factor_;
+  const int64_t stability_window_ms_;
+  const int64_t min_measure_ms_;
+  const float midpoint_;
+  const float steepness_;
+
+  Mutex mutex_;
+  // Steady state nodes per second, excluding the warm-up of a move.
+  float nps_ GUARDED_BY(mutex_) = initial_nps_;
+  // Time from the start of a move until its first batch is evaluated.
+  float warmup_ms_ GUARDED_BY(mutex_) = 0.0f;
+  // Fraction of the final tree of a move which is reused by the next one.
+  float tree_reuse_ GUARDED_BY(mutex_) = initial_tree_reuse_;
+  bool has_measurements_ GUARDED_BY(mutex_) = false;
+  int64_t last_move_final_nodes_ GUARDED_BY(mutex_) = 0;
+};
+
+class PredictiveStopper : public SearchStopper {
+ public:
+  PredictiveStopper(float nodes_to_search, float nps, int64_t max_ms,
+                    float stable_factor, int64_t stability_window_ms,
+                    int64_t min_measure_ms, PredictiveTimeManager* manager)
+      : nodes_to_search_(nodes_to_search),
+        max_ms_(max_ms),
+        stable_factor_(stable_factor),
+        stability_window_ms_(stability_window_ms),
+        min_measure_ms_(min_measure_ms),
+        manager_(manager),
+        nps_(nps) {}
+
+ private:
+  bool ShouldStop(const IterationStats& stats, StoppersHints* hints) override;
+  void OnSearchDone(const IterationStats& stats) override;
+  // Returns the time (since move start) at which the runner-up is projected
+  // to overtake the best move, if it does before max_ms_.
+  std::optional<int64_t> ProjectOvertake(const IterationStats& stats)
+      REQUIRES(mutex_);
+
+  const float nodes_to_search_;
+  const int64_t max_ms_;
+  const float stable_factor_;
+  const int64_t stability_window_ms_;
+  const int64_t min_measure_ms_;
+  PredictiveTimeManager* const manager_;
+
+  Mutex mutex_;
+  float nps_ GUARDED_BY(mutex_);
+  int64_t warmup_ms_ GUARDED_BY(mutex_) = 0;
+  // Root visits at the start of the current stability window.
+  std::vector<uint32_t> window_visits_ GUARDED_BY(mutex_);
+  int64_t window_start_ms_ GUARDED_BY(mutex_) = 0;
+  // Visit rates (per ms) of root edges measured over the last full window.
+  std::vector<float> visit_rates_ GUARDED_BY(mutex_);
+};
+
+std::unique_ptr<SearchStopper> PredictiveTimeManager::GetStopper(
+    const GoParams& params, const NodeTree& tree) {
+  const Position& position = tree.HeadPosition();
+  const bool is_black = position.IsBlackToMove();
+  const std::optional<int64_t>& time = (is_black ? params.btime : params.wtime);
+  // If no time limit is given, don't stop on this condition.
+  if (params.infinite || params.ponder || !time) return nullptr;
+
+  Mutex::Lock lock(mutex_);
+  const auto current_nodes = tree.GetCurrentHead()->GetN();
+  if (last_move_final_nodes_ > 0) {
+    const float reuse =
+        static_cast<float>(current_nodes) / last_move_final_nodes_;
+    tree_reuse_ = std::min(max_tree_reuse_,
+                           tree_reuse_ + (reuse - tree_reuse_) * update_rate_);
+  }
+
+  float remaining_moves =
+      ComputeEstimatedMovesToGo(position.GetGamePly(), midpoint_, steepness_);
+  if (params.movestogo && *params.movestogo > 0 &&
+      *params.movestogo < remaining_moves) {
+    remaining_moves = *params.movestogo;
+  }
+  const std::optional<int64_t>& inc = is_black ? params.binc : params.winc;
+  const int64_t increment = inc ? std::max(int64_t(0), *inc) : 0;
+  const int64_t time_left = std::max(int64_t(0), *time - move_overhead_);
+
+  // Time per move if it was split evenly between the remaining moves.
+  const float avg_ms_per_move =
+      std::max(0.0f, *time + increment * (remaining_moves - 1) -
+                         move_overhead_) /
+      remaining_moves;
+  // Steady state tree size affordable per move. Every move pays the warm-up,
+  // and inherits tree_reuse_ of the previous tree.
+  const float tree_nodes = std::max(0.0f, avg_ms_per_move - warmup_ms_) *
+                           nps_ / 1000.0f / (1.0f - tree_reuse_);
+  const float nodes_to_search = std::max(0.0f, tree_nodes - current_nodes);
+  const float expected_ms = warmup_ms_ + nodes_to_search / nps_ * 1000.0f;
+  const int64_t max_ms = std::min<int64_t>(
+      time_left, std::min(expected_ms * max_extension_,
+                          *time * max_move_budget_));
+
+  LOGFILE << std::fixed << std::setprecision(1)
+          << "TMGR: MOVE: expected=" << expected_ms << "ms, max=" << max_ms
+          << "ms, nodes_to_search=" << nodes_to_search
+          << ", reused=" << current_nodes << ", tree_reuse=" << tree_reuse_
+          << ", nps=" << nps_ << ", warmup=" << warmup_ms_
+          << "ms, moves=" << remaining_moves;
+
+  return std::make_unique<PredictiveStopper>(
+      nodes_to_search, nps_, max_ms, stable_factor_, stability_window_ms_,
+      min_measure_ms_, this);
+}
+
+std::optional<int64_t> PredictiveStopper::ProjectOvertake(
+    const IterationStats& stats) {
+  const RootEdgeVisits& visits = *stats.root_edge_visits;
+  const int edges = stats.num_root_edges;
+  if (static_cast<int>(window_visits_.size()) != edges) {
+    visits.Snapshot(edges, &window_visits_);
+    window_start_ms_ = stats.time_since_movestart;
+    visit_rates_.clear();
+  } else if (stats.time_since_movestart >=
+             window_start_ms_ + stability_window_ms_) {
+    const float window_ms = stats.time_since_movestart - window_start_ms_;
+    visit_rates_.resize(edges);
+    for (int i = 0; i < edges; i++) {
+      // Reverted terminal visits can make a count drop within the window.
+      const uint32_t n = visits.Get(i);
+      visit_rates_[i] =
+          (static_cast<int64_t>(n) - window_visits_[i]) / window_ms;
+      window_visits_[i] = n;
+    }
+    window_start_ms_ = stats.time_since_movestart;
+  }
+  if (static_cast<int>(visit_rates_.size()) != edges) return std::nullopt;
+
+  int best = 0;
+  int64_t best_visits = -1;
+  for (int i = 0; i < edges; i++) {
+    const int64_t n = visits.Get(i);
+    if (n > best_visits) {
+      best = i;
+      best_visits = n;
+    }
+  }
+  // Earliest time any other move reaches the visits of the best one.
+  std::optional<int64_t> overtake;
+  for (int i = 0; i < edges; i++) {
+    const float closing_rate = visit_rates_[i] - visit_rates_[best];
+    if (i == best || closing_rate <= 0.0f) continue;
+    // Counters keep moving while they are read, so the gap may be negative.
+    const int64_t gap =
+        std::max<int64_t>(0, best_visits - static_cast<int64_t>(visits.Get(i)));
+    const int64_t at = stats.time_since_movestart + gap / closing_rate;
+    if (at <= max_ms_ && (!overtake || at < *overtake)) overtake = at;
+  }
+  return overtake;
+}
+
+bool PredictiveStopper::ShouldStop(const IterationStats& stats,
+                                   StoppersHints* hints) {
+  if (stats.time_usage_hint_ == IterationStats::TimeUsageHint::kImmediateMove) {
+    LOGFILE << "Search requested immediate stop, alrite.";
+    return true;
+  }
+  Mutex::Lock lock(mutex_);
+  // Measure the live throughput once the first batch has been evaluated.
+  if (stats.nodes_since_movestart > 0) {
+    warmup_ms_ = stats.time_since_movestart - stats.time_since_first_batch;
+    if (stats.time_since_first_batch >= min_measure_ms_) {
+      nps_ = 1000.0f * stats.nodes_since_movestart /
+             stats.time_since_first_batch;
+    }
+  }
+  int64_t deadline = std::min<int64_t>(
+      max_ms_, warmup_ms_ + nodes_to_search_ / nps_ * 1000.0f);
+  const auto overtake = ProjectOvertake(stats);
+  if (overtake) {
+    // More time is likely to change the best move, let it resolve.
+    deadline = std::max(deadline, *overtake);
+  } else if (!visit_rates_.empty()) {
+    // Nothing catches up with the best move, time has little value.
+    deadline *= stable_factor_;
+  }
+  if (stats.time_usage_hint_ == IterationStats::TimeUsageHint::kNeedMoreTime) {
+    deadline = max_ms_;
+  }
+  hints->UpdateEstimatedNps(nps_);
+  hints->UpdateEstimatedRemainingTimeMs(deadline - stats.time_since_movestart);
+  if (stats.time_since_movestart >= deadline) {
+    LOGFILE << std::fixed << std::setprecision(1)
+            << "Stopping search: Ran out of time. elapsed="
+            << stats.time_since_movestart << "ms, deadline=" << deadline
+            << "ms, max=" << max_ms_ << "ms, nps=" << nps_
+            << ", overtake=" << (overtake ? "yes" : "no");
+    return true;
+  }
+  return false;
+}
+
+void PredictiveStopper::OnSearchDone(const IterationStats& stats) {
+  Mutex::Lock lock(mutex_);
+  const bool measured = stats.time_since_first_batch >= min_measure_ms_;
+  manager_->UpdateEndOfMoveStats(measured ? nps_ : 0.0f, warmup_ms_,
+                                 stats.total_nodes);
+}
+
+}  // namespace
+
+std::unique_ptr<TimeManager> MakePredictiveTimeManager(
+    int64_t move_overhead, const OptionsDict& params) {
+  return std::make_unique<PredictiveTimeManager>(move_overhead, params);
+}
+
+}  // namespace lczero
@@ -230,7 +230,7 @@ class VisitsTrendWatcher {
         bestmove_optimism_(bestmove_optimism),
         overtaker_optimism_(overtaker_optimism) {}
 
-  void Update(uint64_t timestamp, const std::vector<uint32_t>& visits);
+  void Update(uint64_t timestamp, const RootEdgeVisits& visits, int edges);
   bool IsBestmoveBeingOvertaken(uint64_t by_which_time) const;
 
  private:
@@ -516,17 +516,17 @@ class SmoothTimeManager : public TimeManager {
 };
 
 void VisitsTrendWatcher::Update(uint64_t timestamp,
-                                const std::vector<uint32_t>& visits) {
+                                const RootEdgeVisits& visits, int edges) {
   Mutex::Lock lock(mutex_);
   if (timestamp <= last_timestamp_) return;
+  last_timestamp_ = timestamp;
+  visits.Snapshot(edges, &last_visits_);
   if (prev_visits_.empty()) {
-    prev_visits_ = visits;
-    cur_visits_ = visits;
+    prev_visits_ = last_visits_;
+    cur_visits_ = last_visits_;
     prev_timestamp_ = timestamp;
     cur_timestamp_ = timestamp;
   }
-  last_timestamp_ = timestamp;
-  last_visits_ = visits;
   if (cur_timestamp_ + nps_update_period_ >= timestamp) {
     prev_timestamp_ = cur_timestamp_;
     prev_visits_ = std::move(cur_visits_);
@@ -587,7 +587,8 @@ bool SmoothStopper::ShouldStop(const IterationStats& stats,
     return true;
   }
 
-  visits_trend_watcher_.Update(stats.time_since_movestart, stats.edge_n);
+  visits_trend_watcher_.Update(stats.time_since_movestart,
+                               *stats.root_edge_visits, stats.num_root_edges);
   const auto deadline_with_piggybank = deadline_ms_ + allowed_piggybank_use_ms_;
   const bool force_use_piggybank =
       stats.time_since_first_batch <= forced_piggybank_use_ms_;
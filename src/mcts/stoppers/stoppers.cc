@@ -155,20 +155,33 @@ bool KldGainStopper::ShouldStop(const IterationStats& stats, StoppersHints*) {
   const auto new_child_nodes = stats.total_nodes - 1.0;
   if (new_child_nodes < prev_child_nodes_ + average_interval_) return false;
 
-  const auto new_visits = stats.edge_n;
-  if (!prev_visits_.empty()) {
-    double kldgain = 0.0;
-    for (decltype(new_visits)::size_type i = 0; i < new_visits.size(); i++) {
-      double o_p = prev_visits_[i] / prev_child_nodes_;
-      double n_p = new_visits[i] / new_child_nodes;
-      if (prev_visits_[i] != 0) kldgain += o_p * log(o_p / n_p);
-    }
-    if (kldgain / (new_child_nodes - prev_child_nodes_) < min_gain_) {
-      LOGFILE << "Stopping search: KLDGain per node too small.";
-      return true;
+  // With o_i = old_i / old_nodes and n_i = new_i / new_nodes, the gain
+  // sum(o_i * log(o_i / n_i)) over old_i > 0 equals
+  // sum(o_i) * log(new_nodes / old_nodes) + sum(o_i * log(old_i / new_i)),
+  // where the last sum only has non-zero terms for changed edges.
+  double kldgain = 0.0;
+  if (has_snapshot_) {
+    kldgain = prev_visits_sum_ / prev_child_nodes_ *
+              log(new_child_nodes / prev_child_nodes_);
+  }
+  for (const int i : changes_.Collect(stats.root_edge_visits)) {
+    const uint32_t new_visits = stats.root_edge_visits->Get(i);
+    if (i >= static_cast<int>(prev_visits_.size())) prev_visits_.resize(i + 1);
+    const uint32_t old_visits = prev_visits_[i];
+    if (has_snapshot_ && old_visits != 0) {
+      kldgain += old_visits / prev_child_nodes_ *
+                 log(static_cast<double>(old_visits) / new_visits);
     }
+    prev_visits_sum_ += new_visits;
+    prev_visits_sum_ -= old_visits;
+    prev_visits_[i] = new_visits;
+  }
+  if (has_snapshot_ &&
+      kldgain / (new_child_nodes - prev_child_nodes_) < min_gain_) {
+    LOGFILE << "Stopping search: KLDGain per node too small.";
+    return true;
   }
-  prev_visits_ = new_visits;
+  has_snapshot_ = true;
   prev_child_nodes_ = new_child_nodes;
   return false;
 }
@@ -187,16 +200,45 @@ SmartPruningStopper::SmartPruningStopper(float smart_pruning_factor,
     : smart_pruning_factor_(smart_pruning_factor),
       minimum_batches_(minimum_batches) {}
 
+void SmartPruningStopper::UpdateLargestEdges(const IterationStats& stats) {
+  bool decreased = false;
+  for (const int i : changes_.Collect(stats.root_edge_visits)) {
+    if (i >= stats.num_root_edges) continue;
+    const uint32_t n = stats.root_edge_visits->Get(i);
+    decreased |= n < visits_[i];
+    visits_[i] = n;
+    // Visits only grow, except when terminal visits are reverted, so the two
+    // largest edges can be kept up to date from the changed edges alone.
+    if (i == largest_edge_) continue;
+    if (largest_edge_ < 0 || n > visits_[largest_edge_]) {
+      second_edge_ = largest_edge_;
+      largest_edge_ = i;
+    } else if (second_edge_ < 0 || n > visits_[second_edge_]) {
+      second_edge_ = i;
+    }
+  }
+  if (!decreased) return;
+  largest_edge_ = second_edge_ = -1;
+  for (int i = 0; i < stats.num_root_edges; i++) {
+    if (largest_edge_ < 0 || visits_[i] > visits_[largest_edge_]) {
+      second_edge_ = largest_edge_;
+      largest_edge_ = i;
+    } else if (second_edge_ < 0 || visits_[i] > visits_[second_edge_]) {
+      second_edge_ = i;
+    }
+  }
+}
+
 bool SmartPruningStopper::ShouldStop(const IterationStats& stats,
                                      StoppersHints* hints) {
   if (smart_pruning_factor_ <= 0.0) return false;
   Mutex::Lock lock(mutex_);
-  if (stats.edge_n.size() == 1) {
+  if (stats.num_root_edges == 1) {
     LOGFILE << "Only one possible move. Moving immediately.";
     return true;
   }
-  if (stats.edge_n.size() <= static_cast<size_t>(stats.num_losing_edges) +
-                                 (stats.may_resign ? 0 : 1)) {
+  if (stats.num_root_edges <=
+      stats.num_losing_edges + (stats.may_resign ? 0 : 1)) {
     LOGFILE << "At most one non losing move, stopping search.";
     return true;
   }
@@ -209,7 +251,7 @@ bool SmartPruningStopper::ShouldStop(const IterationStats& stats,
     return false;
   }
   if (!first_eval_time_) return false;
-  if (stats.edge_n.size() == 0) return false;
+  if (stats.num_root_edges == 0) return false;
   if (stats.time_since_movestart <
       *first_eval_time_ + kSmartPruningToleranceMs) {
     return false;
@@ -231,16 +273,10 @@ bool SmartPruningStopper::ShouldStop(const IterationStats& stats,
   hints->UpdateEstimatedRemainingPlayouts(remaining_playouts);
   if (stats.batches_since_movestart < minimum_batches_) return false;
 
-  uint32_t largest_n = 0;
-  uint32_t second_largest_n = 0;
-  for (auto n : stats.edge_n) {
-    if (n > largest_n) {
-      second_largest_n = largest_n;
-      largest_n = n;
-    } else if (n > second_largest_n) {
-      second_largest_n = n;
-    }
-  }
+  UpdateLargestEdges(stats);
+  const uint32_t largest_n = largest_edge_ < 0 ? 0 : visits_[largest_edge_];
+  const uint32_t second_largest_n =
+      second_edge_ < 0 ? 0 : visits_[second_edge_];
 
   if (remaining_playouts < (largest_n - second_largest_n)) {
     LOGFILE << std::fixed << remaining_playouts
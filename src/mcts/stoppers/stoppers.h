@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <array>
 #include <optional>
 #include <vector>
 
@@ -122,7 +123,10 @@ class KldGainStopper : public SearchStopper {
   const int average_interval_;
   Mutex mutex_;
   std::vector<uint32_t> prev_visits_ GUARDED_BY(mutex_);
+  uint64_t prev_visits_sum_ GUARDED_BY(mutex_) = 0;
   double prev_child_nodes_ GUARDED_BY(mutex_) = 0.0;
+  bool has_snapshot_ GUARDED_BY(mutex_) = false;
+  RootEdgeChanges changes_ GUARDED_BY(mutex_);
 };
 
 // Does many things:
@@ -137,8 +141,16 @@ class SmartPruningStopper : public SearchStopper {
  private:
   const double smart_pruning_factor_;
   const int64_t minimum_batches_;
+  // Updates the two most visited root edges from the changed ones.
+  void UpdateLargestEdges(const IterationStats& stats) REQUIRES(mutex_);
+
   Mutex mutex_;
   std::optional<int64_t> first_eval_time_ GUARDED_BY(mutex_);
+  RootEdgeChanges changes_ GUARDED_BY(mutex_);
+  std::array<uint32_t, RootEdgeVisits::kMaxEdges> visits_ GUARDED_BY(mutex_) =
+      {};
+  int largest_edge_ GUARDED_BY(mutex_) = -1;
+  int second_edge_ GUARDED_BY(mutex_) = -1;
 };
 
 }  // namespace lczero
@@ -28,9 +28,61 @@
 #include "mcts/stoppers/timemgr.h"
 
 #include "mcts/stoppers/stoppers.h"
+#include "utils/exception.h"
 
 namespace lczero {
 
+void RootEdgeVisits::Reset(const std::vector<uint32_t>& visits) {
+  for (auto& consumer : changed_) {
+    for (auto& word : consumer) word.store(0, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < kMaxEdges; i++) {
+    const uint32_t n = i < static_cast<int>(visits.size()) ? visits[i] : 0;
+    visits_[i].store(n, std::memory_order_relaxed);
+    if (n > 0) MarkChanged(i);
+  }
+}
+
+int RootEdgeVisits::AddConsumer() {
+  Mutex::Lock lock(consumers_mutex_);
+  const int consumer = num_consumers_.load(std::memory_order_relaxed);
+  if (consumer == kMaxConsumers) {
+    throw Exception("Too many consumers of root edge visits");
+  }
+  for (auto& word : changed_[consumer]) {
+    word.store(~uint64_t{0}, std::memory_order_relaxed);
+  }
+  num_consumers_.store(consumer + 1, std::memory_order_release);
+  return consumer;
+}
+
+void RootEdgeVisits::Snapshot(int edges, std::vector<uint32_t>* visits) const {
+  visits->resize(edges);
+  for (int i = 0; i < edges; i++) (*visits)[i] = Get(i);
+}
+
+void RootEdgeVisits::CollectChanged(int consumer, std::vector<int>* edges) {
+  for (int w = 0; w < kMaxEdges / 64; w++) {
+    auto& word = changed_[consumer][w];
+    // Relaxed loads keep the common case of no changes free of RMW operations.
+    if (word.load(std::memory_order_relaxed) == 0) continue;
+    for (uint64_t bits = word.exchange(0, std::memory_order_acquire); bits;
+         bits &= bits - 1) {
+      edges->push_back(w * 64 + __builtin_ctzll(bits));
+    }
+  }
+}
+
+const std::vector<int>& RootEdgeChanges::Collect(RootEdgeVisits* visits) {
+  if (visits != visits_) {
+    visits_ = visits;
+    consumer_ = visits->AddConsumer();
+  }
+  changed_.clear();
+  visits->CollectChanged(consumer_, &changed_);
+  return changed_;
+}
+
 StoppersHints::StoppersHints() { Reset(); }
 
 void StoppersHints::UpdateEstimatedRemainingTimeMs(int64_t v) {
@@ -27,6 +27,8 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <optional>
@@ -34,10 +36,74 @@
 
 #include "chess/uciloop.h"
 #include "mcts/node.h"
+#include "utils/mutex.h"
 #include "utils/optionsdict.h"
 
 namespace lczero {
 
+// Visit counts of the root edges, updated lock-free at backup time. Changed
+// edges are flagged, so that statistics over root edges can be maintained in
+// O(changed edges) rather than by rescanning all of them.
+class RootEdgeVisits {
+ public:
+  static constexpr int kMaxEdges = 256;
+  static constexpr int kMaxConsumers = 4;
+
+  // Sets visit counts of the root edges. Edges with visits are marked changed.
+  void Reset(const std::vector<uint32_t>& visits);
+  // Registers a consumer of changed edges and returns its id. All edges count
+  // as changed for a new consumer.
+  int AddConsumer();
+  // Adds @delta visits to @edge. Safe to call concurrently.
+  void Add(int edge, int delta) {
+    visits_[edge].fetch_add(delta, std::memory_order_relaxed);
+    MarkChanged(edge);
+  }
+  // Sets the visit count of @edge, which is marked changed if it differs.
+  void Set(int edge, uint32_t visits) {
+    if (visits_[edge].exchange(visits, std::memory_order_relaxed) != visits) {
+      MarkChanged(edge);
+    }
+  }
+  uint32_t Get(int edge) const {
+    return visits_[edge].load(std::memory_order_relaxed);
+  }
+  // Copies visit counts of the first @edges root edges into @visits.
+  void Snapshot(int edges, std::vector<uint32_t>* visits) const;
+  // Appends edges changed since the previous call with the same @consumer to
+  // @edges, and clears their changed flags. A consumer must not collect from
+  // several threads at once.
+  void CollectChanged(int consumer, std::vector<int>* edges);
+
+ private:
+  void MarkChanged(int edge) {
+    const uint64_t bit = uint64_t{1} << (edge % 64);
+    const int consumers = num_consumers_.load(std::memory_order_acquire);
+    for (int i = 0; i < consumers; i++) {
+      changed_[i][edge / 64].fetch_or(bit, std::memory_order_release);
+    }
+  }
+
+  std::array<std::atomic<uint32_t>, kMaxEdges> visits_{};
+  // Changed flags, one set per consumer.
+  std::array<std::array<std::atomic<uint64_t>, kMaxEdges / 64>, kMaxConsumers>
+      changed_{};
+  std::atomic<int> num_consumers_{0};
+  Mutex consumers_mutex_;
+};
+
+// The root edges changed since the previous Collect() call, for one consumer
+// that registers with the RootEdgeVisits on first use.
+class RootEdgeChanges {
+ public:
+  const std::vector<int>& Collect(RootEdgeVisits* visits);
+
+ private:
+  RootEdgeVisits* visits_ = nullptr;
+  int consumer_ = -1;
+  std::vector<int> changed_;
+};
+
 // Various statistics that search sends to stoppers for their stopping decision.
 // It is expected that this structure will grow.
 struct IterationStats {
@@ -47,7 +113,11 @@ struct IterationStats {
   int64_t nodes_since_movestart = 0;
   int64_t batches_since_movestart = 0;
   int average_depth = 0;
-  std::vector<uint32_t> edge_n;
+  // Number of root edges, 0 until the root is expanded.
+  int num_root_edges = 0;
+  // Root edge visits maintained during backup. Stoppers read visit counts
+  // from here instead of having search rescan the root edges.
+  RootEdgeVisits* root_edge_visits = nullptr;
 
   // TODO: remove this in favor of time_usage_hint_=kImmediateMove when
   // smooth time manager is the default.
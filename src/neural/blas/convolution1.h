@@ -35,8 +35,8 @@ class Convolution1 {
                       const float* weights, float* output);
 
  private:
-  static constexpr auto kWidth = 8;
-  static constexpr auto kHeight = 8;
+  static constexpr auto kWidth = 9;
+  static constexpr auto kHeight = 10;
   static constexpr auto kSquares = kWidth * kHeight;
 };
 }  // namespace lczero
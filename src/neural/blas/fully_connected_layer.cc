@@ -18,6 +18,7 @@
 
 #include "neural/blas/fully_connected_layer.h"
 #include "neural/blas/blas.h"
+#include "neural/blas/encoder.h"
 #include "neural/shared/activation.h"
 
 #include <algorithm>
@@ -35,6 +36,12 @@ void ApplyBias(size_t batch_size, const size_t output_size, const float* biases,
     Activate(output_size, batch_outputs, biases, batch_outputs, activation);
   }
 }
+
+// Size of the output tiles of FusedForward1D(), small enough for the tile to
+// still be in L2 when its epilogue runs.
+constexpr size_t kEpilogueTileBytes = 256 * 1024;
+// Tiles never get smaller than this many rows, to keep reusing the weights.
+constexpr size_t kEpilogueMinTileRows = 90;
 }  // namespace
 
 template <typename T>
@@ -148,4 +155,37 @@ float FullyConnectedLayer<true>::Forward0D(const size_t size, const float* x,
       ConstEigenVectorMap<float>(y, size));
 }
 
+template <bool use_eigen>
+void FusedForward1D(size_t rows, size_t input_size, size_t output_size,
+                    const float* input, const float* weights,
+                    const float* biases, ActivationFunction activation,
+                    float* output, const SkipLayerNorm* norm) {
+  const size_t tile_rows =
+      std::max(kEpilogueMinTileRows,
+               kEpilogueTileBytes / (output_size * sizeof(float)));
+  for (size_t row = 0; row < rows; row += tile_rows) {
+    const size_t count = std::min(tile_rows, rows - row);
+    float* tile = output + row * output_size;
+    FullyConnectedLayer<use_eigen>::Forward1D(
+        count, input_size, output_size, input + row * input_size, weights,
+        biases, activation, tile);
+    if (norm == nullptr) continue;
+    LayerNorm2DWithSkipConnection(
+        count, output_size, tile, norm->alpha,
+        norm->skip ? norm->skip + row * output_size : nullptr, norm->gammas,
+        norm->betas, norm->epsilon);
+  }
+}
+
+#ifdef USE_BLAS
+template void FusedForward1D<false>(size_t, size_t, size_t, const float*,
+                                    const float*, const float*,
+                                    ActivationFunction, float*,
+                                    const SkipLayerNorm*);
+#endif
+template void FusedForward1D<true>(size_t, size_t, size_t, const float*,
+                                   const float*, const float*,
+                                   ActivationFunction, float*,
+                                   const SkipLayerNorm*);
+
 }  // namespace lczero
@@ -42,4 +42,24 @@ class FullyConnectedLayer {
 
 };
 
+// Skip connection and layer norm following a fully connected layer, i.e.
+// output = LayerNorm(alpha * output + skip). The skip may be null.
+struct SkipLayerNorm {
+  float alpha;
+  const float* skip;
+  const float* gammas;
+  const float* betas;
+  float epsilon;
+};
+
+// Fully connected layer over the rows of a row-major matrix, computed in
+// tiles of rows. Bias, activation and the optional skip connection with layer
+// norm are applied to each tile right after its GEMM, instead of in separate
+// passes over the whole output.
+template <bool use_eigen>
+void FusedForward1D(size_t rows, size_t input_size, size_t output_size,
+                    const float* input, const float* weights,
+                    const float* biases, ActivationFunction activation,
+                    float* output, const SkipLayerNorm* norm = nullptr);
+
 }  // namespace lczero
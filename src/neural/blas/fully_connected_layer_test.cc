@@ -0,0 +1,129 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/blas/fully_connected_layer.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace lczero {
+namespace {
+
+struct FcCase {
+  size_t rows;
+  size_t input_size;
+  size_t output_size;
+  bool norm;
+};
+
+std::vector<float> RandomVector(size_t size, std::mt19937* rng) {
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> result(size);
+  for (auto& x : result) x = dist(*rng);
+  return result;
+}
+
+template <bool use_eigen>
+void ExpectFusedMatchesUnfused(const FcCase& c) {
+  std::mt19937 rng(7);
+  const auto input = RandomVector(c.rows * c.input_size, &rng);
+  const auto weights = RandomVector(c.input_size * c.output_size, &rng);
+  const auto biases = RandomVector(c.output_size, &rng);
+  const auto skip = RandomVector(c.rows * c.output_size, &rng);
+  const auto gammas = RandomVector(c.output_size, &rng);
+  const auto betas = RandomVector(c.output_size, &rng);
+  const float alpha = 0.7f;
+  const float epsilon = 1e-6f;
+
+  // Unfused: the whole layer at once, then the layer norm in a second pass.
+  std::vector<float> expected(c.rows * c.output_size);
+  FullyConnectedLayer<use_eigen>::Forward1D(
+      c.rows, c.input_size, c.output_size, input.data(), weights.data(),
+      biases.data(), ACTIVATION_RELU, expected.data());
+  if (c.norm) {
+    for (size_t row = 0; row < c.rows; row++) {
+      float* x = &expected[row * c.output_size];
+      const float* s = &skip[row * c.output_size];
+      double mean = 0.0;
+      for (size_t i = 0; i < c.output_size; i++) {
+        x[i] = x[i] * alpha + s[i];
+        mean += x[i];
+      }
+      mean /= c.output_size;
+      double var = 0.0;
+      for (size_t i = 0; i < c.output_size; i++) {
+        var += (x[i] - mean) * (x[i] - mean);
+      }
+      var /= c.output_size;
+      for (size_t i = 0; i < c.output_size; i++) {
+        x[i] = betas[i] + gammas[i] * (x[i] - mean) / std::sqrt(var + epsilon);
+      }
+    }
+  }
+
+  std::vector<float> fused(c.rows * c.output_size);
+  const SkipLayerNorm norm{alpha, skip.data(), gammas.data(), betas.data(),
+                           epsilon};
+  FusedForward1D<use_eigen>(c.rows, c.input_size, c.output_size, input.data(),
+                            weights.data(), biases.data(), ACTIVATION_RELU,
+                            fused.data(), c.norm ? &norm : nullptr);
+
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_NEAR(fused[i], expected[i], 1e-4f)
+        << "row " << i / c.output_size << " column " << i % c.output_size;
+  }
+}
+
+// Several tiles of 1024 rows, the last one partial, and tiles held at the
+// minimum of 90 rows for wide outputs.
+const FcCase kCases[] = {
+    {2100, 48, 64, false},
+    {2100, 48, 64, true},
+    {200, 32, 1024, true},
+    {1, 32, 16, true},
+};
+
+TEST(FusedForward1D, EigenMatchesUnfused) {
+  for (const auto& c : kCases) ExpectFusedMatchesUnfused<true>(c);
+}
+
+#ifdef USE_BLAS
+TEST(FusedForward1D, BlasMatchesUnfused) {
+  for (const auto& c : kCases) ExpectFusedMatchesUnfused<false>(c);
+}
+#endif
+
+}  // namespace
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
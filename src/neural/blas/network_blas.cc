@@ -33,6 +33,8 @@
 #include "neural/network_legacy.h"
 #include "neural/shared/activation.h"
 #include "neural/shared/attention_policy_map.h"
+#include "neural/shared/expand_planes.h"
+#include "neural/shared/layer_profiler.h"
 #include "neural/shared/policy_map.h"
 #include "neural/shared/winograd_filter.h"
 #include "utils/numa.h"
@@ -70,7 +72,7 @@ class BlasComputation : public NetworkComputation {
                   const ActivationFunction smolgen_activation,
                   const ActivationFunction ffn_activation,
                   const bool attn_policy, const bool attn_body,
-                  bool is_pe_dense_embedding);
+                  bool is_pe_dense_embedding, bool sparse_policy);
 
   virtual ~BlasComputation() {}
 
@@ -117,21 +119,30 @@ class BlasComputation : public NetworkComputation {
   }
 
  private:
-  void EncodePlanes(const InputPlanes& sample, float* buffer);
   void ForwardEncoderLayer(
       std::vector<float>& encoder_buffer, std::vector<float>& encoder_buffer2,
       std::vector<float>& encoder_buffer3, std::vector<float>& encoder_buffer4,
       size_t batch_size, const MultiHeadWeights::EncoderLayer& layer,
       int embedding_size, int heads, ActivationFunction smolgen_activation,
-      ActivationFunction ffn_activation, float alpha, float default_eps);
-
-  static constexpr auto kWidth = 8;
-  static constexpr auto kHeight = 8;
+      ActivationFunction ffn_activation, float alpha, float default_eps,
+      const char* profile_name, int profile_index);
+  // Attention policy logits for moves from the side to move's pieces to the
+  // other squares only, other entries of the policy are left at zero.
+  void ForwardSparseAttentionPolicy(
+      size_t start, size_t batch_size, size_t embedding_size, size_t d_model,
+      const MultiHeadWeights::PolicyHead& policy_head,
+      std::vector<float>& buffer1, std::vector<float>& buffer2,
+      std::vector<float>& buffer3, std::vector<float>& head_buffer);
+
+  static constexpr auto kWidth = 9;
+  static constexpr auto kHeight = 10;
   static constexpr auto kSquares = kWidth * kHeight;
-  static constexpr auto kPolicyOutputs = 1858;
   // Number of used planes with convolutional policy.
-  // The real number of planes is higher because of padding.
-  static constexpr auto kPolicyUsedPlanes = 73;
+  static constexpr auto kPolicyUsedPlanes = 52;
+  // Number of input planes fed to the dense embedding preprocess layer.
+  static constexpr auto kDenseEmbeddingPlanes = 14;
+  // Number of input planes holding the side to move's pieces.
+  static constexpr auto kOwnPiecePlanes = 7;
 
   const MultiHeadWeights& weights_;
   size_t max_batch_size_;
@@ -145,6 +156,7 @@ class BlasComputation : public NetworkComputation {
   bool attn_policy_;
   bool attn_body_;
   bool is_pe_dense_embedding_;
+  bool sparse_policy_;
   ActivationFunction default_activation_;
   ActivationFunction smolgen_activation_;
   ActivationFunction ffn_activation_;
@@ -163,7 +175,8 @@ class BlasNetwork : public Network {
     return std::make_unique<BlasComputation<use_eigen>>(
         this, weights_, policy_head_, value_head_, max_batch_size_, wdl_,
         moves_left_, conv_policy_, default_activation_, smolgen_activation_,
-        ffn_activation_, attn_policy_, attn_body_, is_pe_dense_embedding_);
+        ffn_activation_, attn_policy_, attn_body_, is_pe_dense_embedding_,
+        sparse_policy_);
   }
 
   const NetworkCapabilities& GetCapabilities() const override {
@@ -205,6 +218,7 @@ class BlasNetwork : public Network {
   bool attn_policy_;
   bool attn_body_;
   bool is_pe_dense_embedding_;
+  bool sparse_policy_;
   ActivationFunction default_activation_;
   ActivationFunction smolgen_activation_;
   ActivationFunction ffn_activation_;
@@ -222,7 +236,7 @@ BlasComputation<use_eigen>::BlasComputation(
     const bool conv_policy, const ActivationFunction default_activation,
     const ActivationFunction smolgen_activation,
     const ActivationFunction ffn_activation, const bool attn_policy,
-    const bool attn_body, bool is_pe_dense_embedding)
+    const bool attn_body, bool is_pe_dense_embedding, bool sparse_policy)
     : weights_(weights),
       max_batch_size_(max_batch_size),
       policies_(0),
@@ -233,6 +247,7 @@ BlasComputation<use_eigen>::BlasComputation(
       attn_policy_(attn_policy),
       attn_body_(attn_body),
       is_pe_dense_embedding_(is_pe_dense_embedding),
+      sparse_policy_(sparse_policy),
       default_activation_(default_activation),
       smolgen_activation_(smolgen_activation),
       ffn_activation_(ffn_activation),
@@ -272,7 +287,8 @@ void BlasComputation<use_eigen>::ForwardEncoderLayer(
     std::vector<float>& encoder_buffer3, std::vector<float>& encoder_buffer4,
     size_t batch_size, const MultiHeadWeights::EncoderLayer& layer,
     int embedding_size, int heads, ActivationFunction smolgen_activation,
-    ActivationFunction ffn_activation, float alpha, float default_eps) {
+    ActivationFunction ffn_activation, float alpha, float default_eps,
+    const char* profile_name, int profile_index) {
   const int d_model = layer.mha.q_b.size();
   const int dff_size = layer.ffn.dense1_b.size();
   const int hidden_channels =
@@ -297,6 +313,7 @@ void BlasComputation<use_eigen>::ForwardEncoderLayer(
 
   // Smolgen.
   if (layer.mha.has_smolgen) {
+    LayerProfiler::Scope scope(profile_name, "smolgen", profile_index);
     const float* input = &encoder_buffer[0];
     float* QK = &encoder_buffer4[0];
 
@@ -306,28 +323,22 @@ void BlasComputation<use_eigen>::ForwardEncoderLayer(
         layer.mha.smolgen.compress.data(), (const float*)nullptr,
         ACTIVATION_NONE, encoder_buffer2.data());
 
-    // Dense 1.
-    FullyConnectedLayer<use_eigen>::Forward1D(
+    // Dense 1 + layer norm.
+    const SkipLayerNorm ln1{1.0f, nullptr, layer.mha.smolgen.ln1_gammas.data(),
+                            layer.mha.smolgen.ln1_betas.data(), 1e-3};
+    FusedForward1D<use_eigen>(
         batch_size, kSquares * hidden_channels, hidden_sz,
         encoder_buffer2.data(), layer.mha.smolgen.dense1_w.data(),
         layer.mha.smolgen.dense1_b.data(), smolgen_activation,
-        encoder_buffer3.data());
-    // Layer Norm.
-    LayerNorm2DWithSkipConnection(batch_size, hidden_sz, encoder_buffer3.data(),
-                                  1.0f, (const float*)nullptr,
-                                  layer.mha.smolgen.ln1_gammas.data(),
-                                  layer.mha.smolgen.ln1_betas.data(), 1e-3);
-
-    // Dense 2.
-    FullyConnectedLayer<use_eigen>::Forward1D(
+        encoder_buffer3.data(), &ln1);
+
+    // Dense 2 + layer norm.
+    const SkipLayerNorm ln2{1.0f, nullptr, layer.mha.smolgen.ln2_gammas.data(),
+                            layer.mha.smolgen.ln2_betas.data(), 1e-3};
+    FusedForward1D<use_eigen>(
         batch_size, hidden_sz, gen_sz_outputs, encoder_buffer3.data(),
         layer.mha.smolgen.dense2_w.data(), layer.mha.smolgen.dense2_b.data(),
-        smolgen_activation, encoder_buffer2.data());
-    // Layer Norm.
-    LayerNorm2DWithSkipConnection(
-        batch_size, gen_sz_outputs, encoder_buffer2.data(), 1.0f,
-        (const float*)nullptr, layer.mha.smolgen.ln2_gammas.data(),
-        layer.mha.smolgen.ln2_betas.data(), 1e-3);
+        smolgen_activation, encoder_buffer2.data(), &ln2);
 
     // Global smolgen weights.
     FullyConnectedLayer<use_eigen>::Forward1D(
@@ -336,13 +347,14 @@ void BlasComputation<use_eigen>::ForwardEncoderLayer(
         (const float*)nullptr, ACTIVATION_NONE, QK);
   }
 
+  LayerProfiler::Scope mha_scope(profile_name, "mha", profile_index);
   // Q
-  FullyConnectedLayer<use_eigen>::Forward1D(
+  FusedForward1D<use_eigen>(
       batch_size * kSquares, embedding_size, d_model, encoder_buffer.data(),
       layer.mha.q_w.data(), layer.mha.q_b.data(), ACTIVATION_NONE,
       encoder_buffer2.data());
   // K
-  FullyConnectedLayer<use_eigen>::Forward1D(
+  FusedForward1D<use_eigen>(
       batch_size * kSquares, embedding_size, d_model, encoder_buffer.data(),
       layer.mha.k_w.data(), layer.mha.k_b.data(), ACTIVATION_NONE,
       encoder_buffer3.data());
@@ -404,7 +416,7 @@ void BlasComputation<use_eigen>::ForwardEncoderLayer(
   }
 
   // V
-  FullyConnectedLayer<use_eigen>::Forward1D(
+  FusedForward1D<use_eigen>(
       batch_size * kSquares, embedding_size, d_model, encoder_buffer.data(),
       layer.mha.v_w.data(), layer.mha.v_b.data(), ACTIVATION_NONE,
       encoder_buffer3.data());
@@ -436,35 +448,33 @@ void BlasComputation<use_eigen>::ForwardEncoderLayer(
     }
   }
 
-  // Fully connected final MHA layer.
-  FullyConnectedLayer<use_eigen>::Forward1D(
+  // Fully connected final MHA layer + skip connection + layer norm.
+  const SkipLayerNorm ln1{alpha, encoder_buffer.data(),
+                          layer.ln1_gammas.data(), layer.ln1_betas.data(),
+                          default_eps};
+  FusedForward1D<use_eigen>(
       batch_size * kSquares, d_model, embedding_size, encoder_buffer2.data(),
       layer.mha.dense_w.data(), layer.mha.dense_b.data(), ACTIVATION_NONE,
-      encoder_buffer3.data());
-
-  // Layer Norm + skip connection.
-  LayerNorm2DWithSkipConnection(batch_size * kSquares, embedding_size,
-                                encoder_buffer3.data(), alpha,
-                                encoder_buffer.data(), layer.ln1_gammas.data(),
-                                layer.ln1_betas.data(), default_eps);
+      encoder_buffer3.data(), &ln1);
   std::swap(encoder_buffer3, encoder_buffer);
+  mha_scope.Stop();
 
   // FFN.
-  FullyConnectedLayer<use_eigen>::Forward1D(
+  LayerProfiler::Scope ffn_scope(profile_name, "ffn", profile_index);
+  FusedForward1D<use_eigen>(
       batch_size * kSquares, embedding_size, dff_size, encoder_buffer.data(),
       layer.ffn.dense1_w.data(), layer.ffn.dense1_b.data(), ffn_activation,
       encoder_buffer4.data());
 
-  FullyConnectedLayer<use_eigen>::Forward1D(
+  // Dense 2 + skip connection + layer norm.
+  const SkipLayerNorm ln2{alpha, encoder_buffer.data(),
+                          layer.ln2_gammas.data(), layer.ln2_betas.data(),
+                          default_eps};
+  FusedForward1D<use_eigen>(
       batch_size * kSquares, dff_size, layer.ffn.dense2_b.size(),
       encoder_buffer4.data(), layer.ffn.dense2_w.data(),
-      layer.ffn.dense2_b.data(), ACTIVATION_NONE, encoder_buffer3.data());
-
-  // Layer Norm + skip connection.
-  LayerNorm2DWithSkipConnection(batch_size * kSquares, embedding_size,
-                                encoder_buffer3.data(), alpha,
-                                encoder_buffer.data(), layer.ln2_gammas.data(),
-                                layer.ln2_betas.data(), default_eps);
+      layer.ffn.dense2_b.data(), ACTIVATION_NONE, encoder_buffer3.data(),
+      &ln2);
   std::swap(encoder_buffer3, encoder_buffer);
 }
 
@@ -489,11 +499,11 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
   // convolution.
   // Residual blocks are identical, but the first convolution might be bigger
   // when the network has very few filters
-  // For attention body nets, input channel size is increased by positional
-  // encoding.
+  // For attention body nets with dense embedding, input channel size is
+  // increased by the preprocessed positional information.
   const auto enc_channels = is_pe_dense_embedding_
-                                ? weights_.ip_emb_preproc_b.size() / 64
-                                : kNumPosEncodingChannels;
+                                ? weights_.ip_emb_preproc_b.size() / kSquares
+                                : 0;
   const auto input_channels =
       static_cast<size_t>(kInputPlanes + (attn_body_ ? enc_channels : 0));
   const auto input_embed_dff = weights_.ip_emb_ffn.dense1_b.size();
@@ -512,14 +522,14 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
   const auto largest_batch_size = std::min(max_batch_size_, total_batches);
 
   /* Typically
-   input_channels = 112
-   position encoding = 64 (512 for new encoding)
+   input_channels = 124
+   position encoding = 0 (dense embedding size for new encoding)
    output_channels = 192
    max_channels = 192
    num_value_input_planes = 32
    num_policy_input_planes = 32
    num_value_channels = 128
-   num_output_policy = 1858
+   num_output_policy = 2062
    */
 
   size_t max_fc_channels = std::max(
@@ -528,8 +538,9 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       std::max(num_policy_input_planes,
                std::max(num_value_input_planes, num_moves_input_planes));
   if (attn_policy_) {
-    max_head_planes = std::max(std::max(max_head_planes, size_t{67}),
-                               policy_head.ip_pol_b.size());
+    max_head_planes =
+        std::max(std::max(max_head_planes, static_cast<size_t>(kSquares)),
+                 policy_head.ip_pol_b.size());
   }
 
   std::unique_ptr<Buffers> buffers = network_->GetBuffers();
@@ -555,21 +566,25 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
 
   for (size_t start = 0; start < total_batches; start += largest_batch_size) {
     const auto batch_size = std::min(total_batches - start, largest_batch_size);
-    for (size_t j = 0; j < batch_size; j++) {
-      EncodePlanes(planes_[start + j], &buffer1[j * kSquares * kInputPlanes]);
-    }
+    LayerProfiler::Scope encode_scope("input encoding");
+    ExpandPlanes(planes_, start, batch_size, buffer1.data());
+    encode_scope.Stop();
 
     if (num_res_blocks > 0) {
       // Input convolution
+      LayerProfiler::Scope input_scope("input conv");
       convolve3.Forward(batch_size, kInputPlanes, output_channels,
                         buffer1.data(), weights_.input.weights.data(),
                         buffer2.data());
 
       BiasActivate(batch_size, output_channels, buffer2.data(),
                    weights_.input.biases.data(), default_activation_);
+      input_scope.Stop();
 
       // Residual tower
-      for (auto& residual : weights_.residual) {
+      for (size_t i = 0; i < num_res_blocks; i++) {
+        const auto& residual = weights_.residual[i];
+        LayerProfiler::Scope scope("residual", i);
         const auto& conv1 = residual.conv1;
         const auto& conv2 = residual.conv2;
         const auto& se = residual.se;
@@ -601,6 +616,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
     if (attn_body_) {
       const auto embedding_size = weights_.ip_emb_b.size();
       assert(embedding_size > 0);
+      LayerProfiler::Scope embedding_scope("embedding");
       const auto input_size =
           num_res_blocks == 0 ? input_channels : weights_.input.biases.size();
 
@@ -608,18 +624,19 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
         // No residual means pure transformer, so process input position
         // encoding.
         if (is_pe_dense_embedding_) {
-          // NCHW to NHWC conversion of 12-channel slice of input.
+          // NCHW to NHWC conversion of 14-channel slice of input.
+          constexpr auto kPlanes = kDenseEmbeddingPlanes;
           for (auto batch = size_t{0}; batch < batch_size; batch++) {
             for (auto i = 0; i < kSquares; i++) {
-              for (size_t j = 0; j < 12; j++) {
-                buffer3[batch * kSquares * 12 + i * 12 + j] =
+              for (size_t j = 0; j < kPlanes; j++) {
+                buffer3[batch * kSquares * kPlanes + i * kPlanes + j] =
                     buffer1[batch * kSquares * kInputPlanes + j * kSquares + i];
               }
             }
           }
           // Dense embedding preprocess layer.
           FullyConnectedLayer<use_eigen>::Forward1D(
-              batch_size, kSquares * 12, weights_.ip_emb_preproc_b.size(),
+              batch_size, kSquares * kPlanes, weights_.ip_emb_preproc_b.size(),
               buffer3.data(), weights_.ip_emb_preproc_w.data(),
               weights_.ip_emb_preproc_b.data(), ACTIVATION_NONE,
               buffer2.data());
@@ -633,36 +650,25 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
               buffer3[batch * kSquares * input_size + i * input_size + j] =
                   buffer1[batch * kSquares * kInputPlanes + j * kSquares + i];
             }
-            // Position encoding concat.
-            if (is_pe_dense_embedding_) {
-              for (size_t j = kInputPlanes; j < input_size; j++) {
-                buffer3[batch * kSquares * input_size + i * input_size + j] =
-                    buffer2[batch * kSquares * enc_channels + i * enc_channels +
-                            j - kInputPlanes];
-              }
-            } else {
-              for (size_t j = kInputPlanes; j < input_size; j++) {
-                buffer3[batch * kSquares * input_size + i * input_size + j] =
-                    kPosEncoding[i][j - kInputPlanes];
-              }
+            // Position encoding concat (dense embedding only).
+            for (size_t j = kInputPlanes; j < input_size; j++) {
+              buffer3[batch * kSquares * input_size + i * input_size + j] =
+                  buffer2[batch * kSquares * enc_channels + i * enc_channels +
+                          j - kInputPlanes];
             }
           }
         }
       }
 
-      // Input embedding.
-      FullyConnectedLayer<use_eigen>::Forward1D(
+      // Input embedding, with layer norm for new encoding.
+      const SkipLayerNorm emb_ln{1.0f, nullptr,
+                                 weights_.ip_emb_ln_gammas.data(),
+                                 weights_.ip_emb_ln_betas.data(), 1e-3};
+      FusedForward1D<use_eigen>(
           batch_size * kSquares, input_size, embedding_size, buffer3.data(),
           weights_.ip_emb_w.data(), weights_.ip_emb_b.data(),
-          default_activation_, buffer1.data());
-
-      // Layer norm for new encoding.
-      if (is_pe_dense_embedding_) {
-        LayerNorm2DWithSkipConnection(
-            batch_size * kSquares, embedding_size, buffer1.data(), 1.0f,
-            (const float*)nullptr, weights_.ip_emb_ln_gammas.data(),
-            weights_.ip_emb_ln_betas.data(), 1e-3);
-      }
+          default_activation_, buffer1.data(),
+          is_pe_dense_embedding_ ? &emb_ln : nullptr);
 
       // Input gating
       if (weights_.ip_mult_gate.size() > 0 && weights_.ip_add_gate.size() > 0) {
@@ -679,49 +685,51 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
         };
       }
 
+      embedding_scope.Stop();
+
       float alpha = (float)pow(2.0 * weights_.encoder.size(), -0.25);
 
       // FFN in embedding for new encoding.
       if (is_pe_dense_embedding_) {
+        LayerProfiler::Scope scope("embedding ffn");
         const auto dff_size = weights_.ip_emb_ffn.dense1_b.size();
         // FFN dense 1.
-        FullyConnectedLayer<use_eigen>::Forward1D(
+        FusedForward1D<use_eigen>(
             batch_size * kSquares, embedding_size, dff_size, buffer1.data(),
             weights_.ip_emb_ffn.dense1_w.data(),
             weights_.ip_emb_ffn.dense1_b.data(), ffn_activation_,
             buffer3.data());
 
-        // FFN dense 2.
-        FullyConnectedLayer<use_eigen>::Forward1D(
+        // FFN dense 2 + skip connection + layer norm.
+        const SkipLayerNorm ffn_ln{alpha, buffer1.data(),
+                                   weights_.ip_emb_ffn_ln_gammas.data(),
+                                   weights_.ip_emb_ffn_ln_betas.data(), 1e-3};
+        FusedForward1D<use_eigen>(
             batch_size * kSquares, dff_size,
             weights_.ip_emb_ffn.dense2_b.size(), buffer3.data(),
             weights_.ip_emb_ffn.dense2_w.data(),
             weights_.ip_emb_ffn.dense2_b.data(), ACTIVATION_NONE,
-            buffer2.data());
-
-        // Layer Norm.
-        LayerNorm2DWithSkipConnection(
-            batch_size * kSquares, weights_.ip_emb_ffn.dense2_b.size(),
-            buffer2.data(), alpha, buffer1.data(),
-            weights_.ip_emb_ffn_ln_gammas.data(),
-            weights_.ip_emb_ffn_ln_betas.data(), 1e-3);
+            buffer2.data(), &ffn_ln);
 
         std::swap(buffer1, buffer2);
       }
 
       // Attention body encoders.
-      for (auto& layer : weights_.encoder) {
+      for (size_t i = 0; i < weights_.encoder.size(); i++) {
         ForwardEncoderLayer(buffer1, buffer2, buffer3, head_buffer, batch_size,
-                            layer, embedding_size, weights_.encoder_head_count,
-                            smolgen_activation_, ffn_activation_, alpha,
-                            is_pe_dense_embedding_ ? 1e-3 : 1e-6);
+                            weights_.encoder[i], embedding_size,
+                            weights_.encoder_head_count, smolgen_activation_,
+                            ffn_activation_, alpha,
+                            is_pe_dense_embedding_ ? 1e-3 : 1e-6, "encoder",
+                            i);
       }
     }
 
     // Preserve buffer1 and buffer2, used for policy and moves left heads.
     // Value head
+    LayerProfiler::Scope value_scope("value head");
     if (attn_body_) {
-      FullyConnectedLayer<use_eigen>::Forward1D(
+      FusedForward1D<use_eigen>(
           batch_size * kSquares, weights_.ip_emb_b.size(),
           num_value_input_planes, buffer1.data(), value_head.ip_val_w.data(),
           value_head.ip_val_b.data(), default_activation_, head_buffer.data());
@@ -769,10 +777,13 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       }
     }
 
+    value_scope.Stop();
+
     // Moves left head.
     if (moves_left_) {
+      LayerProfiler::Scope scope("moves left head");
       if (attn_body_) {
-        FullyConnectedLayer<use_eigen>::Forward1D(
+        FusedForward1D<use_eigen>(
             batch_size * kSquares, weights_.ip_emb_b.size(),
             num_moves_input_planes, buffer1.data(), weights_.ip_mov_w.data(),
             weights_.ip_mov_b.data(), default_activation_, head_buffer.data());
@@ -802,6 +813,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
 
     // Policy head.
     if (attn_policy_) {
+      LayerProfiler::Scope embedding_scope("policy embedding");
       if (!attn_body_) {
         // NCHW to NHWC conversion.
         for (auto batch = size_t{0}; batch < batch_size; batch++) {
@@ -816,7 +828,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       }
       const size_t policy_embedding_size = policy_head.ip_pol_b.size();
       // Policy Embedding.
-      FullyConnectedLayer<use_eigen>::Forward1D(
+      FusedForward1D<use_eigen>(
           batch_size * kSquares, output_channels, policy_embedding_size,
           buffer1.data(), policy_head.ip_pol_w.data(),
           policy_head.ip_pol_b.data(),
@@ -825,93 +837,74 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
               : ACTIVATION_SELU,  // SELU activation hardcoded for apmish nets.
           buffer2.data());
 
+      embedding_scope.Stop();
+
       const size_t policy_d_model = policy_head.ip2_pol_b.size();
 
-      for (auto& layer : policy_head.pol_encoder) {
+      for (size_t i = 0; i < policy_head.pol_encoder.size(); i++) {
         ForwardEncoderLayer(
-            buffer2, buffer1, buffer3, head_buffer, batch_size, layer,
-            policy_embedding_size, policy_head.pol_encoder_head_count,
+            buffer2, buffer1, buffer3, head_buffer, batch_size,
+            policy_head.pol_encoder[i], policy_embedding_size,
+            policy_head.pol_encoder_head_count,
             attn_body_ ? smolgen_activation_ : ACTIVATION_NONE,
-            attn_body_ ? ffn_activation_ : ACTIVATION_SELU, 1.0f, 1e-6);
+            attn_body_ ? ffn_activation_ : ACTIVATION_SELU, 1.0f, 1e-6,
+            "policy encoder", i);
       }
 
-      // Q
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size * kSquares, policy_embedding_size, policy_d_model,
-          buffer2.data(), policy_head.ip2_pol_w.data(),
-          policy_head.ip2_pol_b.data(), ACTIVATION_NONE, buffer1.data());
-      // K
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size * kSquares, policy_embedding_size, policy_d_model,
-          buffer2.data(), policy_head.ip3_pol_w.data(),
-          policy_head.ip3_pol_b.data(), ACTIVATION_NONE, buffer3.data());
-      const float scaling = 1.0f / sqrtf(policy_d_model);
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        const float* A = &buffer1[batch * 64 * policy_d_model];
-        const float* B = &buffer3[batch * 64 * policy_d_model];
-        float* C = &head_buffer[batch * (64 * 64 + 8 * 24)];
-        if (use_eigen) {
-          auto C_mat = EigenMatrixMap<float>(C, kSquares, kSquares);
-          C_mat.noalias() =
-              scaling *
-              ConstEigenMatrixMap<float>(B, policy_d_model, kSquares)
-                  .transpose() *
-              ConstEigenMatrixMap<float>(A, policy_d_model, kSquares);
-        } else {
+      LayerProfiler::Scope scope("policy head");
+      if (sparse_policy_) {
+        ForwardSparseAttentionPolicy(start, batch_size, policy_embedding_size,
+                                     policy_d_model, policy_head, buffer1,
+                                     buffer2, buffer3, head_buffer);
+      } else {
+        // Q
+        FusedForward1D<use_eigen>(
+            batch_size * kSquares, policy_embedding_size, policy_d_model,
+            buffer2.data(), policy_head.ip2_pol_w.data(),
+            policy_head.ip2_pol_b.data(), ACTIVATION_NONE, buffer1.data());
+        // K
+        FusedForward1D<use_eigen>(
+            batch_size * kSquares, policy_embedding_size, policy_d_model,
+            buffer2.data(), policy_head.ip3_pol_w.data(),
+            policy_head.ip3_pol_b.data(), ACTIVATION_NONE, buffer3.data());
+        const float scaling = 1.0f / sqrtf(policy_d_model);
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          const float* A = &buffer1[batch * kSquares * policy_d_model];
+          const float* B = &buffer3[batch * kSquares * policy_d_model];
+          float* C = &head_buffer[batch * kSquares * kSquares];
+          if (use_eigen) {
+            auto C_mat = EigenMatrixMap<float>(C, kSquares, kSquares);
+            C_mat.noalias() =
+                scaling *
+                ConstEigenMatrixMap<float>(B, policy_d_model, kSquares)
+                    .transpose() *
+                ConstEigenMatrixMap<float>(A, policy_d_model, kSquares);
+          } else {
 #ifdef USE_BLAS
-          cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, kSquares,
-                      kSquares, policy_d_model, scaling, A, policy_d_model, B,
-                      policy_d_model, 0.0f, C, 64);
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, kSquares,
+                        kSquares, policy_d_model, scaling, A, policy_d_model, B,
+                        policy_d_model, 0.0f, C, kSquares);
 #else
-          // Should never get here.
-          throw Exception("Blas backend internal error");
+            // Should never get here.
+            throw Exception("Blas backend internal error");
 #endif
-        }
-      }
-      // Promotion offset calculation.
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        float promotion_offsets[4][8];
-        // This is so small that SGEMM seems slower.
-        for (int i = 0; i < 4; i++) {
-          for (int j = 0; j < 8; j++) {
-            float sum = 0;
-            for (size_t k = 0; k < policy_d_model; k++) {
-              sum += buffer3[batch * kSquares * policy_d_model +
-                             (56 + j) * policy_d_model + k] *
-                     policy_head.ip4_pol_w[i * policy_d_model + k];
-            }
-            promotion_offsets[i][j] = sum;
           }
         }
-        for (int i = 0; i < 3; i++) {
-          for (int j = 0; j < 8; j++) {
-            promotion_offsets[i][j] += promotion_offsets[3][j];
-          }
-        }
-        for (int k = 0; k < 8; k++) {      // y in cuda
-          for (int j = 0; j < 8; j++) {    // w in cuda
-            for (int i = 0; i < 3; i++) {  // c in cuda
-              head_buffer[batch * (64 * 64 + 8 * 24) + 64 * 64 + 24 * k +
-                          3 * j + i] = head_buffer[batch * (64 * 64 + 8 * 24) +
-                                                   (48 + k) * 64 + 56 + j] +
-                                       promotion_offsets[i][j];
+        // Mapping from attention policy to px0 policy
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          std::vector<float> policy(num_output_policy);
+          for (auto i = 0; i < kSquares * kSquares; i++) {
+            auto j = kAttnPolicyMap[i];
+            if (j >= 0) {
+              policy[j] = head_buffer[batch * kSquares * kSquares + i];
             }
           }
+          policies_.emplace_back(std::move(policy));
         }
       }
-      // Mapping from attention policy to lc0 policy
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        std::vector<float> policy(num_output_policy);
-        for (auto i = 0; i < 64 * 64 + 8 * 24; i++) {
-          auto j = kAttnPolicyMap[i];
-          if (j >= 0) {
-            policy[j] = head_buffer[batch * (64 * 64 + 8 * 24) + i];
-          }
-        }
-        policies_.emplace_back(std::move(policy));
-      }
     } else if (conv_policy_) {
       assert(!attn_body_);  // not supported with attention body
+      LayerProfiler::Scope scope("policy head");
       convolve3.Forward(batch_size, output_channels, output_channels,
                         buffer2.data(), policy_head.policy1.weights.data(),
                         buffer1.data());
@@ -926,7 +919,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       BiasActivate(batch_size, num_policy_input_planes, head_buffer.data(),
                    policy_head.policy.biases.data(), ACTIVATION_NONE);
 
-      // Mapping from convolutional policy to lc0 policy
+      // Mapping from convolutional policy to px0 policy
       for (auto batch = size_t{0}; batch < batch_size; batch++) {
         std::vector<float> policy(num_output_policy);
         for (auto i = 0; i < kPolicyUsedPlanes * kSquares; i++) {
@@ -941,6 +934,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
 
     } else {
       assert(!attn_body_);  // not supported with attention body
+      LayerProfiler::Scope scope("policy head");
       Convolution1<use_eigen>::Forward(
           batch_size, output_channels, num_policy_input_planes, buffer2.data(),
           policy_head.policy.weights.data(), head_buffer.data());
@@ -969,12 +963,90 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
 }
 
 template <bool use_eigen>
-void BlasComputation<use_eigen>::EncodePlanes(const InputPlanes& sample,
-                                              float* buffer) {
-  for (const InputPlane& plane : sample) {
-    const float value = plane.value;
-    for (auto i = 0; i < kSquares; i++)
-      *(buffer++) = (plane.mask & (((uint64_t)1) << i)) != 0 ? value : 0;
+void BlasComputation<use_eigen>::ForwardSparseAttentionPolicy(
+    size_t start, size_t batch_size, size_t embedding_size, size_t d_model,
+    const MultiHeadWeights::PolicyHead& policy_head,
+    std::vector<float>& buffer1, std::vector<float>& buffer2,
+    std::vector<float>& buffer3, std::vector<float>& head_buffer) {
+  // Only moves of our own pieces are ever read from the policy, and no move
+  // lands on one of our own pieces. So queries are projected for the squares
+  // of our pieces (the first planes of the most recent position), keys for
+  // all other squares, and logits are computed for those pairs only.
+  std::vector<uint8_t> rows;
+  std::vector<uint8_t> cols;
+  std::vector<size_t> row_offsets(batch_size + 1);
+  std::vector<size_t> col_offsets(batch_size + 1);
+  for (size_t batch = 0; batch < batch_size; batch++) {
+    const auto& planes = planes_[start + batch];
+    __uint128_t ours = 0;
+    for (int i = 0; i < kOwnPiecePlanes; i++) ours |= planes[i].mask;
+    row_offsets[batch] = rows.size();
+    col_offsets[batch] = cols.size();
+    for (int sq = 0; sq < kSquares; sq++) {
+      const float* embedding =
+          &buffer2[(batch * kSquares + sq) * embedding_size];
+      if ((ours >> sq) & 1) {
+        std::copy_n(embedding, embedding_size,
+                    &buffer1[rows.size() * embedding_size]);
+        rows.push_back(sq);
+      } else {
+        std::copy_n(embedding, embedding_size,
+                    &head_buffer[cols.size() * embedding_size]);
+        cols.push_back(sq);
+      }
+    }
+  }
+  row_offsets[batch_size] = rows.size();
+  col_offsets[batch_size] = cols.size();
+
+  // Q
+  FusedForward1D<use_eigen>(
+      rows.size(), embedding_size, d_model, buffer1.data(),
+      policy_head.ip2_pol_w.data(), policy_head.ip2_pol_b.data(),
+      ACTIVATION_NONE, buffer3.data());
+  // K
+  FusedForward1D<use_eigen>(
+      cols.size(), embedding_size, d_model, head_buffer.data(),
+      policy_head.ip3_pol_w.data(), policy_head.ip3_pol_b.data(),
+      ACTIVATION_NONE, buffer1.data());
+
+  const float scaling = 1.0f / sqrtf(d_model);
+  const size_t num_output_policy = kPolicyOutputs;
+  for (size_t batch = 0; batch < batch_size; batch++) {
+    const size_t row_count = row_offsets[batch + 1] - row_offsets[batch];
+    const size_t col_count = col_offsets[batch + 1] - col_offsets[batch];
+    const float* A = &buffer3[row_offsets[batch] * d_model];
+    const float* B = &buffer1[col_offsets[batch] * d_model];
+    float* C = buffer2.data();
+    if (row_count > 0 && col_count > 0) {
+      if (use_eigen) {
+        auto C_mat = EigenMatrixMap<float>(C, col_count, row_count);
+        C_mat.noalias() =
+            scaling *
+            ConstEigenMatrixMap<float>(B, d_model, col_count).transpose() *
+            ConstEigenMatrixMap<float>(A, d_model, row_count);
+      } else {
+#ifdef USE_BLAS
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, row_count,
+                    col_count, d_model, scaling, A, d_model, B, d_model, 0.0f,
+                    C, col_count);
+#else
+        // Should never get here.
+        throw Exception("Blas backend internal error");
+#endif
+      }
+    }
+    // Mapping from attention policy to px0 policy
+    std::vector<float> policy(num_output_policy);
+    for (size_t r = 0; r < row_count; r++) {
+      const int from = rows[row_offsets[batch] + r];
+      for (size_t c = 0; c < col_count; c++) {
+        const int to = cols[col_offsets[batch] + c];
+        auto j = kAttnPolicyMap[from * kSquares + to];
+        if (j >= 0) policy[j] = C[r * col_count + c];
+      }
+    }
+    policies_.emplace_back(std::move(policy));
   }
 }
 
@@ -1001,6 +1073,9 @@ BlasNetwork<use_eigen>::BlasNetwork(const WeightsFile& file,
 
   attn_policy_ = nf.policy() == NF::POLICY_ATTENTION;
 
+  sparse_policy_ =
+      attn_policy_ && options.GetOrDefault<bool>("sparse_policy", false);
+
   attn_body_ = nf.network() == NF::NETWORK_ATTENTIONBODY_WITH_HEADFORMAT ||
                nf.network() == NF::NETWORK_ATTENTIONBODY_WITH_MULTIHEADFORMAT;
 
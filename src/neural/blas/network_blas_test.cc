@@ -0,0 +1,235 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "chess/position.h"
+#include "neural/encoder.h"
+#include "neural/factory.h"
+
+namespace lczero {
+namespace {
+
+using pblczero::NetworkFormat;
+using pblczero::Weights;
+
+constexpr int kSquares = 90;
+constexpr int kEmbedding = 32;
+constexpr int kHeads = 2;
+constexpr int kPeChannels = 16;
+
+// Random weights in [offset - scale, offset + scale].
+class WeightsFiller {
+ public:
+  void Fill(Weights::Layer* layer, size_t size, float scale,
+            float offset = 0.0f) {
+    std::string params(size * sizeof(uint16_t), '\0');
+    std::uniform_int_distribution<int> dist(0, 65535);
+    for (size_t i = 0; i < size; i++) {
+      const uint16_t value = dist(rng_);
+      std::memcpy(&params[i * sizeof(uint16_t)], &value, sizeof(value));
+    }
+    layer->set_params(params);
+    layer->set_min_val(offset - scale);
+    layer->set_max_val(offset + scale);
+  }
+
+  void FillFfn(Weights::FFN* ffn, int embedding, int dff) {
+    Fill(ffn->mutable_dense1_w(), embedding * dff, 1.0f / std::sqrt(embedding));
+    Fill(ffn->mutable_dense1_b(), dff, 0.01f);
+    Fill(ffn->mutable_dense2_w(), embedding * dff, 1.0f / std::sqrt(dff));
+    Fill(ffn->mutable_dense2_b(), embedding, 0.01f);
+  }
+
+ private:
+  std::mt19937 rng_{42};
+};
+
+// A small attention body network with an attention policy head and random
+// weights.
+WeightsFile MakeAttentionNet() {
+  WeightsFile net;
+  net.set_magic(0x1c0);
+  auto* format = net.mutable_format();
+  format->set_weights_encoding(pblczero::Format::LINEAR16);
+  auto* nf = format->mutable_network_format();
+  nf->set_input(NetworkFormat::INPUT_CLASSICAL_112_PLANE);
+  nf->set_output(NetworkFormat::OUTPUT_WDL);
+  nf->set_value(NetworkFormat::VALUE_WDL);
+  nf->set_moves_left(NetworkFormat::MOVES_LEFT_V1);
+  nf->set_network(NetworkFormat::NETWORK_ATTENTIONBODY_WITH_MULTIHEADFORMAT);
+  nf->set_policy(NetworkFormat::POLICY_ATTENTION);
+  nf->set_input_embedding(NetworkFormat::INPUT_EMBEDDING_PE_DENSE);
+  nf->set_default_activation(NetworkFormat::DEFAULT_ACTIVATION_MISH);
+  nf->set_ffn_activation(NetworkFormat::ACTIVATION_RELU_2);
+
+  WeightsFiller filler;
+  const int e = kEmbedding;
+  const int dff = 2 * e;
+  auto* w = net.mutable_weights();
+  filler.Fill(w->mutable_ip_emb_preproc_w(), kSquares * 14 * kSquares *
+                                                 kPeChannels, 0.02f);
+  filler.Fill(w->mutable_ip_emb_preproc_b(), kSquares * kPeChannels, 0.01f);
+  filler.Fill(w->mutable_ip_emb_w(), (kInputPlanes + kPeChannels) * e, 0.1f);
+  filler.Fill(w->mutable_ip_emb_b(), e, 0.01f);
+  filler.Fill(w->mutable_ip_emb_ln_gammas(), e, 0.05f, 1.0f);
+  filler.Fill(w->mutable_ip_emb_ln_betas(), e, 0.01f);
+  filler.Fill(w->mutable_ip_mult_gate(), e * kSquares, 0.05f, 1.0f);
+  filler.Fill(w->mutable_ip_add_gate(), e * kSquares, 0.01f);
+  filler.FillFfn(w->mutable_ip_emb_ffn(), e, dff);
+  filler.Fill(w->mutable_ip_emb_ffn_ln_gammas(), e, 0.05f, 1.0f);
+  filler.Fill(w->mutable_ip_emb_ffn_ln_betas(), e, 0.01f);
+
+  auto* encoder = w->add_encoder();
+  auto* mha = encoder->mutable_mha();
+  filler.Fill(mha->mutable_q_w(), e * e, 1.0f / std::sqrt(e));
+  filler.Fill(mha->mutable_q_b(), e, 0.01f);
+  filler.Fill(mha->mutable_k_w(), e * e, 1.0f / std::sqrt(e));
+  filler.Fill(mha->mutable_k_b(), e, 0.01f);
+  filler.Fill(mha->mutable_v_w(), e * e, 1.0f / std::sqrt(e));
+  filler.Fill(mha->mutable_v_b(), e, 0.01f);
+  filler.Fill(mha->mutable_dense_w(), e * e, 1.0f / std::sqrt(e));
+  filler.Fill(mha->mutable_dense_b(), e, 0.01f);
+  filler.Fill(encoder->mutable_ln1_gammas(), e, 0.05f, 1.0f);
+  filler.Fill(encoder->mutable_ln1_betas(), e, 0.01f);
+  filler.FillFfn(encoder->mutable_ffn(), e, dff);
+  filler.Fill(encoder->mutable_ln2_gammas(), e, 0.05f, 1.0f);
+  filler.Fill(encoder->mutable_ln2_betas(), e, 0.01f);
+  w->set_headcount(kHeads);
+
+  auto* policy = w->mutable_policy_heads();
+  filler.Fill(policy->mutable_ip_pol_w(), e * e, 0.1f);
+  filler.Fill(policy->mutable_ip_pol_b(), e, 0.01f);
+  auto* vanilla = policy->mutable_vanilla();
+  filler.Fill(vanilla->mutable_ip2_pol_w(), e * e, 0.1f);
+  filler.Fill(vanilla->mutable_ip2_pol_b(), e, 0.01f);
+  filler.Fill(vanilla->mutable_ip3_pol_w(), e * e, 0.1f);
+  filler.Fill(vanilla->mutable_ip3_pol_b(), e, 0.01f);
+
+  auto* value = w->mutable_value_heads()->mutable_winner();
+  filler.Fill(value->mutable_ip_val_w(), e * 32, 0.1f);
+  filler.Fill(value->mutable_ip_val_b(), 32, 0.01f);
+  filler.Fill(value->mutable_ip1_val_w(), 32 * kSquares * 128, 0.02f);
+  filler.Fill(value->mutable_ip1_val_b(), 128, 0.01f);
+  filler.Fill(value->mutable_ip2_val_w(), 128 * 3, 0.1f);
+  filler.Fill(value->mutable_ip2_val_b(), 3, 0.01f);
+  filler.Fill(w->mutable_ip_mov_w(), e * 8, 0.1f);
+  filler.Fill(w->mutable_ip_mov_b(), 8, 0.01f);
+  filler.Fill(w->mutable_ip1_mov_w(), 8 * kSquares * 128, 0.02f);
+  filler.Fill(w->mutable_ip1_mov_b(), 128, 0.01f);
+  filler.Fill(w->mutable_ip2_mov_w(), 128, 0.1f);
+  filler.Fill(w->mutable_ip2_mov_b(), 1, 0.01f, 1.0f);
+  return net;
+}
+
+struct TestPosition {
+  std::string fen;
+  std::vector<std::string> moves;
+};
+
+const TestPosition kPositions[] = {
+    {ChessBoard::kStartposFen, {}},
+    {ChessBoard::kStartposFen, {"h2e2"}},
+    {ChessBoard::kStartposFen, {"h2e2", "h9g7", "h0g2", "i9h9"}},
+    {"3k5/4a4/9/9/9/9/9/9/4R4/5K3 w - - 0 1", {}},
+};
+
+class SparseAttentionPolicy : public ::testing::TestWithParam<std::string> {};
+
+// With sparse_policy, the logits of all legal moves must match the dense
+// attention policy head.
+TEST_P(SparseAttentionPolicy, MatchesDenseOnLegalMoves) {
+  const WeightsFile weights = MakeAttentionNet();
+  const OptionsDict dense_options;
+  OptionsDict sparse_options;
+  sparse_options.Set<bool>("sparse_policy", true);
+  auto dense =
+      NetworkFactory::Get()->Create(GetParam(), weights, dense_options);
+  auto sparse =
+      NetworkFactory::Get()->Create(GetParam(), weights, sparse_options);
+
+  auto dense_computation = dense->NewComputation();
+  auto sparse_computation = sparse->NewComputation();
+  std::vector<PositionHistory> histories;
+  std::vector<int> transforms;
+  for (const auto& position : kPositions) {
+    ChessBoard board;
+    int rule50_ply;
+    int full_moves;
+    board.SetFromFen(position.fen, &rule50_ply, &full_moves);
+    PositionHistory history;
+    history.Reset(board, rule50_ply,
+                  full_moves * 2 - (board.flipped() ? 1 : 2));
+    for (const auto& move : position.moves) {
+      history.Append(Move(move, history.IsBlackToMove()));
+    }
+    int transform;
+    auto planes = EncodePositionForNN(
+        dense->GetCapabilities().input_format, history, 8,
+        FillEmptyHistory::FEN_ONLY, &transform);
+    dense_computation->AddInput(InputPlanes(planes));
+    sparse_computation->AddInput(std::move(planes));
+    histories.push_back(history);
+    transforms.push_back(transform);
+  }
+  dense_computation->ComputeBlocking();
+  sparse_computation->ComputeBlocking();
+
+  for (size_t i = 0; i < histories.size(); i++) {
+    EXPECT_FLOAT_EQ(sparse_computation->GetQVal(i),
+                    dense_computation->GetQVal(i));
+    const auto legal_moves = histories[i].Last().GetBoard().GenerateLegalMoves();
+    ASSERT_FALSE(legal_moves.empty());
+    for (const auto& move : legal_moves) {
+      const int index = move.as_nn_index(transforms[i]);
+      EXPECT_NEAR(sparse_computation->GetPVal(i, index),
+                  dense_computation->GetPVal(i, index), 1e-4f)
+          << "position " << i << " move " << move.as_string();
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, SparseAttentionPolicy,
+#ifdef USE_BLAS
+                         ::testing::Values("eigen", "blas")
+#else
+                         ::testing::Values("eigen")
+#endif
+);
+
+}  // namespace
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  lczero::InitializeMagicBitboards();
+  return RUN_ALL_TESTS();
+}
@@ -23,8 +23,8 @@
 
 namespace lczero {
 namespace {
-constexpr int kWidth = 8;
-constexpr int kHeight = 8;
+constexpr int kWidth = 9;
+constexpr int kHeight = 10;
 constexpr int kSquares = kWidth * kHeight;
 }  // namespace
 
@@ -77,8 +77,8 @@ void WinogradConvolution3<use_eigen>::TransformIn(const size_t batch_size,
          channel_long += kCacheSize) {
       const size_t channel_step = std::min<size_t>(kCacheSize, channels_rem);
       channels_rem -= channel_step;
-      for (int block_y = 0; block_y < kWtiles; block_y++) {
-        for (int block_x = 0; block_x < kWtiles; block_x++) {
+      for (int block_y = 0; block_y < kWtilesY; block_y++) {
+        for (int block_x = 0; block_x < kWtilesX; block_x++) {
           // Tiles overlap by 2
           const int yin = 2 * block_y - 1;
           const int xin = 2 * block_x - 1;
@@ -141,7 +141,8 @@ void WinogradConvolution3<use_eigen>::TransformIn(const size_t batch_size,
           }
           float* V_channel = V_batch + channel_long;
           const auto V_incr = channels * kTiles * batch_size;
-          float* wTile_V = V_channel + channels * (block_y * kWtiles + block_x);
+          float* wTile_V =
+              V_channel + channels * (block_y * kWtilesX + block_x);
           for (size_t i = 0; i < 16; ++i) {
             for (size_t ch = 0; ch < channel_step; ++ch) {
               wTile_V[ch] = R[i][ch];
@@ -273,12 +274,12 @@ void WinogradConvolution3<use_eigen>::TransformOut(const size_t batch_size,
       const float* M_channel = M_batch + channel;
       float* output_channel = output_batch + channel * (kHeight * kWidth);
 
-      for (int block_x = 0; block_x < kWtiles; block_x++) {
-        for (int block_y = 0; block_y < kWtiles; block_y++) {
+      for (int block_x = 0; block_x < kWtilesX; block_x++) {
+        for (int block_y = 0; block_y < kWtilesY; block_y++) {
           const auto x = 2 * block_x;
           const auto y = 2 * block_y;
 
-          const auto b = block_y * kWtiles + block_x;
+          const auto b = block_y * kWtilesX + block_x;
           const float* M_wtile = M_channel + channels * b;
           const auto M_incr = channels * kTiles * batch_size;
 
@@ -309,10 +310,15 @@ void WinogradConvolution3<use_eigen>::TransformOut(const size_t batch_size,
                      m[2 * 4 + 2] + m[2 * 4 + 3] - m[3 * 4 + 1] + m[3 * 4 + 2] +
                      m[3 * 4 + 3];
 
+          // The last tile column (and row) hangs over the board edge.
+          const bool has_x1 = x + 1 < kWidth;
+          const bool has_y1 = y + 1 < kHeight;
           output_channel[(y)*kWidth + (x)] = o11;
-          output_channel[(y)*kWidth + (x + 1)] = o12;
-          output_channel[(y + 1) * kWidth + (x)] = o21;
-          output_channel[(y + 1) * kWidth + (x + 1)] = o22;
+          if (has_x1) output_channel[(y)*kWidth + (x + 1)] = o12;
+          if (has_y1) output_channel[(y + 1) * kWidth + (x)] = o21;
+          if (has_x1 && has_y1) {
+            output_channel[(y + 1) * kWidth + (x + 1)] = o22;
+          }
         }
       }
     }
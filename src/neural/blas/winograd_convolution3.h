@@ -23,7 +23,7 @@
 
 namespace lczero {
 
-// Convolution 3x3 on a 8x8 board using the Winograd algorithm.
+// Convolution 3x3 on a 10x9 board using the Winograd algorithm.
 //
 // Ref:
 //
@@ -59,12 +59,13 @@ class WinogradConvolution3 {
   void TransformOut(const size_t batch_size, float* output,
                     const size_t channels);
 
-  static constexpr auto kWidth = 8;
-  static constexpr auto kHeight = 8;
+  static constexpr auto kWidth = 9;
+  static constexpr auto kHeight = 10;
   static constexpr auto kSquares = kWidth * kHeight;
 
-  static constexpr auto kWtiles = (kWidth + 1) / 2;  // 4
-  static constexpr auto kTiles = kWtiles * kWtiles;  // 16
+  static constexpr auto kWtilesX = (kWidth + 1) / 2;   // 5
+  static constexpr auto kWtilesY = (kHeight + 1) / 2;  // 5
+  static constexpr auto kTiles = kWtilesX * kWtilesY;  // 25
 
   static constexpr auto kWinogradAlpha = 4;
   static constexpr auto kWinogradTile = kWinogradAlpha * kWinogradAlpha;
@@ -0,0 +1,133 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/blas/winograd_convolution3.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "neural/shared/winograd_filter.h"
+
+namespace lczero {
+namespace {
+
+constexpr int kWidth = 9;
+constexpr int kHeight = 10;
+constexpr int kSquares = kWidth * kHeight;
+
+std::vector<float> RandomVector(size_t size, std::mt19937* rng) {
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> result(size);
+  for (auto& x : result) x = dist(*rng);
+  return result;
+}
+
+// Direct 3x3 convolution with zero padding. The input is NCHW and the
+// weights are [output][input][3][3].
+std::vector<float> NaiveConvolution3(size_t batch_size, size_t input_channels,
+                                     size_t output_channels,
+                                     const std::vector<float>& input,
+                                     const std::vector<float>& weights) {
+  std::vector<float> output(batch_size * output_channels * kSquares);
+  for (size_t b = 0; b < batch_size; b++) {
+    for (size_t o = 0; o < output_channels; o++) {
+      for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+          double sum = 0.0;
+          for (size_t i = 0; i < input_channels; i++) {
+            const float* in = &input[(b * input_channels + i) * kSquares];
+            const float* w = &weights[(o * input_channels + i) * 9];
+            for (int dy = -1; dy <= 1; dy++) {
+              for (int dx = -1; dx <= 1; dx++) {
+                const int yy = y + dy;
+                const int xx = x + dx;
+                if (yy < 0 || yy >= kHeight || xx < 0 || xx >= kWidth) continue;
+                sum += in[yy * kWidth + xx] * w[(dy + 1) * 3 + (dx + 1)];
+              }
+            }
+          }
+          output[(b * output_channels + o) * kSquares + y * kWidth + x] = sum;
+        }
+      }
+    }
+  }
+  return output;
+}
+
+// The Winograd tiles are 2x2 and overhang the 9-wide board on the right, so
+// the last column and the edges are where a geometry bug would show first.
+template <bool use_eigen>
+void ExpectWinogradMatchesNaive(size_t batch_size, size_t input_channels,
+                                size_t output_channels) {
+  std::mt19937 rng(11);
+  const auto input =
+      RandomVector(batch_size * input_channels * kSquares, &rng);
+  const auto weights =
+      RandomVector(output_channels * input_channels * 9, &rng);
+  const auto expected = NaiveConvolution3(batch_size, input_channels,
+                                          output_channels, input, weights);
+
+  const auto transformed =
+      WinogradFilterTransformF(weights, output_channels, input_channels);
+  WinogradConvolution3<use_eigen> convolve3(batch_size, input_channels,
+                                            output_channels);
+  std::vector<float> output(batch_size * output_channels * kSquares);
+  convolve3.Forward(batch_size, input_channels, output_channels, input.data(),
+                    transformed.data(), output.data());
+
+  for (size_t i = 0; i < expected.size(); i++) {
+    const size_t square = i % kSquares;
+    ASSERT_NEAR(output[i], expected[i], 1e-3f)
+        << "sample " << i / (output_channels * kSquares) << " channel "
+        << i / kSquares % output_channels << " rank " << square / kWidth
+        << " file " << square % kWidth;
+  }
+}
+
+TEST(WinogradConvolution3, EigenMatchesNaive) {
+  ExpectWinogradMatchesNaive<true>(1, 1, 1);
+  ExpectWinogradMatchesNaive<true>(3, 16, 8);
+  ExpectWinogradMatchesNaive<true>(2, 124, 32);
+}
+
+#ifdef USE_BLAS
+TEST(WinogradConvolution3, BlasMatchesNaive) {
+  ExpectWinogradMatchesNaive<false>(1, 1, 1);
+  ExpectWinogradMatchesNaive<false>(3, 16, 8);
+  ExpectWinogradMatchesNaive<false>(2, 124, 32);
+}
+#endif
+
+}  // namespace
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -37,6 +37,8 @@
 namespace lczero {
 
 const int kInputPlanes = 124;
+// Number of policy outputs, one per move index.
+const int kPolicyOutputs = 2062;
 
 constexpr __uint128_t kAllSquares = __uint128_t(0x0000000003FFFFFFULL) << 64 | 0xFFFFFFFFFFFFFFFFULL;
 
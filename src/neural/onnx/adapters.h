@@ -110,6 +110,28 @@ class GenericOnnxConst : public OnnxConst {
   std::vector<int> dims_;
 };
 
+// GenericOnnxConst for int8 values.
+class Int8OnnxConst : public GenericOnnxConst<int8_t> {
+ public:
+  using GenericOnnxConst<int8_t>::GenericOnnxConst;
+
+ private:
+  pblczero::TensorProto::DataType GetDataType() const override {
+    return pblczero::TensorProto::INT8;
+  }
+};
+
+// GenericOnnxConst for uint8 values.
+class UInt8OnnxConst : public GenericOnnxConst<uint8_t> {
+ public:
+  using GenericOnnxConst<uint8_t>::GenericOnnxConst;
+
+ private:
+  pblczero::TensorProto::DataType GetDataType() const override {
+    return pblczero::TensorProto::UINT8;
+  }
+};
+
 // GenericOnnxConst for int32 values.
 class Int32OnnxConst : public GenericOnnxConst<int32_t> {
  public:
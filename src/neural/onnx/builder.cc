@@ -84,6 +84,14 @@ void AddFloatAttribute(pblczero::NodeProto* node, const std::string& name,
   attr->set_f(val);
 }
 
+void AddStringAttribute(pblczero::NodeProto* node, const std::string& name,
+                        const std::string& val) {
+  auto* attr = node->add_attribute();
+  attr->set_name(name);
+  attr->set_type(pblczero::AttributeProto::STRING);
+  attr->set_s(val);
+}
+
 void AddIntsAttribute(pblczero::NodeProto* node, const std::string& name,
                       std::initializer_list<int> vals) {
   auto* attr = node->add_attribute();
@@ -423,6 +431,25 @@ std::string OnnxBuilder::Greater(const std::string& name,
   return out;
 }
 
+std::string OnnxBuilder::BitShift(const std::string& name,
+                                  const std::string& input,
+                                  const OnnxConst& shift,
+                                  const std::string& direction) {
+  auto* node = model_.mutable_graph()->add_node();
+  auto out = PopulateStdNodeFields(node, name, input, "BitShift");
+  node->add_input(AddInitializer(name + "/shift", shift));
+  AddStringAttribute(node, "direction", direction);
+  return out;
+}
+
+std::string OnnxBuilder::Mod(const std::string& name, const std::string& input,
+                             const OnnxConst& divisor) {
+  auto* node = model_.mutable_graph()->add_node();
+  auto out = PopulateStdNodeFields(node, name, input, "Mod");
+  node->add_input(AddInitializer(name + "/divisor", divisor));
+  return out;
+}
+
 std::string OnnxBuilder::Where(const std::string& name,
                                const std::string& input1,
                                const std::string& input2,
@@ -478,4 +505,108 @@ std::string OnnxBuilder::ReduceMean(const std::string& name,
   return out;
 }
 
+std::string OnnxBuilder::Gemm(const std::string& name,
+                              const std::string& input,
+                              const std::string& weights,
+                              const OnnxConst& bias, float alpha, float beta) {
+  auto* node = model_.mutable_graph()->add_node();
+  auto out = PopulateStdNodeFields(node, name, input, "Gemm");
+  node->add_input(weights);
+  node->add_input(AddInitializer(name + "/w/bias", bias));
+  if (alpha != 1.0f) AddFloatAttribute(node, "alpha", alpha);
+  if (beta != 1.0f) AddFloatAttribute(node, "beta", beta);
+  return out;
+}
+
+std::string OnnxBuilder::DequantizeLinear(const std::string& name,
+                                          const OnnxConst& input,
+                                          const OnnxConst& scale,
+                                          const OnnxConst& zero_point,
+                                          int axis) {
+  if (opset_ < 13) {
+    throw Exception("Per-axis DequantizeLinear requires opset 13 or later.");
+  }
+  auto* node = model_.mutable_graph()->add_node();
+  auto out = PopulateStdNodeFields(node, name,
+                                   AddInitializer(name + "/x", input),
+                                   "DequantizeLinear");
+  node->add_input(AddInitializer(name + "/scale", scale));
+  node->add_input(AddInitializer(name + "/zero_point", zero_point));
+  AddIntAttribute(node, "axis", axis);
+  return out;
+}
+
+pblczero::NodeProto* OnnxBuilder::AddMicrosoftNode() {
+  if (!microsoft_domain_) {
+    auto* opset = model_.add_opset_import();
+    opset->set_domain("com.microsoft");
+    opset->set_version(1);
+    microsoft_domain_ = true;
+  }
+  auto* node = model_.mutable_graph()->add_node();
+  node->set_domain("com.microsoft");
+  return node;
+}
+
+std::string OnnxBuilder::FusedMatMul(const std::string& name,
+                                     const std::string& input1,
+                                     const std::string& input2, float alpha,
+                                     bool trans_b) {
+  auto* node = AddMicrosoftNode();
+  auto out = PopulateStdNodeFields(node, name, input1, "FusedMatMul");
+  node->add_input(input2);
+  AddFloatAttribute(node, "alpha", alpha);
+  if (trans_b) AddIntAttribute(node, "transB", 1);
+  return out;
+}
+
+std::string OnnxBuilder::DynamicQuantizeMatMul(const std::string& name,
+                                               const std::string& input,
+                                               const OnnxConst& b,
+                                               const OnnxConst& b_scale,
+                                               const OnnxConst& b_zero_point,
+                                               const OnnxConst* bias) {
+  auto* node = AddMicrosoftNode();
+  auto out = PopulateStdNodeFields(node, name, input, "DynamicQuantizeMatMul");
+  node->add_input(AddInitializer(name + "/w/b", b));
+  node->add_input(AddInitializer(name + "/w/b_scale", b_scale));
+  node->add_input(AddInitializer(name + "/w/b_zero_point", b_zero_point));
+  if (bias) node->add_input(AddInitializer(name + "/w/bias", *bias));
+  return out;
+}
+
+std::string OnnxBuilder::SkipLayerNormalization(
+    const std::string& name, const std::string& input, const std::string& skip,
+    const OnnxConst& gamma, const OnnxConst& beta, const OnnxConst& bias,
+    float epsilon) {
+  auto* node = AddMicrosoftNode();
+  auto out = PopulateStdNodeFields(node, name, input, "SkipLayerNormalization");
+  node->add_input(skip);
+  node->add_input(AddInitializer(name + "/w/gamma", gamma));
+  node->add_input(AddInitializer(name + "/w/beta", beta));
+  node->add_input(AddInitializer(name + "/w/bias", bias));
+  AddFloatAttribute(node, "epsilon", epsilon);
+  return out;
+}
+
+std::string OnnxBuilder::MultiHeadAttention(const std::string& name,
+                                            const std::string& query,
+                                            const std::string& key,
+                                            const std::string& value,
+                                            const OnnxConst& bias,
+                                            const std::string& attention_bias,
+                                            int num_heads) {
+  auto* node = AddMicrosoftNode();
+  auto out = PopulateStdNodeFields(node, name, query, "MultiHeadAttention");
+  node->add_input(key);
+  node->add_input(value);
+  node->add_input(AddInitializer(name + "/w/bias", bias));
+  if (!attention_bias.empty()) {
+    node->add_input("");  // key_padding_mask
+    node->add_input(attention_bias);
+  }
+  AddIntAttribute(node, "num_heads", num_heads);
+  return out;
+}
+
 }  // namespace lczero
@@ -117,6 +117,10 @@ class OnnxBuilder {
                   const std::string& input2);
   std::string Greater(const std::string& name, const std::string& input1,
                       const OnnxConst&);
+  std::string BitShift(const std::string& name, const std::string& input,
+                       const OnnxConst& shift, const std::string& direction);
+  std::string Mod(const std::string& name, const std::string& input,
+                  const OnnxConst& divisor);
   std::string Where(const std::string& name, const std::string& input1,
                     const std::string& input2, const std::string& input3);
   std::string Mish(const std::string& name, const std::string& input);
@@ -126,13 +130,50 @@ class OnnxBuilder {
                    pblczero::TensorProto::DataType type);
   std::string ReduceMean(const std::string& name, const std::string& input,
                          std::initializer_list<int> axes, bool keepdims = true);
+  std::string Gemm(const std::string& name, const std::string& input,
+                   const std::string& weights, const OnnxConst& bias,
+                   float alpha = 1.0f, float beta = 1.0f);
+  std::string DequantizeLinear(const std::string& name, const OnnxConst& input,
+                               const OnnxConst& scale,
+                               const OnnxConst& zero_point, int axis);
+
+  // Operators from the com.microsoft domain, only supported by onnxruntime.
+  std::string FusedMatMul(const std::string& name, const std::string& input1,
+                          const std::string& input2, float alpha,
+                          bool trans_b = false);
+  // @bias may be null.
+  std::string DynamicQuantizeMatMul(const std::string& name,
+                                    const std::string& input,
+                                    const OnnxConst& b,
+                                    const OnnxConst& b_scale,
+                                    const OnnxConst& b_zero_point,
+                                    const OnnxConst* bias);
+  std::string SkipLayerNormalization(const std::string& name,
+                                     const std::string& input,
+                                     const std::string& skip,
+                                     const OnnxConst& gamma,
+                                     const OnnxConst& beta,
+                                     const OnnxConst& bias, float epsilon);
+  // @bias is the concatenation of the Q, K and V biases, @attention_bias is
+  // added to the scaled Q.K product (may be empty).
+  std::string MultiHeadAttention(const std::string& name,
+                                 const std::string& query,
+                                 const std::string& key,
+                                 const std::string& value,
+                                 const OnnxConst& bias,
+                                 const std::string& attention_bias,
+                                 int num_heads);
   // Returns ONNX model as protobuf.
   const pblczero::ModelProto& as_proto() const { return model_; }
   // Returns serialized model.
   std::string OutputAsString() const { return model_.OutputAsString(); }
 
  private:
+  // Adds a node from the com.microsoft domain, importing it on first use.
+  pblczero::NodeProto* AddMicrosoftNode();
+
   const int opset_;
+  bool microsoft_domain_ = false;
   pblczero::ModelProto model_;
 };
 
@@ -27,6 +27,7 @@
 
 #include "neural/onnx/converter.h"
 
+#include <algorithm>
 #include <climits>
 #include <cmath>
 #include <cstddef>
@@ -50,6 +51,28 @@
 namespace lczero {
 namespace {
 
+// Symmetric per output channel int8 quantization of dense weights laid out
+// as {output, input}. Returns the weights transposed to {input, output}.
+std::vector<int8_t> QuantizeDenseWeights(const std::vector<float>& weights,
+                                         int input_size, int output_size,
+                                         std::vector<float>* scales) {
+  scales->resize(output_size);
+  std::vector<int8_t> quantized(weights.size());
+  for (int o = 0; o < output_size; o++) {
+    float max = 0.0f;
+    for (int i = 0; i < input_size; i++) {
+      max = std::max(max, std::abs(weights[o * input_size + i]));
+    }
+    (*scales)[o] = max > 0.0f ? max / 127.0f : 1.0f;
+    for (int i = 0; i < input_size; i++) {
+      const float q = std::round(weights[o * input_size + i] / (*scales)[o]);
+      quantized[i * output_size + o] =
+          static_cast<int8_t>(std::clamp(q, -127.0f, 127.0f));
+    }
+  }
+  return quantized;
+}
+
 class Converter {
  public:
   Converter(const pblczero::Net& net,
@@ -77,6 +100,7 @@ class Converter {
   size_t NumEncBlocks() const { return src_.weights().encoder().size(); }
   void CopyGenericFields(pblczero::Net* dst);
   void GenerateOnnx(pblczero::OnnxModel* onnx);
+  std::string MakePackedInput(pblczero::OnnxModel* onnx, OnnxBuilder* builder);
   void FillValueInfo(pblczero::ValueInfoProto* vip, const std::string& name,
                      std::initializer_list<int> dims);
 
@@ -143,10 +167,54 @@ class Converter {
                                ActivationFunction activation,
                                float alpha = 1.0f);
 
+  // Fused variants using onnxruntime contrib operators.
+  std::string MakeFusedEncoderLayer(
+      OnnxBuilder* builder, const MultiHeadWeights::EncoderLayer& layer,
+      int embedding_size, int heads, const std::string& encoder_in,
+      const std::string& name, ActivationFunction activation, float alpha);
+
+  std::string MakeFusedFFN(OnnxBuilder* builder,
+                           const MultiHeadWeights::FFN& ffn,
+                           int embedding_size, const std::string& ffn_in,
+                           const std::string& name,
+                           ActivationFunction activation, float alpha,
+                           const std::string& ln_name,
+                           const std::vector<float>& ln_gammas,
+                           const std::vector<float>& ln_betas, float eps);
+
+  // Computes layernorm(alpha * (input * weights + biases) + skip).
+  std::string MakeDenseSkipLayerNorm(
+      OnnxBuilder* builder, const std::string& name, const std::string& input,
+      const std::string& skip, const std::vector<float>& weights,
+      const std::vector<float>& biases, int input_size, int output_size,
+      float alpha, const std::string& ln_name,
+      const std::vector<float>& ln_gammas, const std::vector<float>& ln_betas,
+      float eps);
+
+  // Returns the name of the {input, output} tensor for dense @weights, stored
+  // as int8 behind a DequantizeLinear node when int8_weights is set.
+  std::string MakeDenseWeights(OnnxBuilder* builder, const std::string& name,
+                               const std::vector<float>& weights,
+                               std::initializer_list<int> dims);
+
+  std::string MakeMatMul(OnnxBuilder* builder, const std::string& name,
+                         const std::string& input,
+                         const std::vector<float>& weights,
+                         std::initializer_list<int> dims);
+
+  // Computes alpha * (input * weights + biases) with fused operators, where
+  // @biases may be null.
+  std::string MakeDense(OnnxBuilder* builder, const std::string& name,
+                        const std::string& input,
+                        const std::vector<float>& weights,
+                        const std::vector<float>* biases, int input_size,
+                        int output_size, float alpha);
+
   std::string MakeAttentionPolicy(OnnxBuilder* builder,
                                   const std::string& input,
                                   const MultiHeadWeights& weights,
-                                  const MultiHeadWeights::PolicyHead& head);
+                                  const MultiHeadWeights::PolicyHead& head,
+                                  const std::string& output);
 
   void MakePolicyHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
                       const std::string& input,
@@ -334,15 +402,13 @@ std::string Converter::MakeSqueezeAndExcite(
   }
   auto flow = input;
   flow = builder->ReduceMean(name + "/reduce_mean", flow, {2, 3}, false);
-  flow = builder->MatMul(
-      name + "/matmul1", flow,
-      *GetWeghtsConverter(se_unit.w1, {NumFilters(), se_filters}, {1, 0}));
+  flow = MakeMatMul(builder, name + "/matmul1", flow, se_unit.w1,
+                    {NumFilters(), se_filters});
   flow = builder->Add(name + "/add1", flow,
                       *GetWeghtsConverter(se_unit.b1, {se_filters}));
   flow = MakeActivation(builder, flow, name, default_activation_);
-  flow = builder->MatMul(
-      name + "/matmul2", flow,
-      *GetWeghtsConverter(se_unit.w2, {se_filters, 2 * NumFilters()}, {1, 0}));
+  flow = MakeMatMul(builder, name + "/matmul2", flow, se_unit.w2,
+                    {se_filters, 2 * NumFilters()});
   flow = builder->Add(name + "/add2", flow,
                       *GetWeghtsConverter(se_unit.b2, {2 * NumFilters()}));
   flow = builder->Reshape(name + "/reshape", flow, "/const/se_reshape");
@@ -415,20 +481,17 @@ std::string Converter::MakeSmolgen(OnnxBuilder* builder,
       layer.mha.smolgen.compress.size() / embedding_size;
   const int smolgen_hidden_sz = layer.mha.smolgen.dense1_b.size();
   const int smolgen_gen_sz = layer.mha.smolgen.dense2_b.size() / heads;
-  auto flow = builder->MatMul(
-      name + "/smolgen/compress", encoder_in,
-      *GetWeghtsConverter(layer.mha.smolgen.compress,
-                          {embedding_size, smolgen_hidden_channels}, {1, 0}));
+  auto flow = MakeMatMul(builder, name + "/smolgen/compress", encoder_in,
+                         layer.mha.smolgen.compress,
+                         {embedding_size, smolgen_hidden_channels});
   flow = builder->Reshape(
       name + "/smolgen/compress/reshape", flow,
       builder->AddInitializer(
           "/const" + name + "/smolgen/compress/shape",
           Int64OnnxConst({-1, 90 * smolgen_hidden_channels}, {2})));
-  flow = builder->MatMul(
-      name + "/smolgen/dense1/w", flow,
-      *GetWeghtsConverter(layer.mha.smolgen.dense1_w,
-                          {90 * smolgen_hidden_channels, smolgen_hidden_sz},
-                          {1, 0}));
+  flow = MakeMatMul(builder, name + "/smolgen/dense1/w", flow,
+                    layer.mha.smolgen.dense1_w,
+                    {90 * smolgen_hidden_channels, smolgen_hidden_sz});
   flow = builder->Add(
       name + "/smolgen/dense1/b", flow,
       *GetWeghtsConverter(layer.mha.smolgen.dense1_b, {smolgen_hidden_sz}));
@@ -438,10 +501,9 @@ std::string Converter::MakeSmolgen(OnnxBuilder* builder,
       *GetWeghtsConverter(layer.mha.smolgen.ln1_gammas, {smolgen_hidden_sz}),
       *GetWeghtsConverter(layer.mha.smolgen.ln1_betas, {smolgen_hidden_sz}),
       1e-3);
-  flow = builder->MatMul(
-      name + "/smolgen/dense2/w", flow,
-      *GetWeghtsConverter(layer.mha.smolgen.dense2_w,
-                          {smolgen_hidden_sz, smolgen_gen_sz * heads}, {1, 0}));
+  flow = MakeMatMul(builder, name + "/smolgen/dense2/w", flow,
+                    layer.mha.smolgen.dense2_w,
+                    {smolgen_hidden_sz, smolgen_gen_sz * heads});
   flow = builder->Add(name + "/smolgen/dense2/b", flow,
                       *GetWeghtsConverter(layer.mha.smolgen.dense2_b,
                                           {smolgen_gen_sz * heads}));
@@ -493,21 +555,162 @@ std::string Converter::MakeLayerNorm(OnnxBuilder* builder,
   return flow;
 }
 
+std::string Converter::MakeDenseWeights(OnnxBuilder* builder,
+                                        const std::string& name,
+                                        const std::vector<float>& weights,
+                                        std::initializer_list<int> dims) {
+  if (!options_.int8_weights) {
+    return builder->AddInitializer(name,
+                                   *GetWeghtsConverter(weights, dims, {1, 0}));
+  }
+  const int output_size = *(dims.begin() + 1);
+  std::vector<float> scales;
+  auto quantized =
+      QuantizeDenseWeights(weights, *dims.begin(), output_size, &scales);
+  return builder->DequantizeLinear(
+      name, Int8OnnxConst(quantized, dims),
+      FloatOnnxConst(scales, {output_size}),
+      Int8OnnxConst(std::vector<int8_t>(output_size), {output_size}), 1);
+}
+
+std::string Converter::MakeMatMul(OnnxBuilder* builder, const std::string& name,
+                                  const std::string& input,
+                                  const std::vector<float>& weights,
+                                  std::initializer_list<int> dims) {
+  if (options_.fuse_ops && options_.int8_weights) {
+    return MakeDense(builder, name, input, weights, nullptr, *dims.begin(),
+                     *(dims.begin() + 1), 1.0f);
+  }
+  return builder->MatMul(name, input,
+                         MakeDenseWeights(builder, name + "/w", weights, dims));
+}
+
+std::string Converter::MakeDense(OnnxBuilder* builder, const std::string& name,
+                                 const std::string& input,
+                                 const std::vector<float>& weights,
+                                 const std::vector<float>* biases,
+                                 int input_size, int output_size,
+                                 float alpha) {
+  if (options_.int8_weights) {
+    // Activations are quantized on the fly, alpha is folded into the scales.
+    std::vector<float> scales;
+    auto quantized =
+        QuantizeDenseWeights(weights, input_size, output_size, &scales);
+    for (auto& scale : scales) scale *= alpha;
+    std::vector<float> scaled_biases;
+    if (biases) {
+      scaled_biases = *biases;
+      for (auto& b : scaled_biases) b *= alpha;
+    }
+    return builder->DynamicQuantizeMatMul(
+        name, input, Int8OnnxConst(quantized, {input_size, output_size}),
+        FloatOnnxConst(scales, {output_size}),
+        Int8OnnxConst(std::vector<int8_t>(output_size), {output_size}),
+        biases ? GetWeghtsConverter(scaled_biases, {output_size}).get()
+               : nullptr);
+  }
+  auto w = MakeDenseWeights(builder, name + "/w", weights,
+                            {input_size, output_size});
+  if (biases) {
+    return builder->Gemm(name, input, w,
+                         *GetWeghtsConverter(*biases, {output_size}), alpha,
+                         alpha);
+  }
+  if (alpha != 1.0f) return builder->FusedMatMul(name, input, w, alpha);
+  return builder->MatMul(name, input, w);
+}
+
+std::string Converter::MakeDenseSkipLayerNorm(
+    OnnxBuilder* builder, const std::string& name, const std::string& input,
+    const std::string& skip, const std::vector<float>& weights,
+    const std::vector<float>& biases, int input_size, int output_size,
+    float alpha, const std::string& ln_name,
+    const std::vector<float>& ln_gammas, const std::vector<float>& ln_betas,
+    float eps) {
+  auto flow = MakeDense(builder, name + "/w", input, weights, nullptr,
+                        input_size, output_size, alpha);
+  std::vector<float> scaled_biases(biases);
+  for (auto& b : scaled_biases) b *= alpha;
+  return builder->SkipLayerNormalization(
+      ln_name, flow, skip, *GetWeghtsConverter(ln_gammas, {output_size}),
+      *GetWeghtsConverter(ln_betas, {output_size}),
+      *GetWeghtsConverter(scaled_biases, {output_size}), eps);
+}
+
+std::string Converter::MakeFusedFFN(
+    OnnxBuilder* builder, const MultiHeadWeights::FFN& ffn, int embedding_size,
+    const std::string& ffn_in, const std::string& name,
+    ActivationFunction activation, float alpha, const std::string& ln_name,
+    const std::vector<float>& ln_gammas, const std::vector<float>& ln_betas,
+    float eps) {
+  const int dff_size = ffn.dense1_b.size();
+  auto flow = MakeDense(builder, name + "/ffn/dense1", ffn_in, ffn.dense1_w,
+                        &ffn.dense1_b, embedding_size, dff_size, 1.0f);
+  flow = MakeActivation(builder, flow, name + "/ffn/dense1", activation);
+  return MakeDenseSkipLayerNorm(builder, name + "/ffn/dense2", flow, ffn_in,
+                                ffn.dense2_w, ffn.dense2_b, dff_size,
+                                embedding_size, alpha, ln_name, ln_gammas,
+                                ln_betas, eps);
+}
+
+std::string Converter::MakeFusedEncoderLayer(
+    OnnxBuilder* builder, const MultiHeadWeights::EncoderLayer& layer,
+    int embedding_size, int heads, const std::string& encoder_in,
+    const std::string& name, ActivationFunction activation, float alpha) {
+  const int d_model = layer.mha.q_b.size();
+  // Q, K and V biases are added inside of MultiHeadAttention.
+  auto mha_shape =
+      builder->AddInitializer("/const" + name + "/mha/shape",
+                              Int64OnnxConst({-1, 90, d_model}, {3}));
+  auto Q = MakeMatMul(builder, name + "/mha/Q/w", encoder_in, layer.mha.q_w,
+                      {embedding_size, d_model});
+  Q = builder->Reshape(name + "/mha/Q/reshape", Q, mha_shape);
+  auto K = MakeMatMul(builder, name + "/mha/K/w", encoder_in, layer.mha.k_w,
+                      {embedding_size, d_model});
+  K = builder->Reshape(name + "/mha/K/reshape", K, mha_shape);
+  auto V = MakeMatMul(builder, name + "/mha/V/w", encoder_in, layer.mha.v_w,
+                      {embedding_size, d_model});
+  V = builder->Reshape(name + "/mha/V/reshape", V, mha_shape);
+  std::vector<float> qkv_b(layer.mha.q_b);
+  qkv_b.insert(qkv_b.end(), layer.mha.k_b.begin(), layer.mha.k_b.end());
+  qkv_b.insert(qkv_b.end(), layer.mha.v_b.begin(), layer.mha.v_b.end());
+  std::string smolgen_weights;
+  if (layer.mha.has_smolgen) {
+    smolgen_weights =
+        MakeSmolgen(builder, layer, embedding_size, heads, encoder_in, name);
+  }
+  auto flow = builder->MultiHeadAttention(
+      name + "/mha", Q, K, V, *GetWeghtsConverter(qkv_b, {3 * d_model}),
+      smolgen_weights, heads);
+  flow = builder->Reshape(
+      name + "/mha/out/reshape", flow,
+      builder->AddInitializer("/const" + name + "/mha/out/shape",
+                              Int64OnnxConst({-1, d_model}, {2})));
+  flow = MakeDenseSkipLayerNorm(
+      builder, name + "/mha/out/dense", flow, encoder_in, layer.mha.dense_w,
+      layer.mha.dense_b, d_model, embedding_size, alpha, name + "/ln1",
+      layer.ln1_gammas, layer.ln1_betas, default_eps_);
+  const auto ffn_activation = static_cast<ActivationFunction>(
+      src_.format().network_format().ffn_activation());
+  return MakeFusedFFN(
+      builder, layer.ffn, embedding_size, flow, name,
+      ffn_activation == ACTIVATION_DEFAULT ? activation : ffn_activation,
+      alpha, name + "/ln2", layer.ln2_gammas, layer.ln2_betas, default_eps_);
+}
+
 std::string Converter::MakeFFN(OnnxBuilder* builder,
                                const MultiHeadWeights::FFN& ffn,
                                int embedding_size, const std::string& ffn_in,
                                const std::string& name,
                                ActivationFunction activation, float alpha) {
   const int dff_size = ffn.dense1_b.size();
-  auto flow = builder->MatMul(
-      name + "/ffn/dense1/w", ffn_in,
-      *GetWeghtsConverter(ffn.dense1_w, {embedding_size, dff_size}, {1, 0}));
+  auto flow = MakeMatMul(builder, name + "/ffn/dense1/w", ffn_in, ffn.dense1_w,
+                         {embedding_size, dff_size});
   flow = builder->Add(name + "/ffn/dense1/b", flow,
                       *GetWeghtsConverter(ffn.dense1_b, {dff_size}));
   flow = MakeActivation(builder, flow, name + "/ffn/dense1", activation);
-  flow = builder->MatMul(
-      name + "/ffn/dense2/w", flow,
-      *GetWeghtsConverter(ffn.dense2_w, {dff_size, embedding_size}, {1, 0}));
+  flow = MakeMatMul(builder, name + "/ffn/dense2/w", flow, ffn.dense2_w,
+                    {dff_size, embedding_size});
   flow = builder->Add(name + "/ffn/dense2/b", flow,
                       *GetWeghtsConverter(ffn.dense2_b, {embedding_size}));
   if (alpha != 1.0) {
@@ -521,29 +724,30 @@ std::string Converter::MakeEncoderLayer(
     OnnxBuilder* builder, const MultiHeadWeights::EncoderLayer& layer,
     int embedding_size, int heads, const std::string& encoder_in,
     const std::string& name, ActivationFunction activation, float alpha) {
+  if (options_.fuse_ops) {
+    return MakeFusedEncoderLayer(builder, layer, embedding_size, heads,
+                                 encoder_in, name, activation, alpha);
+  }
   const int d_model = layer.mha.q_b.size();
   const int depth = d_model / heads;
 
   auto mha_shape =
       builder->AddInitializer("/const" + name + "/mha/shape",
                               Int64OnnxConst({-1, 90, heads, depth}, {4}));
-  auto flow = builder->MatMul(
-      name + "/mha/Q/w", encoder_in,
-      *GetWeghtsConverter(layer.mha.q_w, {embedding_size, d_model}, {1, 0}));
+  auto flow = MakeMatMul(builder, name + "/mha/Q/w", encoder_in, layer.mha.q_w,
+                         {embedding_size, d_model});
   flow = builder->Add(name + "/mha/Q/b", flow,
                       *GetWeghtsConverter(layer.mha.q_b, {d_model}));
   flow = builder->Reshape(name + "/mha/Q/reshape", flow, mha_shape);
   auto Q = builder->Transpose(name + "/mha/Q/transpose", flow, {0, 2, 1, 3});
-  flow = builder->MatMul(
-      name + "/mha/K/w", encoder_in,
-      *GetWeghtsConverter(layer.mha.k_w, {embedding_size, d_model}, {1, 0}));
+  flow = MakeMatMul(builder, name + "/mha/K/w", encoder_in, layer.mha.k_w,
+                    {embedding_size, d_model});
   flow = builder->Add(name + "/mha/K/b", flow,
                       *GetWeghtsConverter(layer.mha.k_b, {d_model}));
   flow = builder->Reshape(name + "/mha/K/reshape", flow, mha_shape);
   auto K = builder->Transpose(name + "/mha/K/transpose", flow, {0, 2, 3, 1});
-  flow = builder->MatMul(
-      name + "/mha/V/w", encoder_in,
-      *GetWeghtsConverter(layer.mha.v_w, {embedding_size, d_model}, {1, 0}));
+  flow = MakeMatMul(builder, name + "/mha/V/w", encoder_in, layer.mha.v_w,
+                    {embedding_size, d_model});
   flow = builder->Add(name + "/mha/V/b", flow,
                       *GetWeghtsConverter(layer.mha.v_b, {d_model}));
   flow = builder->Reshape(name + "/mha/V/reshape", flow, mha_shape);
@@ -565,10 +769,8 @@ std::string Converter::MakeEncoderLayer(
       name + "/mha/out/reshape", flow,
       builder->AddInitializer("/const" + name + "/mha/out/shape",
                               Int64OnnxConst({-1, d_model}, {2})));
-  flow =
-      builder->MatMul(name + "/mha/out/dense/w", flow,
-                      *GetWeghtsConverter(layer.mha.dense_w,
-                                          {d_model, embedding_size}, {1, 0}));
+  flow = MakeMatMul(builder, name + "/mha/out/dense/w", flow, layer.mha.dense_w,
+                    {d_model, embedding_size});
   flow = builder->Add(name + "/mha/out/dense/b", flow,
                       *GetWeghtsConverter(layer.mha.dense_b, {embedding_size}));
   if (alpha != 1.0) {
@@ -675,10 +877,9 @@ std::string Converter::AttentionBodyDenseEmbedding(
       builder->AddInitializer("/const/pos_info_shape",
                               Int64OnnxConst({-1, 90 * 14}, {2})));
 
-  pos_info = builder->MatMul(
-      "/attn_body/embedding/preprocess/matmul", pos_info,
-      *GetWeghtsConverter(weights.ip_emb_preproc_w,
-                          {90 * 14, 90 * embedding_dense_size}, {1, 0}));
+  pos_info = MakeMatMul(builder, "/attn_body/embedding/preprocess/matmul",
+                        pos_info, weights.ip_emb_preproc_w,
+                        {90 * 14, 90 * embedding_dense_size});
   pos_info = builder->Add("/attn_body/embedding/preprocess/add", pos_info,
                           *GetWeghtsConverter(weights.ip_emb_preproc_b,
                                               {90 * embedding_dense_size}));
@@ -734,10 +935,8 @@ std::string Converter::MakeAttentionBody(OnnxBuilder* builder,
   }
 
   int embedding_size = weights.ip_emb_b.size();
-  flow = builder->MatMul(
-      "/attn_body/matmul", flow,
-      *GetWeghtsConverter(weights.ip_emb_w, {fist_stage_out_C, embedding_size},
-                          {1, 0}));
+  flow = MakeMatMul(builder, "/attn_body/matmul", flow, weights.ip_emb_w,
+                    {fist_stage_out_C, embedding_size});
   flow = builder->Add("/attn_body/add", flow,
                       *GetWeghtsConverter(weights.ip_emb_b, {embedding_size}));
   flow = MakeActivation(builder, flow, "/attn_body", default_activation_);
@@ -772,7 +971,13 @@ std::string Converter::MakeAttentionBody(OnnxBuilder* builder,
 
   float alpha = std::pow(2.0f * NumEncBlocks(), -0.25f);
 
-  if (input_embedding == network_format::INPUT_EMBEDDING_PE_DENSE) {
+  if (input_embedding == network_format::INPUT_EMBEDDING_PE_DENSE &&
+      options_.fuse_ops) {
+    flow = MakeFusedFFN(builder, weights.ip_emb_ffn, embedding_size, flow,
+                        "/attn_body", default_activation_, alpha,
+                        "/attn_body/ln2", weights.ip_emb_ffn_ln_gammas,
+                        weights.ip_emb_ffn_ln_betas, 1e-3);
+  } else if (input_embedding == network_format::INPUT_EMBEDDING_PE_DENSE) {
     flow = MakeFFN(builder, weights.ip_emb_ffn, embedding_size, flow,
                    "/attn_body", default_activation_, alpha);
     flow = MakeLayerNorm(
@@ -804,7 +1009,8 @@ std::vector<int> MakePolicyMap(const short* map, int size) {
 
 std::string Converter::MakeAttentionPolicy(
     OnnxBuilder* builder, const std::string& input,
-    const MultiHeadWeights& weights, const MultiHeadWeights::PolicyHead& head) {
+    const MultiHeadWeights& weights, const MultiHeadWeights::PolicyHead& head,
+    const std::string& output) {
   if (head.ip2_pol_b.empty()) {
     throw Exception("The policy head selected '" + options_.policy_head + "'" +
                     " is empty.");
@@ -826,12 +1032,9 @@ std::string Converter::MakeAttentionPolicy(
         builder->AddInitializer("/const/policy_shape",
                                 Int64OnnxConst({-1, NumFilters()}, {2})));
   }
-  flow = builder->MatMul(
-      "/policy/dense1/matmul", flow,
-      *GetWeghtsConverter(head.ip_pol_w,
-                          {NumEncBlocks() > 0 ? embedding_size : NumFilters(),
-                           policy_embedding_size},
-                          {1, 0}));
+  flow = MakeMatMul(builder, "/policy/dense1/matmul", flow, head.ip_pol_w,
+                    {NumEncBlocks() > 0 ? embedding_size : NumFilters(),
+                     policy_embedding_size});
   flow = builder->Add("/policy/dense1/add", flow,
                       *GetWeghtsConverter(head.ip_pol_b,
                                           {policy_embedding_size}));
@@ -845,33 +1048,34 @@ std::string Converter::MakeAttentionPolicy(
                          head.pol_encoder_head_count, flow, name, activation);
   }
   auto encoder_out = flow;
-  flow = builder->MatMul(
-      "/policy/Q/matmul", encoder_out,
-      *GetWeghtsConverter(head.ip2_pol_w,
-                          {policy_embedding_size, policy_d_model}, {1, 0}));
+  flow = MakeMatMul(builder, "/policy/Q/matmul", encoder_out, head.ip2_pol_w,
+                    {policy_embedding_size, policy_d_model});
   flow = builder->Add("/policy/Q/add", flow,
                       *GetWeghtsConverter(head.ip2_pol_b, {policy_d_model}));
   auto Q = builder->Reshape(
       "/policy/Q/reshape", flow,
       builder->AddInitializer("/const/QK_shape",
                               Int64OnnxConst({-1, 90, policy_d_model}, {3})));
-  flow = builder->MatMul(
-      "/policy/K/matmul", encoder_out,
-      *GetWeghtsConverter(head.ip3_pol_w,
-                          {policy_embedding_size, policy_d_model}, {1, 0}));
+  flow = MakeMatMul(builder, "/policy/K/matmul", encoder_out, head.ip3_pol_w,
+                    {policy_embedding_size, policy_d_model});
   flow = builder->Add("/policy/K/add", flow,
                       *GetWeghtsConverter(head.ip3_pol_b, {policy_d_model}));
   auto K = builder->Reshape("/policy/K/reshape", flow, "/const/QK_shape");
-  flow = builder->Transpose("/policy/K/transpose", K, {0, 2, 1});
-  flow = builder->MatMul("/policy/matmul", Q, flow);
-  flow = builder->Mul("/policy/scale", flow,
-                      *GetScalarConverter(1.0f / sqrtf(policy_d_model)));
+  if (options_.fuse_ops) {
+    flow = builder->FusedMatMul("/policy/matmul", Q, K,
+                                1.0f / sqrtf(policy_d_model), true);
+  } else {
+    flow = builder->Transpose("/policy/K/transpose", K, {0, 2, 1});
+    flow = builder->MatMul("/policy/matmul", Q, flow);
+    flow = builder->Mul("/policy/scale", flow,
+                        *GetScalarConverter(1.0f / sqrtf(policy_d_model)));
+  }
   flow = builder->Reshape(
       "/policy/reshape", flow,
       builder->AddInitializer("/const/policy_out_shape",
                               Int64OnnxConst({-1, 90 * 90}, {2})));
   return builder->Gather(
-      options_.output_policy_head, flow,
+      output, flow,
       builder->AddInitializer(
           "/const/mapping_table",
           Int32OnnxConst(
@@ -890,12 +1094,13 @@ void Converter::MakePolicyHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
   }
   const MultiHeadWeights::PolicyHead& head =
       weights.policy_heads.at(options_.policy_head);
+  // With a legal move mask the logits are an intermediate result.
+  const std::string logits =
+      options_.policy_mask ? "/policy/logits" : options_.output_policy_head;
+  std::string output;
   if (src_.format().network_format().policy() ==
       pblczero::NetworkFormat::POLICY_ATTENTION) {
-    auto output = MakeAttentionPolicy(builder, input, weights, head);
-    builder->AddOutput(output, {-1, 2062}, GetDataType());
-    onnx->set_output_policy(output);
-    return;
+    output = MakeAttentionPolicy(builder, input, weights, head, logits);
   } else if (head.policy.weights.empty()) {
     throw Exception("The policy head selected '" + options_.policy_head + "'" +
                     " is empty.");
@@ -913,16 +1118,14 @@ void Converter::MakePolicyHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
         "/policy/flatten", flow,
         builder->AddInitializer("/const/policy_shape",
                                 Int64OnnxConst({-1, 52 * 10 * 9}, {2})));
-    auto output = builder->Gather(
-        options_.output_policy_head, flow,
+    output = builder->Gather(
+        logits, flow,
         builder->AddInitializer(
             "/const/mapping_table",
             Int32OnnxConst(
                 MakePolicyMap(kConvPolicyMap, std::size(kConvPolicyMap)),
                 {2062})),
         1);
-    builder->AddOutput(output, {options_.batch_size, 2062}, GetDataType());
-    onnx->set_output_policy(output);
   } else {
     // Dense policy head.
     if (NumEncBlocks() > 0) {
@@ -936,15 +1139,28 @@ void Converter::MakePolicyHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
                          builder->AddInitializer(
                              "/const/policy_shape",
                              Int64OnnxConst({-1, pol_channels * 10 * 9}, {2})));
-    flow = builder->MatMul(
-        "/policy/dense/matmul", flow,
-        *GetWeghtsConverter(head.ip_pol_w, {pol_channels * 10 * 9, 2062},
-                            {1, 0}));
-    auto output = builder->Add(options_.output_policy_head, flow,
-                               *GetWeghtsConverter(head.ip_pol_b, {2062}));
-    builder->AddOutput(output, {options_.batch_size, 2062}, GetDataType());
-    onnx->set_output_policy(output);
+    flow = MakeMatMul(builder, "/policy/dense/matmul", flow, head.ip_pol_w,
+                      {pol_channels * 10 * 9, 2062});
+    output = builder->Add(logits, flow,
+                          *GetWeghtsConverter(head.ip_pol_b, {2062}));
+  }
+  if (options_.policy_mask) {
+    // Illegal moves get a large negative logit, so that rows without any legal
+    // move (batch padding) still produce finite values.
+    onnx->set_input_policy_mask(options_.input_policy_mask);
+    builder->AddInput(options_.input_policy_mask, {options_.batch_size, 2062},
+                      GetDataType());
+    auto legal = builder->Greater("/policy/mask/legal",
+                                  options_.input_policy_mask,
+                                  *GetScalarConverter(0.5f));
+    auto flow = builder->Where(
+        "/policy/mask/where", legal, output,
+        builder->AddInitializer("/const/policy_illegal",
+                                *GetScalarConverter(-1e4f)));
+    output = builder->Softmax(options_.output_policy_head, flow);
   }
+  builder->AddOutput(output, {options_.batch_size, 2062}, GetDataType());
+  onnx->set_output_policy(output);
 }
 
 void Converter::MakeValueHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
@@ -965,10 +1181,8 @@ void Converter::MakeValueHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
   const int val_channels = NumEncBlocks() > 0 ? head.ip_val_b.size() : 32;
   if (NumEncBlocks() > 0) {
     int embedding_size = weights.ip_emb_b.size();
-    flow = builder->MatMul(
-        "/value/embed/matmul", input,
-        *GetWeghtsConverter(head.ip_val_w, {embedding_size, val_channels},
-                            {1, 0}));
+    flow = MakeMatMul(builder, "/value/embed/matmul", input, head.ip_val_w,
+                      {embedding_size, val_channels});
     flow = builder->Add("/value/embed/add", flow,
                         *GetWeghtsConverter(head.ip_val_b, {val_channels}));
     flow = MakeActivation(builder, flow, "/value/embed", default_activation_);
@@ -981,10 +1195,8 @@ void Converter::MakeValueHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
                        builder->AddInitializer(
                            "/const/value_shape",
                            Int64OnnxConst({-1, val_channels * 10 * 9}, {2})));
-  flow = builder->MatMul(
-      "/value/dense1/matmul", flow,
-      *GetWeghtsConverter(head.ip1_val_w, {val_channels * 10 * 9, 128},
-                          {1, 0}));
+  flow = MakeMatMul(builder, "/value/dense1/matmul", flow, head.ip1_val_w,
+                    {val_channels * 10 * 9, 128});
   flow = builder->Add("/value/dense1/add", flow,
                       *GetWeghtsConverter(head.ip1_val_b, {128}));
   flow = MakeActivation(builder, flow, "/value/dense1", default_activation_);
@@ -992,18 +1204,16 @@ void Converter::MakeValueHead(pblczero::OnnxModel* onnx, OnnxBuilder* builder,
   const bool wdl = src_.format().network_format().value() ==
                    pblczero::NetworkFormat::VALUE_WDL;
   if (wdl) {
-    flow =
-        builder->MatMul("/value/dense2/matmul", flow,
-                        *GetWeghtsConverter(head.ip2_val_w, {128, 3}, {1, 0}));
+    flow = MakeMatMul(builder, "/value/dense2/matmul", flow, head.ip2_val_w,
+                      {128, 3});
     flow = builder->Add("/value/dense2/add", flow,
                         *GetWeghtsConverter(head.ip2_val_b, {3}));
     auto output = builder->Softmax(options_.output_wdl, flow);
     builder->AddOutput(output, {options_.batch_size, 3}, GetDataType());
     onnx->set_output_wdl(output);
   } else {
-    flow =
-        builder->MatMul("/value/dense2/matmul", flow,
-                        *GetWeghtsConverter(head.ip2_val_w, {128, 1}, {1, 0}));
+    flow = MakeMatMul(builder, "/value/dense2/matmul", flow, head.ip2_val_w,
+                      {128, 1});
     flow = builder->Add("/value/dense2/add", flow,
                         *GetWeghtsConverter(head.ip2_val_b, {1}));
     auto output = builder->Tanh(options_.output_value, flow);
@@ -1027,10 +1237,8 @@ void Converter::MakeMovesLeftHead(pblczero::OnnxModel* onnx,
   std::string flow;
   if (NumEncBlocks() > 0) {
     int embedding_size = weights.ip_emb_b.size();
-    flow = builder->MatMul(
-        "/mlh/embed/matmul", input,
-        *GetWeghtsConverter(weights.ip_mov_w, {embedding_size, mlh_channels},
-                            {1, 0}));
+    flow = MakeMatMul(builder, "/mlh/embed/matmul", input, weights.ip_mov_w,
+                      {embedding_size, mlh_channels});
     flow = builder->Add("/mlh/embed/add", flow,
                         *GetWeghtsConverter(weights.ip_mov_b, {mlh_channels}));
     flow = MakeActivation(builder, flow, "/mlh/embed", default_activation_);
@@ -1043,17 +1251,14 @@ void Converter::MakeMovesLeftHead(pblczero::OnnxModel* onnx,
       "/mlh/reshape", flow,
       builder->AddInitializer("/const/mlh_shape",
                               Int64OnnxConst({-1, mlh_channels * 10 * 9}, {2})));
-  flow = builder->MatMul(
-      "/mlh/dense1/matmul", flow,
-      *GetWeghtsConverter(weights.ip1_mov_w,
-                          {mlh_channels * 10 * 9, mlh_fc1_outputs}, {1, 0}));
+  flow = MakeMatMul(builder, "/mlh/dense1/matmul", flow, weights.ip1_mov_w,
+                    {mlh_channels * 10 * 9, mlh_fc1_outputs});
   flow =
       builder->Add("/mlh/dense1/add", flow,
                    *GetWeghtsConverter(weights.ip1_mov_b, {mlh_fc1_outputs}));
   flow = MakeActivation(builder, flow, "/mlh/dense1", default_activation_);
-  flow = builder->MatMul(
-      "/mlh/dense2/matmul", flow,
-      *GetWeghtsConverter(weights.ip2_mov_w, {mlh_fc1_outputs, 1}, {1, 0}));
+  flow = MakeMatMul(builder, "/mlh/dense2/matmul", flow, weights.ip2_mov_w,
+                    {mlh_fc1_outputs, 1});
   flow = builder->Add("/mlh/dense2/add", flow,
                       *GetWeghtsConverter(weights.ip2_mov_b, {1}));
   flow = MakeActivation(builder, flow, "/mlh/dense2", default_activation_);
@@ -1062,6 +1267,46 @@ void Converter::MakeMovesLeftHead(pblczero::OnnxModel* onnx,
   onnx->set_output_mlh(output);
 }
 
+std::string Converter::MakePackedInput(pblczero::OnnxModel* onnx,
+                                       OnnxBuilder* builder) {
+  // 90 squares fit in 12 bytes per plane. Each byte is split into its 8 bits
+  // with a right shift and a modulo (BitwiseAnd needs opset 18), then the
+  // 0/1 planes are scaled by the per-plane values.
+  onnx->set_input_plane_masks(options_.input_plane_masks);
+  onnx->set_input_plane_values(options_.input_plane_values);
+  builder->AddInput(options_.input_plane_masks,
+                    {options_.batch_size, kInputPlanes, 12},
+                    pblczero::TensorProto::UINT8);
+  builder->AddInput(options_.input_plane_values,
+                    {options_.batch_size, kInputPlanes}, GetDataType());
+  auto flow = builder->Reshape(
+      "/input/unpack/reshape", options_.input_plane_masks,
+      builder->AddInitializer(
+          "/const/input_unpack_shape",
+          Int64OnnxConst({-1, kInputPlanes, 12, 1}, {4})));
+  flow = builder->BitShift(
+      "/input/unpack/shift", flow,
+      UInt8OnnxConst({0, 1, 2, 3, 4, 5, 6, 7}, {8}), "RIGHT");
+  flow = builder->Mod("/input/unpack/bit", flow, UInt8OnnxConst({2}, {1}));
+  flow = builder->Cast("/input/unpack/cast", flow, GetDataType());
+  flow = builder->Reshape(
+      "/input/unpack/squares", flow,
+      builder->AddInitializer("/const/input_squares_shape",
+                              Int64OnnxConst({-1, kInputPlanes, 96}, {3})));
+  flow = builder->Slice("/input/unpack/slice", flow, {0, 0, 0},
+                        {INT_MAX, INT_MAX, 90});
+  auto values = builder->Reshape(
+      "/input/values/reshape", options_.input_plane_values,
+      builder->AddInitializer("/const/input_values_shape",
+                              Int64OnnxConst({-1, kInputPlanes, 1}, {3})));
+  flow = builder->Mul("/input/unpack/scale", flow, values);
+  return builder->Reshape(
+      "/input/unpack/planes", flow,
+      builder->AddInitializer(
+          "/const/input_planes_shape",
+          Int64OnnxConst({-1, kInputPlanes, 10, 9}, {4})));
+}
+
 void Converter::GenerateOnnx(pblczero::OnnxModel* onnx) {
   MultiHeadWeights weights(src_.weights());
   OnnxBuilder builder(options_.opset);
@@ -1073,11 +1318,15 @@ void Converter::GenerateOnnx(pblczero::OnnxModel* onnx) {
   } else {
     onnx->set_data_type(pblczero::OnnxModel::FLOAT);
   }
-  onnx->set_input_planes(options_.input_planes_name);
-  builder.AddInput(options_.input_planes_name, {options_.batch_size, kInputPlanes, 10, 9},
-                   GetDataType());
-
-  auto flow = options_.input_planes_name;
+  std::string flow;
+  if (options_.packed_input) {
+    flow = MakePackedInput(onnx, &builder);
+  } else {
+    onnx->set_input_planes(options_.input_planes_name);
+    builder.AddInput(options_.input_planes_name,
+                     {options_.batch_size, kInputPlanes, 10, 9}, GetDataType());
+    flow = options_.input_planes_name;
+  }
 
   // Input convolution.
   if (NumResBlocks() > 0) {
@@ -1196,6 +1445,15 @@ void Converter::Convert(pblczero::Net* dst) {
           WeightsToOnnxConverterOptions::DataType::kFloat8E5M2) {
     throw Exception("FLOAT8 operation is not supported by the generated ONNX.");
   }
+  if (options_.int8_weights &&
+      options_.data_type != WeightsToOnnxConverterOptions::DataType::kFloat32) {
+    throw Exception("Int8 weights are only supported with f32 data type.");
+  }
+  if (options_.fuse_ops &&
+      options_.data_type != WeightsToOnnxConverterOptions::DataType::kFloat32 &&
+      options_.data_type != WeightsToOnnxConverterOptions::DataType::kFloat16) {
+    throw Exception("Fused operators are only supported with f32 or f16.");
+  }
 
   CopyGenericFields(dst);
   GenerateOnnx(dst->mutable_onnx_model());
@@ -39,6 +39,9 @@ struct WeightsToOnnxConverterOptions {
   enum class DataType { kFloat32, kFloat16, kBFloat16, kFloat8E5M2 };
   DataType data_type = DataType::kFloat32;
   std::string input_planes_name = "/input/planes";
+  std::string input_policy_mask = "/input/policy_mask";
+  std::string input_plane_masks = "/input/plane_masks";
+  std::string input_plane_values = "/input/plane_values";
   std::string output_policy_head = "/output/policy";
   std::string output_wdl = "/output/wdl";
   std::string output_value = "/output/value";
@@ -49,6 +52,10 @@ struct WeightsToOnnxConverterOptions {
   bool alt_layernorm = false;  // Discrete "LayerNormalization" implementation.
   bool relax_op_types = true;  // Use data_type even if unsuported by operator.
   bool no_shape = false;       // Avoid use of "Shape" operator.
+  bool fuse_ops = false;       // Use onnxruntime fused operators.
+  bool int8_weights = false;   // Store dense weights as int8 (QDQ).
+  bool policy_mask = false;    // Add legal move mask input, output softmax.
+  bool packed_input = false;   // Take bit-packed planes, expand in the graph.
   std::string policy_head = "vanilla";
   std::string value_head = "winner";
 
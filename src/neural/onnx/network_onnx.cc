@@ -43,9 +43,9 @@
 #include "neural/loader.h"
 #include "neural/network.h"
 #include "neural/onnx/converter.h"
+#include "neural/shared/expand_planes.h"
 #include "onnxruntime_cxx_api.h"
 #include "utils/bf16_utils.h"
-#include "utils/bititer.h"
 #include "utils/exception.h"
 #include "utils/fp16_utils.h"
 #include "utils/logging.h"
@@ -70,11 +70,13 @@ class OnnxComputation : public NetworkComputation {
   float GetMVal(int sample) const override;
 
  private:
-  Ort::Value PrepareInputs(int start, int batch_size);
+  std::vector<Ort::Value> PrepareInputs(int start, int batch_size);
 
   OnnxNetwork* network_;
   std::vector<InputPlanes> raw_input_;
   std::vector<DataType> input_tensor_data_;
+  // Bit-packed input, used when the model expands the planes itself.
+  std::vector<uint8_t> input_masks_data_;
   std::vector<Ort::Value> output_tensors_;
   std::vector<std::vector<DataType>> output_tensors_data_;
   std::vector<size_t> output_tensors_step_;
@@ -118,6 +120,8 @@ class OnnxNetwork : public Network {
   int wdl_head_ = -1;
   int value_head_ = -1;
   int mlh_head_ = -1;
+  // Whether the model takes bit-packed masks and values instead of planes.
+  bool packed_input_ = false;
   NetworkCapabilities capabilities_;
   bool fp16_;
   bool bf16_;
@@ -206,6 +210,21 @@ float OnnxComputation<DataType>::GetMVal(int sample) const {
   return AsFloat(data[sample]);
 }
 
+void ExpandInputs(const std::vector<InputPlanes>& input, size_t start,
+                  size_t count, float* out) {
+  ExpandPlanes(input, start, count, out);
+}
+void ExpandInputs(const std::vector<InputPlanes>& input, size_t start,
+                  size_t count, Ort::Float16_t* out) {
+  static_assert(sizeof(Ort::Float16_t) == sizeof(uint16_t));
+  ExpandPlanesFp16(input, start, count, reinterpret_cast<uint16_t*>(out));
+}
+void ExpandInputs(const std::vector<InputPlanes>& input, size_t start,
+                  size_t count, Ort::BFloat16_t* out) {
+  static_assert(sizeof(Ort::BFloat16_t) == sizeof(uint16_t));
+  ExpandPlanesBf16(input, start, count, reinterpret_cast<uint16_t*>(out));
+}
+
 void AsDataType(float x, float* y) { *y = x; }
 void AsDataType(float x, Ort::Float16_t* y) {
   uint16_t tmp = FP32toFP16(x);
@@ -216,31 +235,51 @@ void AsDataType(float x, Ort::BFloat16_t* y) {
   std::memcpy(reinterpret_cast<uint16_t*>(y), &tmp, sizeof(uint16_t));
 }
 
+// Number of mask bytes per plane, 90 squares rounded up to whole bytes.
+constexpr int kPackedPlaneBytes = 12;
+
 template <typename DataType>
-Ort::Value OnnxComputation<DataType>::PrepareInputs(int start, int batch_size) {
-  input_tensor_data_.clear();
-  input_tensor_data_.resize(batch_size * kInputPlanes * 10 * 9);
-  auto iter = input_tensor_data_.data();
+std::vector<Ort::Value> OnnxComputation<DataType>::PrepareInputs(
+    int start, int batch_size) {
   int end = std::min(start + batch_size, static_cast<int>(raw_input_.size()));
-  for (int i = start; i < end; i++) {
-    for (const auto& plane : raw_input_[i]) {
-      DataType value;
-      AsDataType(plane.value, &value);
-      for (auto bit : IterateBits(plane.mask)) {
-        *(iter + bit) = value;
+  std::vector<Ort::Value> inputs;
+  auto memory_info =
+      Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+  // Samples past the end of the input stay zero.
+  input_tensor_data_.clear();
+  if (network_->packed_input_) {
+    // Square i is bit i % 8 of byte i / 8, i.e. the low bytes of the mask on
+    // a little-endian host.
+    input_masks_data_.clear();
+    input_masks_data_.resize(batch_size * kInputPlanes * kPackedPlaneBytes);
+    input_tensor_data_.resize(batch_size * kInputPlanes);
+    auto* mask = input_masks_data_.data();
+    auto* value = input_tensor_data_.data();
+    for (int i = start; i < end; i++) {
+      for (const auto& plane : raw_input_[i]) {
+        std::memcpy(mask, &plane.mask, kPackedPlaneBytes);
+        mask += kPackedPlaneBytes;
+        AsDataType(plane.value, value++);
       }
-      iter += 90;
-    }
-  }
-  for (int i = end; i < start + batch_size; i++) {
-    for (int j = 0; j < kInputPlanes * 90; j++) {
-      *iter++ = DataType();
     }
+    int64_t mask_dims[] = {batch_size, kInputPlanes, kPackedPlaneBytes};
+    inputs.emplace_back(Ort::Value::CreateTensor<uint8_t>(
+        memory_info, input_masks_data_.data(), input_masks_data_.size(),
+        mask_dims, 3));
+    int64_t value_dims[] = {batch_size, kInputPlanes};
+    inputs.emplace_back(Ort::Value::CreateTensor<DataType>(
+        memory_info, input_tensor_data_.data(), input_tensor_data_.size(),
+        value_dims, 2));
+  } else {
+    input_tensor_data_.resize(batch_size * kInputPlanes * 10 * 9);
+    ExpandInputs(raw_input_, start, end - start, input_tensor_data_.data());
+    int64_t dims[] = {batch_size, kInputPlanes, 10, 9};
+    inputs.emplace_back(Ort::Value::CreateTensor<DataType>(
+        memory_info, input_tensor_data_.data(), input_tensor_data_.size(),
+        dims, 4));
   }
 
-  auto memory_info =
-      Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-
   output_tensors_.clear();
   for (size_t i = 0; i < output_tensors_step_.size(); i++) {
     int size = output_tensors_step_[i];
@@ -249,11 +288,7 @@ Ort::Value OnnxComputation<DataType>::PrepareInputs(int start, int batch_size) {
         memory_info, output_tensors_data_[i].data() + start * size,
         size * batch_size, dims, 2));
   }
-
-  int64_t dims[] = {batch_size, kInputPlanes, 10, 9};
-  return Ort::Value::CreateTensor<DataType>(memory_info,
-                                            input_tensor_data_.data(),
-                                            input_tensor_data_.size(), dims, 4);
+  return inputs;
 }
 
 template <typename DataType>
@@ -266,7 +301,7 @@ void OnnxComputation<DataType>::ComputeBlocking() {
     if (step > network_->steps_) step = network_->steps_;
     int batch = batch_size * step;
 
-    auto input_tensor = PrepareInputs(i, batch);
+    auto input_tensors = PrepareInputs(i, batch);
     // The DML onnxruntime execution provider is documented as not supporting
     // multi-threaded calls to Run on the same inference session. We found the
     // same to be true for the ROCm execution provider (at least for CNNs).
@@ -276,7 +311,8 @@ void OnnxComputation<DataType>::ComputeBlocking() {
       network_->lock_.lock();
     }
     network_->session_[step - 1].Run(
-        {}, network_->inputs_cstr_.data(), &input_tensor, 1,
+        {}, network_->inputs_cstr_.data(), input_tensors.data(),
+        input_tensors.size(),
         network_->outputs_cstr_.data(), output_tensors_.data(),
         output_tensors_.size());
     if (network_->provider_ == OnnxProvider::DML ||
@@ -363,10 +399,20 @@ OnnxNetwork::OnnxNetwork(const WeightsFile& file, const OptionsDict&,
         GetOptions(provider, gpu, threads, batch_size_ * step));
 
   const auto& md = file.onnx_model();
-  if (!md.has_input_planes()) {
+  if (md.has_input_plane_masks() && md.has_input_plane_values()) {
+    packed_input_ = true;
+    inputs_.emplace_back(md.input_plane_masks());
+    inputs_.emplace_back(md.input_plane_values());
+  } else if (md.has_input_planes()) {
+    inputs_.emplace_back(md.input_planes());
+  } else {
     throw Exception("NN doesn't have input planes defined.");
   }
-  inputs_.emplace_back(md.input_planes());
+  if (md.has_input_policy_mask()) {
+    throw Exception(
+        "NN has a legal move mask input, which the onnx backend doesn't "
+        "support.");
+  }
   if (!md.has_output_policy()) {
     throw Exception("NN doesn't have policy head defined.");
   }
@@ -422,6 +468,10 @@ std::unique_ptr<Network> MakeOnnxNetwork(const std::optional<WeightsFile>& w,
     converter_options.alt_layernorm = opts.GetOrDefault<bool>(
         "alt_layernorm", kProvider == OnnxProvider::DML ? true : false);
     converter_options.no_shape = opts.GetOrDefault<bool>("no_shape", false);
+    converter_options.fuse_ops = opts.GetOrDefault<bool>("fuse_ops", false);
+    converter_options.int8_weights = opts.GetOrDefault<bool>("int8", false);
+    converter_options.packed_input =
+        opts.GetOrDefault<bool>("packed_input", false);
     converter_options.policy_head =
         opts.GetOrDefault<std::string>("policy_head", "vanilla");
     converter_options.value_head =
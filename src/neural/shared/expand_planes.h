@@ -0,0 +1,59 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2026 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+ Additional permission under GNU GPL version 3 section 7
+
+ If you modify this Program, or any covered work, by linking or
+ combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+ Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+ modified version of those libraries), containing parts covered by the
+ terms of the respective license agreement, the licensors of this
+ Program grant you additional permission to convey the resulting work.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "neural/network.h"
+
+namespace lczero {
+
+// Number of values one input plane expands to.
+constexpr int kPlaneSquares = 90;
+
+// Expands the bit-packed planes of one sample into kInputPlanes x
+// kPlaneSquares dense values, plane by plane. Squares not in a plane's mask
+// are zero. Uses AVX-512 or AVX2 mask expansion when the build targets them.
+void ExpandPlanes(const InputPlanes& planes, float* out);
+// Same, storing IEEE half precision bit patterns.
+void ExpandPlanesFp16(const InputPlanes& planes, uint16_t* out);
+// Same, storing bfloat16 bit patterns.
+void ExpandPlanesBf16(const InputPlanes& planes, uint16_t* out);
+
+// Expands samples [start, start + count) of a batch into consecutive dense
+// samples at `out`. Large batches are split across several threads.
+void ExpandPlanes(const std::vector<InputPlanes>& batch, size_t start,
+                  size_t count, float* out);
+void ExpandPlanesFp16(const std::vector<InputPlanes>& batch, size_t start,
+                      size_t count, uint16_t* out);
+void ExpandPlanesBf16(const std::vector<InputPlanes>& batch, size_t start,
+                      size_t count, uint16_t* out);
+
+}  // namespace lczero
@@ -0,0 +1,113 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2026 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+ Additional permission under GNU GPL version 3 section 7
+
+ If you modify this Program, or any covered work, by linking or
+ combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+ Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+ modified version of those libraries), containing parts covered by the
+ terms of the respective license agreement, the licensors of this
+ Program grant you additional permission to convey the resulting work.
+ */
+
+#include "neural/shared/expand_planes.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "utils/bf16_utils.h"
+#include "utils/fp16_utils.h"
+
+namespace lczero {
+namespace {
+
+InputPlanes RandomSample(std::mt19937_64* gen) {
+  InputPlanes planes(kInputPlanes);
+  const __uint128_t squares = (__uint128_t(1) << kPlaneSquares) - 1;
+  for (auto& plane : planes) {
+    switch ((*gen)() % 4) {
+      case 0:
+        break;
+      case 1:
+        plane.SetAll();
+        break;
+      default:
+        plane.mask = ((__uint128_t((*gen)()) << 64) | (*gen)()) & squares;
+    }
+    plane.value = static_cast<float>((*gen)() % 100) / 7.0f;
+  }
+  return planes;
+}
+
+template <typename T, typename Convert>
+void CheckSample(const InputPlanes& planes, const T* out, Convert convert) {
+  for (int p = 0; p < kInputPlanes; p++) {
+    for (int sq = 0; sq < kPlaneSquares; sq++) {
+      const bool set = ((planes[p].mask >> sq) & 1) != 0;
+      ASSERT_EQ(out[p * kPlaneSquares + sq],
+                set ? convert(planes[p].value) : T(0))
+          << "plane " << p << " square " << sq;
+    }
+  }
+}
+
+float Identity(float x) { return x; }
+
+}  // namespace
+
+TEST(ExpandPlanes, MatchesMasks) {
+  std::mt19937_64 gen(42);
+  std::vector<float> out(kInputPlanes * kPlaneSquares, -1.0f);
+  std::vector<uint16_t> out16(kInputPlanes * kPlaneSquares, 0xffff);
+  for (int i = 0; i < 100; i++) {
+    const auto planes = RandomSample(&gen);
+    ExpandPlanes(planes, out.data());
+    CheckSample(planes, out.data(), Identity);
+    ExpandPlanesFp16(planes, out16.data());
+    CheckSample(planes, out16.data(), FP32toFP16);
+    ExpandPlanesBf16(planes, out16.data());
+    CheckSample(planes, out16.data(), FP32toBF16);
+  }
+}
+
+TEST(ExpandPlanes, Batch) {
+  std::mt19937_64 gen(7);
+  std::vector<InputPlanes> batch;
+  for (int i = 0; i < 1100; i++) batch.push_back(RandomSample(&gen));
+  const size_t sample_size = kInputPlanes * kPlaneSquares;
+  const size_t start = 3;
+  const size_t count = batch.size() - start;
+  std::vector<float> out(count * sample_size, -1.0f);
+  ExpandPlanes(batch, start, count, out.data());
+  for (size_t i = 0; i < count; i++) {
+    CheckSample(batch[start + i], &out[i * sample_size], Identity);
+  }
+  std::vector<uint16_t> out16(count * sample_size, 0xffff);
+  ExpandPlanesFp16(batch, start, count, out16.data());
+  for (size_t i = 0; i < count; i++) {
+    CheckSample(batch[start + i], &out16[i * sample_size], FP32toFP16);
+  }
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
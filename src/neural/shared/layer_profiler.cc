@@ -0,0 +1,120 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2024 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+ Additional permission under GNU GPL version 3 section 7
+
+ If you modify this Program, or any covered work, by linking or
+ combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+ Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+ modified version of those libraries), containing parts covered by the
+ terms of the respective license agreement, the licensors of this
+ Program grant you additional permission to convey the resulting work.
+ */
+
+
+#include "neural/shared/layer_profiler.h"
+
+#include <algorithm>
+
+namespace lczero {
+namespace {
+void SortByTime(std::vector<LayerProfiler::Entry>* entries) {
+  std::sort(entries->begin(), entries->end(),
+            [](const LayerProfiler::Entry& a, const LayerProfiler::Entry& b) {
+              if (a.seconds != b.seconds) return a.seconds > b.seconds;
+              if (a.type != b.type) return a.type < b.type;
+              return a.index < b.index;
+            });
+}
+}  // namespace
+
+std::string LayerProfiler::Entry::Name() const {
+  if (index < 0) return type;
+  return type + " " + std::to_string(index);
+}
+
+LayerProfiler::Scope::Scope(const char* type, int index)
+    : active_(LayerProfiler::Get().IsEnabled()), index_(index) {
+  if (!active_) return;
+  type_ = type;
+  start_ = std::chrono::steady_clock::now();
+}
+
+LayerProfiler::Scope::Scope(const char* prefix, const char* type, int index)
+    : active_(LayerProfiler::Get().IsEnabled()), index_(index) {
+  if (!active_) return;
+  type_ = std::string(prefix) + " " + type;
+  start_ = std::chrono::steady_clock::now();
+}
+
+void LayerProfiler::Scope::Stop() {
+  if (!active_) return;
+  active_ = false;
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_;
+  LayerProfiler::Get().Record(type_, index_, elapsed.count());
+}
+
+LayerProfiler& LayerProfiler::Get() {
+  static LayerProfiler profiler;
+  return profiler;
+}
+
+void LayerProfiler::Record(const std::string& type, int index,
+                           double seconds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& stats = stats_[{type, index}];
+  stats.seconds += seconds;
+  stats.calls++;
+}
+
+void LayerProfiler::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.clear();
+}
+
+std::vector<LayerProfiler::Entry> LayerProfiler::GetEntries() const {
+  std::vector<Entry> entries;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [key, stats] : stats_) {
+      entries.push_back({key.first, key.second, stats.seconds, stats.calls});
+    }
+  }
+  SortByTime(&entries);
+  return entries;
+}
+
+std::vector<LayerProfiler::Entry> LayerProfiler::GetTypeTotals() const {
+  std::map<std::string, Stats> totals;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [key, stats] : stats_) {
+      auto& total = totals[key.first];
+      total.seconds += stats.seconds;
+      total.calls += stats.calls;
+    }
+  }
+  std::vector<Entry> entries;
+  for (const auto& [type, stats] : totals) {
+    entries.push_back({type, -1, stats.seconds, stats.calls});
+  }
+  SortByTime(&entries);
+  return entries;
+}
+
+}  // namespace lczero
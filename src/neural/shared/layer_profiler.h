@@ -0,0 +1,107 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2024 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+ Additional permission under GNU GPL version 3 section 7
+
+ If you modify this Program, or any covered work, by linking or
+ combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+ Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+ modified version of those libraries), containing parts covered by the
+ terms of the respective license agreement, the licensors of this
+ Program grant you additional permission to convey the resulting work.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lczero {
+
+// Collects wall time spent in individual layers of the CPU backends.
+// Profiling is disabled by default; when disabled, a Scope costs a single
+// relaxed atomic load.
+class LayerProfiler {
+ public:
+  struct Entry {
+    // Layer type, e.g. "residual" or "encoder ffn".
+    std::string type;
+    // Index of the layer within its type, or -1 for single layers.
+    int index;
+    double seconds;
+    uint64_t calls;
+
+    std::string Name() const;
+  };
+
+  // Records the time between construction and destruction (or Stop()) under
+  // (type, index), if profiling was enabled at construction.
+  class Scope {
+   public:
+    explicit Scope(const char* type, int index = -1);
+    // The type is recorded as "<prefix> <type>".
+    Scope(const char* prefix, const char* type, int index);
+    ~Scope() { Stop(); }
+
+    // Records the elapsed time now rather than at destruction.
+    void Stop();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    bool active_;
+    std::string type_;
+    int index_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  // Process-wide instance shared by all backends.
+  static LayerProfiler& Get();
+
+  void Enable(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+  bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void Record(const std::string& type, int index, double seconds);
+  void Reset();
+
+  // Returns all recorded layers, most expensive first.
+  std::vector<Entry> GetEntries() const;
+  // Returns the recorded layers summed per type, most expensive first.
+  std::vector<Entry> GetTypeTotals() const;
+
+ private:
+  struct Stats {
+    double seconds = 0.0;
+    uint64_t calls = 0;
+  };
+
+  std::atomic<bool> enabled_{false};
+  mutable std::mutex mutex_;
+  std::map<std::pair<std::string, int>, Stats> stats_;
+};
+
+}  // namespace lczero
@@ -0,0 +1,237 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <unistd.h>
+
+#include <climits>
+#include <cstring>
+#include <deque>
+
+#include "neural/factory.h"
+#include "neural/shm/shm_batch.h"
+#include "utils/exception.h"
+
+namespace lczero {
+namespace {
+
+// How long a client sleeps between checks that the server is still there.
+constexpr int kLivenessCheckMs = 1000;
+
+class ShmNetwork;
+
+class ShmComputation : public NetworkComputation {
+ public:
+  ShmComputation(ShmNetwork* network) : network_(network) {}
+
+  void AddInput(InputPlanes&& input) override {
+    raw_input_.emplace_back(std::move(input));
+  }
+  void ComputeBlocking() override;
+  int GetBatchSize() const override { return raw_input_.size(); }
+  float GetQVal(int sample) const override {
+    return outputs_[sample * kShmOutputsPerSample];
+  }
+  float GetDVal(int sample) const override {
+    return outputs_[sample * kShmOutputsPerSample + 1];
+  }
+  float GetMVal(int sample) const override {
+    return outputs_[sample * kShmOutputsPerSample + 2];
+  }
+  float GetPVal(int sample, int move_id) const override {
+    return outputs_[sample * kShmOutputsPerSample + 3 + move_id];
+  }
+
+ private:
+  ShmNetwork* network_;
+  std::vector<InputPlanes> raw_input_;
+  std::vector<float> outputs_;
+};
+
+class ShmNetwork : public Network {
+ public:
+  ShmNetwork(const OptionsDict& options)
+      : segment_(ShmSegment::Open(
+            options.GetOrDefault<std::string>("name", "/px0"))),
+        pid_(getpid()) {
+    const auto* header = segment_.header();
+    capabilities_ = {
+        static_cast<pblczero::NetworkFormat::InputFormat>(
+            header->input_format),
+        static_cast<pblczero::NetworkFormat::OutputFormat>(
+            header->output_format),
+        static_cast<pblczero::NetworkFormat::MovesLeftFormat>(
+            header->moves_left)};
+    CheckServer();
+  }
+
+  std::unique_ptr<NetworkComputation> NewComputation() override {
+    return std::make_unique<ShmComputation>(this);
+  }
+  const NetworkCapabilities& GetCapabilities() const override {
+    return capabilities_;
+  }
+  int GetMiniBatchSize() const override {
+    return segment_.header()->mini_batch_size;
+  }
+
+  int slot_capacity() const { return segment_.header()->slot_capacity; }
+
+  // Claims a free slot, walking the ring once from its shared position.
+  // Returns -1 when every slot is in use.
+  int TryAcquireSlot() {
+    auto* header = segment_.header();
+    const uint32_t count = header->slot_count;
+    for (uint32_t i = 0; i < count; i++) {
+      const int idx = header->next_slot.fetch_add(1) % count;
+      auto* slot = segment_.slot(idx);
+      // The owner is cleared last when a slot is freed, so an unowned slot
+      // is always kFree.
+      int32_t expected = 0;
+      if (slot->owner_pid.load(std::memory_order_relaxed) == 0 &&
+          slot->owner_pid.compare_exchange_strong(expected, pid_,
+                                                  std::memory_order_acquire)) {
+        slot->state.store(kFilling, std::memory_order_relaxed);
+        return idx;
+      }
+    }
+    CheckServer();
+    return -1;
+  }
+
+  // Claims a free slot, sleeping until another client frees one if the ring
+  // is full.
+  int AcquireSlot() {
+    auto* header = segment_.header();
+    int idx;
+    header->slot_waiters.fetch_add(1);
+    while (true) {
+      const uint32_t freed = header->slot_freed.load();
+      if ((idx = TryAcquireSlot()) != -1) break;
+      FutexWait(&header->slot_freed, freed, kLivenessCheckMs);
+    }
+    header->slot_waiters.fetch_sub(1);
+    return idx;
+  }
+
+  void Submit(int idx, const std::vector<InputPlanes>& input, size_t start,
+              size_t count) {
+    auto* masks = segment_.masks(idx);
+    auto* values = segment_.values(idx);
+    for (size_t i = start; i < start + count; i++) {
+      for (const auto& plane : input[i]) {
+        *masks++ = plane.mask;
+        *values++ = plane.value;
+      }
+    }
+    auto* slot = segment_.slot(idx);
+    slot->batch_size = count;
+    slot->state.store(kReady, std::memory_order_release);
+    auto* header = segment_.header();
+    header->doorbell.fetch_add(1, std::memory_order_release);
+    FutexWake(&header->doorbell, 1);
+  }
+
+  // Waits for the slot to be computed, copies its outputs and frees it.
+  // Returns false if the server failed to compute it.
+  bool Retrieve(int idx, float* outputs) {
+    auto* slot = segment_.slot(idx);
+    uint32_t state;
+    while ((state = slot->state.load(std::memory_order_acquire)) != kDone &&
+           state != kFailed) {
+      FutexWait(&slot->state, state, kLivenessCheckMs);
+      CheckServer();
+    }
+    if (state == kDone) {
+      std::memcpy(outputs, segment_.outputs(idx),
+                  slot->batch_size * kShmOutputsPerSample * sizeof(float));
+    }
+    slot->state.store(kFree, std::memory_order_relaxed);
+    slot->owner_pid.store(0, std::memory_order_release);
+    auto* header = segment_.header();
+    header->slot_freed.fetch_add(1);
+    if (header->slot_waiters.load() > 0) {
+      FutexWake(&header->slot_freed, INT_MAX);
+    }
+    return state == kDone;
+  }
+
+ private:
+  void CheckServer() const {
+    const auto* header = segment_.header();
+    if (!header->server_alive.load(std::memory_order_acquire) ||
+        !IsProcessAlive(header->server_pid)) {
+      throw Exception("Inference server has stopped.");
+    }
+  }
+
+  ShmSegment segment_;
+  const int32_t pid_;
+  NetworkCapabilities capabilities_;
+};
+
+void ShmComputation::ComputeBlocking() {
+  const size_t capacity = network_->slot_capacity();
+  outputs_.resize(raw_input_.size() * kShmOutputsPerSample);
+  // Batches larger than a slot are split and all parts are in flight
+  // together. When the ring is full our own oldest part is collected first,
+  // so that clients never wait on each other while holding finished slots.
+  // Once a part has failed no more parts are submitted, but those in flight
+  // are still collected, so that their slots are freed.
+  std::deque<std::pair<int, size_t>> pending;
+  bool ok = true;
+  auto retrieve_oldest = [&]() {
+    ok &= network_->Retrieve(pending.front().first,
+                             outputs_.data() +
+                                 pending.front().second * kShmOutputsPerSample);
+    pending.pop_front();
+  };
+  for (size_t start = 0; ok && start < raw_input_.size(); start += capacity) {
+    int idx;
+    while ((idx = network_->TryAcquireSlot()) == -1) {
+      if (pending.empty()) {
+        idx = network_->AcquireSlot();
+        break;
+      }
+      retrieve_oldest();
+    }
+    pending.emplace_back(idx, start);
+    network_->Submit(idx, raw_input_, start,
+                     std::min(capacity, raw_input_.size() - start));
+  }
+  while (!pending.empty()) retrieve_oldest();
+  if (!ok) throw Exception("Inference server failed to compute the batch.");
+}
+
+std::unique_ptr<Network> MakeShmNetwork(
+    const std::optional<WeightsFile>& /*weights*/, const OptionsDict& options) {
+  return std::make_unique<ShmNetwork>(options);
+}
+
+REGISTER_NETWORK("shm", MakeShmNetwork, -1100)
+
+}  // namespace
+}  // namespace lczero
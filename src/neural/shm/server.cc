@@ -0,0 +1,287 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shm/server.h"
+
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <thread>
+
+#include "neural/factory.h"
+#include "neural/shm/shm_batch.h"
+#include "utils/exception.h"
+#include "utils/logging.h"
+#include "utils/optionsparser.h"
+
+namespace lczero {
+namespace {
+
+const OptionId kShmNameId{
+    "shm-name", "",
+    "Name of the POSIX shared memory segment that clients connect to with "
+    "--backend=shm --backend-opts=name=<shm-name>."};
+const OptionId kSlotsId{"slots", "",
+                        "Number of batch slots shared by all clients."};
+const OptionId kSlotBatchSizeId{
+    "slot-batch-size", "",
+    "Positions per slot. Larger client batches use several slots."};
+const OptionId kMaxBatchSizeId{
+    "max-batch-size", "",
+    "Largest batch, gathered from all clients, sent to the backend."};
+const OptionId kBatchWaitId{
+    "batch-wait-us", "",
+    "After the first ready slot, how long to wait for other clients before "
+    "computing a partial batch, in microseconds."};
+const OptionId kThreadsId{"threads", "Threads",
+                          "Number of batches computed concurrently.", 't'};
+
+// Workers recheck the stop flag at least this often.
+constexpr int kIdleWaitMs = 100;
+// How often slots of dead clients are looked for.
+constexpr int kReclaimIntervalMs = 1000;
+
+std::atomic<bool> stop_requested{false};
+
+void OnStopSignal(int) { stop_requested = true; }
+
+class InferenceServer {
+ public:
+  InferenceServer(std::unique_ptr<Network> network, ShmSegment segment,
+                  int max_batch_size, int batch_wait_us)
+      : network_(std::move(network)),
+        segment_(std::move(segment)),
+        max_batch_size_(max_batch_size),
+        batch_wait_us_(batch_wait_us) {}
+
+  void Worker(int id) {
+    auto* header = segment_.header();
+    uint32_t scan_start = id;
+    auto next_reclaim = std::chrono::steady_clock::now();
+    while (!stop_requested) {
+      if (id == 0 && std::chrono::steady_clock::now() >= next_reclaim) {
+        ReclaimAbandonedSlots();
+        next_reclaim = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(kReclaimIntervalMs);
+      }
+      const uint32_t bell = header->doorbell.load(std::memory_order_acquire);
+      std::vector<int> slots;
+      int batch_size = 0;
+      Collect(&scan_start, &slots, &batch_size);
+      if (slots.empty()) {
+        FutexWait(&header->doorbell, bell, kIdleWaitMs);
+        continue;
+      }
+      const auto deadline = std::chrono::steady_clock::now() +
+                            std::chrono::microseconds(batch_wait_us_);
+      while (batch_size < max_batch_size_ &&
+             std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+        Collect(&scan_start, &slots, &batch_size);
+      }
+      Compute(slots);
+      positions_ += batch_size;
+      ++batches_;
+    }
+  }
+
+  // Wakes clients waiting on a slot so they notice the server is gone.
+  void Shutdown() {
+    auto* header = segment_.header();
+    header->server_alive.store(0, std::memory_order_release);
+    for (uint32_t i = 0; i < header->slot_count; i++) {
+      FutexWake(&segment_.slot(i)->state, INT_MAX);
+    }
+    FutexWake(&header->slot_freed, INT_MAX);
+  }
+
+  uint64_t positions() const { return positions_; }
+  uint64_t batches() const { return batches_; }
+
+ private:
+  // Takes ready slots, starting from where this worker stopped last time so
+  // that no client is starved, until the batch is full.
+  void Collect(uint32_t* scan_start, std::vector<int>* slots,
+               int* batch_size) {
+    const uint32_t count = segment_.header()->slot_count;
+    for (uint32_t i = 0; i < count; i++) {
+      const int idx = (*scan_start + i) % count;
+      auto* slot = segment_.slot(idx);
+      uint32_t expected = kReady;
+      if (slot->state.load(std::memory_order_relaxed) != expected) continue;
+      if (*batch_size > 0 &&
+          *batch_size + static_cast<int>(slot->batch_size) > max_batch_size_) {
+        *scan_start = idx;
+        return;
+      }
+      if (!slot->state.compare_exchange_strong(expected, kRunning,
+                                               std::memory_order_acquire)) {
+        continue;
+      }
+      slots->push_back(idx);
+      *batch_size += slot->batch_size;
+    }
+  }
+
+  // Frees slots held by clients that died without freeing them. Slots being
+  // computed are left alone, they are freed once they are done.
+  void ReclaimAbandonedSlots() {
+    auto* header = segment_.header();
+    int reclaimed = 0;
+    for (uint32_t i = 0; i < header->slot_count; i++) {
+      auto* slot = segment_.slot(i);
+      int32_t owner = slot->owner_pid.load(std::memory_order_acquire);
+      if (owner == 0 || IsProcessAlive(owner)) continue;
+      uint32_t state = slot->state.load(std::memory_order_acquire);
+      if (state == kRunning ||
+          !slot->state.compare_exchange_strong(state, kFree,
+                                               std::memory_order_acquire)) {
+        continue;
+      }
+      if (!slot->owner_pid.compare_exchange_strong(
+              owner, 0, std::memory_order_release)) {
+        continue;
+      }
+      ++reclaimed;
+    }
+    if (reclaimed == 0) return;
+    header->slot_freed.fetch_add(1);
+    FutexWake(&header->slot_freed, INT_MAX);
+    CERR << "Freed " << reclaimed << " slots of exited clients.";
+  }
+
+  // Computes the slots as one batch. A backend error fails these slots only,
+  // their clients throw and the server keeps serving.
+  void Compute(const std::vector<int>& slots) {
+    uint32_t state = kDone;
+    try {
+      ComputeSlots(slots);
+    } catch (const std::exception& ex) {
+      CERR << "Failed to compute a batch: " << ex.what();
+      state = kFailed;
+    }
+    for (const int idx : slots) {
+      auto* slot = segment_.slot(idx);
+      slot->state.store(state, std::memory_order_release);
+      FutexWake(&slot->state, 1);
+    }
+  }
+
+  void ComputeSlots(const std::vector<int>& slots) {
+    auto computation = network_->NewComputation();
+    for (const int idx : slots) {
+      const auto* masks = segment_.masks(idx);
+      const auto* values = segment_.values(idx);
+      for (uint32_t i = 0; i < segment_.slot(idx)->batch_size; i++) {
+        InputPlanes planes(kInputPlanes);
+        for (auto& plane : planes) {
+          plane.mask = *masks++;
+          plane.value = *values++;
+        }
+        computation->AddInput(std::move(planes));
+      }
+    }
+    computation->ComputeBlocking();
+    int sample = 0;
+    for (const int idx : slots) {
+      auto* slot = segment_.slot(idx);
+      auto* out = segment_.outputs(idx);
+      for (uint32_t i = 0; i < slot->batch_size; i++, sample++) {
+        *out++ = computation->GetQVal(sample);
+        *out++ = computation->GetDVal(sample);
+        *out++ = computation->GetMVal(sample);
+        for (int move = 0; move < kPolicyOutputs; move++) {
+          *out++ = computation->GetPVal(sample, move);
+        }
+      }
+    }
+  }
+
+  std::unique_ptr<Network> network_;
+  ShmSegment segment_;
+  const int max_batch_size_;
+  const int batch_wait_us_;
+  std::atomic<uint64_t> positions_{0};
+  std::atomic<uint64_t> batches_{0};
+};
+
+}  // namespace
+
+void RunInferenceServer() {
+  OptionsParser options;
+  NetworkFactory::PopulateOptions(&options);
+  options.Add<StringOption>(kShmNameId) = "/px0";
+  options.Add<IntOption>(kSlotsId, 1, 4096) = 32;
+  options.Add<IntOption>(kSlotBatchSizeId, 1, 1024) = 128;
+  options.Add<IntOption>(kMaxBatchSizeId, 1, 4096) = 1024;
+  options.Add<IntOption>(kBatchWaitId, 0, 1000000) = 200;
+  options.Add<IntOption>(kThreadsId, 1, 128) = 2;
+  if (!options.ProcessAllFlags()) return;
+
+  try {
+    const auto option_dict = options.GetOptionsDict();
+    auto network = NetworkFactory::LoadNetwork(option_dict);
+    const auto& name = option_dict.Get<std::string>(kShmNameId);
+    const int slots = option_dict.Get<int>(kSlotsId);
+    const int slot_batch_size = option_dict.Get<int>(kSlotBatchSizeId);
+    auto segment = ShmSegment::Create(name, slots, slot_batch_size);
+    auto* header = segment.header();
+    const auto& capabilities = network->GetCapabilities();
+    header->input_format = capabilities.input_format;
+    header->output_format = capabilities.output_format;
+    header->moves_left = capabilities.moves_left;
+    header->mini_batch_size = network->GetMiniBatchSize();
+    header->server_alive = 1;
+    segment.Publish();
+
+    std::signal(SIGINT, OnStopSignal);
+    std::signal(SIGTERM, OnStopSignal);
+    InferenceServer server(std::move(network), std::move(segment),
+                           option_dict.Get<int>(kMaxBatchSizeId),
+                           option_dict.Get<int>(kBatchWaitId));
+    CERR << "Serving on shared memory " << name << " with " << slots
+         << " slots of " << slot_batch_size << " positions.";
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < option_dict.Get<int>(kThreadsId); i++) {
+      threads.emplace_back([&server, i]() { server.Worker(i); });
+    }
+    for (auto& thread : threads) thread.join();
+    server.Shutdown();
+
+    CERR << "Served " << server.positions() << " positions in "
+         << server.batches() << " batches, "
+         << (server.batches() ? static_cast<double>(server.positions()) /
+                                    server.batches()
+                              : 0.0)
+         << " per batch.";
+  } catch (Exception& ex) {
+    CERR << ex.what();
+  }
+}
+
+}  // namespace lczero
@@ -0,0 +1,192 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shm/shm_batch.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include "utils/exception.h"
+
+namespace lczero {
+namespace {
+
+size_t RoundUp(size_t bytes) { return (bytes + 63) / 64 * 64; }
+
+std::string ErrnoString() { return std::strerror(errno); }
+
+}  // namespace
+
+size_t ShmSlotBytes(int slot_capacity) {
+  return RoundUp(kShmHeaderBytes +
+                 slot_capacity * kInputPlanes *
+                     (sizeof(__uint128_t) + sizeof(float)) +
+                 slot_capacity * kShmOutputsPerSample * sizeof(float));
+}
+
+ShmSegment ShmSegment::Create(const std::string& name, int slot_count,
+                              int slot_capacity) {
+  const size_t slot_bytes = ShmSlotBytes(slot_capacity);
+  const size_t size = kShmHeaderBytes + slot_bytes * slot_count;
+  // A segment left behind by a crashed server is replaced.
+  const int old_fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (old_fd != -1) {
+    struct stat st;
+    void* old = MAP_FAILED;
+    if (fstat(old_fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= kShmHeaderBytes) {
+      old = mmap(nullptr, kShmHeaderBytes, PROT_READ, MAP_SHARED, old_fd, 0);
+    }
+    close(old_fd);
+    int32_t old_pid = 0;
+    if (old != MAP_FAILED) {
+      old_pid = static_cast<const ShmHeader*>(old)->server_pid;
+      munmap(old, kShmHeaderBytes);
+    }
+    if (old_pid > 0 && old_pid != getpid() && IsProcessAlive(old_pid)) {
+      throw Exception("Shared memory " + name +
+                      " is in use by a running server, pid " +
+                      std::to_string(old_pid) + ".");
+    }
+    shm_unlink(name.c_str());
+  }
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd == -1) {
+    throw Exception("Unable to create shared memory " + name + ": " +
+                    ErrnoString());
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw Exception("Unable to size shared memory " + name + ": " +
+                    ErrnoString());
+  }
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw Exception("Unable to map shared memory " + name + ": " +
+                    ErrnoString());
+  }
+  // ftruncate() zero fills, so every slot starts as kFree. The magic is left
+  // zero until the server calls Publish().
+  ShmSegment segment(name, static_cast<uint8_t*>(data), size, true);
+  auto* header = new (data) ShmHeader{};
+  header->version = kShmVersion;
+  header->slot_count = slot_count;
+  header->slot_capacity = slot_capacity;
+  header->slot_bytes = slot_bytes;
+  header->server_pid = getpid();
+  for (int i = 0; i < slot_count; i++) new (segment.slot(i)) ShmSlotHeader{};
+  return segment;
+}
+
+ShmSegment ShmSegment::Open(const std::string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd == -1) {
+    throw Exception("Unable to open shared memory " + name + ": " +
+                    ErrnoString() + ". Is \"lc0 serve\" running?");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < kShmHeaderBytes) {
+    close(fd);
+    throw Exception("Shared memory " + name + " is not initialized.");
+  }
+  const size_t size = st.st_size;
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw Exception("Unable to map shared memory " + name + ": " +
+                    ErrnoString());
+  }
+  ShmSegment segment(name, static_cast<uint8_t*>(data), size, false);
+  const auto* header = segment.header();
+  if (header->magic == 0) {
+    throw Exception("Shared memory " + name + " is not ready yet.");
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (header->magic != kShmMagic || header->version != kShmVersion) {
+    throw Exception("Shared memory " + name +
+                    " was not created by a compatible server.");
+  }
+  if (kShmHeaderBytes + header->slot_bytes * header->slot_count > size) {
+    throw Exception("Shared memory " + name + " is truncated.");
+  }
+  return segment;
+}
+
+void ShmSegment::Publish() {
+  std::atomic_thread_fence(std::memory_order_release);
+  header()->magic = kShmMagic;
+}
+
+ShmSegment::ShmSegment(ShmSegment&& other)
+    : name_(std::move(other.name_)),
+      data_(other.data_),
+      size_(other.size_),
+      owner_(other.owner_) {
+  other.data_ = nullptr;
+  other.owner_ = false;
+}
+
+ShmSegment::~ShmSegment() {
+  if (data_) munmap(data_, size_);
+  if (owner_) shm_unlink(name_.c_str());
+}
+
+void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+               int timeout_ms) {
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  // Not FUTEX_PRIVATE_FLAG, the word is shared between processes.
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+          &timeout, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* word, int count) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, count,
+          nullptr, nullptr, 0);
+}
+
+bool IsProcessAlive(int32_t pid) {
+  // EPERM means the process exists but belongs to someone else.
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+}  // namespace lczero
@@ -0,0 +1,169 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "neural/network.h"
+
+namespace lczero {
+
+// Layout of the POSIX shared memory segment used between "lc0 serve" and the
+// "shm" backend. The segment starts with ShmHeader, followed by slot_count
+// slots of slot_bytes each. A slot holds one batch of up to slot_capacity
+// samples:
+//   ShmSlotHeader, padded to 64 bytes,
+//   __uint128_t masks[slot_capacity * kInputPlanes],
+//   float values[slot_capacity * kInputPlanes],
+//   float outputs[slot_capacity * kShmOutputsPerSample].
+//
+// Slots form a ring. A client claims one by writing its pid into the unowned
+// slot and moving it from kFree to kFilling, writes the encoded batch, marks
+// it kReady and rings the doorbell. A server worker moves every kReady slot
+// it can fit into its batch to kRunning, computes them together, marks them
+// kDone (kFailed if the backend threw) and wakes the client. The client copies
+// the outputs, frees the slot and bumps slot_freed for clients waiting for a
+// slot. The doorbell,
+// slot_freed and every slot state are futex words, so both sides sleep in the
+// kernel while idle. Slots whose owner died are freed by the server.
+
+constexpr uint32_t kShmMagic = 0x73307870;  // "px0s"
+constexpr uint32_t kShmVersion = 3;
+// Q, D, M and the policy.
+constexpr int kShmOutputsPerSample = 3 + kPolicyOutputs;
+
+enum ShmSlotState : uint32_t {
+  kFree,
+  kFilling,
+  kReady,
+  kRunning,
+  kDone,
+  kFailed
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<int32_t>::is_always_lock_free,
+              "Shared memory signalling needs lock-free 32-bit atomics.");
+
+struct ShmHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_capacity;
+  uint64_t slot_bytes;
+  uint32_t input_format;
+  uint32_t output_format;
+  uint32_t moves_left;
+  uint32_t mini_batch_size;
+  int32_t server_pid;
+  // Cleared on orderly shutdown.
+  std::atomic<uint32_t> server_alive;
+  // Incremented on each submitted slot, the server sleeps on it.
+  std::atomic<uint32_t> doorbell;
+  // Ring position where clients start looking for a free slot.
+  std::atomic<uint32_t> next_slot;
+  // Incremented whenever a slot is freed, clients finding the ring full
+  // sleep on it.
+  std::atomic<uint32_t> slot_freed;
+  // Number of clients sleeping on slot_freed.
+  std::atomic<uint32_t> slot_waiters;
+};
+
+struct ShmSlotHeader {
+  std::atomic<uint32_t> state;
+  uint32_t batch_size;
+  // Pid of the client holding the slot, 0 when the slot is unowned.
+  std::atomic<int32_t> owner_pid;
+};
+
+constexpr size_t kShmHeaderBytes = 64;
+static_assert(sizeof(ShmHeader) <= kShmHeaderBytes);
+static_assert(sizeof(ShmSlotHeader) <= kShmHeaderBytes);
+
+// Bytes needed by one slot of the given capacity.
+size_t ShmSlotBytes(int slot_capacity);
+
+// Mapping of the shared segment. The creating side owns the name and removes
+// it on destruction.
+class ShmSegment {
+ public:
+  // Creates and maps a segment with room for the given slots, readable only by
+  // the current user. A stale segment of the same name is replaced, but one
+  // whose server is still running is not.
+  static ShmSegment Create(const std::string& name, int slot_count,
+                           int slot_capacity);
+  // Makes the segment visible to Open(), once the header is filled in.
+  void Publish();
+  // Maps an existing segment and checks its header.
+  static ShmSegment Open(const std::string& name);
+
+  ShmSegment(ShmSegment&& other);
+  ShmSegment(const ShmSegment&) = delete;
+  ShmSegment& operator=(const ShmSegment&) = delete;
+  ~ShmSegment();
+
+  ShmHeader* header() const { return reinterpret_cast<ShmHeader*>(data_); }
+  ShmSlotHeader* slot(int idx) const {
+    return reinterpret_cast<ShmSlotHeader*>(
+        data_ + kShmHeaderBytes + header()->slot_bytes * idx);
+  }
+  __uint128_t* masks(int idx) const {
+    return reinterpret_cast<__uint128_t*>(
+        reinterpret_cast<uint8_t*>(slot(idx)) + kShmHeaderBytes);
+  }
+  float* values(int idx) const {
+    return reinterpret_cast<float*>(masks(idx) +
+                                    header()->slot_capacity * kInputPlanes);
+  }
+  float* outputs(int idx) const {
+    return values(idx) + header()->slot_capacity * kInputPlanes;
+  }
+
+ private:
+  ShmSegment(const std::string& name, uint8_t* data, size_t size, bool owner)
+      : name_(name), data_(data), size_(size), owner_(owner) {}
+
+  std::string name_;
+  uint8_t* data_;
+  size_t size_;
+  bool owner_;
+};
+
+// Blocks while *word == expected, for at most timeout_ms. May return early.
+void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+               int timeout_ms);
+// Wakes up to count waiters blocked on word, in any process.
+void FutexWake(std::atomic<uint32_t>* word, int count);
+
+// Whether a process with the given pid exists.
+bool IsProcessAlive(int32_t pid);
+
+}  // namespace lczero
@@ -30,9 +30,9 @@
 #include "neural/factory.h"
 #include "neural/network.h"
 #include "neural/onnx/converter.h"
+#include "neural/shared/expand_planes.h"
 #include "neural/xla/onnx2hlo.h"
 #include "neural/xla/xla_runner.h"
-#include "utils/bititer.h"
 
 namespace lczero {
 namespace {
@@ -112,11 +112,7 @@ void XlaComputation::AddInput(InputPlanes&& input) {
                new_shape[0] * 10 * 9 * kInputPlanes;
   ++new_shape[0];
   input_tensor_.Reshape(new_shape);
-  memset(ptr, 0, 10 * 9 * kInputPlanes * sizeof(float));
-  for (const auto& plane : input) {
-    for (auto bit : IterateBits(plane.mask)) ptr[bit] = plane.value;
-    ptr += 10 * 9;
-  }
+  ExpandPlanes(input, ptr);
 }
 
 float XlaComputation::GetQVal(int sample) const {
@@ -182,6 +178,15 @@ XlaNetworkOptions FillXlaRunnerFromOnnx(
     const pblczero::OnnxModel& onnx_model, XlaRunner* runner,
     size_t max_batch_size, size_t steps,
     std::optional<pblczero::XlaShapeProto::Type> io_type) {
+  if (onnx_model.has_input_policy_mask()) {
+    throw Exception(
+        "NN has a legal move mask input, which the xla backend doesn't "
+        "support.");
+  }
+  if (onnx_model.has_input_plane_masks()) {
+    throw Exception(
+        "NN has bit-packed inputs, which the xla backend doesn't support.");
+  }
   pblczero::ModelProto onnx;
   onnx.ParseFromString(onnx_model.model());
 
@@ -27,13 +27,21 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "neural/encoder.h"
 #include "neural/factory.h"
 #include "neural/loader.h"
 #include "utils/fastmath.h"
 #include "utils/optionsparser.h"
+#include "utils/string.h"
 
 namespace lczero {
 namespace python {
@@ -92,7 +100,7 @@ class Input {
  public:
   // Exported functions.
   Input() = default;
-  void set_mask(int plane, uint64_t mask) {
+  void set_mask(int plane, __uint128_t mask) {
     CheckPlaneExists(plane);
     data_[plane].mask = mask;
   }
@@ -100,7 +108,7 @@ class Input {
     CheckPlaneExists(plane);
     data_[plane].value = val;
   }
-  uint64_t mask(int plane) const {
+  __uint128_t mask(int plane) const {
     CheckPlaneExists(plane);
     return data_[plane].mask;
   }
@@ -131,7 +139,9 @@ class Output {
  public:
   // Not exposed.
   Output(const NetworkComputation& computation, int idx) {
-    for (int i = 0; i < 1858; ++i) p_[i] = computation.GetPVal(idx, i);
+    for (int i = 0; i < kPolicyOutputs; ++i) {
+      p_[i] = computation.GetPVal(idx, i);
+    }
     q_ = computation.GetQVal(idx);
     d_ = computation.GetDVal(idx);
     m_ = computation.GetMVal(idx);
@@ -143,8 +153,9 @@ class Output {
     std::vector<float> result(indicies.size());
     for (size_t i = 0; i < indicies.size(); ++i) {
       int idx = indicies[i];
-      if (idx < 0 || idx > 1857) {
-        throw Exception("Policy index must be between 0 and 1857.");
+      if (idx < 0 || idx >= kPolicyOutputs) {
+        throw Exception("Policy index must be between 0 and " +
+                        std::to_string(kPolicyOutputs - 1) + ".");
       }
       result[i] = p_[idx];
     }
@@ -170,12 +181,221 @@ class Output {
   }
 
  private:
-  float p_[1858];
+  float p_[kPolicyOutputs];
   float q_;
   float d_;
   float m_;
 };
 
+// Read-only view of a C-contiguous buffer passed from python (e.g. a numpy
+// array). Only valid during the call it was passed to.
+struct ArrayView {
+  ArrayView() = default;
+  template <typename T>
+  ArrayView(const void* data, const char* format, size_t itemsize,
+            const T* shape, int ndim)
+      : data(data),
+        format(NormalizeFormat(format, itemsize)),
+        shape(shape, shape + ndim) {}
+
+  // Returns 'f' for float32, 'H' for uint16, 'q' for int64, 'Q' for uint64
+  // and 0 for anything else.
+  static char NormalizeFormat(const char* format, size_t itemsize) {
+    if (format == nullptr) return 0;
+    // Only native little-endian layouts are supported.
+    if (*format == '@' || *format == '=' || *format == '<') ++format;
+    if (format[0] == 0 || format[1] != 0) return 0;
+    if (format[0] == 'f' && itemsize == 4) return 'f';
+    if (std::strchr("HILQ", format[0]) && itemsize == 2) return 'H';
+    if (std::strchr("ilq", format[0]) && itemsize == 8) return 'q';
+    if (std::strchr("HILQ", format[0]) && itemsize == 8) return 'Q';
+    return 0;
+  }
+
+  size_t size() const {
+    size_t result = 1;
+    for (auto x : shape) result *= x;
+    return result;
+  }
+
+  const void* data = nullptr;
+  char format = 0;
+  std::vector<int64_t> shape;
+};
+
+// Contiguous array of float32 ('f'), int32 ('i') or uint64 ('Q'), exposed to
+// python through the buffer protocol so that numpy.asarray() wraps it without
+// a copy.
+class Array {
+ public:
+  // Not exported.
+  Array(char format, std::vector<ptrdiff_t> shape)
+      : format_{format, 0},
+        itemsize_(format == 'Q' ? sizeof(uint64_t) : sizeof(float)),
+        shape_(std::move(shape)),
+        strides_(shape_.size()) {
+    size_t size = 1;
+    for (size_t i = shape_.size(); i-- > 0;) {
+      strides_[i] = size * itemsize_;
+      size *= shape_[i];
+    }
+    // uint64_t storage keeps every element type aligned.
+    data_.reset(new uint64_t[(size * itemsize_ + 7) / 8]());
+    size_ = size;
+  }
+  template <typename T>
+  T* data() {
+    return reinterpret_cast<T*>(data_.get());
+  }
+
+  // Buffer protocol.
+  void* buffer_data() { return data_.get(); }
+  size_t buffer_size() const { return size_ * itemsize_; }
+  size_t itemsize() const { return itemsize_; }
+  const char* format() const { return format_; }
+  const std::vector<ptrdiff_t>& shape() const { return shape_; }
+  const std::vector<ptrdiff_t>& strides() const { return strides_; }
+
+ private:
+  const char format_[2];
+  const size_t itemsize_;
+  std::vector<ptrdiff_t> shape_;
+  std::vector<ptrdiff_t> strides_;
+  std::unique_ptr<uint64_t[]> data_;
+  size_t size_;
+};
+
+// Converts a batch of inputs to InputPlanes. @planes is either (N, 124, 2)
+// uint64 masks (low and high 64 bits of every plane) with optional (N, 124)
+// float32 @values, or (N, 124, 10, 9) / (N, 124, 90) float32 planes.
+inline std::vector<InputPlanes> DecodeInputBatch(
+    const ArrayView& planes, const std::optional<ArrayView>& values) {
+  if (planes.shape.size() < 2 || planes.shape[1] != kInputPlanes) {
+    throw Exception("Input batch must have shape (N, " +
+                    std::to_string(kInputPlanes) + ", ...).");
+  }
+  const size_t batch_size = planes.shape[0];
+  std::vector<InputPlanes> result(batch_size, InputPlanes(kInputPlanes));
+  if (planes.format == 'Q') {
+    if (planes.shape.size() != 3 || planes.shape[2] != 2) {
+      throw Exception("Mask batch must have shape (N, " +
+                      std::to_string(kInputPlanes) + ", 2).");
+    }
+    const float* vals = nullptr;
+    if (values) {
+      if (values->format != 'f' || values->shape.size() != 2 ||
+          static_cast<size_t>(values->shape[0]) != batch_size ||
+          values->shape[1] != kInputPlanes) {
+        throw Exception("Plane values must be float32 of shape (N, " +
+                        std::to_string(kInputPlanes) + ").");
+      }
+      vals = static_cast<const float*>(values->data);
+    }
+    const uint64_t* masks = static_cast<const uint64_t*>(planes.data);
+    for (size_t i = 0; i < batch_size; ++i) {
+      for (int j = 0; j < kInputPlanes; ++j) {
+        auto& plane = result[i][j];
+        plane.mask = static_cast<__uint128_t>(masks[1]) << 64 | masks[0];
+        if (vals) plane.value = *vals++;
+        masks += 2;
+      }
+    }
+    return result;
+  }
+  if (planes.format == 'f') {
+    if (values) throw Exception("Plane values are only used with masks.");
+    if (planes.size() != batch_size * kInputPlanes * 90) {
+      throw Exception("Plane batch must have shape (N, " +
+                      std::to_string(kInputPlanes) + ", 10, 9).");
+    }
+    const float* data = static_cast<const float*>(planes.data);
+    for (size_t i = 0; i < batch_size; ++i) {
+      for (int j = 0; j < kInputPlanes; ++j) {
+        auto& plane = result[i][j];
+        bool has_value = false;
+        for (int sq = 0; sq < 90; ++sq, ++data) {
+          if (*data == 0.0f) continue;
+          plane.mask |= static_cast<__uint128_t>(1) << sq;
+          if (!has_value) plane.value = *data;
+          has_value = true;
+        }
+      }
+    }
+    return result;
+  }
+  throw Exception("Input batch must be float32 planes or uint64 masks.");
+}
+
+// Evaluates @inputs, splitting them into minibatches the backend prefers.
+// Returns policy logits (N, 2062), WDL (N, 3) and moves left (N,).
+inline std::vector<std::unique_ptr<Array>> ComputeBatch(
+    Network* network, std::vector<InputPlanes> inputs) {
+  const ptrdiff_t batch_size = inputs.size();
+  auto policy = std::make_unique<Array>(
+      'f', std::vector<ptrdiff_t>{batch_size, kPolicyOutputs});
+  auto wdl =
+      std::make_unique<Array>('f', std::vector<ptrdiff_t>{batch_size, 3});
+  auto m = std::make_unique<Array>('f', std::vector<ptrdiff_t>{batch_size});
+  const ptrdiff_t minibatch_size =
+      std::max(1, network->GetMiniBatchSize());
+  for (ptrdiff_t start = 0; start < batch_size; start += minibatch_size) {
+    const ptrdiff_t end = std::min(batch_size, start + minibatch_size);
+    auto computation = network->NewComputation();
+    for (ptrdiff_t i = start; i < end; ++i) {
+      computation->AddInput(std::move(inputs[i]));
+    }
+    computation->ComputeBlocking();
+    for (ptrdiff_t i = start; i < end; ++i) {
+      const int idx = i - start;
+      float* p = policy->data<float>() + i * kPolicyOutputs;
+      for (int j = 0; j < kPolicyOutputs; ++j) {
+        p[j] = computation->GetPVal(idx, j);
+      }
+      const float q = computation->GetQVal(idx);
+      const float d = computation->GetDVal(idx);
+      float* v = wdl->data<float>() + i * 3;
+      v[0] = (1.0f + q - d) / 2.0f;
+      v[1] = d;
+      v[2] = (1.0f - q - d) / 2.0f;
+      m->data<float>()[i] = computation->GetMVal(idx);
+    }
+  }
+  std::vector<std::unique_ptr<Array>> result;
+  result.push_back(std::move(policy));
+  result.push_back(std::move(wdl));
+  result.push_back(std::move(m));
+  return result;
+}
+
+// A batch submitted with Backend::submit() and computed in background.
+class PendingBatch {
+ public:
+  // Exported.
+  int ready() const {
+    return future_.valid() && future_.wait_for(std::chrono::seconds(0)) ==
+                                  std::future_status::ready;
+  }
+  std::vector<std::unique_ptr<Array>> wait() {
+    if (!future_.valid()) throw Exception("Batch result was already taken.");
+    return future_.get();
+  }
+
+  // Not exported.
+  PendingBatch(std::shared_ptr<Network> network,
+               std::vector<InputPlanes> inputs)
+      : network_(std::move(network)),
+        future_(std::async(std::launch::async,
+                           [network = network_.get(),
+                            inputs = std::move(inputs)]() mutable {
+                             return ComputeBatch(network, std::move(inputs));
+                           })) {}
+
+ private:
+  // Keeps the network alive until the computation is finished.
+  const std::shared_ptr<Network> network_;
+  std::future<std::vector<std::unique_ptr<Array>>> future_;
+};
+
 class BackendCapabilities {
  public:
   // Exported.
@@ -228,26 +448,42 @@ class Backend {
     return result;
   }
 
+  // Evaluates the whole batch without per-position python objects. See
+  // DecodeInputBatch() for the accepted input layouts.
+  std::vector<std::unique_ptr<Array>> evaluate_batch(
+      const ArrayView& planes, const std::optional<ArrayView>& values) const {
+    return ComputeBatch(network_.get(), DecodeInputBatch(planes, values));
+  }
+
+  // Same as evaluate_batch(), but returns immediately. Several batches may be
+  // in flight at once.
+  std::unique_ptr<PendingBatch> submit(
+      const ArrayView& planes, const std::optional<ArrayView>& values) const {
+    return std::make_unique<PendingBatch>(network_,
+                                          DecodeInputBatch(planes, values));
+  }
+
  private:
-  std::unique_ptr<::lczero::Network> network_;
+  std::shared_ptr<::lczero::Network> network_;
 };
 
+// Resets @history to the position given by @fen.
+inline void ResetHistory(PositionHistory* history, const std::string& fen) {
+  ChessBoard starting_board;
+  int no_capture_ply;
+  int full_moves;
+  starting_board.SetFromFen(fen, &no_capture_ply, &full_moves);
+  history->Reset(starting_board, no_capture_ply,
+                 full_moves * 2 - (starting_board.flipped() ? 1 : 2));
+}
+
 class GameState {
  public:
   GameState(const std::optional<std::string> startpos,
             const std::vector<std::string>& moves) {
-    ChessBoard starting_board;
-    int no_capture_ply;
-    int full_moves;
-    starting_board.SetFromFen(startpos.value_or(ChessBoard::kStartposFen),
-                              &no_capture_ply, &full_moves);
-
-    history_.Reset(starting_board, no_capture_ply,
-                   full_moves * 2 - (starting_board.flipped() ? 1 : 2));
-
+    ResetHistory(&history_, startpos.value_or(ChessBoard::kStartposFen));
     for (const auto& m : moves) {
       Move move(m, history_.IsBlackToMove());
-      move = history_.Last().GetBoard().GetModernMove(move);
       history_.Append(move);
     }
   }
@@ -291,5 +527,150 @@ class GameState {
   PositionHistory history_;
 };
 
+// Encodes the final positions of many games at once on several threads,
+// without creating python objects for individual positions.
+class BatchEncoder {
+ public:
+  // Exported.
+  BatchEncoder(const Backend& backend, int threads)
+      : input_format_(static_cast<pblczero::NetworkFormat::InputFormat>(
+            backend.capabilities().input_format())),
+        threads_(threads > 0
+                     ? threads
+                     : std::max(1u, std::thread::hardware_concurrency())) {}
+
+  // Every game is a starting FEN (empty string for startpos) and a string of
+  // space separated moves. An empty @fens means all games start from startpos.
+  std::vector<std::unique_ptr<Array>> encode(
+      const std::vector<std::string>& fens,
+      const std::vector<std::string>& moves) const {
+    if (!fens.empty() && fens.size() != moves.size()) {
+      throw Exception("Number of FENs and move lists must match.");
+    }
+    return Encode(moves.size(), [&](size_t idx, PositionHistory* history) {
+      ResetHistory(history, fens.empty() || fens[idx].empty()
+                                ? ChessBoard::kStartposFen
+                                : fens[idx]);
+      for (const auto& m : StrSplitAtWhitespace(moves[idx])) {
+        history->Append(Move(m, history->IsBlackToMove()));
+      }
+    });
+  }
+
+  // Same as encode(), but games are given as uint16 packed moves
+  // (Move::as_packed_int(), from white's point of view) of all games
+  // concatenated, and int64 @offsets of shape (N + 1,) where game i consists
+  // of moves[offsets[i]:offsets[i + 1]].
+  std::vector<std::unique_ptr<Array>> encode_packed(
+      const ArrayView& moves, const ArrayView& offsets,
+      const std::vector<std::string>& fens) const {
+    if (moves.format != 'H' || moves.shape.size() != 1) {
+      throw Exception("Packed moves must be a uint16 vector.");
+    }
+    if ((offsets.format != 'q' && offsets.format != 'Q') ||
+        offsets.shape.size() != 1 || offsets.shape[0] < 1) {
+      throw Exception("Offsets must be a non-empty int64 vector.");
+    }
+    const size_t count = offsets.shape[0] - 1;
+    if (!fens.empty() && fens.size() != count) {
+      throw Exception("Number of FENs and games must match.");
+    }
+    const uint16_t* packed = static_cast<const uint16_t*>(moves.data);
+    const int64_t* bounds = static_cast<const int64_t*>(offsets.data);
+    for (size_t i = 0; i < count; ++i) {
+      if (bounds[i] < 0 || bounds[i] > bounds[i + 1] ||
+          bounds[i + 1] > moves.shape[0]) {
+        throw Exception("Invalid offsets for game " + std::to_string(i) + ".");
+      }
+    }
+    return Encode(count, [&](size_t idx, PositionHistory* history) {
+      ResetHistory(history, fens.empty() || fens[idx].empty()
+                                ? ChessBoard::kStartposFen
+                                : fens[idx]);
+      for (int64_t i = bounds[idx]; i < bounds[idx + 1]; ++i) {
+        Move move = Move::FromPackedInt(packed[i]);
+        if (history->IsBlackToMove()) move.Mirror();
+        history->Append(move);
+      }
+    });
+  }
+
+ private:
+  // Builds the history of every game with @populate and encodes its last
+  // position. Returns (N, 124, 2) uint64 masks and (N, 124) float32 values in
+  // the layout Backend::evaluate_batch() takes, int32 policy indices of all
+  // legal moves of all positions, and (N + 1,) int32 offsets into them.
+  std::vector<std::unique_ptr<Array>> Encode(
+      size_t count,
+      const std::function<void(size_t, PositionHistory*)>& populate) const {
+    const ptrdiff_t batch_size = count;
+    auto masks = std::make_unique<Array>(
+        'Q', std::vector<ptrdiff_t>{batch_size, kInputPlanes, 2});
+    auto values = std::make_unique<Array>(
+        'f', std::vector<ptrdiff_t>{batch_size, kInputPlanes});
+    std::vector<std::vector<int>> legal(count);
+
+    std::atomic<size_t> next_idx{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto worker = [&]() {
+      try {
+        for (size_t idx; (idx = next_idx.fetch_add(1)) < count;) {
+          PositionHistory history;
+          populate(idx, &history);
+          int transform;
+          const auto planes =
+              EncodePositionForNN(input_format_, history, 8,
+                                  FillEmptyHistory::FEN_ONLY, &transform);
+          uint64_t* mask = masks->data<uint64_t>() + idx * kInputPlanes * 2;
+          float* value = values->data<float>() + idx * kInputPlanes;
+          for (const auto& plane : planes) {
+            *mask++ = static_cast<uint64_t>(plane.mask);
+            *mask++ = static_cast<uint64_t>(plane.mask >> 64);
+            *value++ = plane.value;
+          }
+          for (auto m : history.Last().GetBoard().GenerateLegalMoves()) {
+            legal[idx].push_back(m.as_nn_index(transform));
+          }
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+        next_idx = count;
+      }
+    };
+    std::vector<std::thread> threads;
+    const size_t num_threads = std::min<size_t>(threads_, count);
+    for (size_t i = 1; i < num_threads; ++i) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+    if (error) std::rethrow_exception(error);
+
+    auto offsets =
+        std::make_unique<Array>('i', std::vector<ptrdiff_t>{batch_size + 1});
+    int32_t* offset = offsets->data<int32_t>();
+    offset[0] = 0;
+    for (size_t i = 0; i < count; ++i) {
+      offset[i + 1] = offset[i] + legal[i].size();
+    }
+    auto indices = std::make_unique<Array>(
+        'i', std::vector<ptrdiff_t>{offset[count]});
+    for (size_t i = 0; i < count; ++i) {
+      std::copy(legal[i].begin(), legal[i].end(),
+                indices->data<int32_t>() + offset[i]);
+    }
+
+    std::vector<std::unique_ptr<Array>> result;
+    result.push_back(std::move(masks));
+    result.push_back(std::move(values));
+    result.push_back(std::move(indices));
+    result.push_back(std::move(offsets));
+    return result;
+  }
+
+  const pblczero::NetworkFormat::InputFormat input_format_;
+  const size_t threads_;
+};
+
 }  // namespace python
 }  // namespace lczero
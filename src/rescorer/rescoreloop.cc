@@ -370,6 +370,8 @@ void Validate(const std::vector<V6TrainingData>& fileContents,
   }
 }
 
+}  // namespace
+
 void ChangeInputFormat(int newInputFormat, V6TrainingData* data,
                        const PositionHistory& history) {
   data->input_format = newInputFormat;
@@ -385,7 +387,10 @@ void ChangeInputFormat(int newInputFormat, V6TrainingData* data,
     plane = FlipBoard(planes[plane_idx++].mask);
   }
 
-  if ((data->invariance_info & 7) != transform) {
+  // Only the flip transform lives in the low bits, bit 2 is the fast search
+  // flag.
+  const int old_transform = data->invariance_info & FlipTransform;
+  if (old_transform != transform) {
     // Probabilities need reshuffling.
     float newProbs[2062];
     std::fill(std::begin(newProbs), std::end(newProbs), -1);
@@ -393,7 +398,7 @@ void ChangeInputFormat(int newInputFormat, V6TrainingData* data,
     bool best_fixed = false;
     for (auto move : history.Last().GetBoard().GenerateLegalMoves()) {
       int i = move.as_nn_index(transform);
-      int j = move.as_nn_index(data->invariance_info & 7);
+      int j = move.as_nn_index(old_transform);
       newProbs[i] = data->probabilities[j];
       // For V6 data only, the played/best idx need updating.
       if (data->visits > 0) {
@@ -415,7 +420,7 @@ void ChangeInputFormat(int newInputFormat, V6TrainingData* data,
   const auto& position = history.Last();
 
   // Save the bits that aren't connected to the input_format.
-  uint8_t invariance_mask = data->invariance_info & 0x78;
+  uint8_t invariance_mask = data->invariance_info & 0x7C;
   // Other params.
   if (IsCanonicalFormat(input_format)) {
     // Send transform in deprecated move count so rescorer can reverse it to
@@ -430,6 +435,8 @@ void ChangeInputFormat(int newInputFormat, V6TrainingData* data,
   data->invariance_info |= invariance_mask;
 }
 
+namespace {
+
 int ResultForData(const V6TrainingData& data) {
   // Ensure we aren't reprocessing some data that has had custom adjustments to
   // result training target applied.
@@ -29,11 +29,19 @@
 
 #include <thread>
 
+#include "chess/position.h"
 #include "chess/uciloop.h"
+#include "trainingdata/trainingdata.h"
 #include "utils/optionsparser.h"
 
 namespace lczero {
 
+// Re-encodes the planes of |data| for |newInputFormat| from |history| and
+// reshuffles the policy to the new transform. Flags in invariance_info that
+// don't depend on the input format are preserved.
+void ChangeInputFormat(int newInputFormat, V6TrainingData* data,
+                       const PositionHistory& history);
+
 class RescoreLoop : public UciLoop {
  public:
   RescoreLoop();
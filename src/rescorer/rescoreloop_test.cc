@@ -0,0 +1,111 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "rescorer/rescoreloop.h"
+
+#include <gtest/gtest.h>
+
+#include "utils/bititer.h"
+
+namespace lczero {
+
+namespace {
+
+constexpr uint8_t kFastSearchBit = 1u << 2;
+
+// Fills |data| with a policy laid out for |transform| where every legal move
+// has its own value, and marks it as coming from a fast search.
+V6TrainingData MakeFastSearchRecord(const PositionHistory& history,
+                                    int transform) {
+  V6TrainingData data{};
+  std::fill(std::begin(data.probabilities), std::end(data.probabilities), -1);
+  float value = 0.0f;
+  for (auto move : history.Last().GetBoard().GenerateLegalMoves()) {
+    data.probabilities[move.as_nn_index(transform)] = value;
+    value += 1.0f;
+  }
+  auto first = history.Last().GetBoard().GenerateLegalMoves()[0];
+  data.played_idx = first.as_nn_index(transform);
+  data.best_idx = data.played_idx;
+  data.visits = 1;
+  data.invariance_info = transform | kFastSearchBit;
+  return data;
+}
+
+}  // namespace
+
+TEST(ChangeInputFormat, KeepsFastSearchFlag) {
+  ChessBoard board;
+  PositionHistory history;
+  board.SetFromFen(ChessBoard::kStartposFen);
+  history.Reset(board, 0, 1);
+
+  auto data = MakeFastSearchRecord(history, NoTransform);
+  const auto orig = data;
+  ChangeInputFormat(
+      pblczero::NetworkFormat::INPUT_112_WITH_CANONICALIZATION_V2, &data,
+      history);
+
+  // The flag must not be read as part of the transform.
+  EXPECT_EQ(data.invariance_info & FlipTransform, NoTransform);
+  EXPECT_NE(data.invariance_info & kFastSearchBit, 0);
+  EXPECT_EQ(data.played_idx, orig.played_idx);
+  for (int i = 0; i < 2062; i++) {
+    EXPECT_EQ(data.probabilities[i], orig.probabilities[i]);
+  }
+}
+
+TEST(ChangeInputFormat, ReshufflesFastSearchRecord) {
+  // Our king on the right side of the palace needs the flip transform.
+  ChessBoard board;
+  PositionHistory history;
+  board.SetFromFen("3k5/9/9/9/9/9/9/9/9/5K3 w - - 0 1");
+  history.Reset(board, 0, 1);
+
+  auto data = MakeFastSearchRecord(history, NoTransform);
+  const auto orig = data;
+  ChangeInputFormat(
+      pblczero::NetworkFormat::INPUT_112_WITH_CANONICALIZATION_V2, &data,
+      history);
+
+  EXPECT_EQ(data.invariance_info & FlipTransform, FlipTransform);
+  EXPECT_NE(data.invariance_info & kFastSearchBit, 0);
+  for (auto move : history.Last().GetBoard().GenerateLegalMoves()) {
+    EXPECT_EQ(data.probabilities[move.as_nn_index(FlipTransform)],
+              orig.probabilities[move.as_nn_index(NoTransform)]);
+  }
+  auto first = history.Last().GetBoard().GenerateLegalMoves()[0];
+  EXPECT_EQ(data.played_idx, first.as_nn_index(FlipTransform));
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  lczero::InitializeMagicBitboards();
+  return RUN_ALL_TESTS();
+}
@@ -57,6 +57,15 @@ const OptionId kOpeningStopProbId{
     "opening-stop-prob", "OpeningStopProb",
     "From each opening move, start a self-play game with probability max(p, "
     "1/n), where p is the value given and n the opening moves remaining."};
+const OptionId kFullSearchProbId{
+    "full-search-prob", "FullSearchProb",
+    "Playout cap randomization: probability that a move gets the full "
+    "visits/playouts budget and becomes a policy training target. Other moves "
+    "get a fast search without noise, only to advance the game, and are "
+    "flagged in the training data so that their policy can be skipped."};
+const OptionId kFastSearchVisitsId{
+    "fast-search-visits", "FastSearchVisits",
+    "Visits for moves that don't get a full search, see --full-search-prob."};
 }  // namespace
 
 void SelfPlayGame::PopulateUciParams(OptionsParser* options) {
@@ -67,6 +76,11 @@ void SelfPlayGame::PopulateUciParams(OptionsParser* options) {
   options->Add<IntOption>(kMinimumAllowedVistsId, 0, 1000000) = 0;
   PopulateTimeManagementOptions(RunType::kSelfplay, options);
   options->Add<FloatOption>(kOpeningStopProbId, 0.0f, 1.0f) = 0.0f;
+  options->Add<StringOption>(kBookFileId);
+  options->Add<IntOption>(kBookMaxPlyId, 0, 1000) = 20;
+  options->Add<IntOption>(kBookMinWeightId, 1, 1000000) = 1;
+  options->Add<FloatOption>(kFullSearchProbId, 0.0f, 1.0f) = 1.0f;
+  options->Add<IntOption>(kFastSearchVisitsId, 1, 999999999) = 100;
 }
 
 SelfPlayGame::SelfPlayGame(PlayerOptions white, PlayerOptions black,
@@ -76,6 +90,11 @@ SelfPlayGame::SelfPlayGame(PlayerOptions white, PlayerOptions black,
                      SearchParams(*black.uci_options).GetHistoryFill(),
                      white.network->GetCapabilities().input_format) {
   orig_fen_ = opening.start_fen;
+  for (int i = 0; i < 2; i++) {
+    fast_search_options_[i] =
+        std::make_unique<OptionsDict>(options_[i].uci_options);
+    fast_search_options_[i]->Set<float>(SearchParams::kNoiseEpsilonId, 0.0f);
+  }
   tree_[0] = std::make_shared<NodeTree>();
   tree_[0]->ResetToPosition(orig_fen_, {});
 
@@ -134,15 +153,42 @@ void SelfPlayGame::Play(int white_threads, int black_threads, bool training,
       adjudicated_ = true;
       break;
     }
-    // Initialize search.
     const int idx = blacks_move ? 1 : 0;
+    // Play book moves without searching, they don't produce training data.
+    const auto& position = tree_[idx]->HeadPosition();
+    if (options_[idx].book &&
+        position.GetGamePly() <
+            options_[idx].uci_options->Get<int>(kBookMaxPlyId)) {
+      Move move = options_[idx].book->Pick(
+          position.GetBoard(),
+          options_[idx].uci_options->Get<int>(kBookMinWeightId));
+      if (move) {
+        if (blacks_move) move.Mirror();
+        tree_[0]->MakeMove(move);
+        if (tree_[0] != tree_[1]) tree_[1]->MakeMove(move);
+        blacks_move = !blacks_move;
+        continue;
+      }
+    }
+    // Initialize search.
     if (!options_[idx].uci_options->Get<bool>(kReuseTreeId)) {
       tree_[idx]->TrimTreeAtHead();
     }
+    // Playout cap randomization. With tree reuse a fast search may start from
+    // a tree that already has enough visits, then it returns immediately.
+    const float full_search_prob =
+        options_[idx].uci_options->Get<float>(kFullSearchProbId);
+    const bool fast_search = full_search_prob < 1.0f &&
+                             Random::Get().GetFloat(1.0f) >= full_search_prob;
     {
       std::lock_guard<std::mutex> lock(mutex_);
       if (abort_) break;
-      auto stoppers = options_[idx].search_limits.MakeSearchStopper();
+      SelfPlayLimits fast_limits;
+      fast_limits.visits =
+          options_[idx].uci_options->Get<int>(kFastSearchVisitsId);
+      auto stoppers = fast_search
+                          ? fast_limits.MakeSearchStopper()
+                          : options_[idx].search_limits.MakeSearchStopper();
       PopulateIntrinsicStoppers(stoppers.get(), *options_[idx].uci_options);
 
       std::unique_ptr<UciResponder> responder =
@@ -153,7 +199,9 @@ void SelfPlayGame::Play(int white_threads, int black_threads, bool training,
           *tree_[idx], options_[idx].network, std::move(responder),
           /* searchmoves */ MoveList(), std::chrono::steady_clock::now(),
           std::move(stoppers), /* infinite */ false, /* ponder */ false,
-          *options_[idx].uci_options, options_[idx].cache);
+          fast_search ? *fast_search_options_[idx] : *options_[idx].uci_options,
+          options_[idx].cache,
+          /* bitbase */ nullptr);
     }
 
     // Do search.
@@ -267,7 +315,8 @@ void SelfPlayGame::Play(int white_threads, int black_threads, bool training,
           search_->GetCachedNNEval(tree_[idx]->GetCurrentHead());
       training_data_.Add(tree_[idx]->GetCurrentHead(),
                          tree_[idx]->GetPositionHistory(), best_eval,
-                         played_eval, best_is_proof, best_move, move, nneval);
+                         played_eval, best_is_proof, best_move, move, nneval,
+                         fast_search);
     }
     // Must reset the search before mutating the tree.
     search_.reset();
@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include "book/book.h"
 #include "chess/pgn.h"
 #include "chess/position.h"
 #include "chess/uciloop.h"
@@ -59,6 +60,8 @@ struct PlayerOptions {
   OpeningCallback discarded_callback;
   // NNcache to use.
   NNCache* cache;
+  // Opening book to play early moves from, or nullptr.
+  const OpeningBook* book = nullptr;
   // User options dictionary.
   const OptionsDict* uci_options;
   // Limits to use for every move.
@@ -102,6 +105,8 @@ class SelfPlayGame {
  private:
   // options_[0] is for white player, [1] for black.
   PlayerOptions options_[2];
+  // Player options with noise disabled, for fast searches.
+  std::unique_ptr<OptionsDict> fast_search_options_[2];
   // Node tree for player1 and player2. If the tree is shared between players,
   // tree_[0] == tree_[1].
   std::shared_ptr<NodeTree> tree_[2];
@@ -29,6 +29,7 @@
 
 #include <optional>
 
+#include "selfplay/sprt.h"
 #include "selfplay/tournament.h"
 #include "utils/configfile.h"
 #include "utils/optionsparser.h"
@@ -187,6 +188,20 @@ void SelfPlayLoop::SendTournament(const TournamentInfo& info) {
         << (*los * 100.0f) << "%";
   }
 
+  const auto penta = GetPentanomialStats(info.pentanomial);
+  if (penta.pairs > 0) {
+    oss << " Penta: [" << info.pentanomial[0];
+    for (int i = 1; i < 5; i++) oss << " " << info.pentanomial[i];
+    oss << "] PentaElo: " << std::fixed << std::setprecision(2)
+        << ScoreToElo(penta.mean) << " +/- " << EloError95(penta);
+  }
+  if (info.sprt) {
+    oss << " LLR: " << std::fixed << std::setprecision(2) << info.llr << " ("
+        << info.llr_lower << ", " << info.llr_upper << ")";
+    if (info.llr >= info.llr_upper) oss << " H1 accepted";
+    if (info.llr <= info.llr_lower) oss << " H0 accepted";
+  }
+
   oss << " P1-W: +" << info.results[0][0] << " -" << info.results[2][0] << " ="
       << info.results[1][0];
   oss << " P1-B: +" << info.results[0][1] << " -" << info.results[2][1] << " ="
@@ -0,0 +1,92 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "selfplay/sprt.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lczero {
+namespace {
+// Added to every count so that a one-sided or all-draw start doesn't give a
+// zero variance.
+constexpr double kPrior = 1e-3;
+
+double EloToScore(double elo) {
+  return 1.0 / (1.0 + std::pow(10.0, -elo / 400));
+}
+}  // namespace
+
+PentanomialStats GetPentanomialStats(const int counts[5]) {
+  PentanomialStats stats;
+  double total = 0.0;
+  for (int i = 0; i < 5; i++) {
+    stats.pairs += counts[i];
+    total += counts[i] + kPrior;
+  }
+  double mean = 0.0;
+  for (int i = 0; i < 5; i++) mean += (counts[i] + kPrior) * i / 4.0;
+  mean /= total;
+  double variance = 0.0;
+  for (int i = 0; i < 5; i++) {
+    variance += (counts[i] + kPrior) * (i / 4.0 - mean) * (i / 4.0 - mean);
+  }
+  stats.mean = mean;
+  stats.variance = variance / total;
+  return stats;
+}
+
+double ScoreToElo(double score) {
+  score = std::clamp(score, 1e-6, 1.0 - 1e-6);
+  return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+double EloError95(const PentanomialStats& stats) {
+  if (stats.pairs < 2) return 0.0;
+  const double error = 1.96 * std::sqrt(stats.variance / stats.pairs);
+  return (ScoreToElo(stats.mean + error) - ScoreToElo(stats.mean - error)) / 2;
+}
+
+double PentanomialLlr(const int counts[5], double elo0, double elo1) {
+  // The variance estimate is meaningless until at least two different pair
+  // outcomes were seen.
+  if (std::count_if(counts, counts + 5, [](int c) { return c > 0; }) < 2) {
+    return 0.0;
+  }
+  const auto stats = GetPentanomialStats(counts);
+  const double score0 = EloToScore(elo0);
+  const double score1 = EloToScore(elo1);
+  return stats.pairs * (score1 - score0) *
+         (2 * stats.mean - score0 - score1) / (2 * stats.variance);
+}
+
+void SprtBounds(double alpha, double beta, double* lower, double* upper) {
+  *lower = std::log(beta / (1 - alpha));
+  *upper = std::log((1 - beta) / alpha);
+}
+
+}  // namespace lczero
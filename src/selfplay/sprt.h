@@ -0,0 +1,60 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+namespace lczero {
+
+// Statistics of player1's score per game over pairs of games played from the
+// same opening with swapped colors. @counts are the numbers of pairs where
+// player1 scored 0, 0.5, 1, 1.5 and 2 points.
+struct PentanomialStats {
+  int pairs = 0;
+  // Mean score per game, between 0 and 1.
+  double mean = 0.5;
+  // Variance of the per game score of a pair.
+  double variance = 0.0;
+};
+PentanomialStats GetPentanomialStats(const int counts[5]);
+
+// Logistic Elo difference corresponding to an expected score.
+double ScoreToElo(double score);
+
+// Half width of the 95% confidence interval of the Elo estimate, or 0 if there
+// are not enough pairs to tell.
+double EloError95(const PentanomialStats& stats);
+
+// Log-likelihood ratio of H1 (elo == @elo1) against H0 (elo == @elo0) for the
+// pair results in @counts, using the normal approximation of the generalized
+// SPRT. Returns 0 until two different pair outcomes are seen.
+double PentanomialLlr(const int counts[5], double elo0, double elo1);
+
+// LLR below @lower accepts H0, above @upper accepts H1. @alpha and @beta are
+// the probabilities of false positives and false negatives.
+void SprtBounds(double alpha, double beta, double* lower, double* upper);
+
+}  // namespace lczero
@@ -0,0 +1,103 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "selfplay/sprt.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+namespace lczero {
+namespace {
+
+// Pair counts: player1 scored 0, 0.5, 1, 1.5 and 2 points.
+const int kEven[5] = {0, 10, 20, 10, 0};
+const int kEvenLarge[5] = {40, 400, 800, 400, 40};
+const int kSlightlyBetter[5] = {2, 30, 60, 40, 8};
+const int kMuchBetter[5] = {1, 20, 50, 80, 30};
+
+TEST(Sprt, Bounds) {
+  double lower;
+  double upper;
+  SprtBounds(0.05, 0.05, &lower, &upper);
+  EXPECT_NEAR(lower, std::log(0.05 / 0.95), 1e-12);
+  EXPECT_NEAR(upper, std::log(0.95 / 0.05), 1e-12);
+  SprtBounds(0.05, 0.1, &lower, &upper);
+  EXPECT_NEAR(lower, -2.251291799, 1e-9);
+  EXPECT_NEAR(upper, 2.890371758, 1e-9);
+}
+
+TEST(Sprt, PentanomialStats) {
+  const auto stats = GetPentanomialStats(kEven);
+  EXPECT_EQ(stats.pairs, 40);
+  EXPECT_NEAR(stats.mean, 0.5, 1e-12);
+  // (10 + 10) * 0.25^2 / 40 = 0.03125, nudged up by the prior.
+  EXPECT_NEAR(stats.variance, 0.031261717, 1e-9);
+}
+
+TEST(Sprt, KnownLlrValues) {
+  EXPECT_NEAR(PentanomialLlr(kEven, 0, 5), -0.033119870, 1e-9);
+  EXPECT_NEAR(PentanomialLlr(kSlightlyBetter, 0, 10), 1.358880338, 1e-9);
+  EXPECT_NEAR(PentanomialLlr(kMuchBetter, 0, 5), 4.086929721, 1e-9);
+  EXPECT_NEAR(PentanomialLlr(kMuchBetter, 0, 10), 7.987782202, 1e-9);
+  EXPECT_NEAR(PentanomialLlr(kEvenLarge, 0, 10), -4.172915097, 1e-9);
+}
+
+TEST(Sprt, NeedsTwoDifferentOutcomes) {
+  const int all_draws[5] = {0, 0, 7, 0, 0};
+  EXPECT_EQ(PentanomialLlr(all_draws, 0, 5), 0.0);
+  const int nothing[5] = {0, 0, 0, 0, 0};
+  EXPECT_EQ(PentanomialLlr(nothing, 0, 5), 0.0);
+}
+
+TEST(Sprt, Decisions) {
+  double lower;
+  double upper;
+  SprtBounds(0.05, 0.05, &lower, &upper);
+  // A clearly stronger player1 accepts H1.
+  EXPECT_GE(PentanomialLlr(kMuchBetter, 0, 5), upper);
+  // Equal strength over many pairs accepts H0.
+  EXPECT_LE(PentanomialLlr(kEvenLarge, 0, 10), lower);
+  // Neither yet.
+  const double llr = PentanomialLlr(kSlightlyBetter, 0, 10);
+  EXPECT_GT(llr, lower);
+  EXPECT_LT(llr, upper);
+}
+
+TEST(Sprt, EloError) {
+  EXPECT_NEAR(EloError95(GetPentanomialStats(kEven)), 38.228253166, 1e-6);
+  const int one_pair[5] = {0, 0, 0, 1, 0};
+  EXPECT_EQ(EloError95(GetPentanomialStats(one_pair)), 0.0);
+}
+
+}  // namespace
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -28,6 +28,7 @@
 #include "selfplay/tournament.h"
 
 #include <fstream>
+#include <thread>
 
 #include "chess/pgn.h"
 #include "mcts/search.h"
@@ -35,6 +36,7 @@
 #include "neural/factory.h"
 #include "selfplay/game.h"
 #include "selfplay/multigame.h"
+#include "selfplay/sprt.h"
 #include "utils/optionsparser.h"
 #include "utils/random.h"
 
@@ -82,13 +84,37 @@ const OptionId kDiscardedStartChanceId{
     "discarded-start-chance", "DiscardedStartChance",
     "The percentage chance each game will attempt to start from a position "
     "discarded due to not getting enough visits."};
+const OptionId kSeedId{
+    "seed", "Seed",
+    "Seed for the random choices of each game (color of the first game, random "
+    "openings, discarded starts and resign playthrough), derived from the seed "
+    "and the game number. 0 for a random seed."};
 const OptionId kOpeningsFileId{
     "openings-pgn", "OpeningsPgnFile",
-    "A path name to a pgn file containing openings to use."};
+    "A path name to a pgn file containing openings to use. Files ending in "
+    ".epd are read as one starting position per line."};
+const OptionId kOpeningsCacheId{
+    "openings-cache", "OpeningsCache",
+    "A path name to a binary cache of the openings file. It is written after "
+    "parsing the openings and memory-mapped instead while the openings file is "
+    "unchanged."};
 const OptionId kOpeningsMirroredId{
     "mirror-openings", "MirrorOpenings",
     "If true, each opening will be played in pairs. "
     "Not really compatible with openings mode random."};
+const OptionId kSprtId{
+    "sprt", "Sprt",
+    "Stop the tournament as soon as a sequential probability ratio test of "
+    "player1 against player2 is decided. Game pairs from mirrored openings are "
+    "scored as a pentanomial distribution."};
+const OptionId kSprtElo0Id{"sprt-elo0", "SprtElo0",
+                           "Elo difference of the SPRT null hypothesis."};
+const OptionId kSprtElo1Id{"sprt-elo1", "SprtElo1",
+                           "Elo difference of the SPRT alternative hypothesis."};
+const OptionId kSprtAlphaId{"sprt-alpha", "SprtAlpha",
+                            "SPRT probability of a false positive."};
+const OptionId kSprtBetaId{"sprt-beta", "SprtBeta",
+                           "SPRT probability of a false negative."};
 const OptionId kOpeningsModeId{"openings-mode", "OpeningsMode",
                                "A choice of sequential, shuffled, or random."};
 }  // namespace
@@ -123,11 +149,18 @@ void SelfPlayTournament::PopulateOptions(OptionsParser* options) {
   options->Add<BoolOption>(kMoveThinkingId) = false;
   options->Add<FloatOption>(kResignPlaythroughId, 0.0f, 100.0f) = 0.0f;
   options->Add<FloatOption>(kDiscardedStartChanceId, 0.0f, 100.0f) = 0.0f;
+  options->Add<IntOption>(kSeedId, 0, 999999999) = 0;
   options->Add<StringOption>(kOpeningsFileId) = "";
+  options->Add<StringOption>(kOpeningsCacheId) = "";
   options->Add<BoolOption>(kOpeningsMirroredId) = false;
   std::vector<std::string> openings_modes = {"sequential", "shuffled",
                                              "random"};
   options->Add<ChoiceOption>(kOpeningsModeId, openings_modes) = "sequential";
+  options->Add<BoolOption>(kSprtId) = false;
+  options->Add<FloatOption>(kSprtElo0Id, -1000.0f, 1000.0f) = 0.0f;
+  options->Add<FloatOption>(kSprtElo1Id, -1000.0f, 1000.0f) = 5.0f;
+  options->Add<FloatOption>(kSprtAlphaId, 0.0001f, 0.5f) = 0.05f;
+  options->Add<FloatOption>(kSprtBetaId, 0.0001f, 0.5f) = 0.05f;
 
   SelfPlayGame::PopulateUciParams(options);
 
@@ -172,21 +205,26 @@ SelfPlayTournament::SelfPlayTournament(
       kValueGamesSize(options.Get<int>(kValueModeSizeId)),
       kTournamentResultsFile(
           options.Get<std::string>(kTournamentResultsFileId)),
-      kDiscardedStartChance(options.Get<float>(kDiscardedStartChanceId)) {
+      kDiscardedStartChance(options.Get<float>(kDiscardedStartChanceId)),
+      kSeed(options.Get<int>(kSeedId)),
+      kSprt(options.Get<bool>(kSprtId)),
+      kSprtElo0(options.Get<float>(kSprtElo0Id)),
+      kSprtElo1(options.Get<float>(kSprtElo1Id)) {
   multi_games_size_ = std::max(kPolicyGamesSize, kValueGamesSize);
   std::string book = options.Get<std::string>(kOpeningsFileId);
   if (!book.empty()) {
-    PgnReader book_reader;
-    book_reader.AddPgnFile(book);
-    openings_ = book_reader.ReleaseGames();
+    openings_ = std::make_unique<OpeningSuite>(
+        book, options.Get<std::string>(kOpeningsCacheId),
+        std::max(1u, std::thread::hardware_concurrency()));
     if (options.Get<std::string>(kOpeningsModeId) == "shuffled") {
-      Random::Get().Shuffle(openings_.begin(), openings_.end());
+      openings_->Shuffle();
     }
   }
   if (kPolicyGamesSize > 0 && kValueGamesSize > 0) {
     throw Exception("Can't do both policy and value games at the same time.");
   }
-  if (multi_games_size_ > 0 && openings_.size() == 0) {
+  const size_t openings_count = openings_ ? openings_->size() : 0;
+  if (multi_games_size_ > 0 && openings_count == 0) {
     throw Exception(
         "Policy/Value games are deterministic, needs opening book to be "
         "useful.");
@@ -194,15 +232,30 @@ SelfPlayTournament::SelfPlayTournament(
   if (multi_games_size_ > 0 &&
       (kTotalGames == -1 ||
        (kTotalGames > 0 &&
-        static_cast<size_t>(kTotalGames) > openings_.size() * 2))) {
+        static_cast<size_t>(kTotalGames) > openings_count * 2))) {
     throw Exception(
         "Policy/Value games are deterministic, you do not want to go through "
         "the "
         "opening book more than once.");
   }
+  if (kSprt) {
+    if (!options.Get<bool>(kOpeningsMirroredId)) {
+      throw Exception("SPRT needs --mirror-openings to pair the games.");
+    }
+    if (kSprtElo0 >= kSprtElo1) {
+      throw Exception("SPRT elo0 must be less than elo1.");
+    }
+    double lower, upper;
+    SprtBounds(options.Get<float>(kSprtAlphaId),
+               options.Get<float>(kSprtBetaId), &lower, &upper);
+    tournament_info_.sprt = true;
+    tournament_info_.llr_lower = lower;
+    tournament_info_.llr_upper = upper;
+  }
   // If playing just one game, the player1 is white, otherwise randomize.
   if (kTotalGames != 1) {
-    first_game_black_ = Random::Get().GetBool();
+    first_game_black_ =
+        kSeed ? Random::MixSeed(kSeed, -1) & 1 : Random::Get().GetBool();
   }
 
   // Initializing networks.
@@ -226,6 +279,21 @@ SelfPlayTournament::SelfPlayTournament(
         options.GetSubdict("player2").Get<int>(kNNCacheSizeId));
   }
 
+  // Initializing opening books.
+  for (int idx : {0, 1}) {
+    const auto book_file =
+        options.GetSubdict(idx == 0 ? "player1" : "player2")
+            .Get<std::string>(kBookFileId);
+    if (book_file.empty()) continue;
+    if (idx == 1 && book_[0] &&
+        book_file == options.GetSubdict("player1").Get<std::string>(
+                         kBookFileId)) {
+      book_[1] = book_[0];
+    } else {
+      book_[idx] = std::make_shared<OpeningBook>(book_file);
+    }
+  }
+
   // SearchLimits.
   static constexpr const char* kPlayerNames[2] = {"player1", "player2"};
   static constexpr const char* kPlayerColors[2] = {"white", "black"};
@@ -257,22 +325,28 @@ SelfPlayTournament::SelfPlayTournament(
 void SelfPlayTournament::PlayOneGame(int game_number) {
   bool player1_black;  // Whether player1 will player as black in this game.
   Opening opening;
+  // Random choices of this game, reproducible when a seed is given.
+  Xoshiro256 rng(kSeed ? Random::MixSeed(kSeed, game_number)
+                       : std::random_device()());
+  std::uniform_real_distribution<float> percent(0.0f, 100.0f);
   {
     Mutex::Lock lock(mutex_);
     player1_black = ((game_number % 2) == 1) != first_game_black_;
-    if (!openings_.empty()) {
+    if (openings_ && !openings_->empty()) {
+      const size_t count = openings_->size();
       if (player_options_[0][0].Get<bool>(kOpeningsMirroredId)) {
-        opening = openings_[(game_number / 2) % openings_.size()];
+        opening = openings_->Get((game_number / 2) % count);
       } else if (player_options_[0][0].Get<std::string>(kOpeningsModeId) ==
                  "random") {
-        opening = openings_[Random::Get().GetInt(0, openings_.size() - 1)];
+        opening = openings_->Get(
+            std::uniform_int_distribution<size_t>(0, count - 1)(rng));
       } else {
-        opening = openings_[game_number % openings_.size()];
+        opening = openings_->Get(game_number % count);
       }
     }
-    if (discard_pile_.size() > 0 &&
-        Random::Get().GetFloat(100.0f) < kDiscardedStartChance) {
-      const size_t idx = Random::Get().GetInt(0, discard_pile_.size() - 1);
+    if (discard_pile_.size() > 0 && percent(rng) < kDiscardedStartChance) {
+      const size_t idx = std::uniform_int_distribution<size_t>(
+          0, discard_pile_.size() - 1)(rng);
       if (idx != discard_pile_.size() - 1) {
         std::swap(discard_pile_[idx], discard_pile_.back());
       }
@@ -297,6 +371,7 @@ void SelfPlayTournament::PlayOneGame(int game_number) {
                                 player_options_[pl_idx][color])]
                       .get();
     opt.cache = cache_[pl_idx].get();
+    opt.book = book_[pl_idx].get();
     opt.uci_options = &player_options_[pl_idx][color];
     opt.search_limits = search_limits_[pl_idx][color];
 
@@ -367,8 +442,7 @@ void SelfPlayTournament::PlayOneGame(int game_number) {
   auto& game = **game_iter;
 
   // If kResignPlaythrough == 0, then this comparison is unconditionally true
-  const bool enable_resign =
-      Random::Get().GetFloat(100.0f) >= kResignPlaythrough;
+  const bool enable_resign = percent(rng) >= kResignPlaythrough;
 
   // PLAY GAME!
   auto player1_threads = player_options_[0][color_idx[0]].Get<int>(kThreadsId);
@@ -408,6 +482,9 @@ void SelfPlayTournament::PlayOneGame(int game_number) {
       ++tournament_info_.results[result][player1_black ? 1 : 0];
       tournament_info_.move_count_ += game.move_count_;
       tournament_info_.nodes_total_ += game.nodes_total_;
+      if (player_options_[0][0].Get<bool>(kOpeningsMirroredId)) {
+        AddPairResult(game_number / 2, 2 - result);
+      }
       tournament_callback_(tournament_info_);
     }
   }
@@ -423,11 +500,9 @@ void SelfPlayTournament::PlayMultiGames(int game_id, size_t game_count) {
   std::vector<Opening> openings;
   openings.reserve(game_count / 2);
   size_t opening_basis = game_id / 2;
-  {
-    Mutex::Lock lock(mutex_);
-    for (size_t i = 0; i < game_count / 2; i++) {
-      openings.push_back(openings_[(opening_basis + i) % openings_.size()]);
-    }
+  for (size_t i = 0; i < game_count / 2; i++) {
+    openings.push_back(
+        openings_->Get((opening_basis + i) % openings_->size()));
   }
 
   PlayerOptions options[2];
@@ -491,6 +566,7 @@ void SelfPlayTournament::PlayMultiGames(int game_id, size_t game_count) {
                      : game1_res == GameResult::WHITE_WON ? 0
                                                           : 2;
         ++tournament_info_.results[result][0];
+        AddPairResult(game_id / 2 + i, 2 - result);
         tournament_callback_(tournament_info_);
       }
     }
@@ -513,6 +589,7 @@ void SelfPlayTournament::PlayMultiGames(int game_id, size_t game_count) {
                      : game2_res == GameResult::WHITE_WON ? 2
                                                           : 0;
         ++tournament_info_.results[result][1];
+        AddPairResult(game_id / 2 + i, 2 - result);
         tournament_callback_(tournament_info_);
       }
     }
@@ -546,7 +623,7 @@ void SelfPlayTournament::Worker() {
         int to_take = 2 * multi_games_size_;
         int max_take = 2 * multi_games_size_;
         if (kTotalGames != -1) {
-          int cap = kTotalGames == -2 ? openings_.size() * 2 : kTotalGames;
+          int cap = kTotalGames == -2 ? openings_->size() * 2 : kTotalGames;
           to_take = std::min(max_take, cap - games_count_);
         }
         if (to_take <= 0) {
@@ -558,9 +635,9 @@ void SelfPlayTournament::Worker() {
       } else {
         bool mirrored = player_options_[0][0].Get<bool>(kOpeningsMirroredId);
         if ((kTotalGames >= 0 && games_count_ >= kTotalGames) ||
-            (kTotalGames == -2 && !openings_.empty() &&
+            (kTotalGames == -2 && openings_ && !openings_->empty() &&
              games_count_ >=
-                 static_cast<int>(openings_.size()) * (mirrored ? 2 : 1)))
+                 static_cast<int>(openings_->size()) * (mirrored ? 2 : 1)))
           break;
         game_id = games_count_++;
       }
@@ -585,7 +662,7 @@ void SelfPlayTournament::RunBlocking() {
     // No need for multiple threads if there is one worker.
     Worker();
     Mutex::Lock lock(mutex_);
-    if (!abort_) {
+    if ((!abort_ || sprt_decided_) && !tournament_info_.finished) {
       SaveResults();
       tournament_info_.finished = true;
       tournament_callback_(tournament_info_);
@@ -606,7 +683,7 @@ void SelfPlayTournament::Wait() {
   }
   {
     Mutex::Lock lock(mutex_);
-    if (!abort_) {
+    if ((!abort_ || sprt_decided_) && !tournament_info_.finished) {
       SaveResults();
       tournament_info_.finished = true;
       tournament_callback_(tournament_info_);
@@ -617,12 +694,37 @@ void SelfPlayTournament::Wait() {
 void SelfPlayTournament::Abort() {
   Mutex::Lock lock(mutex_);
   abort_ = true;
+  AbortGames();
+}
+
+void SelfPlayTournament::AbortGames() {
   for (auto& game : games_)
     if (game) game->Abort();
   for (auto& game : multigames_)
     if (game) game->Abort();
 }
 
+void SelfPlayTournament::AddPairResult(int pair_id, int half_points) {
+  auto iter = pending_pairs_.find(pair_id);
+  if (iter == pending_pairs_.end()) {
+    pending_pairs_.emplace(pair_id, half_points);
+    return;
+  }
+  ++tournament_info_.pentanomial[iter->second + half_points];
+  pending_pairs_.erase(iter);
+  if (!kSprt) return;
+  tournament_info_.llr =
+      PentanomialLlr(tournament_info_.pentanomial, kSprtElo0, kSprtElo1);
+  if (!sprt_decided_ && (tournament_info_.llr <= tournament_info_.llr_lower ||
+                         tournament_info_.llr >= tournament_info_.llr_upper)) {
+    // Games in progress can't change the outcome any more, so they are
+    // dropped rather than finished.
+    sprt_decided_ = true;
+    abort_ = true;
+    AbortGames();
+  }
+}
+
 void SelfPlayTournament::Stop() {
   Mutex::Lock lock(mutex_);
   abort_ = true;
@@ -28,7 +28,9 @@
 #pragma once
 
 #include <list>
+#include <map>
 
+#include "chess/openings.h"
 #include "chess/pgn.h"
 #include "neural/factory.h"
 #include "selfplay/game.h"
@@ -74,6 +76,11 @@ class SelfPlayTournament {
   void PlayOneGame(int game_id);
   void PlayMultiGames(int game_id, size_t game_count);
   void SaveResults() REQUIRES(mutex_);
+  // Records player1's score (in half points) of a game from pair @pair_id and
+  // runs the SPRT once the pair is complete.
+  void AddPairResult(int pair_id, int half_points) REQUIRES(mutex_);
+  // Aborts all games in progress.
+  void AbortGames() REQUIRES(mutex_);
 
   Mutex mutex_;
   // Whether first game will be black for player1.
@@ -82,7 +89,12 @@ class SelfPlayTournament {
   // Number of games which already started.
   int games_count_ GUARDED_BY(mutex_) = 0;
   bool abort_ GUARDED_BY(mutex_) = false;
-  std::vector<Opening> openings_ GUARDED_BY(mutex_);
+  // Whether the tournament was stopped because the SPRT is decided.
+  bool sprt_decided_ GUARDED_BY(mutex_) = false;
+  // Player1's half points of the first finished game of incomplete pairs.
+  std::map<int, int> pending_pairs_ GUARDED_BY(mutex_);
+  // Not modified after construction.
+  std::unique_ptr<OpeningSuite> openings_;
   // Games in progress. Exposed here to be able to abort them in case if
   // Abort(). Stored as list and not vector so that threads can keep iterators
   // to them and not worry that it becomes invalid.
@@ -98,6 +110,7 @@ class SelfPlayTournament {
   std::map<NetworkFactory::BackendConfiguration, std::unique_ptr<Network>>
       networks_;
   std::shared_ptr<NNCache> cache_[2];
+  std::shared_ptr<OpeningBook> book_[2];
   // [player1 or player2][white or black].
   const OptionsDict player_options_[2][2];
   SelfPlayLimits search_limits_[2][2];
@@ -116,6 +129,10 @@ class SelfPlayTournament {
   int multi_games_size_;
   const std::string kTournamentResultsFile;
   const float kDiscardedStartChance;
+  const uint64_t kSeed;
+  const bool kSprt;
+  const float kSprtElo0;
+  const float kSprtElo1;
 };
 
 }  // namespace lczero
@@ -114,7 +114,8 @@ void V6TrainingDataArray::Write(TrainingDataWriter* writer, GameResult result,
 void V6TrainingDataArray::Add(const Node* node, const PositionHistory& history,
                               Eval best_eval, Eval played_eval,
                               bool best_is_proven, Move best_move,
-                              Move played_move, const NNCacheLock& nneval) {
+                              Move played_move, const NNCacheLock& nneval,
+                              bool fast_search) {
   V6TrainingData result;
   const auto& position = history.Last();
 
@@ -201,6 +202,9 @@ void V6TrainingDataArray::Add(const Node* node, const PositionHistory& history,
   if (best_is_proven) {
     result.invariance_info |= 1u << 3;  // Best node is proven best;
   }
+  if (fast_search) {
+    result.invariance_info |= 1u << 2;  // Policy target from a fast search.
+  }
   result.dummy = 0;
   result.rule50_count = position.GetRule50Ply();
 
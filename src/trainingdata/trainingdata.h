@@ -47,7 +47,7 @@ struct V6TrainingData {
   //  bit 5: game adjudicated (v6)
   //  bit 4: max game length exceeded (v6)
   //  bit 3: best_q is for proven best move (v6)
-  //  bit 2: not used
+  //  bit 2: fast search, probabilities are not a policy target (v6)
   //  bit 1: not used
   //  bit 0: flip transform (input type 3)
   // In versions prior to v5 this spot contained an unused move count field.
@@ -93,7 +93,8 @@ class V6TrainingDataArray {
   // Add a chunk.
   void Add(const Node* node, const PositionHistory& history, Eval best_eval,
            Eval played_eval, bool best_is_proven, Move best_move,
-           Move played_move, const NNCacheLock& nneval);
+           Move played_move, const NNCacheLock& nneval,
+           bool fast_search = false);
 
   // Writes training data to a file.
   void Write(TrainingDataWriter* writer, GameResult result,
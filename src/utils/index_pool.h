@@ -0,0 +1,395 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "utils/exception.h"
+#include "utils/mutex.h"
+#include "utils/numa.h"
+
+namespace lczero {
+
+// Allocates runs of T from large chunks and addresses them with 32-bit
+// indices instead of pointers. Index 0 is never handed out and serves as null.
+// Every pool owns its chunks and returns them to the system when destroyed.
+// Chunk numbers are shared by all pools of T, so indices can be resolved
+// without knowing their pool, and the owner of a pool is found from the
+// address of any of its elements.
+// Freed runs are kept in per-length free lists. A run is reused for a request
+// of its own length, or split when no run of the requested length is free.
+// Threads can allocate through a Cache, which takes the pool lock once per
+// batch rather than once per allocation, and refills from the longest free
+// run.
+// The storage is neither constructed nor destroyed by the pool, so T must be
+// trivially destructible. Runs never cross a chunk boundary, so the elements of
+// a run can be addressed with pointer arithmetic.
+template <typename T, uint32_t kMaxRun>
+class IndexPool {
+ public:
+  struct Run {
+    uint32_t index;
+    uint32_t count;
+  };
+
+  // Elements of one pool kept aside by a single thread: a range carved from
+  // the pool, and single elements taken from its free list in bulk.
+  class Cache {
+   public:
+    // Returns a run of @count uninitialized elements of @pool. The same pool
+    // has to be used until the cache is drained.
+    uint32_t Allocate(IndexPool* pool, uint32_t count) {
+      assert(count > 0 && count <= kMaxRun);
+      if (count == 1 && !singles_.empty()) {
+        const uint32_t index = singles_.back();
+        singles_.pop_back();
+        return index;
+      }
+      if (end_ - begin_ >= count) {
+        const uint32_t index = begin_;
+        begin_ += count;
+        return index;
+      }
+      return pool->Refill(this, count);
+    }
+
+    // Returns all cached elements to @pool.
+    void Drain(IndexPool* pool) { pool->Drain(this); }
+
+   private:
+    std::vector<uint32_t> singles_;
+    uint32_t begin_ = 0;
+    uint32_t end_ = 0;
+    friend class IndexPool;
+  };
+
+  // @owner is returned by OwnerOf() for the elements of this pool. Chunks are
+  // placed on NUMA node @numa_node, unless it is negative.
+  explicit IndexPool(void* owner, int numa_node = -1)
+      : owner_(owner), numa_node_(numa_node) {}
+  IndexPool(const IndexPool&) = delete;
+  IndexPool& operator=(const IndexPool&) = delete;
+
+  ~IndexPool() {
+    for (const uint32_t chunk : chunks_) {
+      T* data = registry_.chunks[chunk].exchange(nullptr);
+#ifdef _WIN32
+      _aligned_free(ChunkHeader(data));
+#else
+      std::free(ChunkHeader(data));
+#endif
+      SpinMutex::Lock lock(registry_.mutex);
+      registry_.free_ids[registry_.num_free++] = chunk;
+    }
+  }
+
+  // Returns the first element of the run at @index.
+  static T* Get(uint32_t index) {
+    return registry_.chunks[index >> kChunkBits].load(
+               std::memory_order_acquire) +
+           (index & kOffsetMask);
+  }
+
+  // Inverse of Get(). Chunks are aligned to their size, and the chunk number
+  // is stored in front of the data.
+  static uint32_t IndexOf(const T* ptr) {
+    const auto* header = ChunkHeader(ptr);
+    return (header->chunk << kChunkBits) |
+           static_cast<uint32_t>(ptr - header->Data());
+  }
+
+  // Returns the owner of the pool holding @ptr.
+  static void* OwnerOf(const T* ptr) { return ChunkHeader(ptr)->owner; }
+
+  // Returns a run of @count uninitialized elements.
+  uint32_t Allocate(uint32_t count) {
+    assert(count > 0 && count <= kMaxRun);
+    SpinMutex::Lock lock(mutex_);
+    if (!free_[count].empty()) return PopFree(count);
+    if (const uint32_t longer = FindFree(count + 1)) {
+      const uint32_t index = PopFree(longer);
+      PushFree(index + count, longer - count);
+      return index;
+    }
+    return Carve(count);
+  }
+
+  void Free(uint32_t index, uint32_t count) {
+    SpinMutex::Lock lock(mutex_);
+    PushFree(index, count);
+  }
+  void Free(const std::vector<Run>& runs) {
+    SpinMutex::Lock lock(mutex_);
+    for (const auto& run : runs) PushFree(run.index, run.count);
+  }
+
+  // Number of elements in the allocated chunks.
+  size_t GetCapacity() const {
+    SpinMutex::Lock lock(mutex_);
+    return chunks_.size() * size_t{kCapacity};
+  }
+
+  // Allocates chunks until they hold at least @count elements, and touches
+  // their memory, so that the first allocations don't pay for page faults.
+  void Reserve(size_t count) {
+    SpinMutex::Lock lock(mutex_);
+    while (chunks_.size() * size_t{kCapacity} < count) {
+      NewChunk();
+      std::memset(static_cast<void*>(Get(chunks_.back() << kChunkBits)), 0,
+                  kCapacity * sizeof(T));
+    }
+  }
+
+  // Returns whether all pools of T together are down to their last
+  // kReserveChunks chunk numbers. Users are expected to stop allocating at
+  // that point, the reserve is for the allocations they still have in flight.
+  // Allocating beyond the reserve throws.
+  static bool IsNearlyExhausted() {
+    SpinMutex::Lock lock(registry_.mutex);
+    return kMaxChunks - registry_.num_ids + registry_.num_free <
+           kReserveChunks;
+  }
+
+ private:
+  // 2 MiB chunks, so that they can be backed by huge pages.
+  static constexpr size_t kChunkBytes = size_t{1} << 21;
+  static constexpr size_t kHeaderBytes = 64;
+  static constexpr uint32_t kCapacity =
+      (kChunkBytes - kHeaderBytes) / sizeof(T);
+  static constexpr uint32_t Log2Ceil(uint32_t x) {
+    uint32_t bits = 0;
+    while ((uint32_t{1} << bits) < x) bits++;
+    return bits;
+  }
+  static constexpr uint32_t kChunkBits = Log2Ceil(kCapacity);
+  static constexpr uint32_t kOffsetMask = (uint32_t{1} << kChunkBits) - 1;
+  static constexpr size_t kMaxChunks = size_t{1} << (32 - kChunkBits);
+  static constexpr size_t kReserveChunks = 64;
+  static_assert(kMaxChunks > kReserveChunks, "Pool element too small");
+  // Number of elements a cache takes from the pool at once, 16 KiB worth.
+  static constexpr uint32_t kCacheBatch =
+      std::max<uint32_t>(kMaxRun, 16384 / sizeof(T));
+  static_assert(alignof(T) <= kHeaderBytes, "Over-aligned pool element");
+
+  struct Header {
+    uint32_t chunk;
+    void* owner;
+    const T* Data() const {
+      return reinterpret_cast<const T*>(reinterpret_cast<const char*>(this) +
+                                        kHeaderBytes);
+    }
+  };
+  static Header* ChunkHeader(const T* ptr) {
+    return reinterpret_cast<Header*>(reinterpret_cast<uintptr_t>(ptr) &
+                                     ~(kChunkBytes - 1));
+  }
+
+  // Chunks of all pools of T. Trivially destructible, so that pools can
+  // still be destroyed at exit.
+  struct Registry {
+    SpinMutex mutex;
+    std::atomic<T*> chunks[kMaxChunks];
+    // Chunk numbers handed out so far.
+    uint32_t num_ids GUARDED_BY(mutex);
+    // Chunk numbers returned by destroyed pools.
+    uint32_t num_free GUARDED_BY(mutex);
+    uint32_t free_ids[kMaxChunks] GUARDED_BY(mutex);
+  };
+  static inline Registry registry_;
+
+  // Takes elements for @cache, returns the first @count of them. Whatever the
+  // cache still holds is returned first, as it didn't fit the request. Single
+  // elements are taken in bulk, otherwise the longest free run is split, so
+  // that its remainder serves the next requests without the lock.
+  uint32_t Refill(Cache* cache, uint32_t count) {
+    SpinMutex::Lock lock(mutex_);
+    PushRange(cache->begin_, cache->end_);
+    cache->begin_ = cache->end_ = 0;
+    if (count == 1 && !free_[1].empty()) {
+      auto& list = free_[1];
+      const size_t take = std::min<size_t>(list.size(), kCacheBatch);
+      cache->singles_.assign(list.end() - take, list.end());
+      list.resize(list.size() - take);
+      if (list.empty()) MarkEmpty(1);
+      const uint32_t index = cache->singles_.back();
+      cache->singles_.pop_back();
+      return index;
+    }
+    uint32_t length = FindLongest(count);
+    uint32_t index;
+    if (length) {
+      index = PopFree(length);
+    } else {
+      if (chunks_.empty() || used_ + count > kCapacity) NewChunk();
+      length = std::min(kCapacity - used_, std::max(count, kCacheBatch));
+      index = (chunks_.back() << kChunkBits) | used_;
+      used_ += length;
+    }
+    cache->begin_ = index + count;
+    cache->end_ = index + length;
+    return index;
+  }
+
+  void Drain(Cache* cache) {
+    SpinMutex::Lock lock(mutex_);
+    PushRange(cache->begin_, cache->end_);
+    cache->begin_ = cache->end_ = 0;
+    for (const uint32_t index : cache->singles_) PushFree(index, 1);
+    cache->singles_.clear();
+  }
+
+  // Takes @count elements from the end of the current chunk.
+  uint32_t Carve(uint32_t count) REQUIRES(mutex_) {
+    if (chunks_.empty() || used_ + count > kCapacity) NewChunk();
+    const uint32_t index = (chunks_.back() << kChunkBits) | used_;
+    used_ += count;
+    return index;
+  }
+
+  void PushFree(uint32_t index, uint32_t count) REQUIRES(mutex_) {
+    free_[count].push_back(index);
+    non_empty_[count / 64] |= uint64_t{1} << (count % 64);
+  }
+  // Frees the elements [begin, end) of one chunk, in runs of at most kMaxRun.
+  void PushRange(uint32_t begin, uint32_t end) REQUIRES(mutex_) {
+    while (begin < end) {
+      const uint32_t count = std::min(end - begin, kMaxRun);
+      PushFree(begin, count);
+      begin += count;
+    }
+  }
+  uint32_t PopFree(uint32_t count) REQUIRES(mutex_) {
+    auto& list = free_[count];
+    const uint32_t index = list.back();
+    list.pop_back();
+    if (list.empty()) MarkEmpty(count);
+    return index;
+  }
+  void MarkEmpty(uint32_t count) REQUIRES(mutex_) {
+    non_empty_[count / 64] &= ~(uint64_t{1} << (count % 64));
+  }
+  static uint32_t LowestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+  }
+  static uint32_t HighestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return index;
+#else
+    return 63 - __builtin_clzll(bits);
+#endif
+  }
+  // Returns the longest length of at least @min with free runs, 0 if none.
+  uint32_t FindLongest(uint32_t min) const REQUIRES(mutex_) {
+    for (uint32_t word = kFreeWords; word-- > min / 64;) {
+      uint64_t bits = non_empty_[word];
+      if (word == min / 64) bits &= ~uint64_t{0} << (min % 64);
+      if (bits) return word * 64 + HighestBit(bits);
+    }
+    return 0;
+  }
+  // Returns the shortest length of at least @min with free runs, 0 if none.
+  uint32_t FindFree(uint32_t min) const REQUIRES(mutex_) {
+    if (min > kMaxRun) return 0;
+    for (uint32_t word = min / 64; word < kFreeWords; word++) {
+      uint64_t bits = non_empty_[word];
+      if (word == min / 64) bits &= ~uint64_t{0} << (min % 64);
+      if (bits) return word * 64 + LowestBit(bits);
+    }
+    return 0;
+  }
+
+  void NewChunk() REQUIRES(mutex_) {
+    if (!chunks_.empty()) {
+      // Keep the tail of the current chunk for shorter runs.
+      const uint32_t tail = (chunks_.back() << kChunkBits) | used_;
+      PushRange(tail, tail + (kCapacity - used_));
+    }
+    uint32_t chunk;
+    {
+      SpinMutex::Lock lock(registry_.mutex);
+      if (registry_.num_free > 0) {
+        chunk = registry_.free_ids[--registry_.num_free];
+      } else if (registry_.num_ids < kMaxChunks) {
+        chunk = registry_.num_ids++;
+      } else {
+        throw Exception("Index pool is exhausted");
+      }
+    }
+#ifdef _WIN32
+    void* mem = _aligned_malloc(kChunkBytes, kChunkBytes);
+#else
+    void* mem = std::aligned_alloc(kChunkBytes, kChunkBytes);
+#endif
+    if (!mem) {
+      SpinMutex::Lock lock(registry_.mutex);
+      registry_.free_ids[registry_.num_free++] = chunk;
+      throw Exception("Failed to allocate index pool chunk");
+    }
+    if (numa_node_ >= 0) Numa::BindMemoryToNode(mem, kChunkBytes, numa_node_);
+    auto* header = static_cast<Header*>(mem);
+    header->chunk = chunk;
+    header->owner = owner_;
+    T* data = const_cast<T*>(header->Data());
+    registry_.chunks[chunk].store(data, std::memory_order_release);
+    chunks_.push_back(chunk);
+    // Index 0 is null.
+    used_ = chunk == 0 ? 1 : 0;
+  }
+
+  static constexpr uint32_t kFreeWords = kMaxRun / 64 + 1;
+
+  void* const owner_;
+  const int numa_node_;
+  mutable SpinMutex mutex_;
+  // Chunks owned by this pool, allocation continues in the last one.
+  std::vector<uint32_t> chunks_ GUARDED_BY(mutex_);
+  // Elements used in the last chunk.
+  uint32_t used_ GUARDED_BY(mutex_) = 0;
+  std::vector<uint32_t> free_[kMaxRun + 1] GUARDED_BY(mutex_);
+  // Bit per free list, set when the list is not empty.
+  uint64_t non_empty_[kFreeWords] GUARDED_BY(mutex_) = {};
+};
+
+}  // namespace lczero
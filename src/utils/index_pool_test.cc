@@ -0,0 +1,129 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "utils/index_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+namespace lczero {
+
+using TestPool = IndexPool<uint64_t, 16>;
+
+TEST(IndexPool, IndexRoundTrip) {
+  int owner;
+  TestPool pool(&owner);
+  const uint32_t index = pool.Allocate(5);
+  EXPECT_NE(index, 0u);
+  uint64_t* run = TestPool::Get(index);
+  for (uint32_t i = 0; i < 5; i++) {
+    EXPECT_EQ(TestPool::IndexOf(run + i), index + i);
+    EXPECT_EQ(TestPool::OwnerOf(run + i), &owner);
+  }
+}
+
+TEST(IndexPool, SplitsLongerFreeRuns) {
+  TestPool pool(nullptr);
+  const uint32_t index = pool.Allocate(10);
+  const size_t capacity = pool.GetCapacity();
+  pool.Free(index, 10);
+  EXPECT_EQ(pool.Allocate(4), index);
+  EXPECT_EQ(pool.Allocate(6), index + 4);
+  EXPECT_EQ(pool.GetCapacity(), capacity);
+}
+
+TEST(IndexPool, CacheReturnsElementsOnDrain) {
+  TestPool pool(nullptr);
+  TestPool::Cache cache;
+  const uint32_t first = cache.Allocate(&pool, 1);
+  const uint32_t second = cache.Allocate(&pool, 3);
+  EXPECT_EQ(second, first + 1);
+  pool.Free(first, 1);
+  pool.Free(second, 3);
+  cache.Drain(&pool);
+  // Everything the cache took is free again and is handed out before any new
+  // element.
+  TestPool::Cache other;
+  for (int i = 0; i < 2048; i++) {
+    const uint32_t index = other.Allocate(&pool, 1);
+    EXPECT_GE(index, first);
+    EXPECT_LT(index, first + 2048);
+  }
+}
+
+TEST(IndexPool, ChunksAreReleasedWithPool) {
+  auto pool = std::make_unique<TestPool>(nullptr);
+  const uint32_t index = pool->Allocate(1);
+  pool.reset();
+  // The chunk number is reused by the next pool.
+  int owner;
+  TestPool next(&owner);
+  const uint32_t reused = next.Allocate(1);
+  EXPECT_EQ(reused >> 18, index >> 18);
+  EXPECT_EQ(TestPool::OwnerOf(TestPool::Get(reused)), &owner);
+}
+
+TEST(IndexPool, ReserveAllocatesChunksUpFront) {
+  TestPool pool(nullptr);
+  EXPECT_EQ(pool.GetCapacity(), 0u);
+  pool.Reserve(1);
+  const size_t chunk = pool.GetCapacity();
+  EXPECT_GT(chunk, 0u);
+  pool.Reserve(chunk + 1);
+  EXPECT_EQ(pool.GetCapacity(), 2 * chunk);
+  // Allocations are served from the reserved chunks.
+  for (int i = 0; i < 1000; i++) pool.Allocate(16);
+  EXPECT_EQ(pool.GetCapacity(), 2 * chunk);
+}
+
+TEST(IndexPool, ReportsExhaustionBeforeThrowing) {
+  // Single bytes in runs of 16K, so that the 32-bit indices run out after a
+  // quarter million allocations. Only the chunk headers get touched.
+  using BytePool = IndexPool<uint8_t, 16384>;
+  auto pool = std::make_unique<BytePool>(nullptr);
+  EXPECT_FALSE(BytePool::IsNearlyExhausted());
+  size_t allocations = 0;
+  while (!BytePool::IsNearlyExhausted()) {
+    pool->Allocate(16384);
+    allocations++;
+  }
+  EXPECT_GT(allocations, 200000u);
+  // The reserve still serves allocations in flight, then the pool throws.
+  for (int i = 0; i < 1000; i++) pool->Allocate(16384);
+  EXPECT_THROW(while (true) pool->Allocate(16384), Exception);
+  // Destroying the pool returns its chunk numbers.
+  pool.reset();
+  EXPECT_FALSE(BytePool::IsNearlyExhausted());
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "utils/mappedfile.h"
+
+#include "utils/exception.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lczero {
+
+MappedFile::MappedFile(const std::string& filename) {
+#ifdef _WIN32
+  file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    throw Exception("Unable to open file " + filename);
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+    CloseHandle(file_);
+    throw Exception("Unable to read file " + filename);
+  }
+  size_ = size.QuadPart;
+  mapping_ = CreateFileMapping(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    CloseHandle(file_);
+    throw Exception("Unable to map file " + filename);
+  }
+  data_ = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == nullptr) {
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+    throw Exception("Unable to map file " + filename);
+  }
+#else
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) throw Exception("Unable to open file " + filename);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw Exception("Unable to read file " + filename);
+  }
+  size_ = st.st_size;
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) throw Exception("Unable to map file " + filename);
+  data_ = static_cast<const uint8_t*>(data);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+#else
+  munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
+
+}  // namespace lczero
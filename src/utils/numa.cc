@@ -27,12 +27,22 @@
 
 #include "utils/numa.h"
 
+#include <algorithm>
+#include <fstream>
+#include <string>
+
 #include "chess/bitboard.h"
 #include "utils/logging.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace lczero {
 
@@ -91,4 +101,71 @@ void Numa::BindThread(int id) {
 #endif
 }
 
+#ifdef __linux__
+namespace {
+std::string NodeCpuListFile(int node) {
+  return "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+}
+}  // namespace
+#endif
+
+int Numa::GetNodeCount() {
+#ifdef __linux__
+  int nodes = 0;
+  while (std::ifstream(NodeCpuListFile(nodes))) nodes++;
+  return std::max(nodes, 1);
+#else
+  return 1;
+#endif
+}
+
+void Numa::BindThreadToNode(int node) {
+#ifdef __linux__
+  // The list looks like "0-15,32-47".
+  std::ifstream file(NodeCpuListFile(node));
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  int first;
+  while (file >> first) {
+    int last = first;
+    if (file.peek() == '-') {
+      file.get();
+      file >> last;
+    }
+    for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &cpus);
+    }
+    if (file.peek() == ',') file.get();
+  }
+  if (CPU_COUNT(&cpus) == 0) return;
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+    CERR << "Failed to bind thread to NUMA node " << node << ".";
+  }
+#else
+  // Silence warning.
+  (void)node;
+#endif
+}
+
+void Numa::BindMemoryToNode(void* addr, size_t size, int node) {
+#ifdef __linux__
+  // Raw mbind(), so that libnuma is not needed. Values from <numaif.h>.
+  constexpr int kMpolPreferred = 1;
+  constexpr unsigned kMpolMfMove = 1 << 1;
+  constexpr int kMaxNodes = sizeof(unsigned long) * 8;
+  if (node < 0 || node >= kMaxNodes) return;
+  const unsigned long mask = 1UL << node;
+  // The kernel reads one bit less than the number of nodes passed.
+  if (syscall(SYS_mbind, addr, size, kMpolPreferred, &mask, kMaxNodes + 1,
+              kMpolMfMove) != 0) {
+    LOGFILE << "Failed to bind memory to NUMA node " << node << ".";
+  }
+#else
+  // Silence warning.
+  (void)addr;
+  (void)size;
+  (void)node;
+#endif
+}
+
 }  // namespace lczero
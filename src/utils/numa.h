@@ -27,6 +27,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 namespace lczero {
 
 class Numa {
@@ -39,6 +41,18 @@ class Numa {
   // Bind thread to processor group.
   static void BindThread(int id);
 
+  // Returns the number of NUMA nodes, 1 when unknown.
+  static int GetNodeCount();
+
+  // Restricts the calling thread to the processors of a NUMA node. Threads
+  // created later by this thread inherit that on Linux. No-op elsewhere.
+  static void BindThreadToNode(int node);
+
+  // Asks for the pages of [@addr, @addr + @size) to be placed on a NUMA node,
+  // falling back to other nodes when it is full. @addr must be page aligned.
+  // Linux only, a no-op elsewhere.
+  static void BindMemoryToNode(void* addr, size_t size, int node);
+
  private:
   static int threads_per_core_;
 };
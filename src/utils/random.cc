@@ -26,19 +26,48 @@
 */
 
 #include "random.h"
+
+#include <atomic>
 #include <random>
 
 namespace lczero {
 
-Random::Random() : gen_(std::random_device()()) {}
+namespace {
+uint64_t SplitMix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Per thread generators are seeded with this and the thread number.
+uint64_t ProcessSeed() {
+  static const uint64_t seed =
+      (uint64_t{std::random_device()()} << 32) | std::random_device()();
+  return seed;
+}
+
+std::atomic<uint64_t> gThreadCounter{0};
+}  // namespace
+
+void Xoshiro256::Seed(uint64_t seed) {
+  for (auto& s : s_) s = SplitMix64(&seed);
+}
+
+Random::Random()
+    : gen_(MixSeed(ProcessSeed(), gThreadCounter.fetch_add(1))) {}
 
 Random& Random::Get() {
-  static Random rand;
+  thread_local Random rand;
   return rand;
 }
 
+uint64_t Random::MixSeed(uint64_t seed, uint64_t stream) {
+  uint64_t state = seed ^ SplitMix64(&stream);
+  return SplitMix64(&state);
+}
+
 int Random::GetInt(int min, int max) {
-  Mutex::Lock lock(mutex_);
   std::uniform_int_distribution<> dist(min, max);
   return dist(gen_);
 }
@@ -46,13 +75,11 @@ int Random::GetInt(int min, int max) {
 bool Random::GetBool() { return GetInt(0, 1) != 0; }
 
 double Random::GetDouble(double maxval) {
-  Mutex::Lock lock(mutex_);
   std::uniform_real_distribution<> dist(0.0, maxval);
   return dist(gen_);
 }
 
 float Random::GetFloat(float maxval) {
-  Mutex::Lock lock(mutex_);
   std::uniform_real_distribution<> dist(0.0, maxval);
   return dist(gen_);
 }
@@ -66,7 +93,6 @@ std::string Random::GetString(int length) {
 }
 
 double Random::GetGamma(double alpha, double beta) {
-  Mutex::Lock lock(mutex_);
   std::gamma_distribution<double> dist(alpha, beta);
   return dist(gen_);
 }
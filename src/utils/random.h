@@ -28,15 +28,50 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <random>
 #include <string>
-#include "utils/mutex.h"
 
 namespace lczero {
 
+// xoshiro256** generator, small and fast. Satisfies UniformRandomBitGenerator,
+// so it can be used with the standard distributions.
+class Xoshiro256 {
+ public:
+  using result_type = uint64_t;
+
+  explicit Xoshiro256(uint64_t seed) { Seed(seed); }
+  // Expands @seed into the full state with SplitMix64.
+  void Seed(uint64_t seed);
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type{0}; }
+  result_type operator()() {
+    const uint64_t result = Rotl(s_[1] * 5, 7) * 9;
+    const uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = Rotl(s_[3], 45);
+    return result;
+  }
+
+ private:
+  static uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t s_[4];
+};
+
+// Random numbers for the calling thread. Every thread has its own generator,
+// so no locking is needed. For reproducible sequences, use a Xoshiro256 seeded
+// with MixSeed() instead.
 class Random {
  public:
   static Random& Get();
+  // Combines a seed with a stream number (e.g. game number) into a new seed.
+  static uint64_t MixSeed(uint64_t seed, uint64_t stream);
+
   double GetDouble(double max_val);
   float GetFloat(float max_val);
   double GetGamma(double alpha, double beta);
@@ -50,13 +85,11 @@ class Random {
  private:
   Random();
 
-  Mutex mutex_;
-  std::mt19937 gen_ GUARDED_BY(mutex_);
+  Xoshiro256 gen_;
 };
 
 template <class RandomAccessIterator>
 void Random::Shuffle(RandomAccessIterator s, RandomAccessIterator e) {
-  Mutex::Lock lock(mutex_);
   std::shuffle(s, e, gen_);
 }
 